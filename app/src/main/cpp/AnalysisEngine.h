@@ -0,0 +1,433 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "AudioSource.h"
+#include "dsp.h"
+#include "DspGraph.h"
+#include "log.h"
+#include "MidiEngine.h"
+#include "noteevents.h"
+#include "onset.h"
+#include "pitchbend.h"
+#include "Seqlock.h"
+#include "TripleBuffer.h"
+#include "util.h"
+
+#define ANALYSIS_FRAME_CAPACITY 4096        // floats per published frame, the longest processor output
+#define ANALYSIS_IDLE_MS 20                 // wait of a realtime session while its source is not live
+
+struct AnalysisTuning
+{
+    float       a4;
+    int32_t     root;
+    uint64_t    scaleMask;
+};
+
+// a processor with what the analysis needs to know about it, swapped as a whole
+struct ProcessorChain
+{
+    DSP*        dsp;            // NULL for raw audio
+    int         mode;
+    int         outputLen;
+    uint32_t    tuningStores;   // of the tuning Seqlock when the tuning was applied
+    ~ProcessorChain() { delete dsp; }
+};
+
+/**
+ * One analysis session
+ *
+ * Owns everything a stream of frames goes through: the source, the processor of the current mode, the
+ * onset detector, the pitch bend tracker, the note event generator and the outputs, the published
+ * frames (TripleBuffer) and the per frame snapshot (Seqlock). Nothing is shared between sessions, so
+ * any number of them can run at once, each on a thread of its own or driven by the caller through
+ * analyseFrame().
+ *
+ * A realtime source is timestamped through a MidiClock, a session on it runs until stop() and idles
+ * while the source is not live. Any other source is timestamped by its sample position and the
+ * session thread ends after its last frame.
+ *
+ * The processor of a mode is built and warmed up with a silent frame outside of the analysis thread,
+ * on the caller of setProcessingMode() or on a builder thread for requestProcessingMode(), and
+ * installed with one atomic pointer exchange. The analysis never takes a lock: it makes the quiescence
+ * counter odd while it uses the processor and even again after the frame, and the old processor is
+ * only deleted once the counter moved past a frame that might still have held it. The tuning goes
+ * the same way, through a Seqlock the analysis applies from when it changed.
+ *
+ * Example code:
+ *
+ * AnalysisEngine session( new WavFileAudioSource( "take.wav", 256 ) );
+ * session.setProcessingMode( ProcessingModes::PitchEstimation );
+ * session.run();                                   // to the end of the file, on this thread
+ * AnalysisSnapshot last = session.getSnapshot().load();
+ */
+class AnalysisEngine
+{
+public:
+    /**
+     * @param source owned by the session
+     * @param noteEvents where the note events go, the session has a queue of its own when NULL
+     */
+    AnalysisEngine( AudioSource* source, NoteEventQueue* noteEvents = NULL ) :
+            source( source ), chain( NULL ), mode( ProcessingModes::RawAudioOnly ), quiescence( 0 ),
+            swaps( 0 ), frames( ANALYSIS_FRAME_CAPACITY ), hopper( ANALYSIS_FRAME_CAPACITY, 0.f ),
+            ownNoteEvents( noteEvents == NULL ? new NoteEventQueue() : NULL ),
+            noteEvents( noteEvents != NULL ? *noteEvents : *ownNoteEvents ), notes( this->noteEvents ),
+            notesEnabled( false ), notesWereEnabled( false ), running( false ), finished( false ),
+            frameCount( 0 ), sampleCount( 0 ) {
+        AnalysisTuning t = { NOTEMAP_DEFAULT_A4, 0, NOTEMAP_MASK_CHROMATIC };
+        this->tuning.store( t );
+        this->chain.store( build( ProcessingModes::RawAudioOnly ) );
+        this->bends.setSmoothing( true );
+    }
+    virtual ~AnalysisEngine() {
+        stop();
+        joinBuilder();
+        delete this->chain.load();
+    }
+
+    /**
+     * A new processor for ProcessingModes mode, built on the calling thread, RawAudioOnly frees it.
+     * Returns once the old processor is deleted, which waits for the frame in progress, if any, so
+     * not from onFrame().
+     */
+    void setProcessingMode( int mode ) {
+        std::lock_guard<std::mutex> guard( this->configLock );
+        joinBuilder();
+        install( build( mode ) );
+    }
+
+    // the same on a builder thread, returns at once unless the build of an earlier request is still going
+    void requestProcessingMode( int mode ) {
+        std::lock_guard<std::mutex> guard( this->configLock );
+        joinBuilder();
+        this->builder = std::thread( [this, mode]() {
+            install( build( mode ) );
+        } );
+    }
+
+    // mode of the installed processor
+    int getProcessingMode() { return this->mode.load(); }
+    // processors installed so far, the first one of the constructor included
+    int64_t getSwaps() { return this->swaps.load(); }
+
+    // A4 in Hz, key root 0..11 (C = 0) and a 12 bit mask of the scale degrees notes snap to
+    void setTuning( float a4, int root, uint64_t scaleMask ) {
+        std::lock_guard<std::mutex> guard( this->configLock );
+        AnalysisTuning t = { a4, root, scaleMask };
+        this->tuning.store( t );
+    }
+
+    // frequency in Hz of formant k = 0..ANALYSIS_FORMANTS-1 of the last frame, 0 when there is none
+    float getFormant( int k ) {
+        return k >= 0 && k < ANALYSIS_FORMANTS ? this->snapshot.load().formants[k] : 0.f;
+    }
+
+    /**
+     * Note events are generated while enabled, the generator starts from scratch when they are enabled
+     * again. Nobody has to drain the queue while they are off.
+     */
+    void setNotesEnabled( bool enabled ) { this->notesEnabled.store( enabled ); }
+
+    // the session thread, until stop() or the end of a non realtime source
+    void start() {
+        if( this->running.load() ) {
+            return;
+        }
+        if( this->thread.joinable() ) {
+            this->thread.join();
+        }
+        this->finished.store( false );
+        this->running.store( true );
+        this->thread = std::thread( &AnalysisEngine::loop, this );
+    }
+    void stop() {
+        this->running.store( false );
+        if( this->thread.joinable() ) {
+            this->thread.join();
+        }
+    }
+    // the thread went through the last frame of a non realtime source
+    bool isFinished() { return this->finished.load(); }
+
+    /**
+     * Analyses the frames of the source on the calling thread until it has none.
+     *
+     * @return frames analysed
+     */
+    int64_t run() {
+        int64_t n = 0;
+        while( analyseFrame() ) {
+            ++n;
+        }
+        return n;
+    }
+
+    /**
+     * One frame of the source through the processor into the back slot of the frames, and the
+     * snapshot of it. Without a frame from the source a silent frame is published for the display,
+     * the snapshot and the frame count stay as they were.
+     *
+     * @return false when the source had no frame
+     */
+    bool analyseFrame() {
+        float* out = this->frames.beginWrite();
+        AnalysisSnapshot snapshot = {};
+        const int N = this->source->getBufferLength();
+        const float R = this->source->getSamplingRate();
+        bool enabled = this->notesEnabled.load( std::memory_order_relaxed );
+        if( enabled && !this->notesWereEnabled ) {
+            this->notes.reset();
+        }
+        this->notesWereEnabled = enabled;
+
+        bool realtime = this->source->isRealtime();
+        bool read = this->source->live() && this->source->read( &this->hopper[0] );
+
+        // the processor is in use until the counter is even again
+        this->quiescence.fetch_add( 1 );
+        ProcessorChain* c = this->chain.load();
+        int len = std::min( c->outputLen, this->frames.getCapacity() );
+        if( !read ) {
+            this->quiescence.fetch_add( 1 );
+            for( int n=0; n < len; ++n ) out[n] = 0;
+            if( enabled ) {
+                this->notes.release( realtime ? cnanos() : this->sampleNanos( this->sampleCount ) );
+            }
+            this->clock.reset();
+            this->frames.publish( len );
+            return false;
+        }
+        snapshot.frame = ++this->frameCount;
+        if( c->tuningStores != this->tuning.getStores() ) {
+            applyTuning( c );
+        }
+
+        // timestamps come from the sample position, not from when this thread got to the frame
+        this->sampleCount += N;
+        if( realtime ) {
+            this->clock.update( this->sampleCount, cnanos(), R );
+        }
+        snapshot.captureNanos = this->sampleNanos( this->sampleCount - N );
+        this->onsets.setSamplingRate( R );
+        bool onset = this->onsets.process( &this->hopper[0], N ) > 0;
+        // the hop the onset fired in, counted back from the samples the detector has consumed
+        int64_t onsetNanos = -1;
+        OnsetEvent onsetEvent;
+        while( this->onsets.pop( onsetEvent ) ) {
+            onsetNanos = this->sampleNanos( this->sampleCount - (this->onsets.getSamples() - onsetEvent.sample) );
+        }
+        DSP* p = c->dsp;
+        if( p != NULL ) {
+            p->setSamplingRate( R );
+            p->process( &this->hopper[0], N, out );
+            // a frame without a fresh estimate has clarity 0 and barely moves the smoothed bend
+            PitchCandidate candidate;
+            float clarity = p->getPitchCandidates( &candidate, 1 ) > 0 ? candidate.confidence : 0.f;
+            this->bends.setFrameRate( R / N );
+            this->bends.process( p->getMidiNoteNumber(), p->getFractionalNote(), clarity, onset );
+
+            snapshot.pitch = p->getPitch();
+            snapshot.clarity = clarity;
+            snapshot.note = p->getMidiNoteNumber();
+            snapshot.noteHz = p->getPitchMidi();
+            snapshot.cents = snapshot.note > 0 ? 100.f * (p->getFractionalNote() - snapshot.note) : 0.f;
+            snapshot.gate = snapshot.note > 0;
+            p->getFormants( snapshot.formants, ANALYSIS_FORMANTS );
+
+            float energy = 0;
+            for( int n=0; n < N; ++n ) {
+                energy += this->hopper[n] * this->hopper[n];
+            }
+            float levelDb = 10.f * log10f( energy / N + 1e-12f );
+            PitchBendEvent bendEvent;
+            if( enabled ) {
+                this->notes.process( snapshot.captureNanos, snapshot.note, onset, levelDb, onsetNanos );
+            }
+            while( this->bends.pop( bendEvent ) ) {
+                if( enabled ) {
+                    this->notes.bend( snapshot.captureNanos, bendEvent.note, bendEvent.bend );
+                }
+            }
+        } else {
+            // raw audio
+            len = std::min( len, N );
+            memcpy( out, &this->hopper[0], sizeof(float) * len );
+        }
+        onFrame( p, out, len, snapshot );
+        this->quiescence.fetch_add( 1 );
+        this->frames.publish( len );
+        this->snapshot.store( snapshot );
+        return true;
+    }
+
+    AudioSource& getSource() { return *this->source; }
+    TripleBuffer& getFrames() { return this->frames; }
+    Seqlock<AnalysisSnapshot>& getSnapshot() { return this->snapshot; }
+    NoteEventQueue& getNoteEvents() { return this->noteEvents; }
+    int64_t getFrameCount() { return this->snapshot.load().frame; }
+
+protected:
+    // every analysed frame, on the analysis thread while it holds the processor
+    virtual void onFrame( DSP* /*processor*/, const float* /*out*/, int /*len*/, const AnalysisSnapshot& /*snapshot*/ ) {}
+
+private:
+    void loop() {
+        bool realtime = this->source->isRealtime();
+        while( this->running.load( std::memory_order_relaxed ) ) {
+            // a realtime read waits for the next captured frame
+            if( !analyseFrame() ) {
+                if( !realtime ) {
+                    break;
+                }
+                std::this_thread::sleep_for( std::chrono::milliseconds( ANALYSIS_IDLE_MS ) );
+            }
+        }
+        this->finished.store( !realtime );
+        this->running.store( false );
+    }
+
+    int64_t sampleNanos( int64_t sample ) {
+        if( this->source->isRealtime() ) {
+            return this->clock.nanos( sample );
+        }
+        return (int64_t)((double)sample * 1e9 / this->source->getSamplingRate());
+    }
+
+    // a processor for mode with the current tuning, warmed up with a silent frame
+    ProcessorChain* build( int mode ) {
+        const int N = this->source->getBufferLength();
+        ProcessorChain* c = new ProcessorChain();
+        // the nodes of the mode, NULL for raw audio
+        c->dsp = (DSP*) DspGraph::forMode( mode, N );
+        if( c->dsp == NULL ) {
+            mode = ProcessingModes::RawAudioOnly;
+        }
+        c->mode = mode;
+        c->outputLen = c->dsp != NULL ? c->dsp->getProcessOutputLen() : N;
+        applyTuning( c );
+        if( c->dsp != NULL ) {
+            // first touch of the buffers and tables, not in the first frame of the analysis
+            std::vector<float> silence( N, 0.f ), out( std::max( c->outputLen, N ), 0.f );
+            c->dsp->setSamplingRate( this->source->getSamplingRate() );
+            c->dsp->process( &silence[0], N, &out[0] );
+        }
+        return c;
+    }
+
+    // exchanges the chain, then deletes the old one once the analysis can no longer hold it
+    void install( ProcessorChain* c ) {
+        ProcessorChain* old = this->chain.exchange( c );
+        this->mode.store( c->mode );
+        this->swaps.fetch_add( 1 );
+        // a frame that started before the exchange may still use old until the counter moves on
+        uint64_t q = this->quiescence.load();
+        if( q & 1 ) {
+            while( this->quiescence.load() == q ) {
+                std::this_thread::yield();
+            }
+        }
+        delete old;
+    }
+
+    void joinBuilder() {
+        if( this->builder.joinable() ) {
+            this->builder.join();
+        }
+    }
+
+    void applyTuning( ProcessorChain* c ) {
+        c->tuningStores = this->tuning.getStores();
+        AnalysisTuning t = this->tuning.load();
+        if( c->dsp != NULL ) {
+            NoteMapper& nm = c->dsp->getNoteMapper();
+            nm.setReference( t.a4 );
+            nm.setRoot( t.root );
+            nm.setScaleMask( t.scaleMask );
+        }
+    }
+
+    std::unique_ptr<AudioSource>        source;
+    std::mutex                          configLock;         // callers of setProcessingMode and setTuning
+    std::thread                         builder;
+    std::atomic<ProcessorChain*>        chain;
+    std::atomic<int>                    mode;
+    std::atomic<uint64_t>               quiescence;         // odd while a frame holds the chain
+    std::atomic<int64_t>                swaps;
+    Seqlock<AnalysisTuning>             tuning;
+    TripleBuffer                        frames;
+    Seqlock<AnalysisSnapshot>           snapshot;
+    std::vector<float>                  hopper;
+    OnsetDetector<64, float>            onsets;
+    PitchBendTracker                    bends;
+    std::unique_ptr<NoteEventQueue>     ownNoteEvents;
+    NoteEventQueue&                     noteEvents;
+    NoteEventGenerator                  notes;
+    std::atomic<bool>                   notesEnabled;
+    bool                                notesWereEnabled;
+    MidiClock                           clock;
+    std::thread                         thread;
+    std::atomic<bool>                   running;
+    std::atomic<bool>                   finished;
+    int64_t                             frameCount;
+    int64_t                             sampleCount;
+};
+
+typedef int64_t AnalysisHandle;
+
+/**
+ * Sessions by handle, for callers that can not hold a C++ object (JNI). A handle is never reused, a
+ * session that is destroyed while another thread still uses it through get() lives until that thread
+ * lets go of it.
+ */
+class AnalysisRegistry
+{
+public:
+    // takes ownership, the handle is > 0
+    static AnalysisHandle create( AnalysisEngine* engine ) {
+        std::lock_guard<std::mutex> guard( lock() );
+        AnalysisHandle h = ++next();
+        sessions()[h] = std::shared_ptr<AnalysisEngine>( engine );
+        return h;
+    }
+    // empty for an unknown or destroyed handle
+    static std::shared_ptr<AnalysisEngine> get( AnalysisHandle h ) {
+        std::lock_guard<std::mutex> guard( lock() );
+        auto it = sessions().find( h );
+        return it != sessions().end() ? it->second : std::shared_ptr<AnalysisEngine>();
+    }
+    static bool destroy( AnalysisHandle h ) {
+        std::shared_ptr<AnalysisEngine> engine;
+        {
+            std::lock_guard<std::mutex> guard( lock() );
+            auto it = sessions().find( h );
+            if( it == sessions().end() ) {
+                return false;
+            }
+            engine = it->second;
+            sessions().erase( it );
+        }
+        // joins the session thread outside of the registry lock
+        engine->stop();
+        return true;
+    }
+    static int size() {
+        std::lock_guard<std::mutex> guard( lock() );
+        return (int)sessions().size();
+    }
+
+private:
+    static std::mutex& lock() { static std::mutex m; return m; }
+    static AnalysisHandle& next() { static AnalysisHandle h = 0; return h; }
+    static std::map<AnalysisHandle, std::shared_ptr<AnalysisEngine>>& sessions() {
+        static std::map<AnalysisHandle, std::shared_ptr<AnalysisEngine>> s;
+        return s;
+    }
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "log.h"
+
+/**
+ * Frames of mono float samples for an AnalysisEngine.
+ *
+ * A realtime source (the microphone) blocks in read() until its next frame is captured or about a
+ * frame period went by without one, its frames are timestamped on the monotonic clock. Any other source is read as fast as the engine can go and
+ * its timestamps are the sample position, starting at 0.
+ */
+class AudioSource
+{
+public:
+    virtual ~AudioSource() {}
+
+    // samples per read()
+    virtual int getBufferLength() = 0;
+    virtual float getSamplingRate() = 0;
+    // a realtime source is live while it is capturing, any other until its last frame was read
+    virtual bool live() = 0;
+    virtual bool isRealtime() { return false; }
+    /**
+     * The next frame, getBufferLength() samples.
+     *
+     * @return false when there is none, dest is then zeroed
+     */
+    virtual bool read( float* dest ) = 0;
+};
+
+/**
+ * Samples in memory, the last frame padded with zeros.
+ */
+class BufferAudioSource : public AudioSource
+{
+public:
+    BufferAudioSource( const float* samples, int len, float R, int bufferLen ) :
+            samples( samples, samples + len ), R( R ), bufferLen( bufferLen ), position( 0 ) { }
+
+    virtual int getBufferLength() { return this->bufferLen; }
+    virtual float getSamplingRate() { return this->R; }
+    virtual bool live() { return this->position < (int)this->samples.size(); }
+    virtual bool read( float* dest ) {
+        int n = std::max( 0, std::min( this->bufferLen, (int)this->samples.size() - this->position ) );
+        memcpy( dest, this->samples.data() + this->position, sizeof(float) * n );
+        memset( dest + n, 0, sizeof(float) * (this->bufferLen - n) );
+        this->position += n;
+        return n > 0;
+    }
+
+private:
+    std::vector<float>  samples;
+    float               R;
+    int                 bufferLen;
+    int                 position;
+};
+
+/**
+ * A RIFF WAVE file, 16 bit PCM or 32 bit float, the channels mixed down to mono. The file is read a
+ * frame at a time, as the recorder and FileDevDumper write it.
+ */
+class WavFileAudioSource : public AudioSource
+{
+public:
+    WavFileAudioSource( const char* path, int bufferLen ) : f( NULL ), R( 0 ), channels( 0 ), bits( 0 ),
+                                                           remaining( 0 ), bufferLen( bufferLen ) {
+        this->f = fopen( path, "rb" );
+        if( this->f == NULL || !parseHeader() ) {
+            LOGE("WavFileAudioSource: can not read %s", path);
+            close();
+        }
+    }
+    virtual ~WavFileAudioSource() {
+        close();
+    }
+
+    bool isOpen() { return this->f != NULL; }
+    int getChannels() { return this->channels; }
+
+    virtual int getBufferLength() { return this->bufferLen; }
+    virtual float getSamplingRate() { return this->R; }
+    virtual bool live() { return this->f != NULL && this->remaining > 0; }
+    virtual bool read( float* dest ) {
+        int bytesPerFrame = this->channels * this->bits / 8;
+        int n = 0;
+        if( live() ) {
+            int frames = (int)std::min( (int64_t)this->bufferLen, this->remaining / bytesPerFrame );
+            this->raw.resize( (size_t)frames * bytesPerFrame );
+            n = (int)fread( this->raw.data(), bytesPerFrame, frames, this->f );
+            this->remaining = n < frames ? 0 : this->remaining - (int64_t)n * bytesPerFrame;
+            for( int k=0; k < n; ++k ) {
+                float sum = 0;
+                for( int c=0; c < this->channels; ++c ) {
+                    const uint8_t* p = &this->raw[ (size_t)(k * this->channels + c) * (this->bits / 8) ];
+                    if( this->bits == 16 ) {
+                        int16_t s;
+                        memcpy( &s, p, 2 );
+                        sum += s / 32768.f;
+                    } else {
+                        float s;
+                        memcpy( &s, p, 4 );
+                        sum += s;
+                    }
+                }
+                dest[k] = sum / this->channels;
+            }
+        }
+        memset( dest + n, 0, sizeof(float) * (this->bufferLen - n) );
+        return n > 0;
+    }
+
+private:
+    bool parseHeader() {
+        uint8_t h[12];
+        if( fread( h, 1, 12, this->f ) != 12 || memcmp( h, "RIFF", 4 ) != 0 || memcmp( h + 8, "WAVE", 4 ) != 0 ) {
+            return false;
+        }
+        // chunks until data, fmt before it
+        uint8_t c[8];
+        while( fread( c, 1, 8, this->f ) == 8 ) {
+            uint32_t size = c[4] | (c[5] << 8) | (c[6] << 16) | ((uint32_t)c[7] << 24);
+            if( memcmp( c, "fmt ", 4 ) == 0 ) {
+                uint8_t fmt[16];
+                if( size < 16 || fread( fmt, 1, 16, this->f ) != 16 ) {
+                    return false;
+                }
+                int format = fmt[0] | (fmt[1] << 8);
+                this->channels = fmt[2] | (fmt[3] << 8);
+                this->R = (float)(fmt[4] | (fmt[5] << 8) | (fmt[6] << 16) | ((uint32_t)fmt[7] << 24));
+                this->bits = fmt[14] | (fmt[15] << 8);
+                bool pcm16 = format == 1 && this->bits == 16;
+                bool float32 = format == 3 && this->bits == 32;
+                if( (!pcm16 && !float32) || this->channels < 1 || this->R <= 0 ) {
+                    return false;
+                }
+                fseek( this->f, (long)(size - 16 + (size & 1)), SEEK_CUR );
+            } else if( memcmp( c, "data", 4 ) == 0 ) {
+                this->remaining = size;
+                return this->channels > 0;
+            } else {
+                fseek( this->f, (long)(size + (size & 1)), SEEK_CUR );
+            }
+        }
+        return false;
+    }
+    void close() {
+        if( this->f != NULL ) {
+            fclose( this->f );
+            this->f = NULL;
+        }
+    }
+
+    FILE*                   f;
+    float                   R;
+    int                     channels;
+    int                     bits;
+    int64_t                 remaining;      // bytes of sample data left
+    int                     bufferLen;
+    std::vector<uint8_t>    raw;
+};
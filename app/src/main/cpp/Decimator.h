@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <math.h>
+#include <vector>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DECIMATOR_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define DECIMATOR_SSE
+#endif
+
+#define DECIMATOR_LINEAR 0
+#define DECIMATOR_LOG_FREQUENCY 1       // column edges spaced logarithmically in the index, for spectra
+#define DECIMATOR_DB 2                  // 20 log10 |x| before the reduction
+#define DECIMATOR_DB_FLOOR -200.f       // dB of 0
+
+/**
+ * 20 log10 |x|
+ *
+ * log2 is the exponent plus a degree 4 polynomial of the mantissa in [1, 2), the error is below
+ * 0.002 dB. Zero and denormals come out at DECIMATOR_DB_FLOOR or above. f4db() below is the same
+ * for 4 lanes.
+ */
+static inline float fastDb( float x ) {
+    uint32_t i;
+    x = fabsf( x );
+    memcpy( &i, &x, sizeof(i) );
+    float e = (float)((int)(i >> 23) - 127);
+    uint32_t mi = (i & 0x007FFFFF) | 0x3F800000;
+    float t;
+    memcpy( &t, &mi, sizeof(t) );
+    t -= 1.f;
+    float p = t * (1.43854679f + t * (-0.678081486f + t * (0.323630368f + t * -0.0842850926f)));
+    return std::max( DECIMATOR_DB_FLOOR, 6.02059991f * (e + p) );
+}
+
+#if defined(DECIMATOR_NEON)
+typedef float32x4_t decimator_f4;
+static inline decimator_f4 f4load( const float* p ) { return vld1q_f32( p ); }
+static inline void f4store( float* p, decimator_f4 v ) { vst1q_f32( p, v ); }
+static inline decimator_f4 f4set( float x ) { return vdupq_n_f32( x ); }
+static inline decimator_f4 f4min( decimator_f4 a, decimator_f4 b ) { return vminq_f32( a, b ); }
+static inline decimator_f4 f4max( decimator_f4 a, decimator_f4 b ) { return vmaxq_f32( a, b ); }
+static inline decimator_f4 f4add( decimator_f4 a, decimator_f4 b ) { return vaddq_f32( a, b ); }
+static inline float f4hmin( decimator_f4 v ) {
+    float32x2_t m = vmin_f32( vget_low_f32( v ), vget_high_f32( v ) );
+    return std::min( vget_lane_f32( m, 0 ), vget_lane_f32( m, 1 ) );
+}
+static inline float f4hmax( decimator_f4 v ) {
+    float32x2_t m = vmax_f32( vget_low_f32( v ), vget_high_f32( v ) );
+    return std::max( vget_lane_f32( m, 0 ), vget_lane_f32( m, 1 ) );
+}
+static inline float f4hsum( decimator_f4 v ) {
+    float32x2_t s = vadd_f32( vget_low_f32( v ), vget_high_f32( v ) );
+    return vget_lane_f32( s, 0 ) + vget_lane_f32( s, 1 );
+}
+static inline decimator_f4 f4db( decimator_f4 x ) {
+    uint32x4_t i = vreinterpretq_u32_f32( vabsq_f32( x ) );
+    decimator_f4 e = vcvtq_f32_s32( vsubq_s32( vreinterpretq_s32_u32( vshrq_n_u32( i, 23 ) ), vdupq_n_s32( 127 ) ) );
+    decimator_f4 t = vreinterpretq_f32_u32( vorrq_u32( vandq_u32( i, vdupq_n_u32( 0x007FFFFF ) ), vdupq_n_u32( 0x3F800000 ) ) );
+    t = vsubq_f32( t, vdupq_n_f32( 1.f ) );
+    decimator_f4 p = vmlaq_f32( vdupq_n_f32( 0.323630368f ), t, vdupq_n_f32( -0.0842850926f ) );
+    p = vmlaq_f32( vdupq_n_f32( -0.678081486f ), t, p );
+    p = vmlaq_f32( vdupq_n_f32( 1.43854679f ), t, p );
+    p = vmulq_f32( t, p );
+    return vmaxq_f32( vdupq_n_f32( DECIMATOR_DB_FLOOR ), vmulq_f32( vdupq_n_f32( 6.02059991f ), vaddq_f32( e, p ) ) );
+}
+#elif defined(DECIMATOR_SSE)
+typedef __m128 decimator_f4;
+static inline decimator_f4 f4load( const float* p ) { return _mm_loadu_ps( p ); }
+static inline void f4store( float* p, decimator_f4 v ) { _mm_storeu_ps( p, v ); }
+static inline decimator_f4 f4set( float x ) { return _mm_set1_ps( x ); }
+static inline decimator_f4 f4min( decimator_f4 a, decimator_f4 b ) { return _mm_min_ps( a, b ); }
+static inline decimator_f4 f4max( decimator_f4 a, decimator_f4 b ) { return _mm_max_ps( a, b ); }
+static inline decimator_f4 f4add( decimator_f4 a, decimator_f4 b ) { return _mm_add_ps( a, b ); }
+static inline float f4hmin( decimator_f4 v ) {
+    v = _mm_min_ps( v, _mm_movehl_ps( v, v ) );
+    v = _mm_min_ss( v, _mm_shuffle_ps( v, v, 1 ) );
+    return _mm_cvtss_f32( v );
+}
+static inline float f4hmax( decimator_f4 v ) {
+    v = _mm_max_ps( v, _mm_movehl_ps( v, v ) );
+    v = _mm_max_ss( v, _mm_shuffle_ps( v, v, 1 ) );
+    return _mm_cvtss_f32( v );
+}
+static inline float f4hsum( decimator_f4 v ) {
+    v = _mm_add_ps( v, _mm_movehl_ps( v, v ) );
+    v = _mm_add_ss( v, _mm_shuffle_ps( v, v, 1 ) );
+    return _mm_cvtss_f32( v );
+}
+static inline decimator_f4 f4db( decimator_f4 x ) {
+    __m128i i = _mm_and_si128( _mm_castps_si128( x ), _mm_set1_epi32( 0x7FFFFFFF ) );
+    decimator_f4 e = _mm_cvtepi32_ps( _mm_sub_epi32( _mm_srli_epi32( i, 23 ), _mm_set1_epi32( 127 ) ) );
+    decimator_f4 t = _mm_castsi128_ps( _mm_or_si128( _mm_and_si128( i, _mm_set1_epi32( 0x007FFFFF ) ), _mm_set1_epi32( 0x3F800000 ) ) );
+    t = _mm_sub_ps( t, _mm_set1_ps( 1.f ) );
+    decimator_f4 p = _mm_add_ps( _mm_set1_ps( 0.323630368f ), _mm_mul_ps( t, _mm_set1_ps( -0.0842850926f ) ) );
+    p = _mm_add_ps( _mm_set1_ps( -0.678081486f ), _mm_mul_ps( t, p ) );
+    p = _mm_add_ps( _mm_set1_ps( 1.43854679f ), _mm_mul_ps( t, p ) );
+    p = _mm_mul_ps( t, p );
+    return _mm_max_ps( _mm_set1_ps( DECIMATOR_DB_FLOOR ), _mm_mul_ps( _mm_set1_ps( 6.02059991f ), _mm_add_ps( e, p ) ) );
+}
+#endif
+
+/**
+ * Display decimator
+ *
+ * Reduces a frame to one minimum, maximum and mean per pixel column, so what goes to the UI and the
+ * number of lines drawn scale with the width of the view and not with the length of the analysis.
+ * The columns split the index range evenly, or logarithmically for spectra (DECIMATOR_LOG_FREQUENCY),
+ * where a column narrower than a bin repeats its bin. With DECIMATOR_DB the reduction runs over
+ * 20 log10 |x|.
+ *
+ * The column edges are kept until the range, width or scale change, the reductions and the dB
+ * conversion run 4 lanes at a time with NEON on ARM or SSE2 on x86.
+ *
+ * Example code:
+ *
+ * Decimator d;
+ * float columns[3 * 1080];
+ * d.process( spectrum, 1, N2, 1080, DECIMATOR_LOG_FREQUENCY | DECIMATOR_DB, columns );
+ * // columns[0..1079] minima, columns[1080..2159] maxima, columns[2160..3239] means
+ */
+class Decimator
+{
+public:
+    Decimator() : from( -1 ), to( -1 ), width( 0 ), scale( -1 ) { }
+
+    /**
+     * @param in frame, the indices from..to-1 are reduced, with DECIMATOR_LOG_FREQUENCY from 1 on
+     * @param out 3 * width floats, the minima of the columns, then the maxima, then the means
+     */
+    void process( const float* in, int from, int to, int width, int scale, float* out ) {
+        if( width <= 0 || to <= from ) {
+            return;
+        }
+        if( from != this->from || to != this->to || width != this->width || scale != this->scale ) {
+            layout( from, to, width, scale );
+        }
+        // the dB values are indexed from 0
+        int offset = 0;
+        if( scale & DECIMATOR_DB ) {
+            db( in + from, to - from, &this->scratch[0] );
+            in = &this->scratch[0];
+            offset = from;
+        }
+        float* mins = out;
+        float* maxs = out + width;
+        float* means = out + 2 * width;
+        for( int c=0; c < width; ++c ) {
+            reduce( in, this->starts[c] - offset, this->ends[c] - offset, mins[c], maxs[c], means[c] );
+        }
+    }
+
+    // first index of column c and one past its last
+    int getStart( int c ) { return this->starts[c]; }
+    int getEnd( int c ) { return this->ends[c]; }
+
+    // 20 log10 |x| of len values, in and out may be the same
+    static void db( const float* in, int len, float* out ) {
+        int n = 0;
+#if defined(DECIMATOR_NEON) || defined(DECIMATOR_SSE)
+        for( ; n + 4 <= len; n += 4 ) {
+            f4store( out + n, f4db( f4load( in + n ) ) );
+        }
+#endif
+        for( ; n < len; ++n ) {
+            out[n] = fastDb( in[n] );
+        }
+    }
+
+    // minimum, maximum and mean of in[start..end-1], end > start
+    static void reduce( const float* in, int start, int end, float& lo, float& hi, float& mean ) {
+        int n = start;
+        lo = hi = in[n];
+        float sum = 0.f;
+#if defined(DECIMATOR_NEON) || defined(DECIMATOR_SSE)
+        if( end - start >= 8 ) {
+            decimator_f4 vlo = f4load( in + n ), vhi = vlo, vsum = f4set( 0.f );
+            for( ; n + 4 <= end; n += 4 ) {
+                decimator_f4 x = f4load( in + n );
+                vlo = f4min( vlo, x );
+                vhi = f4max( vhi, x );
+                vsum = f4add( vsum, x );
+            }
+            lo = f4hmin( vlo );
+            hi = f4hmax( vhi );
+            sum = f4hsum( vsum );
+        }
+#endif
+        for( ; n < end; ++n ) {
+            lo = std::min( lo, in[n] );
+            hi = std::max( hi, in[n] );
+            sum += in[n];
+        }
+        mean = sum / (float)(end - start);
+    }
+
+private:
+    void layout( int from, int to, int width, int scale ) {
+        this->from = from;
+        this->to = to;
+        this->width = width;
+        this->scale = scale;
+        this->starts.resize( width );
+        this->ends.resize( width );
+        this->scratch.resize( to - from );
+        int len = to - from;
+        if( scale & DECIMATOR_LOG_FREQUENCY ) {
+            // edges at lo * (to / lo)^(c / width)
+            double lo = std::max( 1, from );
+            double ratio = (double)to / lo;
+            for( int c=0; c < width; ++c ) {
+                int s = (int)floor( lo * pow( ratio, (double)c / width ) );
+                int e = (int)floor( lo * pow( ratio, (double)(c + 1) / width ) );
+                this->starts[c] = std::min( std::max( s, from ), to - 1 );
+                this->ends[c] = std::min( std::max( e, this->starts[c] + 1 ), to );
+            }
+        } else {
+            for( int c=0; c < width; ++c ) {
+                int s = from + (int)((int64_t)c * len / width);
+                int e = from + (int)((int64_t)(c + 1) * len / width);
+                this->starts[c] = std::min( s, to - 1 );
+                this->ends[c] = std::min( std::max( e, this->starts[c] + 1 ), to );
+            }
+        }
+    }
+
+    int                 from;
+    int                 to;
+    int                 width;
+    int                 scale;
+    std::vector<int>    starts;
+    std::vector<int>    ends;
+    std::vector<float>  scratch;        // the dB values of the range
+};
@@ -0,0 +1,692 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "acorr.h"
+#include "dsp.h"
+#include "log.h"
+#include "lpc.h"
+#include "lse.h"
+#include "mpm.h"
+#include "notemap.h"
+#include "octave.h"
+#include "spectral.h"
+#include "tracker.h"
+
+/**
+ * Static DSP graph
+ *
+ * Small typed nodes (gate, whitening filter, FFT, magnitude, ACF, picker, tracker, note mapper and
+ * taps for the display) wired into a graph that is a DSP like any processor of dsp.h. build()
+ * checks the port types of every connection, drops the nodes no tap or note output depends on,
+ * orders the rest topologically and allocates all outputs in one arena, so a frame runs the nodes
+ * in order without allocating. Nodes that share an input share its work: the magnitude and the ACF
+ * of one FftNode are views of one SpectralContext and cost one forward transform.
+ *
+ * A node whose last input is a DspGate is bypassed while the gate is closed, its output zeroed.
+ * A tap costs nothing, it reads the output of its input in place.
+ *
+ * Example code:
+ *
+ * DspGraph* g = new DspGraph( N );
+ * int fft = g->add( new FftNode( N ), g->getFrame() );
+ * int spectrum = g->addTap( g->add( new MagnitudeNode( N ), fft ) );
+ * int acf = g->addTap( g->add( new AcfNode( N ), fft ) );
+ * g->setDisplay( spectrum );
+ * g->build();
+ * g->process( frame, N, dest );        // dest gets the spectrum
+ * const float* r = g->getOutput( acf );  // from the same transform
+ */
+
+enum DspPortType
+{
+    DspSignal = 0,      // samples of a frame
+    DspGate = 1,        // DSPGRAPH_GATE_*
+    DspSpectrum = 2,    // the SpectralContext of an FftNode, no floats of its own
+    DspBins = 3,        // magnitudes by frequency bin
+    DspLags = 4,        // autocorrelation by lag
+    DspPitch = 5,       // DSPGRAPH_PITCH_*
+    DspNote = 6,        // DSPGRAPH_NOTE_*
+    DspAny = 7          // input of a tap, any of the above
+};
+
+#define DSPGRAPH_GATE_OPEN 0
+#define DSPGRAPH_GATE_DB 1                  // energy of the frame
+#define DSPGRAPH_GATE_LEN 2
+
+#define DSPGRAPH_PITCH_HZ 0                 // 0 when unvoiced, held while a voiced frame has no estimate
+#define DSPGRAPH_PITCH_CONFIDENCE 1         // 0..1, 0 unless estimated
+#define DSPGRAPH_PITCH_PERIOD 2             // samples, 0 when unvoiced
+#define DSPGRAPH_PITCH_ESTIMATED 3          // 1 when the pitch is a candidate of this frame
+#define DSPGRAPH_PITCH_LEN 4
+
+#define DSPGRAPH_NOTE_NUMBER 0              // MIDI note, 0 when unvoiced
+#define DSPGRAPH_NOTE_HZ 1
+#define DSPGRAPH_NOTE_FRACTIONAL 2
+#define DSPGRAPH_NOTE_CENTS 3
+#define DSPGRAPH_NOTE_LEN 4
+
+#define DSPGRAPH_GATE_DB_THRESHOLD -15.f    // of the frame and of its running peak envelope
+
+class DspGraph;
+
+class DspNode
+{
+public:
+    DspNode( DspPortType type, int outputLen ) : type( type ), outputLen( outputLen ), out( NULL ) { }
+    virtual ~DspNode() {}
+
+    DspPortType getType() { return this->type; }
+    int getOutputLen() { return this->outputLen; }
+    const float* getOutput() { return this->out; }
+    int getInputsN() { return (int)this->accepts.size(); }
+    DspPortType getInputType( int k ) { return this->accepts[k]; }
+    bool isGated() { return !this->accepts.empty() && this->accepts.back() == DspGate; }
+    virtual bool isTap() { return false; }
+
+    // one frame, the inputs are done, R is the sampling rate
+    virtual void process( float R ) = 0;
+    // a frame while the gate is closed
+    virtual void bypass() {
+        for( int n=0; n < this->outputLen; ++n ) this->out[n] = 0;
+    }
+
+protected:
+    // the next input takes type t
+    void accept( DspPortType t ) { this->accepts.push_back( t ); }
+    DspNode* input( int k ) { return this->inputs[k]; }
+    const float* in( int k ) { return this->inputs[k]->out; }
+
+    DspPortType                 type;
+    int                         outputLen;
+    float*                      out;
+    std::vector<DspPortType>    accepts;
+    std::vector<DspNode*>       inputs;
+
+    friend class DspGraph;
+};
+
+// the frame of DspGraph::process(), read in place
+class FrameNode : public DspNode
+{
+public:
+    explicit FrameNode( int N ) : DspNode( DspSignal, N ) { }
+    virtual void process( float /*R*/ ) { }
+};
+
+// a tap reads its input in place, the graph sets its type and length
+class TapNode : public DspNode
+{
+public:
+    TapNode() : DspNode( DspAny, 0 ) {
+        accept( DspAny );
+    }
+    virtual void process( float /*R*/ ) { }
+    virtual void bypass() { }
+    virtual bool isTap() { return true; }
+};
+
+/**
+ * Energy gate, open when the frame and the running peak envelope of the frame are above
+ * DSPGRAPH_GATE_DB_THRESHOLD, the gate of PitchEstimator2.
+ */
+class GateNode : public DspNode
+{
+public:
+    explicit GateNode( int N, float thresholdDb = DSPGRAPH_GATE_DB_THRESHOLD ) :
+            DspNode( DspGate, DSPGRAPH_GATE_LEN ), N( N ), thresholdDb( thresholdDb ) {
+        accept( DspSignal );
+    }
+
+    virtual void process( float /*R*/ ) {
+        float energy = 0;
+        bool open = PitchEstimator2::gate( in( 0 ), this->N, this->thresholdDb, &energy );
+        this->out[ DSPGRAPH_GATE_OPEN ] = open ? 1.f : 0.f;
+        this->out[ DSPGRAPH_GATE_DB ] = energy;
+    }
+
+private:
+    int     N;
+    float   thresholdDb;
+};
+
+/**
+ * LPC prewhitening filter, the residual scaled back to the energy of the frame. The formants of
+ * the last open frame are in getLinearPredictor().
+ *
+ * Inputs: the frame, the gate.
+ */
+class WhiteningNode : public DspNode
+{
+public:
+    explicit WhiteningNode( int N ) : DspNode( DspSignal, N ), N( N ) {
+        accept( DspSignal );
+        accept( DspGate );
+    }
+
+    LinearPredictor& getLinearPredictor() { return this->lpc; }
+
+    virtual void process( float R ) {
+        PitchEstimator2::whiten( this->lpc, in( 0 ), this->N, R, in( 1 )[ DSPGRAPH_GATE_DB ], this->out );
+    }
+
+private:
+    int                 N;
+    LinearPredictor     lpc;
+};
+
+/**
+ * The frame into a SpectralContext, its consumers share one forward transform. The transform
+ * runs when the first of them asks for a view.
+ */
+class FftNode : public DspNode
+{
+public:
+    explicit FftNode( int N ) : DspNode( DspSpectrum, 0 ), N( N ), context( N ) {
+        accept( DspSignal );
+    }
+
+    SpectralContext& getContext() { return this->context; }
+
+    virtual void process( float /*R*/ ) {
+        this->context.update( in( 0 ), this->N );
+    }
+
+private:
+    int                 N;
+    SpectralContext     context;
+};
+
+// |X| of the N point DFT, the even bins of the padded spectrum, like FastFourierTransformMagnitudeSpectrum
+class MagnitudeNode : public DspNode
+{
+public:
+    explicit MagnitudeNode( int N ) : DspNode( DspBins, N ), N( N ) {
+        accept( DspSpectrum );
+    }
+
+    virtual void process( float /*R*/ ) {
+        const float* X = ((FftNode*)input( 0 ))->getContext().getSpectrum();
+        for( int n=0; n < this->N; ++n ) {
+            this->out[n] = sqrtf( X[4 * n] * X[4 * n] + X[4 * n + 1] * X[4 * n + 1] );
+        }
+    }
+
+private:
+    int     N;
+};
+
+/**
+ * Linear ACF of the spectrum (Wiener-Khinchin), lags [0, N) then the negative lags, scaled up like
+ * AutocorrelationNormalized for the display.
+ */
+class AcfNode : public DspNode
+{
+public:
+    explicit AcfNode( int N ) : DspNode( DspLags, 2 * N ), N( N ) {
+        accept( DspSpectrum );
+    }
+
+    virtual void process( float /*R*/ ) {
+        SpectralContext& context = ((FftNode*)input( 0 ))->getContext();
+        const float* x = context.getFrame();
+        float xMax = 0;
+        for( int n=0; n < this->N; ++n ) {
+            xMax = std::max( xMax, fabsf( x[n] ) );
+        }
+        if( xMax < 0.9f ) {
+            xMax = 0.9f / xMax;
+        }
+        const float* r = context.getAutocorrelation();
+        for( int n=0; n < this->N; ++n ) {
+            this->out[n] = r[n] * xMax * xMax;
+        }
+        const int N2 = 2 * this->N;
+        this->out[ this->N ] = 0;
+        for( int n = this->N + 1; n < N2; ++n ) {
+            this->out[n] = this->out[ N2 - n ];
+        }
+    }
+
+private:
+    int     N;
+};
+
+/**
+ * Circular ACF scaled by 1 / 2N as MPM takes it, of the lags down to lowestHz only (acorr_r()).
+ *
+ * Inputs: a signal, the gate when gated.
+ */
+class CircularAcfNode : public DspNode
+{
+public:
+    CircularAcfNode( int N, bool gated, float lowestHz = MPM_LOWER_PITCH_CUTOFF ) :
+            DspNode( DspLags, N ), N( N ), lowestHz( lowestHz ), ac( N, AcorrCircular ) {
+        accept( DspSignal );
+        if( gated ) {
+            accept( DspGate );
+        }
+    }
+
+    virtual void process( float R ) {
+        int lags = std::min( (int)((int)R / this->lowestHz) + 2, this->N );
+        this->ac.compute( in( 0 ), this->out, lags, 1.f / (float)(2 * this->N) );
+        for( int tau = lags; tau < this->N; ++tau ) {
+            this->out[ tau ] = (this->N - tau < lags) ? this->out[ this->N - tau ] : 0.f;
+        }
+    }
+
+private:
+    int                 N;
+    float               lowestHz;
+    AcorrEngine<float>  ac;
+};
+
+/**
+ * MPM peak picker on a CircularAcfNode, with the octave check on the same ACF and the least squares
+ * refinement on the frame, the decisions of PitchEstimator2. A voiced frame without an estimate
+ * holds the last pitch.
+ *
+ * Inputs: the ACF, the frame, the gate.
+ */
+class PickerNode : public DspNode
+{
+public:
+    explicit PickerNode( int N ) : DspNode( DspPitch, DSPGRAPH_PITCH_LEN ), N( N ), octave( N ),
+                                   octaveCheck( true ), refinement( false ), pitch( 0 ), period( 0 ),
+                                   clarity( 0 ) {
+        accept( DspLags );
+        accept( DspSignal );
+        accept( DspGate );
+    }
+
+    void setOctaveCheck( bool enable ) { this->octaveCheck = enable; }
+    void setRefinement( bool enable ) { this->refinement = enable; }
+
+    virtual void process( float R ) {
+        const float* acf = in( 0 );
+        bool estimated = false;
+        double P = mpm.pitchFromAcf( acf, R );
+        P = PitchEstimator2::verify( P, acf, this->N, R, this->octaveCheck ? &this->octave : NULL,
+                                     this->refinement ? &this->lse : NULL, in( 1 ) );
+        if( P > 0 ) {
+            this->pitch = P;
+            // the octave check and the refinement may have moved the period MPM picked
+            this->period = R / P;
+            this->clarity = this->mpm.getClarityAt( this->period );
+            estimated = true;
+        }
+        publish( estimated );
+    }
+    virtual void bypass() {
+        this->pitch = 0;
+        publish( false );
+    }
+
+private:
+    void publish( bool estimated ) {
+        if( this->pitch <= 0 ) {
+            this->period = 0;
+        }
+        this->out[ DSPGRAPH_PITCH_HZ ] = this->pitch;
+        this->out[ DSPGRAPH_PITCH_CONFIDENCE ] = estimated ? std::max( 0.f, std::min( 1.f, this->clarity ) ) : 0.f;
+        this->out[ DSPGRAPH_PITCH_PERIOD ] = this->period;
+        this->out[ DSPGRAPH_PITCH_ESTIMATED ] = estimated && this->pitch > 0 ? 1.f : 0.f;
+    }
+
+    int                 N;
+    Mpm<256, float>     mpm;            // as PitchEstimator2, N = 256
+    OctaveVerifier      octave;
+    LSE                 lse;
+    bool                octaveCheck;
+    bool                refinement;
+    float               pitch;
+    float               period;
+    float               clarity;        // normalized ACF at period
+};
+
+// Viterbi tracking of the estimates of a picker, lookahead frames late, like PitchTracked
+class TrackerNode : public DspNode
+{
+public:
+    explicit TrackerNode( int lookahead = 1 ) : DspNode( DspPitch, DSPGRAPH_PITCH_LEN ),
+                                                tracker( 28, 96, 5, lookahead ), pitch( 0 ) {
+        accept( DspPitch );
+    }
+
+    PitchTracker& getTracker() { return this->tracker; }
+
+    virtual void process( float R ) {
+        const float* p = in( 0 );
+        float pitches[1] = { p[ DSPGRAPH_PITCH_HZ ] };
+        float confidences[1] = { p[ DSPGRAPH_PITCH_CONFIDENCE ] };
+        int n = p[ DSPGRAPH_PITCH_ESTIMATED ] > 0 ? 1 : 0;
+        if( this->tracker.push( pitches, confidences, n ) ) {
+            this->pitch = this->tracker.getPitch();
+        }
+        this->out[ DSPGRAPH_PITCH_HZ ] = this->pitch;
+        this->out[ DSPGRAPH_PITCH_CONFIDENCE ] = this->pitch > 0 ? this->tracker.getConfidence() : 0.f;
+        this->out[ DSPGRAPH_PITCH_PERIOD ] = this->pitch > 0 ? R / this->pitch : 0.f;
+        this->out[ DSPGRAPH_PITCH_ESTIMATED ] = this->pitch > 0 ? 1.f : 0.f;
+    }
+
+private:
+    PitchTracker    tracker;
+    float           pitch;
+};
+
+// nearest note of a tuning, the mapper is the one of the graph, so DSP::getNoteMapper() retunes it
+class NoteNode : public DspNode
+{
+public:
+    explicit NoteNode( NoteMapper& mapper ) : DspNode( DspNote, DSPGRAPH_NOTE_LEN ), mapper( mapper ) {
+        accept( DspPitch );
+    }
+
+    virtual void process( float /*R*/ ) {
+        NoteMapping m;
+        this->mapper.map( in( 0 )[ DSPGRAPH_PITCH_HZ ], m );
+        this->out[ DSPGRAPH_NOTE_NUMBER ] = (float)m.note;
+        this->out[ DSPGRAPH_NOTE_HZ ] = m.hz;
+        this->out[ DSPGRAPH_NOTE_FRACTIONAL ] = m.fractional;
+        this->out[ DSPGRAPH_NOTE_CENTS ] = m.cents;
+    }
+
+private:
+    NoteMapper&     mapper;
+};
+
+class DspGraph : DSP {
+public:
+    explicit DspGraph( int N ) : DSP(), N( N ), built( false ), display( -1 ), noteNode( -1 ),
+                                 formants( NULL ), pitch( 0 ), nacIndex( 0 ), confidence( 0 ), estimated( false ) {
+        this->R = 0;
+        this->nodes.push_back( new FrameNode( N ) );
+        this->wiring.push_back( std::vector<int>() );
+    }
+    ~DspGraph( ) {
+        for( DspNode* node : this->nodes ) {
+            delete node;
+        }
+    }
+
+    // id of the frame node
+    int getFrame() { return 0; }
+
+    /**
+     * Takes ownership of node, in0.. are the ids of its inputs, -1 for none. Inputs may be added
+     * later, the order is only checked and resolved by build().
+     *
+     * @return id of the node
+     */
+    int add( DspNode* node, int in0 = -1, int in1 = -1, int in2 = -1 ) {
+        std::vector<int> inputs;
+        const int ins[] = { in0, in1, in2 };
+        for( int k=0; k < 3 && ins[k] >= 0; ++k ) {
+            inputs.push_back( ins[k] );
+        }
+        this->nodes.push_back( node );
+        this->wiring.push_back( inputs );
+        this->built = false;
+        return (int)this->nodes.size() - 1;
+    }
+    // a TapNode on the output of from, kept by build() even when nothing else reads it
+    int addTap( int from ) {
+        int tap = add( new TapNode(), from );
+        this->taps.push_back( tap );
+        return tap;
+    }
+    // the tap process() copies into dest
+    void setDisplay( int tap ) { this->display = tap; }
+    // the NoteNode behind getMidiNoteNumber() and the pitch outputs of the DSP, its input the pitch
+    void setNote( int note ) { this->noteNode = note; }
+    void setFormants( LinearPredictor* lpc ) { this->formants = lpc; }
+
+    /**
+     * Checks the connections, schedules the nodes the taps and the note depend on in topological
+     * order and allocates their outputs.
+     *
+     * @return false on a wrong input count or type, an unknown id or a cycle, nothing runs then
+     */
+    bool build() {
+        this->built = false;
+        this->order.clear();
+        const int V = (int)this->nodes.size();
+        for( int v=0; v < V; ++v ) {
+            DspNode* node = this->nodes[v];
+            const std::vector<int>& ins = this->wiring[v];
+            if( (int)ins.size() != node->getInputsN() ) {
+                LOGE("DspGraph: node %d takes %d inputs, %d connected", v, node->getInputsN(), (int)ins.size());
+                return false;
+            }
+            node->inputs.clear();
+            for( int k=0; k < (int)ins.size(); ++k ) {
+                if( ins[k] >= V || ins[k] == v ) {
+                    LOGE("DspGraph: input %d of node %d is no node", k, v);
+                    return false;
+                }
+                node->inputs.push_back( this->nodes[ ins[k] ] );
+            }
+        }
+
+        // what the sinks depend on
+        std::vector<bool> needed( V, false );
+        std::vector<int> stack( this->taps );
+        if( this->noteNode >= 0 && this->noteNode < V ) stack.push_back( this->noteNode );
+        if( this->display >= 0 && this->display < V ) stack.push_back( this->display );
+        while( !stack.empty() ) {
+            int v = stack.back();
+            stack.pop_back();
+            if( needed[v] ) continue;
+            needed[v] = true;
+            for( int u : this->wiring[v] ) stack.push_back( u );
+        }
+
+        // Kahn, a node runs once all of its inputs ran
+        std::vector<int> pending( V, 0 );
+        std::vector<std::vector<int>> readers( V );
+        for( int v=0; v < V; ++v ) {
+            if( !needed[v] ) continue;
+            for( int u : this->wiring[v] ) {
+                ++pending[v];
+                readers[u].push_back( v );
+            }
+        }
+        std::vector<int> ready;
+        int scheduled = 0, total = 0;
+        for( int v=0; v < V; ++v ) {
+            if( needed[v] ) {
+                ++total;
+                if( pending[v] == 0 ) ready.push_back( v );
+            }
+        }
+        std::vector<int> sorted;
+        while( !ready.empty() ) {
+            int v = ready.back();
+            ready.pop_back();
+            sorted.push_back( v );
+            ++scheduled;
+            for( int w : readers[v] ) {
+                if( --pending[w] == 0 ) ready.push_back( w );
+            }
+        }
+        if( scheduled != total ) {
+            LOGE("DspGraph: cycle, %d of %d nodes scheduled", scheduled, total);
+            return false;
+        }
+
+        // types, taps take theirs from the input
+        for( int v : sorted ) {
+            DspNode* node = this->nodes[v];
+            for( int k=0; k < node->getInputsN(); ++k ) {
+                DspPortType want = node->getInputType( k ), got = node->inputs[k]->getType();
+                if( want != DspAny && want != got ) {
+                    LOGE("DspGraph: input %d of node %d takes type %d, got %d", k, v, want, got);
+                    return false;
+                }
+            }
+            if( node->isTap() ) {
+                node->type = node->inputs[0]->getType();
+                node->outputLen = node->inputs[0]->getOutputLen();
+            }
+        }
+        if( this->noteNode >= 0 && (this->noteNode >= V || this->nodes[ this->noteNode ]->getType() != DspNote) ) {
+            LOGE("DspGraph: node %d is no note", this->noteNode);
+            return false;
+        }
+
+        // one arena for the outputs, taps and the frame are read in place
+        int arenaLen = 0;
+        for( int v : sorted ) {
+            if( v != getFrame() && !this->nodes[v]->isTap() ) {
+                arenaLen += this->nodes[v]->getOutputLen();
+            }
+        }
+        this->arena.assign( std::max( arenaLen, 1 ), 0.f );
+        int offset = 0;
+        for( int v : sorted ) {
+            DspNode* node = this->nodes[v];
+            if( v == getFrame() ) continue;
+            if( node->isTap() ) {
+                node->out = node->inputs[0]->out;
+            } else {
+                node->out = &this->arena[ offset ];
+                offset += node->getOutputLen();
+            }
+            this->order.push_back( node );
+        }
+        this->built = true;
+        LOGV("DspGraph: %d of %d nodes scheduled, %d floats", (int)this->order.size(), V - 1, arenaLen);
+        return true;
+    }
+
+    const float* getOutput( int id ) { return this->nodes[id]->getOutput(); }
+    int getOutputLen( int id ) { return this->nodes[id]->getOutputLen(); }
+    // nodes run per frame
+    int getScheduled() { return (int)this->order.size(); }
+    int getArenaLen() { return this->built ? (int)this->arena.size() : 0; }
+
+    virtual float getNacIndex() { return this->nacIndex; }
+    virtual float getPitch() { return this->pitch; }
+    virtual int getPitchCandidates( PitchCandidate* dest, int destLen ) {
+        if( !this->estimated || this->pitch <= 0 || destLen < 1 ) {
+            return 0;
+        }
+        dest[0].pitch = this->pitch;
+        dest[0].confidence = this->confidence;
+        return 1;
+    }
+    virtual int getFormants( float* dest, int destLen ) {
+        if( this->formants == NULL ) {
+            return 0;
+        }
+        for( int k=0; k < destLen; ++k ) {
+            dest[k] = this->formants->getFormant( k );
+        }
+        return destLen;
+    }
+    virtual int getProcessOutputLen() {
+        return this->built && this->display >= 0 ? this->nodes[ this->display ]->getOutputLen() : 0;
+    }
+    virtual void process( float* src, int srcLen, float* dest ) {
+        assert( srcLen == this->N );
+        if( !this->built ) {
+            return;
+        }
+        this->nodes[ getFrame() ]->out = src;
+        for( DspNode* node : this->order ) {
+            if( node->isGated() && node->inputs.back()->out[ DSPGRAPH_GATE_OPEN ] <= 0 ) {
+                node->bypass();
+            } else {
+                node->process( this->R );
+            }
+        }
+        if( this->display >= 0 ) {
+            const DspNode* tap = this->nodes[ this->display ];
+            memcpy( dest, tap->out, sizeof(float) * tap->outputLen );
+        }
+        if( this->noteNode >= 0 ) {
+            const float* n = this->nodes[ this->noteNode ]->getOutput();
+            const float* p = this->nodes[ this->noteNode ]->inputs[0]->getOutput();
+            this->pitch = p[ DSPGRAPH_PITCH_HZ ];
+            this->confidence = p[ DSPGRAPH_PITCH_CONFIDENCE ];
+            this->nacIndex = p[ DSPGRAPH_PITCH_PERIOD ];
+            this->estimated = p[ DSPGRAPH_PITCH_ESTIMATED ] > 0;
+            this->note.note = (int)n[ DSPGRAPH_NOTE_NUMBER ];
+            this->note.hz = n[ DSPGRAPH_NOTE_HZ ];
+            this->note.fractional = n[ DSPGRAPH_NOTE_FRACTIONAL ];
+            this->note.cents = n[ DSPGRAPH_NOTE_CENTS ];
+        }
+    }
+
+    /**
+     * The graph of a ProcessingModes mode, built, NULL for RawAudioOnly:
+     *
+     *  MagnitudeSpectrum   frame - FFT - magnitude - tap
+     *  Autocorrelation     frame - FFT - ACF - tap
+     *  PitchEstimation     frame - gate - whitening - circular ACF - picker - note, the ACF tapped,
+     *                      the picker refined on the frame, the formants of the whitening
+     */
+    static DspGraph* forMode( int mode, int N ) {
+        DspGraph* g = NULL;
+        switch( mode ) {
+            case ProcessingModes::MagnitudeSpectrum:
+                {
+                    g = new DspGraph( N );
+                    int fft = g->add( new FftNode( N ), g->getFrame() );
+                    g->setDisplay( g->addTap( g->add( new MagnitudeNode( N ), fft ) ) );
+                }
+                break;
+            case ProcessingModes::Autocorrelation:
+                {
+                    g = new DspGraph( N );
+                    int fft = g->add( new FftNode( N ), g->getFrame() );
+                    g->setDisplay( g->addTap( g->add( new AcfNode( N ), fft ) ) );
+                }
+                break;
+            case ProcessingModes::PitchEstimation:
+                {
+                    g = new DspGraph( N );
+                    int frame = g->getFrame();
+                    int gate = g->add( new GateNode( N ), frame );
+                    // formants for MIDI CC, and MPM on the residual does not lock onto the first formant
+                    WhiteningNode* whitening = new WhiteningNode( N );
+                    int white = g->add( whitening, frame, gate );
+                    g->setFormants( &whitening->getLinearPredictor() );
+                    int acf = g->add( new CircularAcfNode( N, true ), white, gate );
+                    // the pitch bend stream wants sub-cent pitch
+                    PickerNode* picker = new PickerNode( N );
+                    picker->setRefinement( true );
+                    int pitch = g->add( picker, acf, frame, gate );
+                    g->setNote( g->add( new NoteNode( g->getNoteMapper() ), pitch ) );
+                    g->setDisplay( g->addTap( acf ) );
+                }
+                break;
+            default:
+                return NULL;
+        }
+        if( !g->build() ) {
+            delete g;
+            return NULL;
+        }
+        return g;
+    }
+
+private:
+    int                             N;
+    bool                            built;
+    std::vector<DspNode*>           nodes;          // by id, the frame first
+    std::vector<std::vector<int>>   wiring;         // input ids by node id
+    std::vector<int>                taps;
+    int                             display;
+    int                             noteNode;
+    LinearPredictor*                formants;
+    std::vector<DspNode*>           order;          // topological, what build() kept
+    std::vector<float>              arena;
+    float                           pitch;
+    float                           nacIndex;
+    float                           confidence;
+    bool                            estimated;
+};
@@ -0,0 +1,379 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __ANDROID__
+#include <dlfcn.h>
+#include <jni.h>
+#include <amidi/AMidi.h>
+#endif
+
+#include "log.h"
+#include "NoteEventQueue.h"
+#include "util.h"
+
+#define MIDI_ENGINE_LATENCY_MS 40           // capture to delivery, more than a frame plus its analysis
+#define MIDI_ENGINE_DRAIN_MS 100
+#define MIDI_ALL_NOTES_OFF 123
+#define MIDI_CLOCK_SLEW_NS 2000             // per frame, of the sample clock anchor
+
+/**
+ * Where the MIDI engine delivers complete channel messages.
+ *
+ * send() is called from the engine thread only, with the delivery time on the CLOCK_MONOTONIC
+ * clock, the same clock as System.nanoTime() and the Android MIDI timestamps.
+ */
+class MidiSink
+{
+public:
+    virtual ~MidiSink() {}
+    virtual bool send( const uint8_t* bytes, int count, int64_t nanos ) = 0;
+    virtual void flush() {}
+};
+
+struct MidiMessage
+{
+    int64_t nanos;      // delivery time
+    int64_t sent;       // CLOCK_MONOTONIC when the sink got it
+    uint8_t bytes[3];
+    int     count;
+};
+
+/**
+ * Keeps every message in memory, for checks on the host.
+ */
+class LoopbackMidiSink : public MidiSink
+{
+public:
+    virtual bool send( const uint8_t* bytes, int count, int64_t nanos ) {
+        MidiMessage m;
+        m.nanos = nanos;
+        m.sent = cnanos();
+        m.count = count < 3 ? count : 3;
+        for( int i=0; i < 3; ++i ) m.bytes[i] = i < m.count ? bytes[i] : 0;
+        std::lock_guard<std::mutex> guard( lock );
+        messages.push_back( m );
+        return true;
+    }
+    // copy of the messages so far
+    std::vector<MidiMessage> getMessages() {
+        std::lock_guard<std::mutex> guard( lock );
+        return messages;
+    }
+    void clear() {
+        std::lock_guard<std::mutex> guard( lock );
+        messages.clear();
+    }
+
+private:
+    std::mutex                  lock;
+    std::vector<MidiMessage>    messages;
+};
+
+/**
+ * One text line per message, "nanos status data1 data2" in hex bytes, the timestamps relative to the
+ * first message.
+ */
+class FileMidiSink : public MidiSink
+{
+public:
+    FileMidiSink( const char* path ) : first( -1 ) {
+        this->f = fopen( path, "w" );
+        if( this->f == NULL ) {
+            LOGE("FileMidiSink: can not open %s", path);
+        }
+    }
+    virtual ~FileMidiSink() {
+        if( this->f != NULL ) {
+            fclose( this->f );
+        }
+    }
+    virtual bool send( const uint8_t* bytes, int count, int64_t nanos ) {
+        if( this->f == NULL ) {
+            return false;
+        }
+        if( first < 0 ) first = nanos;
+        fprintf( this->f, "%lld", (long long)(nanos - first) );
+        for( int i=0; i < count; ++i ) {
+            fprintf( this->f, " %02X", bytes[i] );
+        }
+        fputc( '\n', this->f );
+        return true;
+    }
+    virtual void flush() {
+        if( this->f != NULL ) {
+            fflush( this->f );
+        }
+    }
+    bool isOpen() { return this->f != NULL; }
+
+private:
+    FILE*   f;
+    int64_t first;
+};
+
+/**
+ * The same messages to up to two sinks, e.g. a device and a recorder. The sinks are only changed
+ * while the engine is stopped, an empty slot is skipped.
+ */
+class TeeMidiSink : public MidiSink
+{
+public:
+    TeeMidiSink() {
+        sinks[0] = sinks[1] = NULL;
+    }
+    void set( int k, MidiSink* sink ) { sinks[k & 1] = sink; }
+    MidiSink* get( int k ) { return sinks[k & 1]; }
+    bool isEmpty() { return sinks[0] == NULL && sinks[1] == NULL; }
+
+    virtual bool send( const uint8_t* bytes, int count, int64_t nanos ) {
+        bool ok = true;
+        for( int k=0; k < 2; ++k ) {
+            if( sinks[k] != NULL ) ok = sinks[k]->send( bytes, count, nanos ) && ok;
+        }
+        return ok;
+    }
+    virtual void flush() {
+        for( int k=0; k < 2; ++k ) {
+            if( sinks[k] != NULL ) sinks[k]->flush();
+        }
+    }
+
+private:
+    MidiSink*   sinks[2];
+};
+
+#ifdef __ANDROID__
+/**
+ * An input port of a device opened by android.media.midi on the Java side, through the NDK AMidi
+ * API. libamidi is API 29, it is loaded at run time so the app still starts on older devices where
+ * open() then fails.
+ */
+class AMidiSink : public MidiSink
+{
+public:
+    AMidiSink() : device( NULL ), port( NULL ) { }
+    virtual ~AMidiSink() {
+        close();
+    }
+
+    // @param midiDevice an android.media.midi.MidiDevice
+    bool open( JNIEnv* env, jobject midiDevice, int portNumber ) {
+        close();
+        if( !load() ) {
+            LOGE("AMidiSink: libamidi not available");
+            return false;
+        }
+        if( fromJava( env, midiDevice, &device ) != AMEDIA_OK ) {
+            LOGE("AMidiSink: AMidiDevice_fromJava failed");
+            device = NULL;
+            return false;
+        }
+        if( openPort( device, portNumber, &port ) != AMEDIA_OK ) {
+            LOGE("AMidiSink: AMidiInputPort_open %d failed", portNumber);
+            port = NULL;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if( port != NULL ) {
+            closePort( port );
+            port = NULL;
+        }
+        if( device != NULL ) {
+            release( device );
+            device = NULL;
+        }
+    }
+
+    virtual bool send( const uint8_t* bytes, int count, int64_t nanos ) {
+        if( port == NULL ) {
+            return false;
+        }
+        return sendWithTimestamp( port, bytes, count, nanos ) == count;
+    }
+    virtual void flush() {
+        if( port != NULL ) {
+            sendFlush( port );
+        }
+    }
+
+private:
+    typedef media_status_t (*FromJavaFn)( JNIEnv*, jobject, AMidiDevice** );
+    typedef media_status_t (*ReleaseFn)( const AMidiDevice* );
+    typedef media_status_t (*OpenPortFn)( const AMidiDevice*, int32_t, AMidiInputPort** );
+    typedef void (*ClosePortFn)( const AMidiInputPort* );
+    typedef ssize_t (*SendFn)( const AMidiInputPort*, const uint8_t*, size_t, int64_t );
+    typedef media_status_t (*FlushFn)( const AMidiInputPort* );
+
+    bool load() {
+        static void* lib = dlopen( "libamidi.so", RTLD_NOW );
+        if( lib == NULL ) {
+            return false;
+        }
+        fromJava = (FromJavaFn) dlsym( lib, "AMidiDevice_fromJava" );
+        release = (ReleaseFn) dlsym( lib, "AMidiDevice_release" );
+        openPort = (OpenPortFn) dlsym( lib, "AMidiInputPort_open" );
+        closePort = (ClosePortFn) dlsym( lib, "AMidiInputPort_close" );
+        sendWithTimestamp = (SendFn) dlsym( lib, "AMidiInputPort_sendWithTimestamp" );
+        sendFlush = (FlushFn) dlsym( lib, "AMidiInputPort_sendFlush" );
+        return fromJava && release && openPort && closePort && sendWithTimestamp && sendFlush;
+    }
+
+    AMidiDevice*    device;
+    AMidiInputPort* port;
+    FromJavaFn      fromJava;
+    ReleaseFn       release;
+    OpenPortFn      openPort;
+    ClosePortFn     closePort;
+    SendFn          sendWithTimestamp;
+    FlushFn         sendFlush;
+};
+#endif
+
+/**
+ * Sample position of the input to CLOCK_MONOTONIC, sample n is at anchor + n / R. A frame is read
+ * some time after its last sample was captured, how long varies with the scheduling of the reader,
+ * so the anchor follows the earliest reads: a frame read earlier than the clock predicts moves the
+ * anchor back to it at once, otherwise the anchor slews forward by MIDI_CLOCK_SLEW_NS per frame,
+ * which absorbs a drift of the audio clock against the monotonic clock of up to about 90 ppm.
+ */
+class MidiClock
+{
+public:
+    MidiClock() : anchored( false ), R( 11025.f ), anchorSample( 0 ), anchorNanos( 0 ) { }
+
+    void reset() { anchored = false; }
+
+    /**
+     * @param endSample sample position just past the frame
+     * @param readNanos when the frame was read, its last sample was captured before that
+     */
+    void update( int64_t endSample, int64_t readNanos, float R ) {
+        if( !anchored || R != this->R || readNanos < nanos( endSample ) ) {
+            this->R = R;
+            anchorSample = endSample;
+            anchorNanos = readNanos;
+            anchored = true;
+        } else {
+            anchorNanos += std::min( (int64_t)MIDI_CLOCK_SLEW_NS, readNanos - nanos( endSample ) );
+        }
+    }
+
+    int64_t nanos( int64_t sample ) {
+        return anchorNanos + (int64_t)((double)(sample - anchorSample) * 1e9 / R);
+    }
+
+private:
+    bool    anchored;
+    float   R;
+    int64_t anchorSample;
+    int64_t anchorNanos;
+};
+
+/**
+ * Native MIDI output
+ *
+ * A thread of its own drains the NoteEventQueue of the note layer and sends every event to the sink
+ * on one channel, stamped with the capture time of its frame plus a fixed latency. The delivery time
+ * of a note does not depend on when the thread got to it, only on when its audio was captured, as
+ * long as the pipeline stays within the latency (getLate() counts the events that did not).
+ *
+ * Example code:
+ *
+ * LoopbackMidiSink sink;
+ * MidiEngine engine( queue );
+ * engine.start( &sink, 0 );
+ * ...
+ * engine.stop();
+ */
+class MidiEngine
+{
+public:
+    MidiEngine( NoteEventQueue& queue ) : queue( queue ), sink( NULL ), channel( 0 ), lastAt( 0 ), running( false ),
+                                          sent( 0 ), late( 0 ) {
+        this->latency = MIDI_ENGINE_LATENCY_MS * 1000000LL;
+    }
+    ~MidiEngine() {
+        stop();
+    }
+
+    void setLatency( int64_t nanos ) { this->latency = nanos; }
+    int64_t getLatency() { return this->latency; }
+
+    /**
+     * Starts delivering to sink on MIDI channel 0..15, with a program change first when patch >= 0.
+     */
+    void start( MidiSink* sink, int channel, int patch = -1 ) {
+        stop();
+        this->sink = sink;
+        this->channel = channel & 0x0F;
+        if( patch >= 0 ) {
+            uint8_t bytes[2] = { (uint8_t)(0xC0 | this->channel), (uint8_t)(patch & 0x7F) };
+            sink->send( bytes, 2, cnanos() );
+        }
+        // left over from before the last stop
+        queue.clear();
+        queue.open();
+        lastAt = 0;
+        running.store( true );
+        th = std::thread( &MidiEngine::run, this );
+    }
+
+    // sends what is queued, then all notes off, not before the last of them is delivered
+    void stop() {
+        if( !running.load() ) {
+            return;
+        }
+        queue.close();
+        th.join();
+        running.store( false );
+        uint8_t bytes[3] = { (uint8_t)(NOTE_EVENT_CONTROL_CHANGE | channel), MIDI_ALL_NOTES_OFF, 0 };
+        // the thread is joined, lastAt is ours
+        sink->send( bytes, 3, std::max( cnanos(), lastAt ) );
+        sink->flush();
+        sink = NULL;
+    }
+
+    bool isRunning() { return running.load( std::memory_order_relaxed ); }
+    int64_t getSent() { return sent.load( std::memory_order_relaxed ); }
+    // events that reached the sink after their delivery time
+    int64_t getLate() { return late.load( std::memory_order_relaxed ); }
+
+private:
+    void run() {
+        NoteEvent events[64];
+        int n;
+        while( (n = queue.drain( events, 64, MIDI_ENGINE_DRAIN_MS )) >= 0 ) {
+            int64_t now = cnanos();
+            for( int k=0; k < n; ++k ) {
+                const NoteEvent& e = events[k];
+                uint8_t bytes[3] = { (uint8_t)(e.status | channel), e.data1, e.data2 };
+                int64_t at = e.nanos + latency;
+                if( at < now ) late.fetch_add( 1, std::memory_order_relaxed );
+                sink->send( bytes, 3, at );
+                lastAt = std::max( lastAt, at );
+                sent.fetch_add( 1, std::memory_order_relaxed );
+            }
+        }
+    }
+
+    NoteEventQueue&     queue;
+    MidiSink*           sink;
+    int                 channel;
+    int64_t             latency;
+    std::thread         th;
+    int64_t             lastAt;         // latest delivery time sent, written by the thread
+    std::atomic<bool>   running;
+    std::atomic<int64_t> sent;
+    std::atomic<int64_t> late;
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#include "log.h"
+#include "LockFreeQueue.h"
+
+#define NOTE_EVENT_QUEUE_LENGTH 256
+
+#define NOTE_EVENT_NOTE_OFF 0x80
+#define NOTE_EVENT_NOTE_ON 0x90
+#define NOTE_EVENT_CONTROL_CHANGE 0xB0
+#define NOTE_EVENT_PITCH_BEND 0xE0
+
+// one MIDI channel message, the channel is added by the sink
+struct NoteEvent
+{
+    int64_t nanos;      // CLOCK_MONOTONIC of the audio frame the event belongs to
+    uint8_t status;     // NOTE_EVENT_*, upper nibble of the MIDI status byte
+    uint8_t data1;      // note, controller, or the low 7 bits of a bend
+    uint8_t data2;      // velocity, value, or the high 7 bits of a bend
+};
+
+/**
+ * Note events from the analysis thread to a consumer that sleeps until there are any.
+ *
+ * push() never blocks and never allocates: the event goes to a single producer, single consumer
+ * LockFreeQueue, and the mutex is only taken to notify when the consumer is actually waiting. The
+ * waiting flag and the queue counters are sequentially consistent, so either the producer sees the
+ * flag or the consumer sees the event before it sleeps, no wakeup is lost. A full queue drops the
+ * event and counts it, drain() logs the drops since its last report, nothing is dropped silently.
+ *
+ * Example code:
+ *
+ * NoteEventQueue q;
+ * q.push(e);                                  // analysis thread
+ * NoteEvent events[16];
+ * int n = q.drain(events, 16, 100);           // consumer thread, waits up to 100 ms
+ */
+class NoteEventQueue
+{
+public:
+    NoteEventQueue() : waiting( false ), closed( false ), pushed( 0 ), dropped( 0 ), reported( 0 ) { }
+
+    // producer side
+    bool push( const NoteEvent& e ) {
+        if( !queue.push( e ) ) {
+            // counted only, the consumer reports it, no logging on the audio path
+            dropped.fetch_add( 1, std::memory_order_relaxed );
+            return false;
+        }
+        pushed.fetch_add( 1, std::memory_order_relaxed );
+        if( waiting.load() ) {
+            std::lock_guard<std::mutex> guard( lock );
+            wake.notify_one();
+        }
+        return true;
+    }
+
+    /**
+     * Consumer side, pops the pending events, waiting for the first one when there are none.
+     *
+     * @param timeoutMs longest wait for an event
+     * @return events written to dest, 0 on timeout, -1 once closed and empty
+     */
+    int drain( NoteEvent* dest, int destLen, int timeoutMs ) {
+        reportDropped();
+        int n = popAll( dest, destLen );
+        if( n > 0 ) {
+            return n;
+        }
+        {
+            std::unique_lock<std::mutex> guard( lock );
+            waiting.store( true );
+            wake.wait_for( guard, std::chrono::milliseconds( timeoutMs ),
+                           [this]() { return queue.size() > 0 || closed; } );
+            waiting.store( false );
+        }
+        n = popAll( dest, destLen );
+        if( n == 0 && isClosed() ) {
+            return -1;
+        }
+        return n;
+    }
+
+    // wakes the consumer for good, drain() returns -1 once the queue is empty
+    void close() {
+        std::lock_guard<std::mutex> guard( lock );
+        closed = true;
+        wake.notify_all();
+    }
+    void open() {
+        std::lock_guard<std::mutex> guard( lock );
+        closed = false;
+    }
+    // consumer side, drops what is pending
+    void clear() {
+        NoteEvent e;
+        while( queue.pop( e ) ) {
+        }
+    }
+    bool isClosed() {
+        std::lock_guard<std::mutex> guard( lock );
+        return closed;
+    }
+
+    uint32_t size() { return queue.size(); }
+    int64_t getPushed() { return pushed.load( std::memory_order_relaxed ); }
+    int64_t getDropped() { return dropped.load( std::memory_order_relaxed ); }
+
+private:
+    // consumer side
+    void reportDropped() {
+        int64_t d = dropped.load( std::memory_order_relaxed );
+        if( d != reported ) {
+            LOGE("NoteEventQueue full, %lld events dropped", (long long)(d - reported));
+            reported = d;
+        }
+    }
+    int popAll( NoteEvent* dest, int destLen ) {
+        int n = 0;
+        while( n < destLen && queue.pop( dest[n] ) ) {
+            ++n;
+        }
+        return n;
+    }
+
+    LockFreeQueue<NoteEvent, NOTE_EVENT_QUEUE_LENGTH> queue;
+    std::mutex                  lock;
+    std::condition_variable     wake;
+    std::atomic<bool>           waiting;
+    bool                        closed;
+    std::atomic<int64_t>        pushed;
+    std::atomic<int64_t>        dropped;
+    int64_t                     reported;       // drops already logged by the consumer
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include <stack>
+#include <chrono>
 #include <queue>
 #include <thread>
 #include <oboe/Oboe.h>
@@ -10,11 +11,13 @@
 #include "log.h"
 #include "util.h"
 #include "FileDevDumper.h"
+#include "AudioSource.h"
 #include "LockFreeQueue.h"
 
 #define DEFAULT_QUEUE_LENGTH 64
 #define DEFAULT_RECORDER_BUFFER_LENGTH 256
 #define DEFAULT_REQUEST_SAMPLING_RATE 11025
+#define OBOE_RECORDER_POLL_US 500           // getAudio() sleep between looks at the queue
 
 class OboeRecorder
 {
@@ -194,26 +197,23 @@ public:
     void stop() {
         this->recording = false;
     }
-    void getAudio( float* dest ) {
+    // waits up to a frame period for the next frame, false with zeros in dest when none came
+    bool getAudio( float* dest ) {
         std::int16_t* b;
-        bool bPopped = false;
-        std::int64_t nss = nanos(), ns = 0;
         std::int64_t msTimeout = ((double)this->bufferLen / this->R * 1000) + 1;
-        std::int64_t nsTimeoutGetAudio = msTimeout * oboe::kNanosPerMillisecond;
-        while( !(bPopped = Q.pop( b )) && ns < nsTimeoutGetAudio ) {
-            ns = nss - nanos();
-        }
-        if( ns > nsTimeoutGetAudio ) {
-            for( int n=0; n < this->bufferLen; ++n ) dest[n] = 0;
-            LOGI("OboeRecorder getAudio empty buffers timeout");
-        }
-        if( bPopped ) {
-            oboe::convertPcm16ToFloat( b, dest, this->bufferLen );
-            F.push(b);
-        } else {
-            for( int n=0; n < this->bufferLen; ++n ) dest[n] = 0;
-            LOGI("OboeRecorder getAudio zeros returned");
+        std::int64_t nsDeadline = nanos() + msTimeout * oboe::kNanosPerMillisecond;
+        while( !Q.pop( b ) ) {
+            if( !this->recording || nanos() >= nsDeadline ) {
+                for( int n=0; n < this->bufferLen; ++n ) dest[n] = 0;
+                LOGI("OboeRecorder getAudio timeout, zeros returned");
+                return false;
+            }
+            // the queue has no signal, poll well below the frame period
+            std::this_thread::sleep_for( std::chrono::microseconds( OBOE_RECORDER_POLL_US ) );
         }
+        oboe::convertPcm16ToFloat( b, dest, this->bufferLen );
+        F.push(b);
+        return true;
     }
     bool live() {
         return this->recording;
@@ -224,4 +224,24 @@ public:
     int getBufferLength() {
         return this->bufferLen;
     }
-};
\ No newline at end of file
+};
+/**
+ * The microphone as the source of an AnalysisEngine, read() waits up to a frame period for the
+ * next recorder frame.
+ */
+class OboeAudioSource : public AudioSource
+{
+public:
+    OboeRecorder& getRecorder() { return this->recorder; }
+
+    virtual int getBufferLength() { return this->recorder.getBufferLength(); }
+    virtual float getSamplingRate() { return (float)this->recorder.samplingRate(); }
+    virtual bool live() { return this->recorder.live(); }
+    virtual bool isRealtime() { return true; }
+    virtual bool read( float* dest ) {
+        return this->recorder.getAudio( dest );
+    }
+
+private:
+    OboeRecorder    recorder;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * A value published by a single writer and read by any number of readers, lock free for the writer
+ * and wait free unless a read overlaps a write.
+ *
+ * The sequence counter is odd while a store is in progress. A reader copies the value between two
+ * reads of the counter and retries when they differ or are odd, so a load never returns a mix of two
+ * stores. The value is kept as relaxed atomic words, the copy is a plain word loop without any data
+ * race in the C++ memory model. Meant for small trivially copyable structs (a frame of analysis
+ * results), a store or load is a few ns.
+ *
+ * Example code:
+ *
+ * Seqlock<Snapshot> published;
+ * published.store(snapshot);      // writer thread
+ * Snapshot s = published.load();  // any thread
+ */
+template <typename T>
+class Seqlock {
+public:
+    static_assert(std::is_trivially_copyable<T>::value, "Seqlock values are copied word by word");
+
+    Seqlock() : sequence( 0 ) {
+        for( int i=0; i < WORDS; ++i ) {
+            words[i].store( 0, std::memory_order_relaxed );
+        }
+    }
+
+    // writer side, only one thread may store
+    void store( const T& value ) {
+        uint32_t w[WORDS] = { 0 };
+        memcpy( w, &value, sizeof(T) );
+        uint32_t s = sequence.load( std::memory_order_relaxed );
+        sequence.store( s + 1, std::memory_order_relaxed );
+        // the odd sequence is visible before any word of the new value
+        std::atomic_thread_fence( std::memory_order_release );
+        for( int i=0; i < WORDS; ++i ) {
+            words[i].store( w[i], std::memory_order_relaxed );
+        }
+        sequence.store( s + 2, std::memory_order_release );
+    }
+
+    /**
+     * One attempt at a consistent copy.
+     *
+     * @return false if a store overlapped, value is then unchanged
+     */
+    bool tryLoad( T& value ) const {
+        uint32_t s0 = sequence.load( std::memory_order_acquire );
+        if( s0 & 1 ) {
+            return false;
+        }
+        uint32_t w[WORDS];
+        for( int i=0; i < WORDS; ++i ) {
+            w[i] = words[i].load( std::memory_order_relaxed );
+        }
+        // the words are read before the sequence is checked again
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if( sequence.load( std::memory_order_relaxed ) != s0 ) {
+            return false;
+        }
+        memcpy( &value, w, sizeof(T) );
+        return true;
+    }
+
+    // retries until no store overlaps, the writer holds the lock for a few ns only
+    T load() const {
+        T value;
+        while( !tryLoad( value ) ) {
+        }
+        return value;
+    }
+
+    // number of completed stores
+    uint32_t getStores() const { return sequence.load( std::memory_order_acquire ) / 2; }
+
+private:
+    static const int WORDS = (int)((sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+
+    std::atomic<uint32_t>   sequence;
+    std::atomic<uint32_t>   words[WORDS];
+};
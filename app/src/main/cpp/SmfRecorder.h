@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log.h"
+#include "LockFreeQueue.h"
+#include "MidiEngine.h"
+
+#define SMF_ARENA_EVENTS 4096               // messages between two passes of the writer
+#define SMF_PPQ 480                         // ticks per quarter note
+#define SMF_TEMPO_US 500000                 // per quarter note, 120 bpm, a tick is 1.04 ms
+#define SMF_WRITER_MS 20                    // period of the writer thread
+
+/**
+ * Standard MIDI File recorder
+ *
+ * A MidiSink that records the messages of the MIDI engine into a type 0 or type 1 file. send() only
+ * copies the message into a preallocated single producer, single consumer arena (a LockFreeQueue),
+ * it never blocks, allocates or wakes anybody. A writer thread of its own polls the arena every
+ * SMF_WRITER_MS, turns the delivery times into ticks and appends the events with variable length
+ * delta times to the track buffers, and writes the file at stop().
+ *
+ * Type 0 is a single track with the tempo and all events, type 1 a tempo track followed by one track
+ * per MIDI channel that has events. The tick clock starts at start(), a message stamped before it is
+ * moved to tick 0, one stamped before the previous message of its track gets a delta of 0.
+ *
+ * Example code:
+ *
+ * SmfRecorder smf;
+ * smf.start("/sdcard/performance.mid", 1);
+ * engine.start(&smf, 0);
+ * ...
+ * engine.stop();
+ * smf.stop();
+ */
+class SmfRecorder : public MidiSink
+{
+public:
+    SmfRecorder() : recording( false ), format( 1 ), startNanos( 0 ), events( 0 ), dropped( 0 ) {
+        arena = new LockFreeQueue<MidiMessage, SMF_ARENA_EVENTS>();
+    }
+    virtual ~SmfRecorder() {
+        stop();
+        delete arena;
+    }
+
+    /**
+     * @param format 0 or 1
+     * @return false when already recording
+     */
+    bool start( const char* path, int format ) {
+        if( recording.load() ) {
+            return false;
+        }
+        this->path = path;
+        this->format = format == 0 ? 0 : 1;
+        this->startNanos = cnanos();
+        this->events = 0;
+        this->dropped.store( 0 );
+        for( int c=0; c < 16; ++c ) {
+            tracks[c].clear();
+            lastTick[c] = 0;
+        }
+        MidiMessage m;
+        while( arena->pop( m ) ) {
+        }
+        recording.store( true );
+        writer = std::thread( &SmfRecorder::run, this );
+        return true;
+    }
+
+    /**
+     * Serializes what is left in the arena and writes the file.
+     *
+     * @return false when nothing was recorded or the file could not be written
+     */
+    bool stop() {
+        if( !recording.load() ) {
+            return false;
+        }
+        recording.store( false );
+        writer.join();
+        drain();
+        return write();
+    }
+
+    // real time side, a copy into the arena
+    virtual bool send( const uint8_t* bytes, int count, int64_t nanos ) {
+        if( !recording.load( std::memory_order_relaxed ) || count < 1 || count > 3 ) {
+            return false;
+        }
+        MidiMessage m;
+        m.nanos = nanos;
+        m.sent = 0;
+        m.count = count;
+        for( int i=0; i < 3; ++i ) m.bytes[i] = i < count ? bytes[i] : 0;
+        if( !arena->push( m ) ) {
+            dropped.fetch_add( 1, std::memory_order_relaxed );
+            return false;
+        }
+        return true;
+    }
+
+    bool isRecording() { return recording.load( std::memory_order_relaxed ); }
+    // messages serialized so far
+    int64_t getEvents() { return events; }
+    int64_t getDropped() { return dropped.load( std::memory_order_relaxed ); }
+
+    static int64_t ticks( int64_t nanos ) {
+        return (int64_t)((double)nanos * SMF_PPQ / (SMF_TEMPO_US * 1000.0) + 0.5);
+    }
+
+private:
+    void run() {
+        while( recording.load() ) {
+            drain();
+            std::this_thread::sleep_for( std::chrono::milliseconds( SMF_WRITER_MS ) );
+        }
+    }
+
+    // arena into the track buffers, writer thread or stop() after the join
+    void drain() {
+        MidiMessage m;
+        while( arena->pop( m ) ) {
+            int c = format == 0 ? 0 : (m.bytes[0] & 0x0F);
+            int64_t tick = std::max( (int64_t)0, ticks( m.nanos - startNanos ) );
+            int64_t delta = std::max( (int64_t)0, tick - lastTick[c] );
+            lastTick[c] += delta;
+            putVarLen( tracks[c], (uint32_t)delta );
+            for( int i=0; i < m.count; ++i ) {
+                tracks[c].push_back( m.bytes[i] );
+            }
+            ++events;
+        }
+    }
+
+    bool write() {
+        if( events == 0 ) {
+            LOGI("SmfRecorder: nothing recorded, %s not written", path.c_str());
+            return false;
+        }
+        std::vector<uint8_t> tempo;
+        putVarLen( tempo, 0 );
+        const uint8_t setTempo[] = { 0xFF, 0x51, 0x03,
+                                     (uint8_t)(SMF_TEMPO_US >> 16), (uint8_t)(SMF_TEMPO_US >> 8), (uint8_t)SMF_TEMPO_US };
+        tempo.insert( tempo.end(), setTempo, setTempo + sizeof(setTempo) );
+
+        std::vector<uint8_t> file;
+        const char* mthd = "MThd";
+        file.insert( file.end(), mthd, mthd + 4 );
+        put32( file, 6 );
+        int used = 0;
+        for( int c=0; c < 16; ++c ) used += tracks[c].empty() ? 0 : 1;
+        put16( file, (uint16_t)format );
+        put16( file, (uint16_t)(format == 0 ? 1 : 1 + used) );
+        put16( file, SMF_PPQ );
+
+        if( format == 0 ) {
+            std::vector<uint8_t> track( tempo );
+            track.insert( track.end(), tracks[0].begin(), tracks[0].end() );
+            putTrack( file, track );
+        } else {
+            putTrack( file, tempo );
+            for( int c=0; c < 16; ++c ) {
+                if( !tracks[c].empty() ) {
+                    putTrack( file, tracks[c] );
+                }
+            }
+        }
+
+        FILE* f = fopen( path.c_str(), "wb" );
+        if( f == NULL ) {
+            LOGE("SmfRecorder: can not open %s", path.c_str());
+            return false;
+        }
+        bool ok = fwrite( file.data(), 1, file.size(), f ) == file.size();
+        ok = fclose( f ) == 0 && ok;
+        LOGI("SmfRecorder: %s, type %d, %lld events, %lld dropped, %d bytes", path.c_str(), format,
+             (long long)events, (long long)getDropped(), (int)file.size());
+        return ok;
+    }
+
+    // chunk with the end of track meta event appended
+    static void putTrack( std::vector<uint8_t>& file, const std::vector<uint8_t>& events ) {
+        const char* mtrk = "MTrk";
+        file.insert( file.end(), mtrk, mtrk + 4 );
+        put32( file, (uint32_t)events.size() + 4 );
+        file.insert( file.end(), events.begin(), events.end() );
+        const uint8_t end[] = { 0x00, 0xFF, 0x2F, 0x00 };
+        file.insert( file.end(), end, end + 4 );
+    }
+
+    // 7 bits per byte, most significant first, the continuation bit set on all but the last
+    static void putVarLen( std::vector<uint8_t>& out, uint32_t value ) {
+        uint8_t bytes[5];
+        int n = 0;
+        bytes[n++] = value & 0x7F;
+        while( (value >>= 7) > 0 ) {
+            bytes[n++] = 0x80 | (value & 0x7F);
+        }
+        while( n > 0 ) {
+            out.push_back( bytes[--n] );
+        }
+    }
+    static void put32( std::vector<uint8_t>& out, uint32_t v ) {
+        out.push_back( v >> 24 );
+        out.push_back( v >> 16 );
+        out.push_back( v >> 8 );
+        out.push_back( v );
+    }
+    static void put16( std::vector<uint8_t>& out, uint16_t v ) {
+        out.push_back( v >> 8 );
+        out.push_back( v );
+    }
+
+    LockFreeQueue<MidiMessage, SMF_ARENA_EVENTS>* arena;
+    std::atomic<bool>       recording;
+    std::thread             writer;
+    std::string             path;
+    int                     format;
+    int64_t                 startNanos;
+    int64_t                 events;
+    std::atomic<int64_t>    dropped;
+    std::vector<uint8_t>    tracks[16];     // type 0 uses the first
+    int64_t                 lastTick[16];
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Triple buffered frames for a single writer and a single reader, lock and wait free on both sides.
+ *
+ * The writer fills the back slot and publishes it by swapping it with the middle slot. The reader
+ * takes the latest published frame by swapping the middle slot with its front slot, only when the
+ * middle holds a frame the reader has not seen yet. Neither side ever touches the slot the other one
+ * owns, so a frame is never torn and the writer never waits for a slow reader: frames the reader
+ * did not pick up in time are overwritten.
+ *
+ * The slots are one contiguous region, meant to be shared as is (JNI NewDirectByteBuffer). Each slot
+ * is a 16 byte header followed by capacity floats, all native byte order:
+ *
+ *      slot * getSlotBytes() + 0      int32   frame length in floats
+ *      slot * getSlotBytes() + 4      int32   frame sequence number, 1 for the first published frame
+ *      slot * getSlotBytes() + 16     float[] frame
+ *
+ * Example code:
+ *
+ * TripleBuffer frames(512);
+ * // writer
+ * float* back = frames.beginWrite();
+ * back[0] = 1.f;
+ * frames.publish(1);
+ * // reader
+ * int slot = frames.acquire();
+ * const float* frame = frames.getFrame(slot);
+ */
+class TripleBuffer
+{
+public:
+    static const int HEADER_FLOATS = 4;
+
+    explicit TripleBuffer( int capacity ) : capacity( capacity ), sequence( 0 ) {
+        this->slotFloats = HEADER_FLOATS + capacity;
+        this->region = new float[ 3 * this->slotFloats ];
+        memset( this->region, 0, sizeof(float) * 3 * this->slotFloats );
+        this->back = 0;
+        this->middle.store( 1, std::memory_order_relaxed );
+        this->front = 2;
+    }
+    ~TripleBuffer() {
+        delete[] this->region;
+    }
+
+    /**
+     * Writer side, the back slot to fill, capacity floats. Stays valid until publish().
+     */
+    float* beginWrite() {
+        return this->region + this->back * this->slotFloats + HEADER_FLOATS;
+    }
+
+    /**
+     * Writer side, make the back slot the latest frame.
+     *
+     * @param length floats written, clamped to the capacity
+     */
+    void publish( int length ) {
+        int32_t* header = (int32_t*)(this->region + this->back * this->slotFloats);
+        header[0] = length < 0 ? 0 : (length > this->capacity ? this->capacity : length);
+        header[1] = (int32_t)++this->sequence;
+        // release: the frame and its header are visible before the index
+        uint32_t previous = this->middle.exchange( this->back | FRESH, std::memory_order_acq_rel );
+        this->back = previous & SLOT_MASK;
+    }
+
+    /**
+     * Reader side, the slot of the latest published frame. The slot stays the reader's until the next
+     * call, it is the same as the previous one when nothing was published in between.
+     */
+    int acquire() {
+        if( this->middle.load( std::memory_order_relaxed ) & FRESH ) {
+            // acquire: pairs with the release in publish
+            uint32_t previous = this->middle.exchange( this->front, std::memory_order_acq_rel );
+            this->front = previous & SLOT_MASK;
+        }
+        return (int)this->front;
+    }
+
+    const float* getFrame( int slot ) {
+        return this->region + slot * this->slotFloats + HEADER_FLOATS;
+    }
+    int getLength( int slot ) {
+        return ((int32_t*)(this->region + slot * this->slotFloats))[0];
+    }
+    // 0 until the first frame was published
+    int getSequence( int slot ) {
+        return ((int32_t*)(this->region + slot * this->slotFloats))[1];
+    }
+
+    int getCapacity() { return this->capacity; }
+    void* getRegion() { return this->region; }
+    int getRegionBytes() { return 3 * getSlotBytes(); }
+    int getSlotBytes() { return (int)sizeof(float) * this->slotFloats; }
+
+private:
+    static const uint32_t SLOT_MASK = 3;
+    static const uint32_t FRESH = 4;
+
+    float*                  region;
+    int                     capacity;
+    int                     slotFloats;
+    uint32_t                sequence;
+    uint32_t                back;           // writer only
+    uint32_t                front;          // reader only
+    std::atomic<uint32_t>   middle;         // slot index | FRESH
+};
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#define WORKERPOOL_NO_CPU -1        // workers float over all cores
+#define WORKERPOOL_MAX_PARTS 64     // of one parallelFor(), the caller included
+
+/**
+ * A fixed set of persistent worker threads, each with a single task slot.
+ *
+ * Tasks are plain function pointers with an argument, nothing is allocated after construction.
+ * Work is assigned to a specific worker so callers that keep a stable mapping (one analysis band or
+ * one estimator per worker) never contend for a slot, and a task that overruns a deadline only
+ * blocks its own worker. Workers can be pinned to consecutive cores on Linux and Android.
+ *
+ * parallelFor() splits a range over the caller and the idle workers, but only into parts of at least
+ * a grain of iterations: waking a worker and waiting for it costs microseconds, a loop over a frame
+ * of a few hundred samples is done long before. It pays for whole frames, bands or channels
+ * (bench_worker_pool() in dsp_test.h measures the dispatch against OpenMP).
+ *
+ * Example code:
+ *
+ * WorkerPool pool(2);
+ * pool.submit(0, &analyze, &band0);
+ * pool.submit(1, &analyze, &band1);
+ * pool.wait(0);
+ * pool.wait(1);
+ *
+ * pool.parallelFor(0, frames, 1, &analyzeFrames, &batch);   // analyzeFrames(&batch, begin, end, part)
+ */
+class WorkerPool
+{
+public:
+    typedef void (*TaskFn)( void* arg );
+    // iterations [begin, end) of a parallelFor(), part 0 runs on the caller, at most size() + 1 parts
+    typedef void (*RangeFn)( void* arg, int begin, int end, int part );
+
+    /**
+     * @param firstCpu worker n is pinned to core firstCpu + n (modulo the cores), WORKERPOOL_NO_CPU
+     * leaves the placement to the scheduler
+     */
+    explicit WorkerPool( int workers, int firstCpu = WORKERPOOL_NO_CPU ) : slots( workers > 0 ? workers : 0 ) {
+        int cores = std::max( 1, (int)std::thread::hardware_concurrency() );
+        for( size_t n=0; n < slots.size(); ++n ) {
+            slots[n].cpu = firstCpu < 0 ? WORKERPOOL_NO_CPU : (firstCpu + (int)n) % cores;
+            slots[n].th = std::thread( &WorkerPool::run, this, (int)n );
+        }
+    }
+
+    ~WorkerPool() {
+        for( size_t n=0; n < slots.size(); ++n ) {
+            Slot& s = slots[n];
+            {
+                std::lock_guard<std::mutex> guard( s.lock );
+                s.quit = true;
+            }
+            s.wake.notify_one();
+        }
+        for( size_t n=0; n < slots.size(); ++n ) {
+            slots[n].th.join();
+        }
+    }
+
+    int size() const { return (int)slots.size(); }
+
+    // the core of the worker, WORKERPOOL_NO_CPU when it is not pinned or pinning failed
+    int getCpu( int worker ) {
+        Slot& s = slots[worker];
+        std::unique_lock<std::mutex> guard( s.lock );
+        s.done.wait( guard, [&s] { return s.started; } );
+        return s.pinned ? s.cpu : WORKERPOOL_NO_CPU;
+    }
+
+    /**
+     * Hand a task to one worker.
+     *
+     * @return false if the worker is still running its previous task
+     */
+    bool submit( int worker, TaskFn fn, void* arg ) {
+        Slot& s = slots[worker];
+        {
+            std::lock_guard<std::mutex> guard( s.lock );
+            if( s.busy ) {
+                return false;
+            }
+            s.fn = fn;
+            s.arg = arg;
+            s.busy = true;
+        }
+        s.wake.notify_one();
+        return true;
+    }
+
+    /**
+     * fn over [begin, end) in parts of at least grain iterations, part 0 on the calling thread and one
+     * part on each idle worker, returns when all parts are done. A range of less than two grains runs
+     * as a single part on the calling thread, so does the part of a worker that is busy.
+     *
+     * @return number of parts
+     */
+    int parallelFor( int begin, int end, int grain, RangeFn fn, void* arg ) {
+        int count = end - begin;
+        if( count <= 0 ) {
+            return 0;
+        }
+        int parts = std::min( std::min( (int)slots.size() + 1, WORKERPOOL_MAX_PARTS ), count / std::max( grain, 1 ) );
+        if( parts <= 1 ) {
+            fn( arg, begin, end, 0 );
+            return 1;
+        }
+        // part p is [begin + p count / parts, begin + (p + 1) count / parts), worker p - 1 takes it
+        uint64_t submitted = 0;
+        for( int p=1; p < parts; ++p ) {
+            Slot& s = slots[p - 1];
+            {
+                std::lock_guard<std::mutex> guard( s.lock );
+                if( s.busy ) {
+                    continue;
+                }
+                s.range = fn;
+                s.arg = arg;
+                s.begin = begin + (int)((int64_t)p * count / parts);
+                s.end = begin + (int)((int64_t)(p + 1) * count / parts);
+                s.part = p;
+                s.busy = true;
+            }
+            s.wake.notify_one();
+            submitted |= 1ull << p;
+        }
+        fn( arg, begin, begin + count / parts, 0 );
+        for( int p=1; p < parts; ++p ) {
+            if( !(submitted & (1ull << p)) ) {
+                fn( arg, begin + (int)((int64_t)p * count / parts), begin + (int)((int64_t)(p + 1) * count / parts), p );
+            }
+        }
+        for( int p=1; p < parts; ++p ) {
+            if( submitted & (1ull << p) ) {
+                wait( p - 1 );
+            }
+        }
+        return parts;
+    }
+
+    bool busy( int worker ) {
+        Slot& s = slots[worker];
+        std::lock_guard<std::mutex> guard( s.lock );
+        return s.busy;
+    }
+
+    // block until the worker finished its task
+    void wait( int worker ) {
+        Slot& s = slots[worker];
+        std::unique_lock<std::mutex> guard( s.lock );
+        s.done.wait( guard, [&s] { return !s.busy; } );
+    }
+
+    /**
+     * Block until the worker finished its task or the deadline passed.
+     *
+     * @return true if the task finished in time
+     */
+    bool waitUntil( int worker, std::chrono::steady_clock::time_point deadline ) {
+        Slot& s = slots[worker];
+        std::unique_lock<std::mutex> guard( s.lock );
+        return s.done.wait_until( guard, deadline, [&s] { return !s.busy; } );
+    }
+
+private:
+    struct Slot
+    {
+        std::thread             th;
+        std::mutex              lock;
+        std::condition_variable wake;
+        std::condition_variable done;
+        TaskFn                  fn = nullptr;
+        RangeFn                 range = nullptr;
+        void*                   arg = nullptr;
+        int                     begin = 0;
+        int                     end = 0;
+        int                     part = 0;
+        int                     cpu = WORKERPOOL_NO_CPU;
+        bool                    pinned = false;
+        bool                    started = false;
+        bool                    busy = false;
+        bool                    quit = false;
+    };
+
+    // the calling thread onto one core
+    static bool pin( int cpu ) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO( &set );
+        CPU_SET( cpu, &set );
+        return sched_setaffinity( 0, sizeof(set), &set ) == 0;
+#else
+        return false;
+#endif
+    }
+
+    void run( int worker ) {
+        Slot& s = slots[worker];
+        bool pinned = s.cpu != WORKERPOOL_NO_CPU && pin( s.cpu );
+        std::unique_lock<std::mutex> guard( s.lock );
+        s.pinned = pinned;
+        s.started = true;
+        s.done.notify_all();
+        while( true ) {
+            s.wake.wait( guard, [&s] { return s.quit || (s.busy && (s.fn != nullptr || s.range != nullptr)); } );
+            if( s.quit ) {
+                break;
+            }
+            TaskFn fn = s.fn;
+            RangeFn range = s.range;
+            void* arg = s.arg;
+            int begin = s.begin, end = s.end, part = s.part;
+            s.fn = nullptr;
+            s.range = nullptr;
+            guard.unlock();
+            if( range != nullptr ) {
+                range( arg, begin, end, part );
+            } else {
+                fn( arg );
+            }
+            guard.lock();
+            s.busy = false;
+            s.done.notify_all();
+        }
+    }
+
+    std::vector<Slot> slots;
+};
@@ -0,0 +1,220 @@
+#pragma once
+
+/**
+ * Size adaptive autocorrelation
+ *
+ * For short frames and few lags the direct lag product is cheaper than the FFT path (forward and
+ * inverse transform of the zero padded frame) used by acorr_r() and AutocorrelationNormalized.
+ * The direct path is written lag-vectorized,
+ *
+ *      for each j:  out[0..L) += x[j] * x[j..j+L)
+ *
+ * so the inner loop is a plain multiply-add over contiguous memory that the compiler maps to
+ * NEON / SSE without reassociating any sum.
+ *
+ * Both paths produce the same values, out[tau] = scale * sum_j x[j] x[j+tau] for tau < lags, where
+ * the index wraps modulo N for AcorrCircular (acorr_r) and is zero padded for AcorrLinear.
+ *
+ * The path is chosen from N and the lag count with a cost model, multiply-adds of the direct path
+ * against M log2(M) for the transform of size M. The linear path pays for a transform of twice the
+ * size, so each mode has its own ratio. The defaults were fitted on a host benchmark, calibrate()
+ * re-measures one engine on the running device and calibrateDefaults() does it once for both modes
+ * at startup, before the processors are built (see bench_autocorrelation() in dsp_test.h).
+ */
+
+#include <algorithm>
+#include <stdint.h>
+#include <time.h>
+
+#include "ffts.h"
+
+// direct path wins while its multiply-adds < ratio * M * log2(M), M the FFT size, fitted with
+// bench_autocorrelation() at -O2 for N = 128..1024
+#define ACORR_DIRECT_COST_RATIO_CIRCULAR 9.0    // circular N = 256: ~70 lags
+#define ACORR_DIRECT_COST_RATIO_LINEAR 6.0      // linear N = 256: ~160 lags
+#define ACORR_CALIBRATION_N 256                 // frame size calibrateDefaults() measures
+
+enum AcorrMode
+{
+    AcorrCircular = 0,
+    AcorrLinear = 1
+};
+
+template <typename T> class AcorrEngine
+{
+public:
+    AcorrEngine( int N, AcorrMode mode ) {
+        this->N = N;
+        this->mode = mode;
+        this->M = mode == AcorrLinear ? 2 * N : N;
+        this->buffer = new T[ 2 * this->M ];
+        this->acc = new T[ N + 1 ];
+
+        int log2M = 0;
+        while( (1 << log2M) < this->M ) ++log2M;
+        this->transformCost = (double)this->M * log2M;
+        this->directCostRatio = defaultRatio( mode );
+    }
+    ~AcorrEngine( ) {
+        delete[] acc;
+        delete[] buffer;
+    }
+
+    // ratio of the engines built from now on, per mode
+    static double& defaultRatio( AcorrMode mode ) {
+        static double ratios[2] = { ACORR_DIRECT_COST_RATIO_CIRCULAR, ACORR_DIRECT_COST_RATIO_LINEAR };
+        return ratios[ mode ];
+    }
+
+    // calibrate both modes on this device, call once before the first engine is built
+    static void calibrateDefaults( int reps = 32 ) {
+        const AcorrMode modes[] = { AcorrCircular, AcorrLinear };
+        for( AcorrMode mode : modes ) {
+            AcorrEngine<T> ac( ACORR_CALIBRATION_N, mode );
+            ac.calibrate( reps );
+            defaultRatio( mode ) = ac.getDirectCostRatio();
+        }
+    }
+
+    double getDirectCostRatio() { return directCostRatio; }
+    void setDirectCostRatio( double ratio ) { directCostRatio = ratio; }
+
+    bool isDirect( int lags ) {
+        return directCost( std::min( lags, N ) ) <= directCostRatio * transformCost;
+    }
+
+    // largest lag count still computed with the direct path
+    int getDirectMaxLags() {
+        int lags = 0;
+        while( lags < N && isDirect( lags + 1 ) ) ++lags;
+        return lags;
+    }
+
+    void compute( const T* x, T* out, int lags, T scale ) {
+        lags = std::min( lags, N );
+        if( isDirect( lags ) ) {
+            direct( x, out, lags, scale );
+        } else {
+            transform( x, out, lags, scale );
+        }
+    }
+
+    // time lag products against the transform and move the crossover to where they break even
+    int calibrate( int reps = 32 ) {
+        T* x = new T[ N ];
+        T* out = new T[ N ];
+        for( int n=0; n < N; ++n ) {
+            x[ n ] = (T)((n * 7919) % 101) / (T)101 - (T)0.5;
+        }
+
+        int64_t nsTransform = time( x, out, N, reps, false );
+        int lo = 1, hi = N;
+        while( lo < hi ) {
+            int mid = (lo + hi + 1) / 2;
+            if( time( x, out, mid, reps, true ) <= nsTransform ) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        directCostRatio = directCost( lo ) / transformCost;
+
+        delete[] out;
+        delete[] x;
+        return getDirectMaxLags();
+    }
+
+    void direct( const T* x, T* out, int lags, T scale ) {
+        for( int tau=0; tau < lags; ++tau ) {
+            acc[ tau ] = 0;
+        }
+        if( mode == AcorrLinear ) {
+            for( int j=0; j < N; ++j ) {
+                const T xj = x[ j ];
+                const T* xd = &x[ j ];
+                const int L = std::min( lags, N - j );
+                for( int tau=0; tau < L; ++tau ) {
+                    acc[ tau ] += xj * xd[ tau ];
+                }
+            }
+        } else {
+            // r(tau) = r(N - tau), only half the lags need products, the frame is repeated so the
+            // delayed samples are contiguous
+            const int L = std::min( lags, N / 2 + 1 );
+            for( int n=0; n < N; ++n ) {
+                buffer[ n ] = x[ n ];
+                buffer[ n + N ] = x[ n ];
+            }
+            for( int j=0; j < N; ++j ) {
+                const T xj = buffer[ j ];
+                const T* xd = &buffer[ j ];
+                for( int tau=0; tau < L; ++tau ) {
+                    acc[ tau ] += xj * xd[ tau ];
+                }
+            }
+            for( int tau=L; tau < lags; ++tau ) {
+                acc[ tau ] = acc[ N - tau ];
+            }
+        }
+        for( int tau=0; tau < lags; ++tau ) {
+            out[ tau ] = acc[ tau ] * scale;
+        }
+    }
+
+    void transform( const T* x, T* out, int lags, T scale ) {
+        for( int n=0; n < N; ++n ) {
+            buffer[ 2*n ]     = x[ n ]; // real
+            buffer[ 2*n + 1 ] = 0;      // imaginary
+        }
+        for( int n=N; n < M; ++n ) {
+            buffer[ 2*n ]     = 0;
+            buffer[ 2*n + 1 ] = 0;
+        }
+        dft.fft( buffer, M );
+        for( int n=0; n < M; ++n ) {
+            T r = buffer[ 2*n ], i = buffer[ 2*n + 1 ];
+            buffer[ 2*n ] = (r*r + i*i) * scale;
+            buffer[ 2*n + 1 ] = 0;
+        }
+        dft.ifft( buffer, M );
+        for( int tau=0; tau < lags; ++tau ) {
+            out[ tau ] = buffer[ 2*tau ];
+        }
+    }
+
+protected:
+    // multiply-adds of direct(), the circular path stops at N/2 + 1 lags and mirrors the rest
+    double directCost( int lags ) {
+        if( mode == AcorrCircular ) {
+            return (double)N * std::min( lags, N / 2 + 1 );
+        }
+        return (double)N * lags - 0.5 * (double)lags * (lags - 1);
+    }
+
+    int64_t time( const T* x, T* out, int lags, int reps, bool directPath ) {
+        struct timespec t0, t1;
+        int64_t best = INT64_MAX;
+        for( int r=0; r < reps; ++r ) {
+            clock_gettime( CLOCK_MONOTONIC, &t0 );
+            if( directPath ) {
+                direct( x, out, lags, (T)1 );
+            } else {
+                transform( x, out, lags, (T)1 );
+            }
+            clock_gettime( CLOCK_MONOTONIC, &t1 );
+            int64_t ns = (int64_t)(t1.tv_sec - t0.tv_sec) * 1000000000LL + (t1.tv_nsec - t0.tv_nsec);
+            best = std::min( best, ns );
+        }
+        return best;
+    }
+
+protected:
+    int         N;
+    int         M;
+    AcorrMode   mode;
+    double      transformCost;
+    double      directCostRatio;
+    T*          buffer;
+    T*          acc;
+    FFTS<T>     dft;
+};
@@ -0,0 +1,209 @@
+#pragma once
+
+/**
+ * One bit (sign) autocorrelation pitch detection
+ *
+ * The frame is sign-quantized into packed 64 bit words after removing its mean. For every lag in
+ * the voice range the agreement between the first W = N/2 bits and the bits delayed by tau is
+ *
+ *      c(tau) = 1 - 2 * popcount( b[0..W) ^ b[tau..tau+W) ) / W
+ *
+ * so a lag costs W/64 XOR + popcount operations instead of W multiply-accumulates. The highest
+ * sign peak of every positive lobe that comes close to the best one is rescored on the real signal
+ * with three exact normalized lag products, and the winner is refined with a parabola.
+ *
+ * On the dsp_test.h synthetic voice (256 samples at 11025 Hz) it runs about 3x faster than MPM,
+ * with 14 gross / 0 octave errors against MPM's 21 / 0 on a clean signal and 26 / 13 against
+ * 24 / 0 with breath noise 0.3, where the signs are mostly noise. Only lags up to W = N/2 are
+ * seen, so periods near the 80 Hz cutoff are often left unvoiced, about 1% of the frames.
+ */
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+
+#define BITACF_CANDIDATE_CUTOFF 0.6      // sign agreement peaks within this fraction of the best are rescored
+#define BITACF_CUTOFF 0.9                // first candidate within this fraction of the best exact score
+#define BITACF_LOWER_PITCH_CUTOFF 80.0
+#define BITACF_UPPER_PITCH_CUTOFF 1600.0
+
+template <int N, typename T> class BitstreamAcf
+{
+public:
+    static const int W = N / 2;
+    static const int WORDS = N / 64;
+    static const int WINDOW_WORDS = W / 64;
+
+    static_assert( N % 128 == 0, "BitstreamAcf needs a multiple of 128 samples" );
+
+    BitstreamAcf( ) : period( 0 ), clarity( 0 ) { }
+
+    T pitch( T* audio_buffer, int sample_rate, T* output, int outputLen )
+    {
+        T* x = audio_buffer;
+
+        // sign quantization around the frame mean
+        T mean = 0;
+        for( int n=0; n < N; ++n ) {
+            mean += x[ n ];
+        }
+        mean /= N;
+        for( int k=0; k < WORDS; ++k ) {
+            uint64_t w = 0;
+            const T* xk = &x[ 64 * k ];
+            for( int b=0; b < 64; ++b ) {
+                w |= (uint64_t)(xk[ b ] > mean) << b;
+            }
+            bits[ k ] = w;
+        }
+        bits[ WORDS ] = 0;
+
+        int tauMin = std::max( 2, (int)(sample_rate / BITACF_UPPER_PITCH_CUTOFF) );
+        int tauMax = std::min( W - 1, (int)(sample_rate / BITACF_LOWER_PITCH_CUTOFF) + 1 );
+
+        for( int tau=0; tau < W; ++tau ) {
+            c[ tau ] = 0;
+        }
+        for( int tau = tauMin - 1; tau <= tauMax; ++tau ) {
+            c[ tau ] = agreement( tau );
+        }
+
+        for( int n=0; n < outputLen; ++n ) {
+            output[ n ] = n < W ? c[ n ] : (T)0;
+        }
+
+        period = 0;
+        clarity = 0;
+
+        // the sign autocorrelation peaks are triangular, estimate the apex height of every local
+        // maximum so fractional periods (short lags) are not beaten by their integer multiples
+        int peaksN = 0;
+        T best = 0;
+        // like MPM, the lobe around lag zero is skipped up to the first negative agreement
+        int tauStart = tauMin;
+        while( tauStart < tauMax && c[ tauStart ] >= 0 ) {
+            ++tauStart;
+        }
+        bool lobe = false;
+        for( int tau = tauStart; tau < tauMax; ++tau ) {
+            if( c[ tau ] <= 0 ) {
+                lobe = false;
+            } else if( c[ tau ] > c[ tau - 1 ] && c[ tau ] >= c[ tau + 1 ] ) {
+                T a = c[ tau - 1 ], b = c[ tau ], e = c[ tau + 1 ];
+                T slope = b - std::min( a, e );
+                T h = b + (T)0.5 * (std::max( a, e ) - b + slope);
+                // one key maximum per positive lobe, as in MPM
+                if( lobe && h <= peaksHeight[ peaksN - 1 ] ) {
+                    continue;
+                }
+                if( lobe ) {
+                    --peaksN;
+                }
+                peaks[ peaksN ] = tau;
+                peaksHeight[ peaksN ] = h;
+                best = std::max( best, h );
+                ++peaksN;
+                lobe = true;
+            }
+        }
+        if( best <= 0 )
+            return -1;
+
+        // the sign agreement keeps too little amplitude information to tell a period from its
+        // multiples or from a strong formant lag, so only the candidates that come close to the
+        // best one are rescored on the real signal, and the first of those near the best exact
+        // score wins, as in MPM
+        T cutoff = (T)BITACF_CANDIDATE_CUTOFF * best;
+        T bestExact = 0;
+        int candidatesN = 0;
+        for( int k=0; k < peaksN; ++k ) {
+            if( peaksHeight[ k ] >= cutoff ) {
+                // parabolic apex, an integer lag undersells the short fractional periods
+                T a = exact( x, peaks[ k ] - 1 ), b = exact( x, peaks[ k ] ), e = exact( x, peaks[ k ] + 1 );
+                T den = a - 2 * b + e;
+                T s = den < 0 ? b - (T)0.125 * (a - e) * (a - e) / den : std::max( b, std::max( a, e ) );
+                s = std::min( s, (T)1 );
+                peaks[ candidatesN ] = peaks[ k ];
+                peaksHeight[ candidatesN ] = s;
+                bestExact = std::max( bestExact, s );
+                ++candidatesN;
+            }
+        }
+        int peak = -1;
+        for( int k=0; k < candidatesN; ++k ) {
+            if( peaksHeight[ k ] >= (T)BITACF_CUTOFF * bestExact ) {
+                peak = peaks[ k ];
+                break;
+            }
+        }
+        if( peak < 0 || bestExact <= 0 )
+            return -1;
+
+        // exact refinement, walk uphill on the normalized lag product then interpolate
+        T a = exact( x, peak - 1 ), b = exact( x, peak ), e = exact( x, peak + 1 );
+        for( int step=0; step < 2; ++step ) {
+            if( a > b && peak - 1 > tauMin ) {
+                --peak; e = b; b = a; a = exact( x, peak - 1 );
+            } else if( e > b && peak + 1 < tauMax ) {
+                ++peak; a = b; b = e; e = exact( x, peak + 1 );
+            } else {
+                break;
+            }
+        }
+        // still rising at either end of the lag range, the true period lies outside of it
+        if( (a > b && peak - 1 <= tauMin) || (e > b && peak + 1 >= tauMax) )
+            return -1;
+        T den = a - 2 * b + e;
+        T delta = den != 0 ? (T)0.5 * (a - e) / den : (T)0;
+        if( delta < (T)-1 || delta > (T)1 ) {
+            delta = 0;
+        }
+        period = peak + delta;
+        clarity = b - (T)0.25 * (a - e) * delta;
+
+        T pitch_estimate = sample_rate / period;
+        return (pitch_estimate > BITACF_LOWER_PITCH_CUTOFF) ? pitch_estimate : -1;
+    }
+
+    T getPeriod() { return period; }
+    T getClarity() { return clarity; }
+
+protected:
+    T agreement( int tau )
+    {
+        const int q = tau >> 6;
+        const int r = tau & 63;
+        int mismatches = 0;
+        if( r == 0 ) {
+            for( int k=0; k < WINDOW_WORDS; ++k ) {
+                mismatches += __builtin_popcountll( bits[ k ] ^ bits[ k + q ] );
+            }
+        } else {
+            for( int k=0; k < WINDOW_WORDS; ++k ) {
+                uint64_t delayed = (bits[ k + q ] >> r) | (bits[ k + q + 1 ] << (64 - r));
+                mismatches += __builtin_popcountll( bits[ k ] ^ delayed );
+            }
+        }
+        return (T)1 - (T)(2 * mismatches) / W;
+    }
+
+    // normalized square difference at one lag, 2 r(tau) / (e(0) + e(tau))
+    T exact( const T* x, int tau )
+    {
+        T r = 0, m = 0;
+        for( int j=0; j < W; ++j ) {
+            r += x[ j ] * x[ j + tau ];
+            m += x[ j ] * x[ j ] + x[ j + tau ] * x[ j + tau ];
+        }
+        return m > 0 ? 2 * r / m : (T)0;
+    }
+
+protected:
+    uint64_t    bits[ WORDS + 1 ];
+    T           c[ W ];
+    int         peaks[ W ];
+    T           peaksHeight[ W ];
+    T           period;
+    T           clarity;
+};
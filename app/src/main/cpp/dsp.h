@@ -2,10 +2,20 @@
 
 #include <algorithm>
 #include <vector>
-#include <omp.h>
+#include "acorr.h"
 #include "ffts.h"
 #include "log.h"
+#include "lpc.h"
+#include "lse.h"
 #include "mpm.h"
+#include "notemap.h"
+#include "octave.h"
+#include "spectral.h"
+#include "swipe.h"
+#include "yin.h"
+#include "bitacf.h"
+#include "WorkerPool.h"
+#include "tracker.h"
 
 enum ProcessingModes
 {
@@ -15,38 +25,84 @@ enum ProcessingModes
     PitchEstimation = 3
 };
 
+struct PitchCandidate
+{
+    float pitch;        // Hz
+    float confidence;   // 0..1
+};
+
+#define ANALYSIS_FORMANTS 4
+
+// the results of one analysis frame, published as a whole so readers never mix two frames
+struct AnalysisSnapshot
+{
+    int64_t frame;          // analysis frames since the start
+    int64_t captureNanos;   // CLOCK_MONOTONIC when the audio of the frame was taken
+    float pitch;            // Hz, 0 when unvoiced
+    float clarity;          // confidence of the pitch 0..1
+    float noteHz;           // of the mapped note
+    float cents;            // deviation of the pitch from the mapped note
+    int32_t note;           // MIDI note, 0 when unvoiced
+    int32_t gate;           // 1 when the frame is voiced and maps to a note
+    float formants[ ANALYSIS_FORMANTS ];    // Hz of F1.., 0 when not found or not estimated
+};
+
 class DSP
 {
 public:
-    DSP() {}
+    DSP() : note() {}
     virtual ~DSP() {}
 
 public:
-    virtual int getMidiNoteNumber() { return 0; }
-    virtual float getPitchMidi() { return 0; }
+    virtual int getMidiNoteNumber() { return this->note.note; }
+    virtual float getPitchMidi() { return this->note.hz; }
+    // mapped note plus the deviation from it in semitones, for pitch bend
+    virtual float getFractionalNote() { return this->note.fractional; }
+    NoteMapper& getNoteMapper() { return this->noteMapper; }
     virtual float getNacIndex() { return 0; }
     virtual float getPitch() { return 0; }
+    virtual int getPitchCandidates( PitchCandidate* dest, int destLen ) {
+        float p = this->getPitch();
+        if( p <= 0 || destLen < 1 ) {
+            return 0;
+        }
+        dest[0].pitch = p;
+        dest[0].confidence = 1.f;
+        return 1;
+    }
+    // formant frequencies in Hz of the last frame, 0 when not found, returns how many were written
+    virtual int getFormants( float* /*dest*/, int /*destLen*/ ) { return 0; }
     virtual int getProcessOutputLen() = 0;
     virtual void process( float* src, int srcLen, float* dest ) = 0;
-    void setSamplingRate( float sampsPerSec ) {
+    // processors with tables per rate build them here, never in process()
+    virtual void setSamplingRate( float sampsPerSec ) {
         this->R = sampsPerSec;
     }
 
 protected:
     float R;
+    NoteMapper noteMapper;
+    NoteMapping note;
     struct timespec now;
     int64_t nanos() {
         clock_gettime(CLOCK_MONOTONIC, &now);
         return (int64_t) now.tv_sec*1000000000LL + now.tv_nsec;
     }
+
+    // nearest note of the tuning, zeroed when unvoiced or outside MIDI 0..127
+    void mapNote( float pitch ) {
+        this->noteMapper.map( pitch, this->note );
+    }
 };
 
 class FastFourierTransformMagnitudeSpectrum : DSP {
 public:
-    FastFourierTransformMagnitudeSpectrum( int fftSize ) : DSP() {
+    // with a context of fftSize samples the even bins of its padded spectrum are displayed
+    FastFourierTransformMagnitudeSpectrum( int fftSize, SpectralContext* context = NULL ) : DSP() {
         this->fftSize = fftSize;
         this->bufLen = 2 * fftSize;
         this->buffer = new float[ this->bufLen ];
+        this->context = context;
     }
     ~FastFourierTransformMagnitudeSpectrum( ) {
         delete[] buffer;
@@ -56,6 +112,7 @@ private:
     int fftSize;
     float* buffer;
     FFTS<float> dft;
+    SpectralContext* context;
 
 public:
     virtual int getProcessOutputLen() {
@@ -64,6 +121,15 @@ public:
     virtual void process( float* src, int srcLen, float* dest ) {
         assert( srcLen == this->fftSize );
 
+        if( this->context != NULL ) {
+            this->context->update( src, srcLen );
+            const float* X = this->context->getSpectrum();
+            for( int n = 0; n < this->fftSize; ++n ) {
+                dest[n] = sqrt( X[4 * n]*X[4 * n] + X[4 * n + 1]*X[4 * n + 1] );
+            }
+            return;
+        }
+
         // compute FFT
         for( int n = 0; n < this->fftSize; ++n )
         {
@@ -84,10 +150,12 @@ public:
 
 class AutocorrelationNormalized : DSP {
 public:
-    AutocorrelationNormalized(int acLen ) : DSP() {
+    // with a context the Wiener-Khinchin ACF of its spectrum is used
+    AutocorrelationNormalized(int acLen, SpectralContext* context = NULL ) : DSP(), ac( acLen, AcorrLinear ) {
         this->acLen = acLen;
-        this->bufLen = 4 * acLen;
+        this->bufLen = acLen;
         this->buffer = new float[ this->bufLen ];
+        this->context = context;
     }
     ~AutocorrelationNormalized( ) {
         delete[] buffer;
@@ -96,7 +164,8 @@ private:
     int bufLen;
     int acLen;
     float* buffer;
-    FFTS<float> dft;
+    AcorrEngine<float> ac;
+    SpectralContext* context;
 
 public:
     virtual int getProcessOutputLen() {
@@ -116,51 +185,38 @@ public:
             srcMax = 0.9f / srcMax;
         }
 
-        // compute FFT
-        for( int n = 0; n < this->acLen; ++n )
-        {
-            buffer[2 * n]       = src[n] * srcMax;   // real
-            buffer[2 * n + 1]   = 0;        // imaginary
-        }
+        // lags [0, N) then the negative lags, as the inverse transform of the 2N zero padded frame
         int n2 = 2 * this->acLen;
-        for( int n = this->acLen; n < n2; ++n )
-        {
-            buffer[2 * n]       = 0;   // real
-            buffer[2 * n + 1]   = 0;        // imaginary
-        }
-        this->dft.fft( &buffer[0], n2 );
-
-        for( int n=0; n < n2; ++n ) {
-            float r = buffer[ 2 * n ];
-            float i = buffer[ 2 * n + 1 ];
-            float m = r*r + i*i;
-            buffer[ 2 * n ] = m;
-            buffer[ 2 * n + 1 ] = 0;
+        if( this->context != NULL ) {
+            this->context->update( src, srcLen );
+            const float* r = this->context->getAutocorrelation();
+            for( int n = 0; n < this->acLen; ++n ) {
+                dest[n] = r[n] * srcMax * srcMax;
+            }
+        } else {
+            for( int n = 0; n < this->acLen; ++n )
+            {
+                buffer[n] = src[n] * srcMax;
+            }
+            this->ac.compute( &buffer[0], dest, this->acLen, 1.f );
         }
-
-        this->dft.ifft( &buffer[0], n2 );
-
-        for( int n=0; n < n2; ++n ) {
-            dest[n] = buffer[2*n];
+        dest[ this->acLen ] = 0;
+        for( int n = this->acLen + 1; n < n2; ++n ) {
+            dest[n] = dest[n2 - n];
         }
     }
 };
 
 class AutocorrelationNormalized2 : DSP {
 public:
-    AutocorrelationNormalized2( int acLen ) : DSP() {
+    AutocorrelationNormalized2( int acLen ) : DSP(), ac( acLen, AcorrCircular ) {
         this->acLen = acLen;
-        this->bufLen = 2 * acLen;
-        this->buffer = new float[ this->bufLen ];
     }
     ~AutocorrelationNormalized2( ) {
-        delete[] buffer;
     }
 private:
-    int bufLen;
     int acLen;
-    float* buffer;
-    FFTS<float> dft;
+    AcorrEngine<float> ac;
 
 public:
     virtual int getProcessOutputLen() {
@@ -169,52 +225,28 @@ public:
     virtual void process( float* src, int srcLen, float* dest ) {
         assert( srcLen == this->acLen );
 
-        // compute FFT
-        for( int n = 0; n < this->acLen; ++n )
-        {
-            buffer[2 * n]       = src[n];   // real
-            buffer[2 * n + 1]   = 0;        // imaginary
-        }
-        this->dft.fft( &buffer[0], this->acLen );
-
-        for( int n=0; n < this->acLen; ++n ) {
-            float r = buffer[ 2 * n ];
-            float i = buffer[ 2 * n + 1 ];
-            float m = r*r + i*i;
-            buffer[ 2 * n ] = m;
-            buffer[ 2 * n + 1 ] = 0;
-        }
-        this->dft.ifft( &buffer[0], this->acLen );
+        this->ac.compute( src, dest, this->acLen, 1.f );
 
         for( int n=0; n < this->acLen; ++n ) {
-            dest[n] = abs(buffer[2*n]);
+            dest[n] = abs(dest[n]);
         }
     }
 };
 
 class PitchEstimator : DSP {
 public:
-    PitchEstimator( int acLen ) : DSP() {
+    PitchEstimator( int acLen ) : DSP(), ac( acLen, AcorrLinear ), octave( acLen ) {
         this->acLen = acLen;
+        this->octaveCheck = true;
+        this->pitch = 0;
+        this->clarity = 0;
         this->N = this->acLen;
         this->N2 = 2 * this->N;
-        this->bufLen = 4 * this->N;
+        this->bufLen = this->N;
         this->buffer = new float[ this->bufLen ];
-
-        // possible notes to detect, standard tuning, A = (55, 110, 220, 440 ... ) Hz
-        this->tuningN = 48;
-        this->midiNoteNumsN = 48;
-        this->tuning = new float[ this->tuningN ];
-        this->midiNoteNums = new int[ this->midiNoteNumsN ];
-        for( int n=0, nn=1; n < 48; ++n, ++nn ) {
-            this->tuning[ n ] = (float)(pow(2.0, (double)nn / 12.0) * 55.0); // todo user changeable
-            this->midiNoteNums[ n ] = 34 + n;
-        }
     }
     ~PitchEstimator( ) {
         delete[] buffer;
-        delete[] tuning;
-        delete[] midiNoteNums;
     }
 
 private:
@@ -223,23 +255,26 @@ private:
     int acLen;
     int bufLen;
     float* buffer;
-    FFTS<float> dft;
+    AcorrEngine<float> ac;
+    OctaveVerifier octave;
+    bool octaveCheck;
 
     float pitch;
-
-    float*  tuning;
-    int     tuningN;
-
-    float   pitchMidi;
-    int     midiNoteNum;
-    int*    midiNoteNums;
-    int     midiNoteNumsN;
+    float clarity;
 
 public:
+    void setOctaveCheck( bool enable ) { this->octaveCheck = enable; }
+    OctaveVerifier& getOctaveVerifier() { return this->octave; }
     virtual float getPitch() { return this->pitch; }
-    virtual int getMidiNoteNumber() { return this->midiNoteNum; }
-    virtual float getPitchMidi() { return this->pitchMidi; }
     virtual int getProcessOutputLen() { return this->N2; }
+    virtual int getPitchCandidates( PitchCandidate* dest, int destLen ) {
+        if( this->pitch <= 0 || destLen < 1 ) {
+            return 0;
+        }
+        dest[0].pitch = this->pitch;
+        dest[0].confidence = this->clarity;
+        return 1;
+    }
     virtual void process( float* src, int srcLen, float* dest ) {
         assert( srcLen == this->N );
 
@@ -263,38 +298,15 @@ public:
                 maximizeFactor = 0.9f / srcMax;
             }
 
-            int _2n, _2n_1;
-
-            // compute FFT
-            #pragma omp parallel for
             for (int n = 0; n < this->N; ++n) {
-                _2n = 2 * n;
-                _2n_1 = _2n + 1;
-                buffer[_2n] = src[n] * maximizeFactor;  // real
-                buffer[_2n_1] = 0;                      // imaginary
-            }
-
-            #pragma omp parallel for
-            for (int n = N; n < this->N2; ++n) {
-                _2n = 2 * n;
-                _2n_1 = _2n + 1;
-                buffer[_2n] = 0;    // real
-                buffer[_2n_1] = 0;  // imaginary
+                buffer[n] = src[n] * maximizeFactor;
             }
-            this->dft.fft(&buffer[0], this->N2);
 
-            #pragma omp parallel for
-            for (int n = 0; n < this->N2; ++n) {
-                _2n = 2 * n;
-                _2n_1 = _2n + 1;
-                buffer[_2n] = buffer[_2n] * buffer[_2n] + buffer[_2n_1] * buffer[_2n_1];
-                buffer[_2n_1] = 0;
-            }
-            this->dft.ifft(&buffer[0], this->N2);
-
-            #pragma omp parallel for
-            for (int n = 0; n < this->N2; ++n) {
-                dest[n] = buffer[2*n];
+            // only the voice lag range is searched, lags past R / 60 are not computed
+            int lags = std::min( this->N, (int)(this->R / 60.f) + 2 );
+            this->ac.compute( &buffer[0], dest, lags, 1.f );
+            for (int n = lags; n < this->N2; ++n) {
+                dest[n] = 0;
             }
 
             // find first, greatest positive peak going left-to-right
@@ -302,7 +314,7 @@ public:
             bool b = true;
             int lastPeakNdx = 0;
             float lastPeakAmp = 0;
-            for (int n = 1; /*b &&*/ n < this->N; ++n) {
+            for (int n = 1; /*b &&*/ n < lags; ++n) {
                 float d = dest[n] - dest[n - 1];
                 if (d < 0) {
                     if (dir == 1) {
@@ -325,8 +337,11 @@ public:
                     dir = 0;
                 }
             }
+            // normalized peak, unbiased for the N - lag products of the zero padded ACF
+            this->clarity = dest[0] > 0 && lastPeakNdx < this->N ?
+                std::max( 0.f, std::min( 1.f, lastPeakAmp * this->N / ((this->N - lastPeakNdx) * dest[0]) ) ) : 0.f;
             if ( /*!b &&*/ lastPeakNdx < (this->R / 60.f) && lastPeakNdx > (this->R / 1600.f)) {
-                if (lastPeakNdx > 0 && lastPeakNdx < (this->N - 1)) {
+                if (lastPeakNdx > 0 && lastPeakNdx < (lags - 1)) {
                     float a = dest[lastPeakNdx - 1];
                     float b = dest[lastPeakNdx];
                     float c = dest[lastPeakNdx + 1];
@@ -336,79 +351,230 @@ public:
                 } else {
                     this->pitch = this->R / lastPeakNdx;
                 }
+                if( this->octaveCheck ) {
+                    this->pitch = this->octave.verify( dest, lags, this->R, this->pitch, 60.f, 1600.f );
+                }
             } else {
                 this->pitch = 0;
             }
         } else {
             this->pitch = 0;
-            #pragma omp parallel for
             for (int n = 0; n < this->N2; ++n) {
                 dest[n] = 0;
             }
         }
 
-        if( this->pitch > 0 ) {
-            //std::binary_search()
-            int ji = -1;
-            float jd = std::numeric_limits<float>::max();
-            for (int jn = 0; jn < this->tuningN; ++jn) {
-                float d = fabs(this->tuning[jn] - this->pitch);
-                if (d < jd) {
-                    ji = jn;
-                    jd = d;
-                }
+        this->mapNote( this->pitch );
+
+        nsEnd = this->nanos();
+        int ns = (int) (nsEnd - nsStart);
+        LOGV("PitchEstimator::process %d ns", ns);
+    }
+};
+
+class PitchEstimator2 : DSP {
+public:
+    PitchEstimator2( int acLen ) : DSP(), octave( acLen ) {
+        this->N = acLen;
+        this->octaveCheck = true;
+        this->refinement = false;
+        this->prewhitening = false;
+        this->pitch = 0;
+        this->nacIndex = 0;
+        this->clarity = 0;
+        this->estimated = false;
+        this->N2 = 2 * this->N;
+        this->bufLen = 4 * this->N;
+        this->buffer = new float[ this->bufLen ];
+
+        this->white = new float[ this->N ];
+    }
+    ~PitchEstimator2( ) {
+        delete[] white;
+        delete[] buffer;
+    }
+
+private:
+    int N;
+    int N2;
+    int bufLen;
+    float* buffer;
+
+    float pitch;
+    float nacIndex;
+    float clarity;          // normalized ACF at nacIndex
+    bool estimated;
+
+    Mpm<256, float>         mpm;
+    OctaveVerifier          octave;
+    bool                    octaveCheck;
+    LSE                     lse;
+    bool                    refinement;
+    LinearPredictor         lpc;
+    bool                    prewhitening;
+    float*                  white;
+
+public:
+    /*
+     * The stages of process(), shared with GateNode, WhiteningNode and PickerNode of DspGraph.h so
+     * the graph makes the same decisions.
+     */
+
+    // open when the frame and its running peak envelope are above thresholdDb
+    static bool gate( const float* x, int N, float thresholdDb, float* energyDb ) {
+        float xMax = 0, xmSqrSum = 0, energy = 0, xmEnergy = 0;
+        for( int n=0; n < N; ++n ) {
+            xMax = std::max( xMax, fabsf( x[n] ) );
+            xmSqrSum += xMax * xMax;
+            energy += x[n] * x[n];
+            xmEnergy += 10.f * log10f( xmSqrSum );
+        }
+        xmEnergy /= (float)N;
+        *energyDb = 10.f * log10f( energy );
+        return xmEnergy > thresholdDb && *energyDb > thresholdDb;
+    }
+
+    // LPC residual of x into dest, scaled back to energyDb, the pickers have absolute cutoffs
+    static void whiten( LinearPredictor& lpc, const float* x, int N, float R, float energyDb, float* dest ) {
+        // the predictor needs lags [0, p] only, dest is the scratch of the windowed frame
+        float r[ LPC_MAX_ORDER + 2 ] = { 0 };
+        LinearPredictor::autocorrelate( x, N, r, lpc.getOrder(), dest );
+        lpc.analyse( r, R );
+        lpc.whiten( x, N, dest );
+        lpc.findFormants( R );
+        float whiteEnergy = 0;
+        for( int n=0; n < N; ++n ) {
+            whiteEnergy += dest[n] * dest[n];
+        }
+        float g = whiteEnergy > 0 ? sqrtf( (float)pow( 10.0, energyDb / 10.0 ) / whiteEnergy ) : 0.f;
+        for( int n=0; n < N; ++n ) {
+            dest[n] *= g;
+        }
+    }
+
+    /**
+     * Octave check of an MPM estimate on its circular ACF, then the least squares refinement on
+     * the frame, each skipped when its stage is NULL.
+     *
+     * @return pitch in Hz, -1 outside 80..1600 Hz
+     */
+    static double verify( double P, const float* acf, int N, float R, OctaveVerifier* octave, LSE* lse,
+                          const float* frame ) {
+        if( octave != NULL && P > 80.0 && P < 1600.0 ) {
+            // MPM never looks past the lower pitch cutoff
+            int lags = std::min( N, (int)(R / MPM_LOWER_PITCH_CUTOFF) + 2 );
+            P = octave->verify( acf, lags, R, (float)P, 80.f, 1600.f );
+        }
+        if( !(P > 80.0 && P < 1600.0) ) {
+            return -1;
+        }
+        if( lse != NULL ) {
+            P = lse->refine( frame, N, R, (float)P );
+        }
+        return P;
+    }
+
+    void setOctaveCheck( bool enable ) { this->octaveCheck = enable; }
+    OctaveVerifier& getOctaveVerifier() { return this->octave; }
+    // least squares harmonic fit of the MPM pitch, sub-cent accuracy for tuning and pitch bends
+    void setRefinement( bool enable ) { this->refinement = enable; }
+    LSE& getLSE() { return this->lse; }
+    // MPM on the LPC residual, the formant envelope no longer shapes the NSDF peaks; formants of
+    // the frame are then in getLinearPredictor()
+    void setPrewhitening( bool enable ) { this->prewhitening = enable; }
+    LinearPredictor& getLinearPredictor() { return this->lpc; }
+    virtual int getFormants( float* dest, int destLen ) {
+        if( !this->prewhitening ) {
+            return 0;
+        }
+        for( int k=0; k < destLen; ++k ) {
+            dest[k] = this->lpc.getFormant( k );
+        }
+        return destLen;
+    }
+    virtual float getNacIndex() { return this->nacIndex; }
+    virtual float getPitch() { return this->pitch; }
+    virtual int getProcessOutputLen() { return this->N2; }
+    // only a pitch found in this frame is a candidate, getPitch() holds the last one
+    virtual int getPitchCandidates( PitchCandidate* dest, int destLen ) {
+        if( !this->estimated || this->pitch <= 0 || destLen < 1 ) {
+            return 0;
+        }
+        dest[0].pitch = this->pitch;
+        dest[0].confidence = std::max( 0.f, std::min( 1.f, this->clarity ) );
+        return 1;
+    }
+    virtual void process( float* src, int srcLen, float* dest ) {
+        assert( srcLen == this->N );
+
+        int64_t nsStart = 0LL, nsEnd = 0LL;
+        nsStart = this->nanos();
+
+        //const float energyThreshold = -13.f;
+        const float energyThreshold = -15.f;
+        float srcEnergy = 0;
+        this->estimated = false;
+        if( gate( src, this->N, energyThreshold, &srcEnergy ) ) {
+            // the MPM transform runs on the residual
+            float* x = src;
+            if( this->prewhitening ) {
+                whiten( this->lpc, src, this->N, this->R, srcEnergy, this->white );
+                x = this->white;
             }
 
-            // todo user changeable & vibrato tracking
-            if (ji > -1 && ji < tuningN) {
-                this->pitchMidi = tuning[ji];
-                this->midiNoteNum = this->midiNoteNums[ji];
+            double P = -1;
+            P = mpm.pitch( x, this->R, dest, this->getProcessOutputLen() );
+            // dest holds the circular ACF
+            P = verify( P, dest, this->N, this->R, this->octaveCheck ? &this->octave : NULL,
+                        this->refinement ? &this->lse : NULL, src );
+            if( P > 0 ) {
+                this->pitch = P;
+                // the octave check and the refinement may have moved the period MPM picked
+                this->nacIndex = this->R / P;
+                this->clarity = this->mpm.getClarityAt( this->nacIndex );
+                this->estimated = true;
             }
         } else {
-            this->pitchMidi = 0;
-            this->midiNoteNum = 0;
+            this->pitch = 0;
+            this->nacIndex = 0;
+            for (int n = 0; n < this->N2; ++n) {
+                dest[n] = 0;
+            }
+        }
+
+        if( this->pitch <= 0 ) {
+            this->nacIndex = 0;
         }
+        this->mapNote( this->pitch );
 
         nsEnd = this->nanos();
         int ns = (int) (nsEnd - nsStart);
-        LOGI("PitchEstimator::process %d ns", ns);
+        LOGV("PitchEstimator::process %d ns", ns);
     }
 };
 
-class PitchEstimator2 : DSP {
+class PitchEstimatorYin : DSP {
 public:
-    PitchEstimator2( int acLen ) : DSP() {
+    PitchEstimatorYin( int acLen, bool probabilistic = false ) : DSP() {
         this->N = acLen;
         this->N2 = 2 * this->N;
-        this->bufLen = 4 * this->N;
-        this->buffer = new float[ this->bufLen ];
+        this->probabilistic = probabilistic;
+        this->pitch = 0;
+        this->nacIndex = 0;
+        this->candidatesN = 0;
 
         this->xm = new float[ this->N ];
         this->db = new float[ this->N ];
-
-        // possible notes to detect, standard tuning, A = (55, 110, 220, 440 ... ) Hz
-        this->tuningN = 48;
-        this->midiNoteNumsN = 48;
-        this->tuning = new float[ this->tuningN ];
-        this->midiNoteNums = new int[ this->midiNoteNumsN ];
-        for( int n=0, nn=1; n < 48; ++n, ++nn ) {
-            this->tuning[ n ] = (float)(pow(2.0, (double)nn / 12.0) * 55.0); // todo user changeable
-            this->midiNoteNums[ n ] = 34 + n;
-        }
     }
-    ~PitchEstimator2( ) {
+    ~PitchEstimatorYin( ) {
         delete[] db;
         delete[] xm;
-        delete[] buffer;
-        delete[] tuning;
-        delete[] midiNoteNums;
     }
 
 private:
     int N;
     int N2;
-    int bufLen;
-    float* buffer;
+    bool probabilistic;
 
     float* xm;
     float* db;
@@ -416,29 +582,29 @@ private:
     float pitch;
     float nacIndex;
 
-    float*  tuning;
-    int     tuningN;
-
-    float   pitchMidi;
-    int     midiNoteNum;
-    int*    midiNoteNums;
-    int     midiNoteNumsN;
+    PitchCandidate candidates[ PYIN_MAX_CANDIDATES ];
+    int candidatesN;
 
-    Mpm<256, float>         mpm;
+    Yin<256, float>         yin;
 
 public:
     virtual float getNacIndex() { return this->nacIndex; }
     virtual float getPitch() { return this->pitch; }
-    virtual int getMidiNoteNumber() { return this->midiNoteNum; }
-    virtual float getPitchMidi() { return this->pitchMidi; }
     virtual int getProcessOutputLen() { return this->N2; }
+    virtual int getPitchCandidates( PitchCandidate* dest, int destLen ) {
+        int n = std::min( this->candidatesN, destLen );
+        for( int k=0; k < n; ++k ) {
+            dest[k] = this->candidates[k];
+        }
+        return n;
+    }
     virtual void process( float* src, int srcLen, float* dest ) {
         assert( srcLen == this->N );
 
         int64_t nsStart = 0LL, nsEnd = 0LL;
         nsStart = this->nanos();
 
-        //const float energyThreshold = -13.f;
+        // same energy gate as PitchEstimator2
         const float energyThreshold = -15.f;
         float xMax = 0, xmSqrSum = 0, srcEnergy = 0, xmEnergy = 0;
         for( int n = 0; n < this->N; ++n ) {
@@ -454,52 +620,1001 @@ public:
         }
         xmEnergy /= (float)this->N;
         srcEnergy = 10.f * log10( srcEnergy );
+
+        this->pitch = 0;
+        this->nacIndex = 0;
+        this->candidatesN = 0;
         if( xmEnergy > energyThreshold && srcEnergy > energyThreshold ) {
-            float maximizeFactor = 1;
-            if (xMax < 0.9f) {
-                maximizeFactor = 0.9f / xMax;
+            float P;
+            if( this->probabilistic ) {
+                P = yin.probabilisticPitch( src, this->R, dest, this->getProcessOutputLen() );
+            } else {
+                P = yin.pitch( src, this->R, dest, this->getProcessOutputLen() );
+            }
+            if( P > 80.f && P < 1600.f ) {
+                this->pitch = P;
+                this->nacIndex = this->yin.getPeriod();
             }
 
-            double P = -1;
-            P = mpm.pitch( src, this->R, dest, this->getProcessOutputLen() );
-            if( P > 80.0 && P < 1600.0 ) {
+            const YinCandidate<float>* yc = this->yin.getCandidates();
+            for( int k=0; k < this->yin.getCandidatesN(); ++k ) {
+                float cp = this->R / yc[k].period;
+                if( cp > 80.f && cp < 1600.f ) {
+                    this->candidates[ this->candidatesN ].pitch = cp;
+                    this->candidates[ this->candidatesN ].confidence = yc[k].probability;
+                    ++this->candidatesN;
+                }
+            }
+        } else {
+            for (int n = 0; n < this->N2; ++n) {
+                dest[n] = 0;
+            }
+        }
+
+        this->mapNote( this->pitch );
+
+        nsEnd = this->nanos();
+        int ns = (int) (nsEnd - nsStart);
+        LOGV("PitchEstimatorYin::process %d ns", ns);
+    }
+};
+
+class PitchEstimatorBitstream : DSP {
+public:
+    PitchEstimatorBitstream( int acLen ) : DSP() {
+        this->N = acLen;
+        this->N2 = 2 * this->N;
+        this->pitch = 0;
+        this->nacIndex = 0;
+        this->clarity = 0;
+    }
+    ~PitchEstimatorBitstream( ) {
+    }
+
+private:
+    int N;
+    int N2;
+
+    float pitch;
+    float nacIndex;
+    float clarity;
+
+    BitstreamAcf<256, float> bacf;
+
+public:
+    virtual float getNacIndex() { return this->nacIndex; }
+    virtual float getPitch() { return this->pitch; }
+    virtual int getProcessOutputLen() { return this->N2; }
+    virtual int getPitchCandidates( PitchCandidate* dest, int destLen ) {
+        if( this->pitch <= 0 || destLen < 1 ) {
+            return 0;
+        }
+        dest[0].pitch = this->pitch;
+        dest[0].confidence = std::max( 0.f, std::min( 1.f, this->clarity ) );
+        return 1;
+    }
+    virtual void process( float* src, int srcLen, float* dest ) {
+        assert( srcLen == this->N );
+
+        int64_t nsStart = 0LL, nsEnd = 0LL;
+        nsStart = this->nanos();
+
+        // plain energy gate, the running max envelope gate of PitchEstimator2 costs more than the estimate
+        const float energyThreshold = 0.0316228f; // -15 dB
+        float srcEnergy = 0;
+        for( int n = 0; n < this->N; ++n ) {
+            srcEnergy += src[n] * src[n];
+        }
+
+        this->pitch = 0;
+        this->nacIndex = 0;
+        this->clarity = 0;
+        if( srcEnergy > energyThreshold ) {
+            float P = bacf.pitch( src, this->R, dest, this->getProcessOutputLen() );
+            if( P > 80.f && P < 1600.f ) {
                 this->pitch = P;
-                this->nacIndex = this->mpm.getPeriod();
+                this->nacIndex = this->bacf.getPeriod();
+                this->clarity = this->bacf.getClarity();
             }
         } else {
-            this->pitch = 0;
-            this->nacIndex = 0;
-#pragma omp parallel for
             for (int n = 0; n < this->N2; ++n) {
                 dest[n] = 0;
             }
         }
 
-        if( this->pitch > 0 ) {
-            //std::binary_search()
-            int ji = -1;
-            float jd = std::numeric_limits<float>::max();
-            for (int jn = 0; jn < this->tuningN; ++jn) {
-                float d = fabs(this->tuning[jn] - this->pitch);
-                if (d < jd) {
-                    ji = jn;
-                    jd = d;
-                }
+        this->mapNote( this->pitch );
+
+        nsEnd = this->nanos();
+        int ns = (int) (nsEnd - nsStart);
+        LOGV("PitchEstimatorBitstream::process %d ns", ns);
+    }
+};
+
+#define CEPSTRUM_THRESHOLD 0.05f            // cepstral peak of a voiced frame
+#define CEPSTRUM_UPPER_PITCH_CUTOFF 1400.f  // shorter quefrencies belong to the spectral envelope
+#define HPS_HARMONICS 4
+#define HPS_THRESHOLD 0.35f                 // share of the frame power in the harmonics of a voiced frame
+#define HPS_OCTAVE_LEVEL 0.1f               // odd against even harmonic power below which the pick is an octave low
+
+/**
+ * Real cepstrum pitch estimate, the quefrency of the largest cepstral peak between the period of
+ * CEPSTRUM_UPPER_PITCH_CUTOFF and 60 Hz.
+ *
+ * The spectrum comes from a SpectralContext, pass one shared with other processors of the same
+ * frame to reuse its transform. Without one the estimator owns its context.
+ */
+class PitchEstimatorCepstrum : DSP {
+public:
+    PitchEstimatorCepstrum( int acLen, SpectralContext* context = NULL ) : DSP() {
+        this->N = acLen;
+        this->N2 = 2 * this->N;
+        this->ownsContext = context == NULL;
+        this->context = context ? context : new SpectralContext( acLen );
+        this->pitch = 0;
+        this->nacIndex = 0;
+        this->peak = 0;
+    }
+    ~PitchEstimatorCepstrum( ) {
+        if( ownsContext ) {
+            delete context;
+        }
+    }
+
+private:
+    int N;
+    int N2;
+    SpectralContext* context;
+    bool ownsContext;
+
+    float pitch;
+    float nacIndex;
+    float peak;
+
+public:
+    virtual float getNacIndex() { return this->nacIndex; }
+    virtual float getPitch() { return this->pitch; }
+    virtual int getProcessOutputLen() { return this->N2; }
+    virtual int getPitchCandidates( PitchCandidate* dest, int destLen ) {
+        if( this->pitch <= 0 || destLen < 1 ) {
+            return 0;
+        }
+        dest[0].pitch = this->pitch;
+        dest[0].confidence = std::min( 1.f, this->peak / (4.f * CEPSTRUM_THRESHOLD) );
+        return 1;
+    }
+    virtual void process( float* src, int srcLen, float* dest ) {
+        assert( srcLen == this->N );
+
+        int64_t nsStart = 0LL, nsEnd = 0LL;
+        nsStart = this->nanos();
+
+        const float energyThreshold = 0.0316228f; // -15 dB
+        float srcEnergy = 0;
+        for( int n = 0; n < this->N; ++n ) {
+            srcEnergy += src[n] * src[n];
+        }
+
+        this->pitch = 0;
+        this->nacIndex = 0;
+        this->peak = 0;
+        if( srcEnergy > energyThreshold ) {
+            this->context->update( src, srcLen );
+            const float* c = this->context->getCepstrum();
+            for( int n=0; n < this->N2; ++n ) {
+                dest[n] = c[n];
             }
 
-            // todo user changeable & vibrato tracking
-            if (ji > -1 && ji < tuningN) {
-                this->pitchMidi = tuning[ji];
-                this->midiNoteNum = this->midiNoteNums[ji];
+            int qMin = (int)ceilf( this->R / CEPSTRUM_UPPER_PITCH_CUTOFF );
+            int qMax = std::min( (int)(this->R / 60.f), this->N - 2 );
+            int q = -1;
+            for( int n = qMin; n <= qMax; ++n ) {
+                if( q < 0 || c[n] > c[q] ) q = n;
+            }
+            if( q > qMin && q < qMax && c[q] > CEPSTRUM_THRESHOLD ) {
+                float a = c[q - 1], b = c[q], d = c[q + 1];
+                float den = a - 2.f * b + d;
+                float pos = den != 0 ? 0.5f * (a - d) / den : 0.f;
+                this->peak = b;
+                this->nacIndex = q + pos;
+                this->pitch = this->R / this->nacIndex;
             }
         } else {
-            this->nacIndex = 0;
-            this->pitchMidi = 0;
-            this->midiNoteNum = 0;
+            for( int n=0; n < this->N2; ++n ) {
+                dest[n] = 0;
+            }
         }
 
+        this->mapNote( this->pitch );
+
         nsEnd = this->nanos();
         int ns = (int) (nsEnd - nsStart);
-        LOGI("PitchEstimator::process %d ns", ns);
+        LOGV("PitchEstimatorCepstrum::process %d ns", ns);
+    }
+};
+
+/**
+ * Harmonic product spectrum pitch estimate.
+ *
+ * The bin k between 60 Hz and 1600 Hz maximizing sum_h log |X(h k)|, h = 1..HPS_HARMONICS, of the
+ * Hann windowed spectrum is the coarse fundamental. The pitch is refined from the interpolated peaks of all its harmonics, and the
+ * frame is voiced when they hold HPS_THRESHOLD of its power. Like PitchEstimatorCepstrum it reads a
+ * shared or owned SpectralContext, the output is the magnitude spectrum.
+ */
+class PitchEstimatorHps : DSP {
+public:
+    PitchEstimatorHps( int acLen, SpectralContext* context = NULL ) : DSP() {
+        this->N = acLen;
+        this->N2 = 2 * this->N;
+        this->ownsContext = context == NULL;
+        this->context = context ? context : new SpectralContext( acLen );
+        this->pitch = 0;
+        this->nacIndex = 0;
+        this->harmonicity = 0;
+    }
+    ~PitchEstimatorHps( ) {
+        if( ownsContext ) {
+            delete context;
+        }
     }
-};
\ No newline at end of file
+
+private:
+    int N;
+    int N2;
+    SpectralContext* context;
+    bool ownsContext;
+
+    float pitch;
+    float nacIndex;
+    float harmonicity;
+
+public:
+    virtual float getNacIndex() { return this->nacIndex; }
+    virtual float getPitch() { return this->pitch; }
+    virtual int getProcessOutputLen() { return this->N2; }
+    virtual int getPitchCandidates( PitchCandidate* dest, int destLen ) {
+        if( this->pitch <= 0 || destLen < 1 ) {
+            return 0;
+        }
+        dest[0].pitch = this->pitch;
+        dest[0].confidence = this->harmonicity;
+        return 1;
+    }
+    virtual void process( float* src, int srcLen, float* dest ) {
+        assert( srcLen == this->N );
+
+        int64_t nsStart = 0LL, nsEnd = 0LL;
+        nsStart = this->nanos();
+
+        const float energyThreshold = 0.0316228f; // -15 dB
+        float srcEnergy = 0;
+        for( int n = 0; n < this->N; ++n ) {
+            srcEnergy += src[n] * src[n];
+        }
+
+        this->pitch = 0;
+        this->nacIndex = 0;
+        this->harmonicity = 0;
+        for( int n=0; n < this->N2; ++n ) {
+            dest[n] = 0;
+        }
+        if( srcEnergy > energyThreshold ) {
+            this->context->update( src, srcLen );
+            const float* mag = this->context->getHannMagnitude();
+            const int bins = this->context->getBins();
+            const float binHz = this->R / this->context->getSize();
+            for( int k=0; k < bins; ++k ) {
+                dest[k] = mag[k];
+            }
+
+            int kMin = std::max( 1, (int)ceilf( 60.f / binHz ) );
+            int kMax = std::min( (int)(1600.f / binHz), (bins - 2) / HPS_HARMONICS );
+            int best = -1;
+            float bestScore = 0;
+            for( int k = kMin; k <= kMax; ++k ) {
+                // the fundamental has to stand out, leakage of its neighbours does not
+                if( mag[k] < mag[k - 1] || mag[k] < mag[k + 1] ) {
+                    continue;
+                }
+                float score = 0;
+                for( int h=1; h <= HPS_HARMONICS; ++h ) {
+                    score += logf( mag[ h * k ] + 1e-9f );
+                }
+                if( best < 0 || score > bestScore ) {
+                    best = k;
+                    bestScore = score;
+                }
+            }
+
+            if( best > 0 ) {
+                float totalPower = 0;
+                for( int k=1; k < bins; ++k ) {
+                    totalPower += mag[k] * mag[k];
+                }
+                float bin = 0, oddPower = 0, evenPower = 0;
+                float harmonicPower = harmonics( best, mag, bins, &bin, &oddPower, &evenPower );
+
+                // the product also peaks an octave low, where the odd harmonics fall between the
+                // true ones
+                if( 2 * best <= kMax && oddPower < HPS_OCTAVE_LEVEL * evenPower ) {
+                    best *= 2;
+                    harmonicPower = harmonics( best, mag, bins, &bin, &oddPower, &evenPower );
+                }
+                this->harmonicity = totalPower > 0 ? std::min( 1.f, harmonicPower / totalPower ) : 0.f;
+                if( this->harmonicity > HPS_THRESHOLD && bin > 0 ) {
+                    this->pitch = bin * binHz;
+                    this->nacIndex = this->R / this->pitch;
+                }
+            }
+        }
+
+        this->mapNote( this->pitch );
+
+        nsEnd = this->nanos();
+        int ns = (int) (nsEnd - nsStart);
+        LOGV("PitchEstimatorHps::process %d ns", ns);
+    }
+
+private:
+    /**
+     * Interpolated peaks of the harmonics of bin k, each searched within one bin of h * k.
+     *
+     * @param bin fundamental in bins, from the first HPS_HARMONICS peaks
+     * @return power of all harmonic peaks, odd and even harmonics also separately
+     */
+    float harmonics( int k0, const float* mag, int bins, float* bin, float* oddPower, float* evenPower ) {
+        float power = 0, binSum = 0, hSum = 0;
+        *oddPower = 0;
+        *evenPower = 0;
+        for( int h=1; h * k0 < bins - 1; ++h ) {
+            int k = h * k0;
+            if( mag[k - 1] > mag[k] && mag[k - 1] >= mag[k + 1] ) --k;
+            else if( mag[k + 1] > mag[k] ) ++k;
+            if( k < 1 || k >= bins - 1 ) break;
+            float a = logf( mag[k - 1] + 1e-9f ), b = logf( mag[k] + 1e-9f ), c = logf( mag[k + 1] + 1e-9f );
+            float den = a - 2.f * b + c;
+            float pos = den != 0 ? 0.5f * (a - c) / den : 0.f;
+            float p = mag[k - 1] * mag[k - 1] + mag[k] * mag[k] + mag[k + 1] * mag[k + 1];
+            power += p;
+            if( h % 2 ) *oddPower += p; else *evenPower += p;
+            if( h <= HPS_HARMONICS ) {
+                binSum += k + pos;
+                hSum += h;
+            }
+        }
+        *bin = hSum > 0 ? binSum / hSum : 0.f;
+        return power;
+    }
+};
+
+#define SWIPE_WINDOW_FRAMES 4       // analysis window in frames, 8 periods of the lowest notes
+
+/**
+ * SWIPE' pitch estimate (see swipe.h) on the magnitude spectrum of the last SWIPE_WINDOW_FRAMES
+ * frames. A 256 sample frame does not resolve the harmonics below about 130 Hz, the window follows
+ * the paper, which sizes it to eight periods of the candidate. A context passed in must be sized
+ * for the window and can be shared with other estimators on the same window. The output is the
+ * candidate score over the log frequency grid.
+ */
+class PitchEstimatorSwipe : DSP {
+public:
+    PitchEstimatorSwipe( int acLen, SpectralContext* context = NULL ) : DSP() {
+        this->N = acLen;
+        this->N2 = 2 * this->N;
+        this->W = context ? context->getFrameLength() : SWIPE_WINDOW_FRAMES * acLen;
+        assert( this->W >= this->N );
+        this->ownsContext = context == NULL;
+        this->context = context ? context : new SpectralContext( this->W );
+        this->window = new float[ this->W ];
+        for( int n=0; n < this->W; ++n ) {
+            this->window[n] = 0;
+        }
+        this->pitch = 0;
+        this->nacIndex = 0;
+    }
+    ~PitchEstimatorSwipe( ) {
+        delete[] window;
+        if( ownsContext ) {
+            delete context;
+        }
+    }
+
+private:
+    int N;
+    int N2;
+    int W;
+    float* window;
+    SpectralContext* context;
+    bool ownsContext;
+    Swipe swipe;
+
+    float pitch;
+    float nacIndex;
+
+public:
+    virtual float getNacIndex() { return this->nacIndex; }
+    virtual float getPitch() { return this->pitch; }
+    virtual int getProcessOutputLen() { return this->N2; }
+    virtual int getPitchCandidates( PitchCandidate* dest, int destLen ) {
+        if( this->pitch <= 0 || destLen < 1 ) {
+            return 0;
+        }
+        dest[0].pitch = this->pitch;
+        dest[0].confidence = std::max( 0.f, std::min( 1.f, this->swipe.getStrength() ) );
+        return 1;
+    }
+    // the sparse kernel is built for the rate here, off the audio path, and only when it changed
+    virtual void setSamplingRate( float R ) {
+        this->R = R;
+        this->swipe.setup( R, this->context->getSize() );
+    }
+    // multiply-adds per frame of the kernel product, fixed for a sampling rate
+    int getKernelNonZeros() { return this->swipe.getNonZeros(); }
+    int getWindowLength() { return this->W; }
+    virtual void process( float* src, int srcLen, float* dest ) {
+        assert( srcLen == this->N );
+
+        int64_t nsStart = 0LL, nsEnd = 0LL;
+        nsStart = this->nanos();
+
+        memmove( this->window, this->window + this->N, sizeof( float ) * (this->W - this->N) );
+        memcpy( this->window + this->W - this->N, src, sizeof( float ) * this->N );
+
+        // SWIPE' is scale invariant, the gate only skips silence
+        const float energyThreshold = 0.0316228f; // -15 dB
+        float srcEnergy = 0;
+        for( int n = 0; n < this->N; ++n ) {
+            srcEnergy += src[n] * src[n];
+        }
+
+        this->pitch = 0;
+        this->nacIndex = 0;
+        for( int n=0; n < this->N2; ++n ) {
+            dest[n] = 0;
+        }
+        // no kernel before the first setSamplingRate()
+        if( srcEnergy > energyThreshold && this->swipe.getCandidatesN() > 0 ) {
+            this->context->update( this->window, this->W );
+            this->pitch = this->swipe.pitch( this->context->getHannMagnitude() );
+            if( this->pitch > 0 ) {
+                this->nacIndex = this->R / this->pitch;
+            }
+            const float* scores = this->swipe.getScores();
+            for( int n=0; n < std::min( this->N2, this->swipe.getCandidatesN() ); ++n ) {
+                dest[n] = scores[n];
+            }
+        }
+
+        this->mapNote( this->pitch );
+
+        nsEnd = this->nanos();
+        int ns = (int) (nsEnd - nsStart);
+        LOGV("PitchEstimatorSwipe::process %d ns", ns);
+    }
+};
+
+#define MULTIRES_HISTORY 1024
+#define MULTIRES_CLARITY 0.9f       // a band is trusted on its own above this clarity
+#define MULTIRES_UPPER_PITCH_CUTOFF 1600.f
+#define MULTIRES_LOWER_PITCH_CUTOFF 40.f
+
+// one analysis window of PitchEstimatorMultiResolution, run on the caller or a pool worker
+template <int W> struct MultiResolutionBand
+{
+    Mpm<W, float>   mpm;
+    const float*    src;        // newest W samples of the history
+    float           R;
+    float           minHz;      // two periods have to fit the window
+    float           pitch;
+    float           clarity;
+
+    MultiResolutionBand( ) : src( nullptr ), R( 0 ), pitch( 0 ), clarity( 0 ) {
+        this->minHz = 0;
+    }
+
+    void setSamplingRate( float R ) {
+        this->R = R;
+        this->minHz = std::max( 2.f * R / W, MULTIRES_LOWER_PITCH_CUTOFF );
+        this->mpm.setLowerPitchCutoff( this->minHz );
+    }
+
+    static void run( void* arg ) {
+        MultiResolutionBand<W>* b = (MultiResolutionBand<W>*) arg;
+        float P = b->mpm.pitch( (float*) b->src, (int) b->R, nullptr, 0 );
+        b->pitch = 0;
+        b->clarity = 0;
+        if( P >= b->minHz && P < MULTIRES_UPPER_PITCH_CUTOFF ) {
+            b->pitch = P;
+            b->clarity = b->mpm.getClarity();
+        }
+    }
+};
+
+/**
+ * MPM over three window lengths of the same signal, 128, 256 and 1024 samples.
+ *
+ * The short window reacts to attacks within 12 ms but only sees pitches above 2R/128 (172 Hz at
+ * 11025 Hz), the long one reaches down to 40 Hz bass notes at the cost of 93 ms of history. The
+ * short band runs on the calling thread while the longer ones run on pool workers, all three read
+ * the shared history in place so the frame waits for every band.
+ *
+ * Fusion takes the shortest band whose clarity passes MULTIRES_CLARITY, unless a longer band is
+ * confident about a pitch below what the shorter window can resolve. Without a confident band the
+ * clearest estimate wins.
+ */
+class PitchEstimatorMultiResolution : DSP {
+public:
+    static const int BANDS = 3;
+
+    PitchEstimatorMultiResolution( int acLen ) : DSP(), pool( BANDS - 1 ) {
+        this->N = acLen;
+        this->N2 = 2 * this->N;
+        this->pitch = 0;
+        this->nacIndex = 0;
+        this->clarity = 0;
+        this->band = -1;
+        this->history = new float[ MULTIRES_HISTORY ];
+        for( int n=0; n < MULTIRES_HISTORY; ++n ) {
+            this->history[ n ] = 0;
+        }
+    }
+    ~PitchEstimatorMultiResolution( ) {
+        // pool is declared last and joins its workers before the bands go away
+        delete[] history;
+    }
+
+private:
+    int N;
+    int N2;
+
+    float* history;
+
+    float pitch;
+    float nacIndex;
+    float clarity;
+    int band;
+
+    MultiResolutionBand<128>    band0;
+    MultiResolutionBand<256>    band1;
+    MultiResolutionBand<1024>   band2;
+
+    WorkerPool pool;
+
+public:
+    virtual float getNacIndex() { return this->nacIndex; }
+    virtual float getPitch() { return this->pitch; }
+    virtual int getProcessOutputLen() { return this->N2; }
+    virtual int getPitchCandidates( PitchCandidate* dest, int destLen ) {
+        const float pitches[ BANDS ] = { band0.pitch, band1.pitch, band2.pitch };
+        const float clarities[ BANDS ] = { band0.clarity, band1.clarity, band2.clarity };
+        int n = 0;
+        for( int k=0; k < BANDS && n < destLen; ++k ) {
+            if( pitches[k] > 0 ) {
+                dest[n].pitch = pitches[k];
+                dest[n].confidence = std::max( 0.f, std::min( 1.f, clarities[k] ) );
+                ++n;
+            }
+        }
+        return n;
+    }
+
+    // window length that produced the current pitch, 0 when unvoiced
+    int getBandLength() {
+        const int lengths[ BANDS ] = { 128, 256, 1024 };
+        return this->band < 0 ? 0 : lengths[ this->band ];
+    }
+
+    virtual void process( float* src, int srcLen, float* dest ) {
+        assert( srcLen == this->N );
+
+        int64_t nsStart = 0LL, nsEnd = 0LL;
+        nsStart = this->nanos();
+
+        if( band0.R != this->R ) {
+            band0.setSamplingRate( this->R );
+            band1.setSamplingRate( this->R );
+            band2.setSamplingRate( this->R );
+        }
+
+        // the history is kept linear so every band reads its newest samples in one piece, the
+        // workers were joined at the end of the last frame so shifting it is safe
+        int keep = MULTIRES_HISTORY - srcLen;
+        for( int n=0; n < keep; ++n ) {
+            history[ n ] = history[ n + srcLen ];
+        }
+        for( int n=0; n < srcLen; ++n ) {
+            history[ keep + n ] = src[ n ];
+        }
+
+        const float energyThreshold = 0.0316228f; // -15 dB
+        float srcEnergy = 0;
+        for( int n = 0; n < this->N; ++n ) {
+            srcEnergy += src[n] * src[n];
+        }
+
+        this->pitch = 0;
+        this->nacIndex = 0;
+        this->clarity = 0;
+        this->band = -1;
+        band0.pitch = band1.pitch = band2.pitch = 0;
+        band0.clarity = band1.clarity = band2.clarity = 0;
+
+        if( srcEnergy > energyThreshold ) {
+            band0.src = &history[ MULTIRES_HISTORY - 128 ];
+            band1.src = &history[ MULTIRES_HISTORY - 256 ];
+            band2.src = &history[ MULTIRES_HISTORY - 1024 ];
+            // both workers were joined last frame, a submit cannot find them busy
+            pool.submit( 0, &MultiResolutionBand<256>::run, &band1 );
+            pool.submit( 1, &MultiResolutionBand<1024>::run, &band2 );
+            MultiResolutionBand<128>::run( &band0 );
+            pool.wait( 0 );
+            pool.wait( 1 );
+
+            fuse();
+        }
+
+        // display the 256 sample autocorrelation like PitchEstimator2
+        for( int n=0; n < this->N2; ++n ) {
+            dest[n] = (this->band >= 0 && n < 256) ? band1.mpm.out_real[n] : 0.f;
+        }
+
+        this->mapNote( this->pitch );
+
+        nsEnd = this->nanos();
+        int ns = (int) (nsEnd - nsStart);
+        LOGV("PitchEstimatorMultiResolution::process %d ns", ns);
+    }
+
+private:
+    void fuse() {
+        const float pitches[ BANDS ] = { band0.pitch, band1.pitch, band2.pitch };
+        const float clarities[ BANDS ] = { band0.clarity, band1.clarity, band2.clarity };
+        const float minHz[ BANDS ] = { band0.minHz, band1.minHz, band2.minHz };
+
+        int best = -1;
+        for( int k=0; k < BANDS && best < 0; ++k ) {
+            if( pitches[k] <= 0 || clarities[k] < MULTIRES_CLARITY ) {
+                continue;
+            }
+            // a longer window sure about a note this one cannot resolve overrules it
+            bool overruled = false;
+            for( int j=k+1; j < BANDS; ++j ) {
+                if( pitches[j] > 0 && clarities[j] >= MULTIRES_CLARITY && pitches[j] < minHz[k] ) {
+                    overruled = true;
+                }
+            }
+            if( !overruled ) {
+                best = k;
+            }
+        }
+        if( best < 0 ) {
+            for( int k=0; k < BANDS; ++k ) {
+                if( pitches[k] > 0 && (best < 0 || clarities[k] > clarities[best]) ) {
+                    best = k;
+                }
+            }
+        }
+        if( best < 0 ) {
+            return;
+        }
+        this->band = best;
+        this->pitch = pitches[best];
+        this->clarity = clarities[best];
+        this->nacIndex = this->R / this->pitch;
+    }
+};
+
+#define ENSEMBLE_MAX_MEMBERS 4
+#define ENSEMBLE_AGREE_CENTS 50.f           // estimates this close vote for the same pitch
+#define ENSEMBLE_DEADLINE_FRACTION 0.5f     // of the frame period
+
+// one estimator of PitchEstimatorEnsemble with its own copy of the frame, run on a pool worker
+struct EnsembleMember
+{
+    DSP*        dsp;
+    float*      src;
+    float*      dest;
+    int         srcLen;
+    float       pitch;
+    float       confidence;
+    int64_t     ns;         // time spent in process
+
+    static void run( void* arg ) {
+        EnsembleMember* m = (EnsembleMember*) arg;
+        auto start = std::chrono::steady_clock::now();
+        m->dsp->process( m->src, m->srcLen, m->dest );
+
+        // the confidence the estimator gives its own pitch, estimators that do not rate it give 1
+        PitchCandidate candidates[ TRACKER_MAX_CANDIDATES ];
+        int n = m->dsp->getPitchCandidates( candidates, TRACKER_MAX_CANDIDATES );
+        m->pitch = m->dsp->getPitch();
+        m->confidence = 0;
+        for( int k=0; k < n; ++k ) {
+            if( fabsf( 1200.f * log2f( candidates[k].pitch / m->pitch ) ) < ENSEMBLE_AGREE_CENTS ) {
+                m->confidence = std::max( m->confidence, candidates[k].confidence );
+            }
+        }
+        if( m->pitch <= 0 ) {
+            m->confidence = 0;
+        }
+        m->ns = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+    }
+};
+
+/**
+ * Several pitch estimators voting on the same frame, each on its own pool worker.
+ *
+ * Every member gets a copy of the frame, the caller waits for the results until a hard deadline of
+ * ENSEMBLE_DEADLINE_FRACTION of the frame period (or setDeadline()) and votes with what arrived.
+ * A late member keeps running on its copy, it is skipped while still busy and its stale results
+ * are never used. Each estimate votes with its confidence for all estimates within
+ * ENSEMBLE_AGREE_CENTS, the best supported one wins and the pitch is the confidence weighted mean of
+ * its supporters in cents.
+ *
+ * The members are owned. Deadline misses, busy skips and the pool overhead (frame time beyond the
+ * slowest member) are counted.
+ */
+class PitchEstimatorEnsemble : DSP {
+public:
+    PitchEstimatorEnsemble( int acLen, DSP** estimators, int estimatorsN ) :
+        DSP(), membersN( std::max( 1, std::min( estimatorsN, ENSEMBLE_MAX_MEMBERS ) ) ), pool( membersN ) {
+        this->N = acLen;
+        this->N2 = 2 * this->N;
+        this->pitch = 0;
+        this->nacIndex = 0;
+        this->confidence = 0;
+        this->winner = -1;
+        this->deadlineUs = 0;
+        this->frames = 0;
+        this->overheadNs = 0;
+        for( int k=0; k < this->membersN; ++k ) {
+            EnsembleMember& m = this->members[k];
+            m.dsp = estimators[k];
+            m.src = new float[ this->N ];
+            m.dest = new float[ m.dsp->getProcessOutputLen() ];
+            m.srcLen = this->N;
+            m.pitch = 0;
+            m.confidence = 0;
+            m.ns = 0;
+            this->missed[k] = 0;
+            this->skipped[k] = 0;
+        }
+    }
+    ~PitchEstimatorEnsemble( ) {
+        for( int k=0; k < membersN; ++k ) {
+            pool.wait( k );
+            delete members[k].dsp;
+            delete[] members[k].dest;
+            delete[] members[k].src;
+        }
+    }
+
+private:
+    int N;
+    int N2;
+
+    const int membersN;
+    EnsembleMember members[ ENSEMBLE_MAX_MEMBERS ];
+    bool arrived[ ENSEMBLE_MAX_MEMBERS ];
+
+    float pitch;
+    float nacIndex;
+    float confidence;
+    int winner;
+
+    int deadlineUs;
+    int64_t frames;
+    int64_t missed[ ENSEMBLE_MAX_MEMBERS ];
+    int64_t skipped[ ENSEMBLE_MAX_MEMBERS ];
+    int64_t overheadNs;
+
+    WorkerPool pool;
+
+public:
+    virtual float getNacIndex() { return this->nacIndex; }
+    virtual float getPitch() { return this->pitch; }
+    virtual int getProcessOutputLen() { return this->N2; }
+    virtual int getPitchCandidates( PitchCandidate* dest, int destLen ) {
+        if( this->pitch <= 0 || destLen < 1 ) {
+            return 0;
+        }
+        dest[0].pitch = this->pitch;
+        dest[0].confidence = this->confidence;
+        return 1;
+    }
+
+    // 0 sets ENSEMBLE_DEADLINE_FRACTION of the frame period
+    void setDeadline( int us ) { this->deadlineUs = us; }
+    int getMembersN() { return this->membersN; }
+    // member whose output is displayed, -1 when unvoiced
+    int getWinner() { return this->winner; }
+    int64_t getFrames() { return this->frames; }
+    // frames the member finished after the deadline
+    int64_t getMissed( int member ) { return this->missed[member]; }
+    // frames the member was left out because it still ran a late frame
+    int64_t getSkipped( int member ) { return this->skipped[member]; }
+    // share of member frames that brought no result in time
+    float getMissRate() {
+        int64_t lost = 0;
+        for( int k=0; k < membersN; ++k ) lost += missed[k] + skipped[k];
+        return frames > 0 ? (float)lost / (frames * membersN) : 0.f;
+    }
+    // mean time per frame beyond the slowest member that arrived: copies, dispatch and wake-ups, and
+    // members waiting for a core when there are fewer cores than members
+    float getOverheadNs() { return frames > 0 ? (float)overheadNs / frames : 0.f; }
+
+    virtual void process( float* src, int srcLen, float* dest ) {
+        assert( srcLen == this->N );
+
+        int64_t nsStart = 0LL, nsEnd = 0LL;
+        nsStart = this->nanos();
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(
+            this->deadlineUs > 0 ? (int64_t)this->deadlineUs
+                                 : (int64_t)(1e6f * ENSEMBLE_DEADLINE_FRACTION * srcLen / this->R) );
+
+        // a busy member still works on its own copy of an older frame
+        bool submitted[ ENSEMBLE_MAX_MEMBERS ];
+        for( int k=0; k < membersN; ++k ) {
+            EnsembleMember& m = members[k];
+            arrived[k] = false;
+            submitted[k] = false;
+            if( pool.busy( k ) ) {
+                ++skipped[k];
+                continue;
+            }
+            for( int n=0; n < srcLen; ++n ) {
+                m.src[n] = src[n];
+            }
+            m.dsp->setSamplingRate( this->R );
+            submitted[k] = pool.submit( k, &EnsembleMember::run, &m );
+            if( !submitted[k] ) {
+                ++skipped[k];
+            }
+        }
+
+        int64_t slowest = 0;
+        for( int k=0; k < membersN; ++k ) {
+            if( !submitted[k] ) {
+                continue;
+            }
+            if( pool.waitUntil( k, deadline ) ) {
+                arrived[k] = true;
+                slowest = std::max( slowest, members[k].ns );
+            } else {
+                ++missed[k];
+            }
+        }
+
+        vote();
+
+        for( int n=0; n < this->N2; ++n ) {
+            dest[n] = 0;
+        }
+        if( this->winner >= 0 ) {
+            EnsembleMember& m = members[ this->winner ];
+            int len = std::min( this->N2, m.dsp->getProcessOutputLen() );
+            for( int n=0; n < len; ++n ) {
+                dest[n] = m.dest[n];
+            }
+        }
+
+        this->mapNote( this->pitch );
+
+        nsEnd = this->nanos();
+        overheadNs += std::max( (int64_t)0, (nsEnd - nsStart) - slowest );
+        ++frames;
+        int ns = (int) (nsEnd - nsStart);
+        LOGV("PitchEstimatorEnsemble::process %d ns", ns);
+    }
+
+private:
+    void vote() {
+        this->pitch = 0;
+        this->nacIndex = 0;
+        this->confidence = 0;
+        this->winner = -1;
+
+        float total = 0, bestSupport = 0;
+        int best = -1;
+        for( int k=0; k < membersN; ++k ) {
+            if( !arrived[k] || members[k].pitch <= 0 ) continue;
+            total += members[k].confidence;
+            float support = 0;
+            for( int j=0; j < membersN; ++j ) {
+                if( arrived[j] && members[j].pitch > 0 && agree( members[k].pitch, members[j].pitch ) ) {
+                    support += members[j].confidence;
+                }
+            }
+            if( best < 0 || support > bestSupport ) {
+                best = k;
+                bestSupport = support;
+            }
+        }
+        if( best < 0 || bestSupport <= 0 ) {
+            return;
+        }
+
+        float cents = 0;
+        for( int j=0; j < membersN; ++j ) {
+            if( arrived[j] && members[j].pitch > 0 && agree( members[best].pitch, members[j].pitch ) ) {
+                cents += members[j].confidence * 1200.f * log2f( members[j].pitch / members[best].pitch );
+            }
+        }
+        this->pitch = members[best].pitch * exp2f( cents / bestSupport / 1200.f );
+        this->confidence = bestSupport / total;
+        this->nacIndex = this->R / this->pitch;
+        this->winner = best;
+    }
+
+    bool agree( float a, float b ) {
+        return fabsf( 1200.f * log2f( a / b ) ) < ENSEMBLE_AGREE_CENTS;
+    }
+};
+
+/**
+ * Viterbi tracking stage on top of any pitch estimator of this file.
+ *
+ * The wrapped estimator processes the frame as usual, its candidates go through a PitchTracker and
+ * the note outputs follow the tracked pitch, lookahead frames late. The estimator is owned.
+ */
+class PitchTracked : DSP {
+public:
+    PitchTracked( DSP* estimator, int lookahead = 1 ) : DSP(), tracker( 28, 96, 5, lookahead ) {
+        this->estimator = estimator;
+        this->pitch = 0;
+        this->nacIndex = 0;
+    }
+    ~PitchTracked( ) {
+        delete estimator;
+    }
+
+private:
+    DSP* estimator;
+    PitchTracker tracker;
+
+    PitchCandidate candidates[ TRACKER_MAX_CANDIDATES ];
+    float candidatePitches[ TRACKER_MAX_CANDIDATES ];
+    float candidateConfidences[ TRACKER_MAX_CANDIDATES ];
+
+    float pitch;
+    float nacIndex;
+
+public:
+    virtual float getNacIndex() { return this->nacIndex; }
+    virtual float getPitch() { return this->pitch; }
+    virtual int getProcessOutputLen() { return this->estimator->getProcessOutputLen(); }
+    virtual int getPitchCandidates( PitchCandidate* dest, int destLen ) {
+        if( this->pitch <= 0 || destLen < 1 ) {
+            return 0;
+        }
+        dest[0].pitch = this->pitch;
+        dest[0].confidence = this->tracker.getConfidence();
+        return 1;
+    }
+    int getLookahead() { return this->tracker.getLookahead(); }
+    void setLookahead( int lookahead ) { this->tracker.setLookahead( lookahead ); }
+
+    virtual void process( float* src, int srcLen, float* dest ) {
+        int64_t nsStart = 0LL, nsEnd = 0LL;
+        nsStart = this->nanos();
+
+        this->estimator->setSamplingRate( this->R );
+        this->estimator->process( src, srcLen, dest );
+
+        int n = this->estimator->getPitchCandidates( this->candidates, TRACKER_MAX_CANDIDATES );
+        for( int k=0; k < n; ++k ) {
+            this->candidatePitches[k] = this->candidates[k].pitch;
+            this->candidateConfidences[k] = this->candidates[k].confidence;
+        }
+        if( this->tracker.push( this->candidatePitches, this->candidateConfidences, n ) ) {
+            this->pitch = this->tracker.getPitch();
+            this->nacIndex = this->pitch > 0 ? this->R / this->pitch : 0;
+        }
+
+        this->mapNote( this->pitch );
+
+        nsEnd = this->nanos();
+        int ns = (int) (nsEnd - nsStart);
+        LOGV("PitchTracked::process %d ns", ns);
+    }
+};
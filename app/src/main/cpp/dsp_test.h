@@ -0,0 +1,2250 @@
+#pragma once
+
+/*
+ * Host benchmarks and checks for the dsp.h processors, results are logged with LOGI.
+ *
+ * On a Linux host (see log.h for the non-Android logging):
+ *
+ *   echo 'int main() { bench_pitch_estimators(); }' | \
+ *       g++ -O2 -fopenmp -I. -include dsp_test.h -x c++ - -o dsp_test && ./dsp_test
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "acorr.h"
+#include "AnalysisEngine.h"
+#include "AudioSource.h"
+#include "Decimator.h"
+#include "dsp.h"
+#include "DspGraph.h"
+#include "FileDevDumper.h"
+#include "log.h"
+#include "MidiEngine.h"
+#include "notemap.h"
+#include "noteevents.h"
+#include "onset.h"
+#include "pitchbend.h"
+#include "Seqlock.h"
+#include "SmfRecorder.h"
+#include "TripleBuffer.h"
+#include "util.h"
+#include "WorkerPool.h"
+
+#define DSP_TEST_R 11025.f
+#define DSP_TEST_N 256
+
+// harmonic tone with 1/h rolloff plus white "breath" noise, random phases per frame
+static void synth_voice( float* x, int N, float R, float f0, float breath )
+{
+    for( int n=0; n < N; ++n ) x[n] = 0;
+    for( int h=1; h * f0 < R / 2; ++h ) {
+        float ph = 2.f * (float)M_PI * rand() / (RAND_MAX + 1.0);
+        float a = 0.5f / h;
+        for( int n=0; n < N; ++n ) {
+            x[n] += a * sinf( 2.f * (float)M_PI * h * f0 * n / R + ph );
+        }
+    }
+    for( int n=0; n < N; ++n ) {
+        x[n] += breath * (2.f * rand() / (RAND_MAX + 1.0) - 1.f);
+    }
+}
+
+struct PitchBenchResult
+{
+    int frames;
+    int voiced;         // frames with an estimate
+    int gross;          // estimates off by more than 50 cents
+    int octave;         // gross errors within 50 cents of +-12 semitones
+    double nsPerFrame;
+};
+
+static PitchBenchResult bench_pitch_estimator( DSP* dsp, float breath, int framesPerNote )
+{
+    PitchBenchResult r = { 0, 0, 0, 0, 0.0 };
+    float x[ DSP_TEST_N ];
+    float* out = new float[ dsp->getProcessOutputLen() ];
+    int64_t ns = 0;
+
+    dsp->setSamplingRate( DSP_TEST_R );
+    srand( 1 );
+    for( int note = 40; note <= 84; ++note ) {
+        float f0 = 440.f * powf( 2.f, (note - 69) / 12.f );
+        for( int k=0; k < framesPerNote; ++k ) {
+            synth_voice( x, DSP_TEST_N, DSP_TEST_R, f0, breath );
+
+            int64_t nsStart = cnanos();
+            dsp->process( x, DSP_TEST_N, out );
+            ns += cnanos() - nsStart;
+
+            ++r.frames;
+            float p = dsp->getPitch();
+            if( p > 0 ) {
+                ++r.voiced;
+                float cents = 1200.f * log2f( p / f0 );
+                if( fabsf( cents ) > 50.f ) {
+                    ++r.gross;
+                    if( fabsf( fabsf( cents ) - 1200.f ) < 50.f ) {
+                        ++r.octave;
+                    }
+                }
+            }
+        }
+    }
+    r.nsPerFrame = (double)ns / r.frames;
+    delete[] out;
+    return r;
+}
+
+static void log_pitch_bench( const char* name, float breath, PitchBenchResult r )
+{
+    LOGI("%-24s breath %.2f: voiced %4d/%4d gross %4d octave %4d  %8.0f ns/frame",
+         name, breath, r.voiced, r.frames, r.gross, r.octave, r.nsPerFrame);
+}
+
+static void bench_pitch_estimators( )
+{
+    const float breaths[] = { 0.f, 0.05f, 0.15f, 0.3f };
+    for( float breath : breaths ) {
+        DSP* mpm = (DSP*) new PitchEstimator2( DSP_TEST_N );
+        DSP* yin = (DSP*) new PitchEstimatorYin( DSP_TEST_N );
+        DSP* pyin = (DSP*) new PitchEstimatorYin( DSP_TEST_N, true );
+        DSP* acf = (DSP*) new PitchEstimator( DSP_TEST_N );
+        DSP* bits = (DSP*) new PitchEstimatorBitstream( DSP_TEST_N );
+        DSP* cep = (DSP*) new PitchEstimatorCepstrum( DSP_TEST_N );
+        DSP* hps = (DSP*) new PitchEstimatorHps( DSP_TEST_N );
+        log_pitch_bench( "PitchEstimator2 (MPM)", breath, bench_pitch_estimator( mpm, breath, 20 ) );
+        log_pitch_bench( "PitchEstimatorYin", breath, bench_pitch_estimator( yin, breath, 20 ) );
+        log_pitch_bench( "PitchEstimatorYin (pYIN)", breath, bench_pitch_estimator( pyin, breath, 20 ) );
+        log_pitch_bench( "PitchEstimator (ACF)", breath, bench_pitch_estimator( acf, breath, 20 ) );
+        log_pitch_bench( "PitchEstimatorBitstream", breath, bench_pitch_estimator( bits, breath, 20 ) );
+        log_pitch_bench( "PitchEstimatorCepstrum", breath, bench_pitch_estimator( cep, breath, 20 ) );
+        log_pitch_bench( "PitchEstimatorHps", breath, bench_pitch_estimator( hps, breath, 20 ) );
+        delete hps;
+        delete cep;
+        delete bits;
+        delete acf;
+        delete pyin;
+        delete yin;
+        delete mpm;
+    }
+}
+
+// direct vs FFT autocorrelation: agreement, per-lag-count timings and the calibrated crossover
+static void bench_autocorrelation( )
+{
+    const int sizes[] = { 128, 256, 512, 1024 };
+    const AcorrMode modes[] = { AcorrCircular, AcorrLinear };
+    for( AcorrMode mode : modes ) {
+        for( int N : sizes ) {
+            AcorrEngine<float> ac( N, mode );
+            float* x = new float[ N ];
+            float* a = new float[ N ];
+            float* b = new float[ N ];
+            srand( 1 );
+            for( int n=0; n < N; ++n ) x[n] = 2.f * rand() / (RAND_MAX + 1.0) - 1.f;
+
+            ac.direct( x, a, N, 1.f / N );
+            ac.transform( x, b, N, 1.f / N );
+            float err = 0;
+            for( int n=0; n < N; ++n ) err = std::max( err, fabsf( a[n] - b[n] ) );
+
+            int modelLags = ac.getDirectMaxLags();
+            int calibratedLags = ac.calibrate( 64 );
+            LOGI("Autocorrelation %s N %5d: max |direct - fft| %.2e, crossover model %4d calibrated %4d lags",
+                 mode == AcorrLinear ? "linear  " : "circular", N, err, modelLags, calibratedLags);
+
+            const int lagsList[] = { 8, 32, 64, 128, 185, 256, 512, 1024 };
+            for( int lags : lagsList ) {
+                if( lags > N ) break;
+                int64_t t0 = cnanos();
+                for( int r=0; r < 200; ++r ) ac.direct( x, a, lags, 1.f );
+                int64_t t1 = cnanos();
+                for( int r=0; r < 200; ++r ) ac.transform( x, b, lags, 1.f );
+                int64_t t2 = cnanos();
+                LOGI("    lags %4d: direct %8.0f ns  fft %8.0f ns", lags, (t1 - t0) / 200.0, (t2 - t1) / 200.0);
+            }
+            delete[] b;
+            delete[] a;
+            delete[] x;
+        }
+    }
+}
+
+// phase continuous harmonic tone, the state carries the phase of every harmonic across calls
+struct VoiceState
+{
+    float phase[ 64 ];
+};
+
+static void synth_voice_continuous( float* x, int N, float R, float f0, float breath, VoiceState* s )
+{
+    for( int n=0; n < N; ++n ) x[n] = 0;
+    for( int h=1; h * f0 < R / 2 && h <= 64; ++h ) {
+        float a = 0.5f / h;
+        float w = 2.f * (float)M_PI * h * f0 / R;
+        for( int n=0; n < N; ++n ) {
+            x[n] += a * sinf( s->phase[h - 1] + w * n );
+        }
+        s->phase[h - 1] = fmodf( s->phase[h - 1] + w * N, 2.f * (float)M_PI );
+    }
+    for( int n=0; n < N; ++n ) {
+        x[n] += breath * (2.f * rand() / (RAND_MAX + 1.0) - 1.f);
+    }
+}
+
+// magnitude of a cascade of two pole resonators at the formants, at f Hz
+static float formant_gain( float f, float R, const float* formants, const float* bandwidths, int n )
+{
+    float g = 1;
+    for( int k=0; k < n; ++k ) {
+        float r = expf( -(float)M_PI * bandwidths[k] / R );
+        float theta = 2.f * (float)M_PI * formants[k] / R;
+        float w = 2.f * (float)M_PI * f / R;
+        // 1 - 2 r cos(theta) e^-jw + r^2 e^-2jw
+        float re = 1.f - 2.f * r * cosf( theta ) * cosf( w ) + r * r * cosf( 2.f * w );
+        float im = 2.f * r * cosf( theta ) * sinf( w ) - r * r * sinf( 2.f * w );
+        // unit gain at DC
+        float re0 = 1.f - 2.f * r * cosf( theta ) + r * r;
+        g *= re0 / sqrtf( re * re + im * im );
+    }
+    return g;
+}
+
+// phase continuous vowel, a 1/h source (glottal pulse and lip radiation) through formant resonators, plus breath noise
+static void synth_vowel_continuous( float* x, int N, float R, float f0, const float* formants, const float* bandwidths,
+                                    int formantsN, float breath, VoiceState* s )
+{
+    for( int n=0; n < N; ++n ) x[n] = 0;
+    for( int h=1; h * f0 < R / 2 && h <= 64; ++h ) {
+        float a = 0.5f / h * formant_gain( h * f0, R, formants, bandwidths, formantsN );
+        float w = 2.f * (float)M_PI * h * f0 / R;
+        for( int n=0; n < N; ++n ) {
+            x[n] += a * sinf( s->phase[h - 1] + w * n );
+        }
+        s->phase[h - 1] = fmodf( s->phase[h - 1] + w * N, 2.f * (float)M_PI );
+    }
+    for( int n=0; n < N; ++n ) {
+        x[n] += breath * (2.f * rand() / (RAND_MAX + 1.0) - 1.f);
+    }
+}
+
+/*
+ * Note sequence from MIDI 28 (41 Hz) to 84 with phase continuous notes, so estimators with history
+ * see real note changes. Reports gross errors per register and the frames from a note change to
+ * the first estimate within 50 cents.
+ */
+static void bench_multi_resolution( )
+{
+    const float breaths[] = { 0.f, 0.05f, 0.15f };
+    const int framesPerNote = 12;
+    for( float breath : breaths ) {
+        DSP* dsps[] = {
+            (DSP*) new PitchEstimator2( DSP_TEST_N ),
+            (DSP*) new PitchEstimatorMultiResolution( DSP_TEST_N )
+        };
+        const char* names[] = { "PitchEstimator2 (MPM)", "PitchEstimatorMultiRes" };
+        for( int d=0; d < 2; ++d ) {
+            DSP* dsp = dsps[d];
+            float x[ DSP_TEST_N ];
+            float* out = new float[ dsp->getProcessOutputLen() ];
+            VoiceState vs = {};
+            int frames[2] = { 0, 0 }, good[2] = { 0, 0 }, gross[2] = { 0, 0 };
+            int latencySum = 0, latencyNotes = 0;
+            int64_t ns = 0;
+
+            dsp->setSamplingRate( DSP_TEST_R );
+            srand( 1 );
+            for( int note = 28; note <= 84; note += 2 ) {
+                float f0 = 440.f * powf( 2.f, (note - 69) / 12.f );
+                int reg = note < 45 ? 0 : 1;
+                int firstGood = -1;
+                for( int k=0; k < framesPerNote; ++k ) {
+                    synth_voice_continuous( x, DSP_TEST_N, DSP_TEST_R, f0, breath, &vs );
+                    int64_t nsStart = cnanos();
+                    dsp->process( x, DSP_TEST_N, out );
+                    ns += cnanos() - nsStart;
+
+                    float p = dsp->getPitch();
+                    bool ok = p > 0 && fabsf( 1200.f * log2f( p / f0 ) ) <= 50.f;
+                    if( ok && firstGood < 0 ) firstGood = k;
+                    // settled part of the note, after the longest window filled with it
+                    if( k >= 4 ) {
+                        ++frames[reg];
+                        if( ok ) ++good[reg];
+                        else if( p > 0 ) ++gross[reg];
+                    }
+                }
+                if( firstGood >= 0 ) {
+                    latencySum += firstGood;
+                    ++latencyNotes;
+                }
+            }
+            LOGI("%-24s breath %.2f: bass < 110 Hz correct %3d/%3d gross %3d, above correct %3d/%3d gross %3d, "
+                 "onset %.2f frames (%d/%d notes), %6.0f ns/frame",
+                 names[d], breath, good[0], frames[0], gross[0], good[1], frames[1], gross[1],
+                 latencyNotes ? (float)latencySum / latencyNotes : -1.f, latencyNotes, (84 - 28) / 2 + 1,
+                 (double)ns / ((84 - 28) / 2 + 1) / framesPerNote);
+            delete[] out;
+            delete dsp;
+        }
+    }
+}
+
+/*
+ * Viterbi tracker against per-frame decisions.
+ *
+ * A candidate stream with known notes gets octave errors, dropouts and jitter, the tracker output is
+ * compared lookahead frames late. Then the PitchTracked wrapper runs on synthetic voice through
+ * PitchEstimatorBitstream and counts MIDI note changes, which MidiWriter turns into note on/off.
+ */
+static void bench_pitch_tracker( )
+{
+    const int notes[] = { 45, 47, 48, 52, 57, 55, 53, 52, 60, 64, 69, 67, 72, 40, 43, 76 };
+    const int framesPerNote = 12;
+    const float errorRates[] = { 0.f, 0.1f, 0.25f };
+
+    for( float errorRate : errorRates ) {
+        for( int lookahead = -1; lookahead <= TRACKER_MAX_LOOKAHEAD; ++lookahead ) {
+            PitchTracker tracker( 28, 96, 5, std::max( lookahead, 0 ) );
+            srand( 7 );
+            int truth[ 16 * 12 ];
+            int frames = 0, wrong = 0, changes = 0, prevNote = -1;
+            int64_t ns = 0;
+            for( int note : notes ) {
+                for( int k=0; k < framesPerNote; ++k ) {
+                    truth[ frames ] = note;
+                    float p = 440.f * powf( 2.f, (note - 69 + 0.1f * (2.f * rand() / (RAND_MAX + 1.0) - 1.f)) / 12.f );
+                    float c = 0.9f;
+                    float r = rand() / (RAND_MAX + 1.0);
+                    if( r < errorRate * 0.7f ) {
+                        p *= (rand() & 1) ? 2.f : 0.5f;
+                    } else if( r < errorRate ) {
+                        p = 0;
+                    }
+
+                    int out = -1;
+                    if( lookahead < 0 ) {
+                        out = p > 0 ? (int)lrintf( 69.f + 12.f * log2f( p / 440.f ) ) : 0;
+                    } else {
+                        int64_t t0 = cnanos();
+                        bool ready = tracker.push( &p, &c, p > 0 ? 1 : 0 );
+                        ns += cnanos() - t0;
+                        if( ready ) out = tracker.getPitch() > 0 ? (int)lrintf( tracker.getMidi() ) : 0;
+                    }
+                    if( out >= 0 ) {
+                        int t = frames - std::max( lookahead, 0 );
+                        if( out != truth[ t ] ) ++wrong;
+                        if( out != prevNote ) ++changes;
+                        prevNote = out;
+                    }
+                    ++frames;
+                }
+            }
+            if( lookahead < 0 ) {
+                LOGI("errors %.2f  per frame      : wrong %3d/%d  note changes %3d (true %d)",
+                     errorRate, wrong, frames, changes, 16);
+            } else {
+                LOGI("errors %.2f  lookahead %d    : wrong %3d/%d  note changes %3d (true %d)  %6.0f ns/frame, %d states",
+                     errorRate, lookahead, wrong, frames, changes, 16, (double)ns / frames, tracker.getStatesN());
+            }
+        }
+    }
+
+    const float breaths[] = { 0.05f, 0.3f };
+    for( float breath : breaths ) {
+        for( int lookahead = -1; lookahead <= TRACKER_MAX_LOOKAHEAD; ++lookahead ) {
+            DSP* dsp = lookahead < 0 ? (DSP*) new PitchEstimatorBitstream( DSP_TEST_N )
+                                     : (DSP*) new PitchTracked( (DSP*) new PitchEstimatorBitstream( DSP_TEST_N ), lookahead );
+            float x[ DSP_TEST_N ];
+            float* out = new float[ dsp->getProcessOutputLen() ];
+            VoiceState vs = {};
+            int changes = 0, prevNote = -1;
+            int64_t ns = 0;
+            dsp->setSamplingRate( DSP_TEST_R );
+            srand( 1 );
+            for( int note : notes ) {
+                float f0 = 440.f * powf( 2.f, (note - 69) / 12.f );
+                for( int k=0; k < framesPerNote; ++k ) {
+                    synth_voice_continuous( x, DSP_TEST_N, DSP_TEST_R, f0, breath, &vs );
+                    int64_t t0 = cnanos();
+                    dsp->process( x, DSP_TEST_N, out );
+                    ns += cnanos() - t0;
+                    int m = dsp->getMidiNoteNumber();
+                    if( m != prevNote ) ++changes;
+                    prevNote = m;
+                }
+            }
+            LOGI("Bitstream breath %.2f %s %d: MIDI note changes %3d (true 16)  %6.0f ns/frame",
+                 breath, lookahead < 0 ? "untracked " : "lookahead", std::max( lookahead, 0 ), changes,
+                 (double)ns / (16 * framesPerNote));
+            delete[] out;
+            delete dsp;
+        }
+    }
+}
+
+/*
+ * Onset detector latency on synthetic attacks.
+ *
+ * Notes with a 2 ms attack, exponential decay and 10 ms release start at random positions, separated by gaps of
+ * breath noise, plus legato note changes without a gap. Latency is counted from the true onset to
+ * the end of the hop that emitted the event (when the note layer can see it), and compared with the
+ * first 256 sample frame where PitchEstimator2 reports the right pitch.
+ */
+static void bench_onsets( )
+{
+    const float R = DSP_TEST_R;
+    const int N = DSP_TEST_N;
+    const int notesN = 40;
+    const int total = notesN * 4096;
+    float* x = new float[ total ];
+    int onsets[ notesN ];
+    bool legato[ notesN ];
+    float f0s[ notesN ];
+
+    const float breaths[] = { 0.003f, 0.02f };
+    const OnsetFunction functions[] = { OnsetSpectralFlux, OnsetHighFrequencyContent };
+    for( float breath : breaths ) {
+        srand( 3 );
+        for( int n=0; n < total; ++n ) x[n] = breath * (2.f * rand() / (RAND_MAX + 1.0) - 1.f);
+        int pos = 1000;
+        for( int k=0; k < notesN; ++k ) {
+            legato[k] = k > 0 && (k % 4) == 3;
+            int start = legato[k] ? onsets[k - 1] + 2500 + rand() % 500 : pos + rand() % 700;
+            int len = 3000 + rand() % 500;
+            onsets[k] = start;
+            int note = 48 + rand() % 30;
+            f0s[k] = 440.f * powf( 2.f, (note - 69) / 12.f );
+            float amp = 0.2f + 0.3f * rand() / (RAND_MAX + 1.0);
+            int end = std::min( start + len, total );
+            if( legato[k] ) {
+                // the previous note stops where this one starts
+                for( int n=start; n < std::min( start + len, total ); ++n ) x[n] = breath * (2.f * rand() / (RAND_MAX + 1.0) - 1.f);
+            }
+            for( int h=1; h * f0s[k] < R / 2 && h < 12; ++h ) {
+                float a = amp / h;
+                for( int n=start; n < end; ++n ) {
+                    float t = (n - start) / R;
+                    float env = std::min( 1.f, t / 0.002f ) * expf( -t / 0.25f ) *
+                                std::min( 1.f, (end - n) / (0.01f * R) );
+                    x[n] += a * env * sinf( 2.f * (float)M_PI * h * f0s[k] * t );
+                }
+            }
+            pos = start + len;
+        }
+
+        for( OnsetFunction fn : functions ) {
+            OnsetDetector<64, float> od( fn );
+            od.setSamplingRate( R );
+            int64_t ns = 0;
+            int detected = 0, detectedLegato = 0, falsePositives = 0;
+            double latency = 0;
+            int maxLatency = 0;
+            bool hit[ notesN ] = {};
+            for( int n=0; n + N <= total; n += N ) {
+                int64_t t0 = cnanos();
+                od.process( &x[n], N );
+                ns += cnanos() - t0;
+
+                OnsetEvent e;
+                while( od.pop( e ) ) {
+                    int avail = (int)e.sample + 64;
+                    int k = -1;
+                    for( int j=0; j < notesN; ++j ) {
+                        if( avail >= onsets[j] && avail - onsets[j] < (int)(0.03f * R) ) k = j;
+                    }
+                    if( k < 0 || hit[k] ) {
+                        ++falsePositives;
+                        continue;
+                    }
+                    hit[k] = true;
+                    ++detected;
+                    if( legato[k] ) ++detectedLegato;
+                    latency += avail - onsets[k];
+                    maxLatency = std::max( maxLatency, avail - onsets[k] );
+                }
+            }
+            LOGI("Onsets %-4s breath %.3f: detected %2d/%d (legato %d/%d) false %2d, latency mean %.1f ms max %.1f ms, %5.0f ns/hop",
+                 fn == OnsetSpectralFlux ? "flux" : "hfc", breath, detected, notesN, detectedLegato, notesN / 4,
+                 falsePositives, detected ? 1000.0 * latency / detected / R : 0.0, 1000.0 * maxLatency / R,
+                 (double)ns / (total / 64));
+        }
+
+        // first correct pitch of the frame based estimator
+        DSP* dsp = (DSP*) new PitchEstimator2( N );
+        float* out = new float[ dsp->getProcessOutputLen() ];
+        dsp->setSamplingRate( R );
+        int found = 0;
+        double latency = 0;
+        int k = 0;
+        for( int n=0; n + N <= total && k < notesN; n += N ) {
+            dsp->process( &x[n], N, out );
+            while( k < notesN && n + N - onsets[k] > (int)(0.1f * R) ) ++k;
+            if( k < notesN && n + N > onsets[k] ) {
+                float p = dsp->getPitch();
+                if( p > 0 && fabsf( 1200.f * log2f( p / f0s[k] ) ) < 50.f ) {
+                    latency += n + N - onsets[k];
+                    ++found;
+                    ++k;
+                }
+            }
+        }
+        LOGI("PitchEstimator2 breath %.3f: first correct pitch for %2d/%d notes, latency mean %.1f ms",
+             breath, found, notesN, found ? 1000.0 * latency / found / R : 0.0);
+        delete[] out;
+        delete dsp;
+    }
+    delete[] x;
+}
+
+// NoteMapper against the direct formula, key snapping, a Scala scale and the old table scan timing
+static void test_note_mapper( )
+{
+    NoteMapper nm;
+    NoteMapping m;
+    int errors = 0;
+    srand( 5 );
+    for( int n=0; n < 100000; ++n ) {
+        float hz = 20.f * powf( 2.f, 9.f * rand() / (RAND_MAX + 1.0) );
+        float midi = 69.f + 12.f * log2f( hz / 440.f );
+        int expect = (int)lrintf( midi );
+        if( fabsf( midi - floorf( midi ) - 0.5f ) < 1e-3f ) continue; // ties
+        if( !nm.map( hz, m ) || m.note != expect || fabsf( m.fractional - midi ) > 1e-3f ) ++errors;
+    }
+    LOGI("NoteMapper 12-TET: %d errors", errors);
+
+    nm.setReference( 442.f );
+    NoteMapping m440;
+    nm.map( 442.f, m );
+    nm.map( 440.f, m440 );
+    LOGI("NoteMapper A4 = 442: 442 Hz -> note %d (%.1f cents), 440 Hz -> %.2f", m.note, m.cents, m440.fractional);
+    nm.setReference( 440.f );
+
+    // D major: C# stays, C snaps to B or C#, F snaps to E or F#
+    nm.setRoot( 2 );
+    nm.setScaleMask( NOTEMAP_MASK_MAJOR );
+    const int probe[] = { 60, 61, 62, 65, 66, 67, 68 };
+    for( int p : probe ) {
+        nm.map( 440.f * exp2f( (p - 69 + 0.2f) / 12.f ), m );
+        LOGI("NoteMapper D major: MIDI %d +20 cents -> %d (%.0f cents)", p, m.note, m.cents);
+    }
+    nm.setRoot( 0 );
+    nm.setScaleMask( ~0ull );
+
+    // 5-limit just intonation on C
+    const char* scl =
+        "! just.scl\n"
+        "!\n"
+        "5-limit just intonation\n"
+        " 12\n"
+        "!\n"
+        " 16/15\n 9/8\n 6/5\n 5/4\n 4/3\n 45/32\n 3/2\n 8/5\n 5/3\n 9/5\n 15/8\n 2/1\n";
+    bool ok = nm.setTuningScala( scl );
+    nm.map( 261.6256f * 1.25f, m );
+    LOGI("NoteMapper Scala %s: just major third of C4 -> note %d %.2f cents, %.2f Hz", ok ? "ok" : "FAILED",
+         m.note, m.cents, m.hz);
+    nm.setEqualTemperament( 12 );
+
+    // cost against the 48 entry tuning table scan it replaces
+    float tuning[ 48 ];
+    for( int n=0; n < 48; ++n ) tuning[ n ] = (float)(pow( 2.0, (n + 1) / 12.0 ) * 55.0);
+    float hzs[ 1024 ];
+    for( int n=0; n < 1024; ++n ) hzs[ n ] = 60.f * powf( 2.f, 4.5f * rand() / (RAND_MAX + 1.0) );
+    volatile int sink = 0;
+    int64_t t0 = cnanos();
+    for( int r=0; r < 100; ++r ) {
+        for( int n=0; n < 1024; ++n ) {
+            int ji = -1;
+            float jd = std::numeric_limits<float>::max();
+            for( int jn=0; jn < 48; ++jn ) {
+                float d = fabs( tuning[ jn ] - hzs[ n ] );
+                if( d < jd ) { ji = jn; jd = d; }
+            }
+            sink += ji;
+        }
+    }
+    int64_t t1 = cnanos();
+    for( int r=0; r < 100; ++r ) {
+        for( int n=0; n < 1024; ++n ) {
+            nm.map( hzs[ n ], m );
+            sink += m.note;
+        }
+    }
+    int64_t t2 = cnanos();
+    LOGI("NoteMapper %.1f ns/map, tuning table scan %.1f ns", (t2 - t1) / 102400.0, (t1 - t0) / 102400.0);
+}
+
+/*
+ * Pitch bend stream on synthetic fractional notes: a held note with estimator jitter, a 5.5 Hz /
+ * 50 cent vibrato, a glide and a note change. Reports the vibrato estimate, the events sent against
+ * the frames analysed and the worst difference between the sent bend and the true deviation.
+ */
+static void test_pitch_bend( )
+{
+    const float frameRate = DSP_TEST_R / DSP_TEST_N;
+    struct Case { const char* name; float rate; float depth; float glide; float jitter; };
+    const Case cases[] = {
+        { "held note, 2 cent jitter", 0.f, 0.f, 0.f, 2.f },
+        { "vibrato 5.5 Hz 50 cents", 5.5f, 50.f, 0.f, 2.f },
+        { "vibrato 7 Hz 20 cents", 7.f, 20.f, 0.f, 1.f },
+        { "glide 100 cents/s", 0.f, 0.f, 100.f, 1.f },
+    };
+    for( const Case& c : cases ) {
+        PitchBendTracker pb( frameRate, 2.f );
+        srand( 9 );
+        int frames = (int)(3.f * frameRate);
+        float worst = 0, sent = 0;
+        bool vibratoAtEnd = false;
+        for( int n=0; n < frames; ++n ) {
+            float t = n / frameRate;
+            float dev = c.depth * sinf( 2.f * (float)M_PI * c.rate * t ) + c.glide * t - (c.glide > 0 ? 100.f : 0.f);
+            float truth = dev;
+            dev += c.jitter * (2.f * rand() / (RAND_MAX + 1.0) - 1.f);
+            pb.process( 60, 60.f + dev / 100.f );
+            PitchBendEvent e;
+            while( pb.pop( e ) ) {
+                sent = (e.bend - PITCHBEND_CENTER) * 200.f / PITCHBEND_CENTER;
+            }
+            if( n > 0 ) worst = std::max( worst, fabsf( sent - truth ) );
+            vibratoAtEnd = pb.isVibrato();
+        }
+        LOGI("PitchBend %-26s: vibrato %d rate %.2f Hz depth %.1f cents, %3d events / %3d frames, max error %.1f cents",
+             c.name, vibratoAtEnd, pb.getVibratoRate(), pb.getVibratoDepth(), pb.getEvents(), frames, worst);
+    }
+
+    // a note change sends the new deviation at once, unvoiced frames send nothing
+    PitchBendTracker pb( frameRate, 2.f );
+    bool a = pb.process( 60, 60.1f );
+    bool b = pb.process( 60, 60.11f );
+    bool c = pb.process( 62, 61.9f );
+    bool d = pb.process( 0, 0.f );
+    PitchBendEvent e;
+    int n = 0, last = -1;
+    while( pb.pop( e ) ) { ++n; last = e.bend; }
+    LOGI("PitchBend note change: sent %d %d %d %d, %d events, last bend %d (expect %d)", a, b, c, d, n, last,
+         PITCHBEND_CENTER - PITCHBEND_CENTER / 20);
+}
+
+/*
+ * PitchKalman on a held note, vibratos and a glide with 6 cents of estimator jitter: rms error of the
+ * raw and the filtered pitch, pitch bend events with and without smoothing, restarts on a note jump
+ * and an onset, and the cost of an update.
+ */
+static void test_pitch_kalman( )
+{
+    const float frameRate = DSP_TEST_R / DSP_TEST_N;
+    const float jitter = 6.f;
+    struct Case { const char* name; float rate; float depth; float glide; };
+    const Case cases[] = {
+        { "held note", 0.f, 0.f, 0.f },
+        { "vibrato 5.5 Hz 50 cents", 5.5f, 50.f, 0.f },
+        { "vibrato 7 Hz 20 cents", 7.f, 20.f, 0.f },
+        { "glide 100 cents/s", 0.f, 0.f, 100.f },
+    };
+    for( const Case& c : cases ) {
+        PitchBendTracker raw( frameRate, 2.f ), smooth( frameRate, 2.f );
+        raw.setSmoothing( false );
+        smooth.setSmoothing( true );
+        srand( 9 );
+        int frames = (int)(3.f * frameRate);
+        double rawSqr = 0, filteredSqr = 0;
+        for( int n=0; n < frames; ++n ) {
+            float t = n / frameRate;
+            float truth = 6000.f + c.depth * sinf( 2.f * (float)M_PI * c.rate * t ) + c.glide * t - (c.glide > 0 ? 100.f : 0.f);
+            // uniform jitter with a standard deviation of jitter cents
+            float measured = truth + jitter * 1.732f * (2.f * rand() / (RAND_MAX + 1.0) - 1.f);
+            raw.process( 60, measured / 100.f, 0.9f );
+            smooth.process( 60, measured / 100.f, 0.9f );
+            // the deviation the bends carry, the smoothed one follows the detected vibrato
+            float filtered = 6000.f + smooth.getCents();
+            rawSqr += (measured - truth) * (measured - truth);
+            filteredSqr += (filtered - truth) * (filtered - truth);
+            PitchBendEvent e;
+            while( raw.pop( e ) ) { }
+            while( smooth.pop( e ) ) { }
+        }
+        LOGI("PitchKalman %-24s: rms error raw %5.2f filtered %5.2f cents, bend events raw %3d smoothed %3d / %3d frames",
+             c.name, sqrt( rawSqr / frames ), sqrt( filteredSqr / frames ), raw.getEvents(), smooth.getEvents(), frames);
+    }
+
+    // a jump of a semitone and an onset restart the filter at the measurement
+    PitchKalman kalman( frameRate );
+    kalman.update( 6000.f, 1.f );
+    kalman.update( 6003.f, 1.f );
+    float jump = kalman.update( 6100.f, 1.f );
+    float next = kalman.update( 6102.f, 1.f );
+    float onset = kalman.update( 6140.f, 1.f, true );
+    LOGI("PitchKalman restarts: jump %.1f (expect 6100.0) next %.1f onset %.1f (expect 6140.0), %d resets (expect 2)",
+         jump, next, onset, kalman.getResets());
+
+    const int updates = 1000000;
+    float acc = 0;
+    int64_t nsStart = cnanos();
+    for( int n=0; n < updates; ++n ) {
+        acc += kalman.update( 6140.f + (n & 7), 0.5f + 0.05f * (n & 7) );
+    }
+    int64_t ns = cnanos() - nsStart;
+    LOGI("PitchKalman: %.1f ns per update (%.0f)", (double)ns / updates, acc / updates);
+}
+
+// harmonic tone with a per-harmonic amplitude envelope env[h-1], random phases, white breath noise
+static void synth_timbre( float* x, int N, float R, float f0, const float* env, int envLen, float breath )
+{
+    for( int n=0; n < N; ++n ) x[n] = 0;
+    for( int h=1; h * f0 < R / 2 && h <= envLen; ++h ) {
+        float ph = 2.f * (float)M_PI * rand() / (RAND_MAX + 1.0);
+        for( int n=0; n < N; ++n ) {
+            x[n] += env[h - 1] * sinf( 2.f * (float)M_PI * h * f0 * n / R + ph );
+        }
+    }
+    for( int n=0; n < N; ++n ) {
+        x[n] += breath * (2.f * rand() / (RAND_MAX + 1.0) - 1.f);
+    }
+}
+
+/*
+ * Octave errors of the ACF and MPM estimators with and without OctaveVerifier on a labelled corpus:
+ * notes 45..81 in timbres that provoke both directions of error, a 1/h voice, a weak fundamental,
+ * dominant even harmonics, and a random formant envelope per note.
+ */
+static void bench_octave_verifier( )
+{
+    const int H = 40;
+    const char* timbres[] = { "1/h", "weak fundamental", "strong even", "formants" };
+    const float breaths[] = { 0.05f, 0.2f };
+    for( int t=0; t < 4; ++t ) {
+        for( float breath : breaths ) {
+            for( int estimator=0; estimator < 2; ++estimator ) {
+                for( int check=0; check < 2; ++check ) {
+                    PitchEstimator* acf = estimator == 0 ? new PitchEstimator( DSP_TEST_N ) : NULL;
+                    PitchEstimator2* mpm = estimator == 1 ? new PitchEstimator2( DSP_TEST_N ) : NULL;
+                    DSP* dsp = acf ? (DSP*) acf : (DSP*) mpm;
+                    if( acf ) acf->setOctaveCheck( check );
+                    if( mpm ) mpm->setOctaveCheck( check );
+                    dsp->setSamplingRate( DSP_TEST_R );
+
+                    float x[ DSP_TEST_N ];
+                    float* out = new float[ dsp->getProcessOutputLen() ];
+                    float env[ H ];
+                    int frames = 0, voiced = 0, up = 0, down = 0, other = 0, stale = 0;
+                    double confidence = 0;
+                    int64_t ns = 0;
+                    srand( 7 );
+                    for( int note = 45; note <= 81; ++note ) {
+                        float f0 = 440.f * powf( 2.f, (note - 69) / 12.f );
+                        for( int h=1; h <= H; ++h ) {
+                            float a = 0.5f / h;
+                            if( t == 1 && h == 1 ) a *= 0.15f;
+                            if( t == 2 && h % 2 == 0 ) a *= 2.5f;
+                            if( t == 3 ) a *= 0.2f + 1.6f * rand() / (RAND_MAX + 1.0);
+                            env[ h - 1 ] = a;
+                        }
+                        for( int k=0; k < 20; ++k ) {
+                            synth_timbre( x, DSP_TEST_N, DSP_TEST_R, f0, env, H, breath );
+                            int64_t nsStart = cnanos();
+                            dsp->process( x, DSP_TEST_N, out );
+                            ns += cnanos() - nsStart;
+                            ++frames;
+                            float p = dsp->getPitch();
+                            if( p <= 0 ) continue;
+                            ++voiced;
+                            // a reported period and the confidence follow the corrected pitch
+                            float period = dsp->getNacIndex();
+                            if( period > 0 && fabsf( period * p - DSP_TEST_R ) > 0.01f * DSP_TEST_R ) ++stale;
+                            PitchCandidate candidate;
+                            if( dsp->getPitchCandidates( &candidate, 1 ) > 0 ) confidence += candidate.confidence;
+                            float cents = 1200.f * log2f( p / f0 );
+                            if( fabsf( cents - 1200.f ) < 50.f ) ++up;
+                            else if( fabsf( cents + 1200.f ) < 50.f ) ++down;
+                            else if( fabsf( cents ) > 50.f ) ++other;
+                        }
+                    }
+                    LOGI("Octave %-16s breath %.2f %-15s check %d: voiced %3d/%3d octave up %3d down %3d other gross %3d, stale period %3d confidence %.2f  %6.0f ns/frame",
+                         timbres[ t ], breath, estimator == 0 ? "PitchEstimator" : "PitchEstimator2", check,
+                         voiced, frames, up, down, other, stale, voiced > 0 ? confidence / voiced : 0.0, (double)ns / frames);
+                    delete[] out;
+                    delete dsp;
+                }
+            }
+
+            // the verifier alone on the ACF of each frame, fed the true pitch and both octave errors
+            AcorrEngine<float> ac( DSP_TEST_N, AcorrLinear );
+            OctaveVerifier ov( DSP_TEST_N );
+            const int lags = (int)(DSP_TEST_R / 60.f) + 2;
+            float x[ DSP_TEST_N ], r[ DSP_TEST_N ];
+            float env[ H ];
+            int checks = 0, right[ 3 ] = { 0, 0, 0 };
+            int64_t ns = 0;
+            srand( 7 );
+            for( int note = 45; note <= 81; ++note ) {
+                float f0 = 440.f * powf( 2.f, (note - 69) / 12.f );
+                for( int h=1; h <= H; ++h ) {
+                    float a = 0.5f / h;
+                    if( t == 1 && h == 1 ) a *= 0.15f;
+                    if( t == 2 && h % 2 == 0 ) a *= 2.5f;
+                    if( t == 3 ) a *= 0.2f + 1.6f * rand() / (RAND_MAX + 1.0);
+                    env[ h - 1 ] = a;
+                }
+                for( int k=0; k < 20; ++k ) {
+                    synth_timbre( x, DSP_TEST_N, DSP_TEST_R, f0, env, H, breath );
+                    ac.compute( x, r, lags, 1.f );
+                    const float given[ 3 ] = { 0.5f * f0, f0, 2.f * f0 };
+                    for( int g=0; g < 3; ++g ) {
+                        int64_t nsStart = cnanos();
+                        float p = ov.verify( r, lags, DSP_TEST_R, given[ g ], 60.f, 1600.f );
+                        ns += cnanos() - nsStart;
+                        if( fabsf( 1200.f * log2f( p / f0 ) ) < 50.f ) ++right[ g ];
+                    }
+                    ++checks;
+                }
+            }
+            LOGI("Octave %-16s breath %.2f verifier alone: fed f0/2 %3d/%3d f0 %3d/%3d 2f0 %3d/%3d right  %4.0f ns/check",
+                 timbres[ t ], breath, right[ 0 ], checks, right[ 1 ], checks, right[ 2 ], checks, (double)ns / (3 * checks));
+        }
+    }
+}
+
+/*
+ * PitchEstimatorEnsemble of the ACF, MPM and pYIN estimators against its members alone, with the
+ * default deadline and with deadlines tight enough to lose members, see the miss rate and overhead.
+ */
+static void bench_ensemble( )
+{
+    const float breaths[] = { 0.05f, 0.3f };
+    const int deadlines[] = { 0, 40, 15 };
+    for( float breath : breaths ) {
+        DSP* acf = (DSP*) new PitchEstimator( DSP_TEST_N );
+        DSP* mpm = (DSP*) new PitchEstimator2( DSP_TEST_N );
+        DSP* pyin = (DSP*) new PitchEstimatorYin( DSP_TEST_N, true );
+        log_pitch_bench( "PitchEstimator (ACF)", breath, bench_pitch_estimator( acf, breath, 20 ) );
+        log_pitch_bench( "PitchEstimator2 (MPM)", breath, bench_pitch_estimator( mpm, breath, 20 ) );
+        log_pitch_bench( "PitchEstimatorYin (pYIN)", breath, bench_pitch_estimator( pyin, breath, 20 ) );
+        delete pyin;
+        delete mpm;
+        delete acf;
+
+        for( int us : deadlines ) {
+            DSP* members[] = {
+                (DSP*) new PitchEstimator( DSP_TEST_N ),
+                (DSP*) new PitchEstimator2( DSP_TEST_N ),
+                (DSP*) new PitchEstimatorYin( DSP_TEST_N, true )
+            };
+            PitchEstimatorEnsemble* ensemble = new PitchEstimatorEnsemble( DSP_TEST_N, members, 3 );
+            ensemble->setDeadline( us );
+            log_pitch_bench( "PitchEstimatorEnsemble", breath, bench_pitch_estimator( (DSP*) ensemble, breath, 20 ) );
+            LOGI("    deadline %s%d us: missed %lld %lld %lld skipped %lld %lld %lld of %lld frames, miss rate %.3f, overhead %.0f ns/frame",
+                 us == 0 ? "frame/2 " : "", us, (long long)ensemble->getMissed( 0 ), (long long)ensemble->getMissed( 1 ),
+                 (long long)ensemble->getMissed( 2 ), (long long)ensemble->getSkipped( 0 ), (long long)ensemble->getSkipped( 1 ),
+                 (long long)ensemble->getSkipped( 2 ), (long long)ensemble->getFrames(), ensemble->getMissRate(),
+                 ensemble->getOverheadNs());
+            delete ensemble;
+        }
+    }
+}
+
+/*
+ * Spectral display, ACF display, cepstrum and HPS pitch on the same frames, each with its own
+ * transforms against all four reading one SpectralContext. Reports the outputs' largest difference,
+ * transforms per frame and ns per frame for the four processors together.
+ */
+static void bench_spectral_context( )
+{
+    const int frames = 500;
+    float x[ DSP_TEST_N ];
+    float outA[ 4 ][ 2 * DSP_TEST_N ], outB[ 4 ][ 2 * DSP_TEST_N ];
+
+    SpectralContext shared( DSP_TEST_N );
+    DSP* alone[ 4 ] = {
+        (DSP*) new FastFourierTransformMagnitudeSpectrum( DSP_TEST_N ),
+        (DSP*) new AutocorrelationNormalized( DSP_TEST_N ),
+        (DSP*) new PitchEstimatorCepstrum( DSP_TEST_N ),
+        (DSP*) new PitchEstimatorHps( DSP_TEST_N )
+    };
+    DSP* sharing[ 4 ] = {
+        (DSP*) new FastFourierTransformMagnitudeSpectrum( DSP_TEST_N, &shared ),
+        (DSP*) new AutocorrelationNormalized( DSP_TEST_N, &shared ),
+        (DSP*) new PitchEstimatorCepstrum( DSP_TEST_N, &shared ),
+        (DSP*) new PitchEstimatorHps( DSP_TEST_N, &shared )
+    };
+    for( int k=0; k < 4; ++k ) {
+        alone[ k ]->setSamplingRate( DSP_TEST_R );
+        sharing[ k ]->setSamplingRate( DSP_TEST_R );
+    }
+
+    int64_t nsAlone = 0, nsShared = 0;
+    float maxDiff[ 4 ] = { 0, 0, 0, 0 };
+    int pitchDiffer = 0;
+    srand( 3 );
+    for( int f=0; f < frames; ++f ) {
+        float f0 = 440.f * powf( 2.f, (45 + f % 36 - 69) / 12.f );
+        synth_voice( x, DSP_TEST_N, DSP_TEST_R, f0, 0.05f );
+
+        int64_t t0 = cnanos();
+        for( int k=0; k < 4; ++k ) alone[ k ]->process( x, DSP_TEST_N, outA[ k ] );
+        int64_t t1 = cnanos();
+        for( int k=0; k < 4; ++k ) sharing[ k ]->process( x, DSP_TEST_N, outB[ k ] );
+        int64_t t2 = cnanos();
+        nsAlone += t1 - t0;
+        nsShared += t2 - t1;
+
+        for( int k=0; k < 4; ++k ) {
+            float peak = 0;
+            for( int n=0; n < alone[ k ]->getProcessOutputLen(); ++n ) peak = std::max( peak, fabsf( outA[ k ][ n ] ) );
+            for( int n=0; n < alone[ k ]->getProcessOutputLen(); ++n ) {
+                maxDiff[ k ] = std::max( maxDiff[ k ], fabsf( outA[ k ][ n ] - outB[ k ][ n ] ) / std::max( peak, 1e-9f ) );
+            }
+        }
+        if( alone[ 2 ]->getPitch() != sharing[ 2 ]->getPitch() || alone[ 3 ]->getPitch() != sharing[ 3 ]->getPitch() ) {
+            ++pitchDiffer;
+        }
+    }
+    LOGI("SpectralContext: relative difference spectrum %.1e acf %.1e cepstrum %.1e hps %.1e, pitch differs in %d/%d frames",
+         maxDiff[ 0 ], maxDiff[ 1 ], maxDiff[ 2 ], maxDiff[ 3 ], pitchDiffer, frames);
+    LOGI("SpectralContext: separate %6.0f ns/frame, shared %6.0f ns/frame, shared context %.2f forward + %.2f inverse transforms/frame",
+         (double)nsAlone / frames, (double)nsShared / frames,
+         (double)shared.getForwardTransforms() / frames, (double)shared.getInverseTransforms() / frames);
+    for( int k=0; k < 4; ++k ) {
+        delete sharing[ k ];
+        delete alone[ k ];
+    }
+}
+
+/*
+ * SWIPE' against MPM over signal to noise ratio, phase continuous notes from MIDI 40 to 84 scored
+ * after the SWIPE' window filled with the note. The harmonic tone has about 0.205 power, uniform
+ * noise of amplitude b has b^2 / 3.
+ */
+static void bench_swipe( )
+{
+    const float snrs[] = { 20.f, 10.f, 5.f, 0.f, -5.f };
+    const int framesPerNote = 16;
+    for( float snr : snrs ) {
+        float breath = sqrtf( 3.f * 0.205f / powf( 10.f, snr / 10.f ) );
+        PitchEstimatorSwipe* swipe = new PitchEstimatorSwipe( DSP_TEST_N );
+        DSP* dsps[] = { (DSP*) new PitchEstimator2( DSP_TEST_N ), (DSP*) swipe };
+        const char* names[] = { "PitchEstimator2 (MPM)", "PitchEstimatorSwipe" };
+        for( int d=0; d < 2; ++d ) {
+            DSP* dsp = dsps[d];
+            float x[ DSP_TEST_N ];
+            float* out = new float[ dsp->getProcessOutputLen() ];
+            VoiceState vs = {};
+            int frames = 0, voiced = 0, gross = 0, octave = 0;
+            int64_t ns = 0;
+
+            dsp->setSamplingRate( DSP_TEST_R );
+            srand( 1 );
+            for( int note = 40; note <= 84; ++note ) {
+                float f0 = 440.f * powf( 2.f, (note - 69) / 12.f );
+                for( int k=0; k < framesPerNote; ++k ) {
+                    synth_voice_continuous( x, DSP_TEST_N, DSP_TEST_R, f0, breath, &vs );
+                    int64_t nsStart = cnanos();
+                    dsp->process( x, DSP_TEST_N, out );
+                    ns += cnanos() - nsStart;
+
+                    if( k < SWIPE_WINDOW_FRAMES ) continue;
+                    ++frames;
+                    float p = dsp->getPitch();
+                    if( p > 0 ) {
+                        ++voiced;
+                        float cents = 1200.f * log2f( p / f0 );
+                        if( fabsf( cents ) > 50.f ) {
+                            ++gross;
+                            if( fabsf( fabsf( cents ) - 1200.f ) < 50.f ) ++octave;
+                        }
+                    }
+                }
+            }
+            LOGI("%-24s SNR %3.0f dB: voiced %4d/%4d gross %4d octave %4d  %8.0f ns/frame",
+                 names[d], snr, voiced, frames, gross, octave, (double)ns / ((84 - 40 + 1) * framesPerNote));
+            delete[] out;
+        }
+        if( snr == snrs[0] ) {
+            LOGI("PitchEstimatorSwipe: window %d samples, %d kernel non zeros per frame",
+                 swipe->getWindowLength(), swipe->getKernelNonZeros());
+        }
+        delete dsps[0];
+        delete swipe;
+    }
+}
+
+/*
+ * Pitch accuracy in cents of MPM alone and refined by the LSE harmonic fit, on frames with a random
+ * offset of up to +-50 cents from the equal tempered notes, plus the cost of the fit per frame.
+ */
+static void bench_lse( )
+{
+    const float breaths[] = { 0.f, 0.05f, 0.15f, 0.3f };
+    const int framesPerNote = 10;
+    for( float breath : breaths ) {
+        PitchEstimator2* plain = new PitchEstimator2( DSP_TEST_N );
+        PitchEstimator2* refined = new PitchEstimator2( DSP_TEST_N );
+        refined->setRefinement( true );
+        PitchEstimator2* dsps[] = { plain, refined };
+        const char* names[] = { "PitchEstimator2 (MPM)", "PitchEstimator2 + LSE" };
+        for( int d=0; d < 2; ++d ) {
+            DSP* dsp = (DSP*) dsps[d];
+            float x[ DSP_TEST_N ];
+            float* out = new float[ dsp->getProcessOutputLen() ];
+            double sqrSum = 0, maxCents = 0;
+            int frames = 0, scored = 0;
+            int64_t ns = 0;
+
+            dsp->setSamplingRate( DSP_TEST_R );
+            srand( 5 );
+            for( int note = 40; note <= 84; ++note ) {
+                for( int k=0; k < framesPerNote; ++k ) {
+                    float offset = (float)(rand() % 100 - 50);
+                    float f0 = 440.f * powf( 2.f, (note - 69 + offset / 100.f) / 12.f );
+                    synth_voice( x, DSP_TEST_N, DSP_TEST_R, f0, breath );
+                    int64_t nsStart = cnanos();
+                    dsp->process( x, DSP_TEST_N, out );
+                    ns += cnanos() - nsStart;
+                    ++frames;
+
+                    // octave and gross errors are the business of bench_pitch_estimators
+                    float p = dsp->getPitch();
+                    float cents = p > 0 ? 1200.f * log2f( p / f0 ) : 1e9f;
+                    if( fabsf( cents ) <= 50.f ) {
+                        sqrSum += cents * cents;
+                        maxCents = std::max( maxCents, (double)fabsf( cents ) );
+                        ++scored;
+                    }
+                }
+            }
+            LOGI("%-24s breath %.2f: rms %6.3f cents max %6.3f cents over %4d/%4d frames  %8.0f ns/frame",
+                 names[d], breath, scored ? sqrt( sqrSum / scored ) : 0.0, maxCents, scored, frames, (double)ns / frames);
+            delete[] out;
+        }
+        LOGI("LSE: %d harmonics, %d Gauss-Newton iterations in the last frame, residual %.3f",
+             refined->getLSE().getHarmonics(), refined->getLSE().getIterations(), refined->getLSE().getResidual());
+        delete refined;
+        delete plain;
+    }
+}
+
+/*
+ * LPC: formant accuracy on five synthetic vowels, MPM gross errors with and without pre-whitening on
+ * the same vowels, and the cost of the Levinson-Durbin recursion (O(p^2)), the root finding and the
+ * inverse filter.
+ */
+static void bench_lpc( )
+{
+    const float vowels[5][3] = {
+        { 730, 1090, 2440 },    // a
+        { 270, 2290, 3010 },    // i
+        { 300, 870, 2240 },     // u
+        { 530, 1840, 2480 },    // e
+        { 570, 840, 2410 },     // o
+    };
+    const float bandwidths[3] = { 80, 100, 120 };
+    const int framesPerNote = 8;
+
+    // formants at a steady 150 Hz
+    for( int v=0; v < 5; ++v ) {
+        LinearPredictor lpc;
+        VoiceState vs = {};
+        float x[ DSP_TEST_N ], work[ DSP_TEST_N ], r[ LPC_MAX_ORDER + 2 ];
+        srand( 2 );
+        float error[3] = { 0, 0, 0 };
+        int found = 0, frames = 0;
+        for( int k=0; k < 20; ++k ) {
+            synth_vowel_continuous( x, DSP_TEST_N, DSP_TEST_R, 150.f, vowels[v], bandwidths, 3, 0.005f, &vs );
+            LinearPredictor::autocorrelate( x, DSP_TEST_N, r, lpc.getOrder(), work );
+            lpc.analyse( r, DSP_TEST_R );
+            int n = lpc.findFormants( DSP_TEST_R );
+            ++frames;
+            if( n >= 3 ) {
+                ++found;
+                for( int f=0; f < 3; ++f ) {
+                    error[f] = std::max( error[f], fabsf( lpc.getFormant( f ) / vowels[v][f] - 1.f ) );
+                }
+            }
+        }
+        LOGI("LPC vowel %d: F1-F3 found in %2d/%2d frames, worst error %4.1f%% %4.1f%% %4.1f%%, last %4.0f %4.0f %4.0f Hz",
+             v, found, frames, 100.f * error[0], 100.f * error[1], 100.f * error[2],
+             lpc.getFormant( 0 ), lpc.getFormant( 1 ), lpc.getFormant( 2 ));
+    }
+
+    // MPM on vowels from MIDI 40 to 76
+    const float breaths[] = { 0.005f, 0.05f };
+    for( float breath : breaths ) {
+        for( int d=0; d < 2; ++d ) {
+            PitchEstimator2* mpm = new PitchEstimator2( DSP_TEST_N );
+            mpm->setPrewhitening( d == 1 );
+            DSP* dsp = (DSP*) mpm;
+            dsp->setSamplingRate( DSP_TEST_R );
+            float x[ DSP_TEST_N ];
+            float* out = new float[ dsp->getProcessOutputLen() ];
+            int frames = 0, voiced = 0, gross = 0, octave = 0;
+            int64_t ns = 0;
+            srand( 1 );
+            for( int v=0; v < 5; ++v ) {
+                VoiceState vs = {};
+                for( int note = 40; note <= 76; ++note ) {
+                    float f0 = 440.f * powf( 2.f, (note - 69) / 12.f );
+                    for( int k=0; k < framesPerNote; ++k ) {
+                        synth_vowel_continuous( x, DSP_TEST_N, DSP_TEST_R, f0, vowels[v], bandwidths, 3, breath, &vs );
+                        int64_t nsStart = cnanos();
+                        dsp->process( x, DSP_TEST_N, out );
+                        ns += cnanos() - nsStart;
+                        ++frames;
+                        float p = dsp->getPitch();
+                        if( p > 0 && k > 0 ) {
+                            ++voiced;
+                            float cents = 1200.f * log2f( p / f0 );
+                            if( fabsf( cents ) > 50.f ) {
+                                ++gross;
+                                if( fabsf( fabsf( cents ) - 1200.f ) < 50.f ) ++octave;
+                            }
+                        }
+                    }
+                }
+            }
+            LOGI("%-28s breath %.3f: voiced %4d gross %4d octave %4d / %4d frames  %8.0f ns/frame",
+                 d ? "PitchEstimator2 prewhitened" : "PitchEstimator2", breath, voiced, gross, octave, frames,
+                 (double)ns / frames);
+            delete[] out;
+            delete mpm;
+        }
+    }
+
+    // cost per stage and order
+    const int orders[] = { 8, 12, 16, 24 };
+    for( int order : orders ) {
+        LinearPredictor lpc( order );
+        VoiceState vs = {};
+        float x[ DSP_TEST_N ], work[ DSP_TEST_N ], r[ LPC_MAX_ORDER + 2 ];
+        synth_vowel_continuous( x, DSP_TEST_N, DSP_TEST_R, 150.f, vowels[0], bandwidths, 3, 0.005f, &vs );
+        LinearPredictor::autocorrelate( x, DSP_TEST_N, r, order, work );
+        const int runs = 10000;
+        int64_t t0 = cnanos();
+        for( int n=0; n < runs; ++n ) {
+            r[0] += 1e-9f;
+            lpc.analyse( r, DSP_TEST_R );
+        }
+        int64_t t1 = cnanos();
+        for( int n=0; n < runs; ++n ) {
+            lpc.findFormants( DSP_TEST_R );
+        }
+        int64_t t2 = cnanos();
+        for( int n=0; n < runs; ++n ) {
+            lpc.whiten( x, DSP_TEST_N, work );
+        }
+        int64_t t3 = cnanos();
+        for( int n=0; n < runs; ++n ) {
+            LinearPredictor::autocorrelate( x, DSP_TEST_N, r, order, work );
+        }
+        int64_t t4 = cnanos();
+        LOGI("LPC order %2d: Levinson-Durbin %6.0f ns, formants %6.0f ns (%d iterations), whiten %6.0f ns, windowed ACF %6.0f ns",
+             order, (double)(t1 - t0) / runs, (double)(t2 - t1) / runs, lpc.getRootIterations(),
+             (double)(t3 - t2) / runs, (double)(t4 - t3) / runs);
+    }
+}
+
+/*
+ * TripleBuffer with a writer thread standing in for the analysis thread and a reader thread standing
+ * in for the UI: every frame is filled with its sequence number and a varying length, the reader
+ * checks that no frame it acquires is torn or older than the previous one. Then the cost of a publish
+ * and an acquire next to copying the frame, what getDspOutput did twice per frame.
+ */
+static void test_triple_buffer( )
+{
+    const int capacity = 1024;
+    const int frames = 200000;
+    TripleBuffer tb( capacity );
+    std::atomic<bool> done( false );
+    int torn = 0, older = 0, seen = 0, repeated = 0, lastSequence = 0;
+
+    std::thread reader( [&]() {
+        while( !done.load( std::memory_order_acquire ) || lastSequence < frames ) {
+            int slot = tb.acquire();
+            int sequence = tb.getSequence( slot );
+            if( sequence == 0 ) { std::this_thread::yield(); continue; }
+            if( sequence < lastSequence ) ++older;
+            if( sequence == lastSequence ) { ++repeated; std::this_thread::yield(); continue; }
+            const float* f = tb.getFrame( slot );
+            int len = tb.getLength( slot );
+            if( len != 1 + sequence % capacity ) ++torn;
+            for( int n=0; n < len; ++n ) {
+                if( f[n] != (float)sequence ) { ++torn; break; }
+            }
+            lastSequence = sequence;
+            ++seen;
+        }
+    } );
+    for( int k=1; k <= frames; ++k ) {
+        float* back = tb.beginWrite();
+        int len = 1 + k % capacity;
+        for( int n=0; n < len; ++n ) back[n] = (float)k;
+        tb.publish( len );
+        // lets the reader in between frames on a single core
+        if( k % 4 == 0 ) std::this_thread::yield();
+    }
+    done.store( true, std::memory_order_release );
+    reader.join();
+    LOGI("TripleBuffer: %d frames written, %d read (%d repeated acquires), %d torn, %d out of order, last %d",
+         frames, seen, repeated, torn, older, lastSequence);
+
+    // single threaded cost per frame
+    const int reps = 100000;
+    const int len = 512;
+    float* src = new float[ len ];
+    float* dst = new float[ len ];
+    for( int n=0; n < len; ++n ) src[n] = (float)n;
+    int64_t t0 = cnanos();
+    int sum = 0;
+    for( int k=0; k < reps; ++k ) {
+        tb.beginWrite()[0] = (float)k;
+        tb.publish( len );
+        sum += tb.acquire();
+    }
+    int64_t t1 = cnanos();
+    for( int k=0; k < reps; ++k ) {
+        src[0] = (float)k;
+        memcpy( dst, src, sizeof(float) * len );
+        sum += (int)dst[k % len];
+    }
+    int64_t t2 = cnanos();
+    LOGI("TripleBuffer: publish + acquire %.1f ns, copy of %d floats %.1f ns (%d)",
+         (double)(t1 - t0) / reps, len, (double)(t2 - t1) / reps, sum & 1);
+    delete[] src;
+    delete[] dst;
+}
+
+/*
+ * Seqlock<AnalysisSnapshot> with one writer and 3 concurrent readers: every field of snapshot k is
+ * derived from k, a reader counts loads that mix two snapshots and snapshots older than the last one
+ * it saw. Then the cost of an uncontended store and load.
+ */
+static void test_seqlock( )
+{
+    const int stores = 1000000;
+    const int readersN = 3;
+    Seqlock<AnalysisSnapshot> published;
+    std::atomic<bool> done( false );
+    int torn[readersN] = { 0 }, older[readersN] = { 0 }, loads[readersN] = { 0 }, retries[readersN] = { 0 };
+
+    std::vector<std::thread> readers;
+    for( int r=0; r < readersN; ++r ) {
+        readers.push_back( std::thread( [&, r]() {
+            int64_t last = 0;
+            while( !done.load( std::memory_order_acquire ) ) {
+                AnalysisSnapshot s;
+                if( !published.tryLoad( s ) ) {
+                    ++retries[r];
+                    continue;
+                }
+                ++loads[r];
+                if( s.frame < last ) ++older[r];
+                last = s.frame;
+                int32_t k = (int32_t)s.frame;
+                if( s.captureNanos != 3 * s.frame || s.pitch != (float)(k & 0xffff) || s.clarity != (float)(k & 0xff)
+                    || s.noteHz != -(float)(k & 0xffff) || s.cents != (float)(k & 0xfff) || s.note != k || s.gate != (k & 1) ) {
+                    ++torn[r];
+                }
+                if( (loads[r] & 63) == 0 ) std::this_thread::yield();
+            }
+        } ) );
+    }
+    for( int k=1; k <= stores; ++k ) {
+        AnalysisSnapshot s;
+        s.frame = k;
+        s.captureNanos = 3LL * k;
+        s.pitch = (float)(k & 0xffff);
+        s.clarity = (float)(k & 0xff);
+        s.noteHz = -(float)(k & 0xffff);
+        s.cents = (float)(k & 0xfff);
+        s.note = k;
+        s.gate = k & 1;
+        published.store( s );
+        // lets the readers in between stores on a single core
+        if( (k & 255) == 0 ) std::this_thread::yield();
+    }
+    done.store( true, std::memory_order_release );
+    for( std::thread& t : readers ) t.join();
+    for( int r=0; r < readersN; ++r ) {
+        LOGI("Seqlock reader %d: %d loads, %d retries, %d torn, %d out of order", r, loads[r], retries[r], torn[r], older[r]);
+    }
+    LOGI("Seqlock: %u stores, last frame %lld", published.getStores(), (long long)published.load().frame);
+
+    const int reps = 1000000;
+    AnalysisSnapshot s = {};
+    int64_t t0 = cnanos();
+    for( int k=0; k < reps; ++k ) {
+        s.frame = k;
+        published.store( s );
+    }
+    int64_t t1 = cnanos();
+    int64_t sum = 0;
+    for( int k=0; k < reps; ++k ) {
+        sum += published.load().frame;
+    }
+    int64_t t2 = cnanos();
+    LOGI("Seqlock: store %.1f ns, load %.1f ns (%d)", (double)(t1 - t0) / reps, (double)(t2 - t1) / reps, (int)(sum & 1));
+}
+
+/*
+ * NoteEventQueue between a producer thread standing in for the analysis thread and a consumer that
+ * blocks in drain(): bursts of numbered events must arrive complete and in order, the time from a
+ * push to the return of drain() is the wakeup latency, a queue without a consumer counts what it
+ * drops. Then NoteEventGenerator on a scripted phrase.
+ */
+static void test_note_events( )
+{
+    // ordering and loss, bursts of 1..64 events with pauses in between
+    {
+        NoteEventQueue q;
+        const int total = 200000;
+        int received = 0, outOfOrder = 0, timeouts = 0, drains = 0;
+        std::thread consumer( [&]() {
+            NoteEvent events[64];
+            int expect = 0;
+            for( ;; ) {
+                int n = q.drain( events, 64, 100 );
+                if( n < 0 ) break;
+                if( n == 0 ) { ++timeouts; continue; }
+                ++drains;
+                for( int k=0; k < n; ++k ) {
+                    int seq = (int)events[k].nanos;
+                    if( seq != expect ) ++outOfOrder;
+                    expect = seq + 1;
+                    ++received;
+                }
+            }
+        } );
+        srand( 5 );
+        for( int k=0; k < total; ) {
+            int burst = 1 + rand() % 64;
+            for( int b=0; b < burst && k < total; ++b, ++k ) {
+                NoteEvent e = { k, NOTE_EVENT_NOTE_ON, (uint8_t)(k & 0x7F), 100 };
+                while( q.size() >= NOTE_EVENT_QUEUE_LENGTH ) std::this_thread::yield();
+                q.push( e );
+            }
+            if( rand() % 8 == 0 ) std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+            else std::this_thread::yield();
+        }
+        q.close();
+        consumer.join();
+        LOGI("NoteEventQueue: %d pushed, %d received in %d drains, %d out of order, %lld dropped, %d timeouts",
+             total, received, drains, outOfOrder, (long long)q.getDropped(), timeouts);
+    }
+
+    // wakeup latency of a sleeping consumer
+    {
+        NoteEventQueue q;
+        const int total = 500;
+        std::vector<int64_t> latency;
+        std::thread consumer( [&]() {
+            NoteEvent e;
+            for( ;; ) {
+                int n = q.drain( &e, 1, 100 );
+                if( n < 0 ) break;
+                if( n > 0 ) latency.push_back( cnanos() - e.nanos );
+            }
+        } );
+        for( int k=0; k < total; ++k ) {
+            std::this_thread::sleep_for( std::chrono::microseconds( 2000 ) );
+            NoteEvent e = { cnanos(), NOTE_EVENT_NOTE_ON, 60, 100 };
+            q.push( e );
+        }
+        q.close();
+        consumer.join();
+        std::sort( latency.begin(), latency.end() );
+        LOGI("NoteEventQueue wakeup: %d events, median %lld us, 99%% %lld us, max %lld us", (int)latency.size(),
+             (long long)latency[ latency.size() / 2 ] / 1000, (long long)latency[ latency.size() * 99 / 100 ] / 1000,
+             (long long)latency.back() / 1000);
+    }
+
+    // overflow without a consumer
+    {
+        NoteEventQueue q;
+        NoteEvent e = { 0, NOTE_EVENT_NOTE_ON, 60, 100 };
+        for( int k=0; k < NOTE_EVENT_QUEUE_LENGTH + 44; ++k ) q.push( e );
+        LOGI("NoteEventQueue overflow: %lld pushed, %lld dropped (expect 44)", (long long)q.getPushed(), (long long)q.getDropped());
+        // the first drain after it logs the 44 once, the next one nothing
+        NoteEvent pending[ NOTE_EVENT_QUEUE_LENGTH ];
+        int drained = q.drain( pending, NOTE_EVENT_QUEUE_LENGTH, 0 );
+        drained += q.drain( pending, NOTE_EVENT_QUEUE_LENGTH, 0 );
+        LOGI("NoteEventQueue overflow: %d drained", drained);
+    }
+
+    // a phrase at 43 frames per second: silence, onset, 60, 60, 62, unvoiced, onset that never gets a pitch
+    {
+        NoteEventQueue q;
+        NoteEventGenerator g( q );
+        const int64_t frame = 23219955;     // 256 / 11025 s
+        struct Frame { int note; bool onset; float db; };
+        const Frame phrase[] = {
+            { 0, false, -70 }, { 0, true, -20 }, { 60, false, -20 }, { 60, false, -10 }, { 62, false, -10 },
+            { 0, false, -70 }, { 0, true, -20 }, { 0, false, -30 }, { 0, false, -30 }, { 0, false, -30 },
+        };
+        int64_t t = 0;
+        for( const Frame& f : phrase ) {
+            g.process( t, f.note, f.onset, f.db );
+            g.bend( t, f.note, PITCHBEND_CENTER );
+            t += frame;
+        }
+        NoteEvent events[64];
+        int n = q.drain( events, 64, 0 );
+        char line[512];
+        int pos = 0;
+        for( int k=0; k < n && pos < 480; ++k ) {
+            const char* name = events[k].status == NOTE_EVENT_NOTE_ON ? "on" : events[k].status == NOTE_EVENT_NOTE_OFF ? "off"
+                             : events[k].status == NOTE_EVENT_PITCH_BEND ? "bend" : "cc";
+            pos += snprintf( line + pos, sizeof(line) - pos, " %s %d@%d", name, events[k].data1, (int)(events[k].nanos / frame) );
+        }
+        LOGI("NoteEventGenerator phrase:%s", line);
+    }
+}
+
+/*
+ * MidiEngine with a loopback and a file sink. A phrase of 10 notes with bends runs through
+ * NoteEventGenerator, the frames are read with 0..15 ms of random scheduling delay and an audio clock
+ * 50 ppm off the monotonic clock. The delivery times of MidiClock stamps are compared with the
+ * capture times plus the latency, next to what stamping at read time would give.
+ */
+static void test_midi_engine( )
+{
+    const float R = DSP_TEST_R;
+    const int N = DSP_TEST_N;
+    const int64_t latency = MIDI_ENGINE_LATENCY_MS * 1000000LL;
+    NoteEventQueue q;
+    NoteEventGenerator g( q );
+    LoopbackMidiSink loopback;
+    MidiEngine engine( q );
+    engine.start( &loopback, 5, 42 );
+
+    MidiClock clock;
+    srand( 3 );
+    const int64_t t0 = cnanos() + 1000000000LL;
+    const double ppm = 50e-6;
+    std::vector<int64_t> truth;             // capture time of the frame of every event, in push order
+    std::vector<int64_t> readStamped;
+    int64_t samples = 0;
+    int frames = 0;
+    for( int note=0; note < 10; ++note ) {
+        for( int k=0; k < 40; ++k, ++frames ) {
+            samples += N;
+            int64_t captureStart = t0 + (int64_t)((samples - N) * 1e9 / R * (1.0 + ppm));
+            int64_t captureEnd = t0 + (int64_t)(samples * 1e9 / R * (1.0 + ppm));
+            int64_t read = captureEnd + (int64_t)(15e6 * rand() / (RAND_MAX + 1.0));
+            clock.update( samples, read, R );
+            int mapped = k < 30 ? 60 + note : 0;
+            uint32_t before = (uint32_t)q.getPushed();
+            g.process( clock.nanos( samples - N ), mapped, false, -20.f );
+            if( mapped > 0 && k % 5 == 0 ) g.bend( clock.nanos( samples - N ), mapped, PITCHBEND_CENTER + 100 * k );
+            for( uint32_t e = before; e < (uint32_t)q.getPushed(); ++e ) {
+                truth.push_back( captureStart );
+                readStamped.push_back( read - (int64_t)(N * 1e9 / R) );
+            }
+            // the engine thread drains while the phrase goes on
+            if( k % 8 == 0 ) std::this_thread::yield();
+        }
+    }
+    engine.stop();
+
+    std::vector<MidiMessage> m = loopback.getMessages();
+    // program change first, all notes off last and not before the last event, the events in between
+    bool framing = m.size() == truth.size() + 2 && m.front().bytes[0] == 0xC5 && m.front().bytes[1] == 42
+                   && m.back().bytes[0] == 0xB5 && m.back().bytes[1] == MIDI_ALL_NOTES_OFF
+                   && m.back().nanos >= m[ m.size() - 2 ].nanos;
+    int wrongChannel = 0, outOfOrder = 0;
+    double worst = 0, worstRead = 0, sum = 0, sumRead = 0;
+    int settled = 0;
+    for( size_t i=1; i + 1 < m.size() && i - 1 < truth.size(); ++i ) {
+        if( (m[i].bytes[0] & 0x0F) != 5 ) ++wrongChannel;
+        if( i > 1 && m[i].nanos < m[i-1].nanos ) ++outOfOrder;
+        // the first tenth of the events is the anchor settling on the earliest read, left out of both
+        if( i <= m.size() / 10 ) continue;
+        double err = fabs( (double)(m[i].nanos - latency - truth[i-1]) ) / 1e6;
+        double errRead = fabs( (double)(readStamped[i-1] - truth[i-1]) ) / 1e6;
+        worst = std::max( worst, err );
+        worstRead = std::max( worstRead, errRead );
+        sum += err;
+        sumRead += errRead;
+        ++settled;
+    }
+    int n = (int)truth.size();
+    LOGI("MidiEngine: %d frames, %d events, %d messages, framing %d, %d wrong channel, %d out of order, %lld late",
+         frames, n, (int)m.size(), framing, wrongChannel, outOfOrder, (long long)engine.getLate());
+    LOGI("MidiEngine timestamps vs capture, last %d events: sample clock mean %.2f ms max %.2f ms, read time mean %.2f ms max %.2f ms",
+         settled, sum / std::max( settled, 1 ), worst, sumRead / std::max( settled, 1 ), worstRead);
+
+    // the same phrase into a file
+    const char* path = "/tmp/dsp_test_midi.txt";
+    {
+        FileMidiSink file( path );
+        MidiEngine fileEngine( q );
+        fileEngine.start( &file, 0 );
+        g.reset();
+        // a phrase that was captured during the last 20 frames, all notes off is sent now
+        const int64_t start = cnanos() - 20 * 23219955LL;
+        for( int k=0; k < 20; ++k ) {
+            g.process( start + k * 23219955LL, k < 15 ? 64 : 0, false, -20.f );
+        }
+        fileEngine.stop();
+    }
+    FILE* f = fopen( path, "r" );
+    int lines = 0;
+    char line[64], first[64] = "", last[64] = "";
+    while( f != NULL && fgets( line, sizeof(line), f ) ) {
+        if( lines == 0 ) strcpy( first, line );
+        strcpy( last, line );
+        ++lines;
+    }
+    if( f != NULL ) fclose( f );
+    first[ strcspn( first, "\n" ) ] = 0;
+    last[ strcspn( last, "\n" ) ] = 0;
+    LOGI("FileMidiSink: %d lines, first \"%s\", last \"%s\"", lines, first, last);
+}
+
+struct SmfTestEvent
+{
+    int     track;
+    int64_t tick;
+    uint8_t bytes[3];
+    int     count;
+};
+
+// a minimal Standard MIDI File reader, channel messages with running status, meta and sysex skipped
+static bool parse_smf( const char* path, int& format, int& ppq, int& tempoUs, std::vector<int>& trackEvents,
+                       std::vector<SmfTestEvent>& events )
+{
+    std::vector<uint8_t> d;
+    FILE* f = fopen( path, "rb" );
+    if( f == NULL ) return false;
+    int c;
+    while( (c = fgetc( f )) != EOF ) d.push_back( (uint8_t)c );
+    fclose( f );
+    size_t p = 0;
+    auto u32 = [&]() { uint32_t v = (d[p] << 24) | (d[p+1] << 16) | (d[p+2] << 8) | d[p+3]; p += 4; return v; };
+    auto u16 = [&]() { uint32_t v = (d[p] << 8) | d[p+1]; p += 2; return v; };
+    auto varLen = [&]() { uint32_t v = 0; uint8_t b; do { b = d[p++]; v = (v << 7) | (b & 0x7F); } while( b & 0x80 ); return v; };
+    if( d.size() < 14 || memcmp( &d[0], "MThd", 4 ) != 0 ) return false;
+    p = 4;
+    if( u32() != 6 ) return false;
+    format = u16();
+    int tracks = u16();
+    ppq = u16();
+    tempoUs = 0;
+    trackEvents.clear();
+    events.clear();
+    for( int t=0; t < tracks; ++t ) {
+        if( p + 8 > d.size() || memcmp( &d[p], "MTrk", 4 ) != 0 ) return false;
+        p += 4;
+        size_t end = p + u32();
+        if( end > d.size() ) return false;
+        int64_t tick = 0;
+        uint8_t status = 0;
+        int n = 0;
+        bool endOfTrack = false;
+        while( p < end && !endOfTrack ) {
+            tick += varLen();
+            if( d[p] & 0x80 ) status = d[p++];
+            if( status == 0xFF ) {
+                uint8_t type = d[p++];
+                uint32_t len = varLen();
+                if( type == 0x51 && len == 3 ) tempoUs = (d[p] << 16) | (d[p+1] << 8) | d[p+2];
+                endOfTrack = type == 0x2F;
+                p += len;
+                status = 0;
+            } else if( status == 0xF0 || status == 0xF7 ) {
+                p += varLen();
+                status = 0;
+            } else if( status >= 0x80 ) {
+                SmfTestEvent e;
+                e.track = t;
+                e.tick = tick;
+                e.bytes[0] = status;
+                e.count = (status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0 ? 2 : 3;
+                for( int i=1; i < e.count; ++i ) e.bytes[i] = d[p++];
+                if( e.count < 3 ) e.bytes[2] = 0;
+                events.push_back( e );
+                ++n;
+            } else {
+                return false;
+            }
+        }
+        if( !endOfTrack || p != end ) return false;
+        trackEvents.push_back( n );
+    }
+    return p == d.size();
+}
+
+static void test_smf_recorder( )
+{
+    // the engine into a device and the recorder at once, the file must hold what the device got
+    const char* path0 = "/tmp/dsp_test_type0.mid";
+    NoteEventQueue q;
+    NoteEventGenerator g( q );
+    LoopbackMidiSink loopback;
+    SmfRecorder smf;
+    TeeMidiSink tee;
+    tee.set( 0, &loopback );
+    tee.set( 1, &smf );
+    MidiEngine engine( q );
+    smf.start( path0, 0 );
+    engine.start( &tee, 2, 7 );
+    const int64_t t0 = cnanos();
+    int64_t t = t0;
+    for( int note=0; note < 8; ++note ) {
+        for( int k=0; k < 30; ++k ) {
+            t += 23219955LL;
+            int mapped = k < 20 ? 60 + note : 0;
+            g.process( t, mapped, false, -30.f + k );
+            if( mapped > 0 && k % 3 == 0 ) g.bend( t, mapped, PITCHBEND_CENTER + 50 * k );
+            if( k % 8 == 0 ) std::this_thread::yield();
+        }
+        // rests of a few seconds need multi-byte delta times
+        t += (note + 1) * 1700000000LL;
+    }
+    engine.stop();
+    tee.set( 1, NULL );
+    bool written = smf.stop();
+
+    std::vector<MidiMessage> m = loopback.getMessages();
+    int format, ppq, tempoUs;
+    std::vector<int> trackEvents;
+    std::vector<SmfTestEvent> e;
+    bool parsed = parse_smf( path0, format, ppq, tempoUs, trackEvents, e );
+    int wrongBytes = 0, wrongTicks = 0;
+    bool sameCount = parsed && e.size() == m.size();
+    for( size_t i=1; sameCount && i < m.size(); ++i ) {
+        if( memcmp( e[i].bytes, m[i].bytes, 3 ) != 0 ) ++wrongBytes;
+        // the all notes off is stamped at stop(), before the delivery time of the last notes
+        if( i + 1 < m.size() ) {
+            int64_t expect = SmfRecorder::ticks( m[i].nanos - m[1].nanos );
+            if( llabs( (e[i].tick - e[1].tick) - expect ) > 1 ) ++wrongTicks;
+        }
+    }
+    LOGI("SmfRecorder type 0: written %d, parsed %d, format %d, ppq %d, tempo %d us, %d tracks, %d events of %d sent, %d wrong bytes, %d wrong ticks, %lld dropped",
+         written, parsed, format, ppq, tempoUs, (int)trackEvents.size(), (int)e.size(), (int)m.size(), wrongBytes, wrongTicks,
+         (long long)smf.getDropped());
+
+    // type 1 from a producer thread, one track per channel in order of the channels
+    const char* path1 = "/tmp/dsp_test_type1.mid";
+    smf.start( path1, 1 );
+    const int channels[3] = { 9, 0, 3 };
+    const int perChannel = 2000;
+    const int64_t start = cnanos();
+    std::thread producer( [&]() {
+        for( int i=0; i < perChannel; ++i ) {
+            for( int c=0; c < 3; ++c ) {
+                uint8_t b[3] = { (uint8_t)((i & 1 ? 0x80 : 0x90) | channels[c]), (uint8_t)(40 + c), (uint8_t)(i % 128) };
+                smf.send( b, 3, start + i * 5000000LL );
+            }
+            // a dense phrase, about 100 messages per ms, the arena holds a pass of the writer
+            if( i % 32 == 0 ) std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+        }
+    } );
+    producer.join();
+    written = smf.stop();
+    parsed = parse_smf( path1, format, ppq, tempoUs, trackEvents, e );
+    int misplaced = 0;
+    wrongTicks = 0;
+    for( size_t i=0; parsed && i < e.size(); ++i ) {
+        int track = e[i].track;
+        int c = track >= 1 && track <= 3 ? (track == 1 ? 0 : track == 2 ? 3 : 9) : -1;
+        int k = (int)(i % perChannel);
+        if( (e[i].bytes[0] & 0x0F) != c || e[i].bytes[1] != 40 + (c == 9 ? 0 : c == 0 ? 1 : 2) || e[i].bytes[2] != k % 128 ) ++misplaced;
+        if( llabs( (e[i].tick - e[i - k].tick) - SmfRecorder::ticks( k * 5000000LL ) ) > 1 ) ++wrongTicks;
+    }
+    LOGI("SmfRecorder type 1: written %d, parsed %d, format %d, %d tracks (%d %d %d %d events), %d events of %d sent, %d misplaced, %d wrong ticks, %lld dropped",
+         written, parsed, format, (int)trackEvents.size(), trackEvents.size() > 0 ? trackEvents[0] : -1,
+         trackEvents.size() > 1 ? trackEvents[1] : -1, trackEvents.size() > 2 ? trackEvents[2] : -1,
+         trackEvents.size() > 3 ? trackEvents[3] : -1, (int)e.size(), 3 * perChannel, misplaced, wrongTicks,
+         (long long)smf.getDropped());
+}
+
+// the reduction of Decimator, one sample at a time with log10f
+static void decimate_reference( const Decimator& layout, const float* in, int width, int scale, float* out )
+{
+    Decimator& d = const_cast<Decimator&>( layout );
+    for( int c=0; c < width; ++c ) {
+        float lo = INFINITY, hi = -INFINITY, sum = 0;
+        for( int n = d.getStart( c ); n < d.getEnd( c ); ++n ) {
+            float x = in[n];
+            if( scale & DECIMATOR_DB ) x = std::max( DECIMATOR_DB_FLOOR, 20.f * log10f( fabsf( x ) ) );
+            lo = std::min( lo, x );
+            hi = std::max( hi, x );
+            sum += x;
+        }
+        out[c] = lo;
+        out[width + c] = hi;
+        out[2 * width + c] = sum / (d.getEnd( c ) - d.getStart( c ));
+    }
+}
+
+static void test_decimator( )
+{
+    const int lengths[] = { 7, 256, 1000, 4096 };
+    const int widths[] = { 1, 100, 720, 1080, 5000 };
+    const int scales[] = { DECIMATOR_LINEAR, DECIMATOR_DB, DECIMATOR_LOG_FREQUENCY, DECIMATOR_LOG_FREQUENCY | DECIMATOR_DB };
+    srand( 5 );
+    std::vector<float> x( 4096 ), fast, reference;
+    for( int scale : scales ) {
+        int cases = 0, badLayout = 0;
+        double worstMinMax = 0, worstMean = 0;
+        for( int len : lengths ) {
+            for( int width : widths ) {
+                for( int n=0; n < len; ++n ) {
+                    x[n] = (float)rand() / RAND_MAX * 2.f - 1.f;
+                }
+                x[len / 2] = 0.f;
+                int from = (scale & DECIMATOR_LOG_FREQUENCY) ? 0 : len / 8;
+                Decimator d;
+                fast.assign( 3 * width, 0.f );
+                reference.assign( 3 * width, 0.f );
+                d.process( &x[0], from, len, width, scale, &fast[0] );
+                decimate_reference( d, &x[0], width, scale, &reference[0] );
+                // the columns cover the range in order, none empty, the last ends at len
+                for( int c=0; c < width; ++c ) {
+                    if( d.getEnd( c ) <= d.getStart( c ) || d.getStart( c ) < std::max( from, (scale & DECIMATOR_LOG_FREQUENCY) ? 1 : 0 )
+                        || (c > 0 && d.getStart( c ) < d.getStart( c - 1 )) ) ++badLayout;
+                }
+                if( d.getEnd( width - 1 ) != len ) ++badLayout;
+                for( int c=0; c < width; ++c ) {
+                    worstMinMax = std::max( worstMinMax, (double)fabsf( fast[c] - reference[c] ) );
+                    worstMinMax = std::max( worstMinMax, (double)fabsf( fast[width + c] - reference[width + c] ) );
+                    worstMean = std::max( worstMean, (double)fabsf( fast[2 * width + c] - reference[2 * width + c] ) );
+                }
+                ++cases;
+            }
+        }
+        LOGI("Decimator scale %d: %d cases, %d bad columns, worst min/max error %.6f, worst mean error %.6f (%s)",
+             scale, cases, badLayout, worstMinMax, worstMean, scale & DECIMATOR_DB ? "dB" : "linear");
+    }
+}
+
+static void bench_decimator( )
+{
+    const int len = 4096;
+    const int runs = 2000;
+    std::vector<float> x( len ), out( 3 * len );
+    srand( 6 );
+    for( int n=0; n < len; ++n ) x[n] = (float)rand() / RAND_MAX;
+    const int widths[] = { 1080, 1080, 128 };
+    const int scales[] = { DECIMATOR_LINEAR, DECIMATOR_LOG_FREQUENCY | DECIMATOR_DB, DECIMATOR_LINEAR };
+    for( int i=0; i < 3; ++i ) {
+        int width = widths[i];
+        int scale = scales[i];
+        Decimator d;
+        d.process( &x[0], 0, len, width, scale, &out[0] );
+        int64_t t0 = cnanos();
+        for( int k=0; k < runs; ++k ) {
+            d.process( &x[0], 0, len, width, scale, &out[0] );
+        }
+        int64_t t1 = cnanos();
+        for( int k=0; k < runs; ++k ) {
+            decimate_reference( d, &x[0], width, scale, &out[0] );
+        }
+        int64_t t2 = cnanos();
+        LOGI("Decimator %d samples to %d columns, scale %d: %6.1f us, scalar reference %6.1f us, %d floats and %d lines instead of %d",
+             len, width, scale, (t1 - t0) / 1e3 / runs, (t2 - t1) / 1e3 / runs, 3 * width, 2 * width, len);
+    }
+}
+
+// keeps the snapshot of every frame
+class RecordingAnalysis : public AnalysisEngine
+{
+public:
+    RecordingAnalysis( AudioSource* source ) : AnalysisEngine( source ) { }
+    std::vector<AnalysisSnapshot> frames;
+
+protected:
+    virtual void onFrame( DSP* /*processor*/, const float* /*out*/, int /*len*/, const AnalysisSnapshot& snapshot ) {
+        frames.push_back( snapshot );
+    }
+};
+
+// samples in memory delivered at the pace of a microphone
+class PacedAudioSource : public BufferAudioSource
+{
+public:
+    PacedAudioSource( const float* samples, int len, float R, int bufferLen ) : BufferAudioSource( samples, len, R, bufferLen ) { }
+    virtual bool isRealtime() { return true; }
+    virtual bool read( float* dest ) {
+        std::this_thread::sleep_for( std::chrono::microseconds( (int64_t)(1e6 * getBufferLength() / getSamplingRate()) ) );
+        return BufferAudioSource::read( dest );
+    }
+};
+
+static void test_analysis_engine( )
+{
+    const float R = DSP_TEST_R;
+    const int N = DSP_TEST_N;
+    const float pitches[] = { 110.f, 196.f, 330.f, 523.f, 262.f };
+    const int files = 5;
+    const int len = (int)(2.f * R);
+    std::vector<float> signals[ files ];
+    for( int f=0; f < files; ++f ) {
+        signals[f].resize( len );
+        VoiceState vs = {};
+        for( int n=0; n + N <= len; n += N ) {
+            synth_voice_continuous( &signals[f][n], N, R, pitches[f], 0.01f, &vs );
+        }
+    }
+    // the last one also as a 16 bit WAV file, the way the recorder dumps it
+    const char* wavPath = "/tmp/dsp_test_analysis.wav";
+    {
+        FileDevDumper wav;
+        wav.setPath( wavPath );
+        wav.openWav( 1, (int)R, 16 );
+        for( int n=0; n < len; ++n ) {
+            signals[files - 1][n] = std::max( -32768, std::min( 32767, (int)lrintf( signals[files - 1][n] * 16384.f ) ) ) / 32768.f;
+            wav.writeWavData( (int)lrintf( signals[files - 1][n] * 32768.f ) );
+        }
+        wav.closeWav();
+    }
+
+    // every file alone on this thread
+    std::vector<AnalysisSnapshot> reference[ files ];
+    for( int f=0; f < files; ++f ) {
+        RecordingAnalysis a( new BufferAudioSource( &signals[f][0], len, R, N ) );
+        a.setProcessingMode( ProcessingModes::PitchEstimation );
+        a.run();
+        reference[f] = a.frames;
+    }
+
+    // all at once, each on its session thread, the last from the WAV file, next to a live session
+    int64_t t0 = cnanos();
+    AnalysisHandle liveHandle = AnalysisRegistry::create( new RecordingAnalysis( new PacedAudioSource( &signals[0][0], len / 4, R, N ) ) );
+    std::shared_ptr<AnalysisEngine> liveSession = AnalysisRegistry::get( liveHandle );
+    liveSession->setProcessingMode( ProcessingModes::PitchEstimation );
+    liveSession->start();
+    AnalysisHandle handles[ files ];
+    for( int f=0; f < files; ++f ) {
+        AudioSource* source = f < files - 1 ? (AudioSource*) new BufferAudioSource( &signals[f][0], len, R, N )
+                                            : (AudioSource*) new WavFileAudioSource( wavPath, N );
+        handles[f] = AnalysisRegistry::create( new RecordingAnalysis( source ) );
+        AnalysisRegistry::get( handles[f] )->setProcessingMode( ProcessingModes::PitchEstimation );
+    }
+    for( int f=0; f < files; ++f ) {
+        AnalysisRegistry::get( handles[f] )->start();
+    }
+    int sessions = AnalysisRegistry::size();
+    for( int f=0; f < files; ++f ) {
+        std::shared_ptr<AnalysisEngine> s = AnalysisRegistry::get( handles[f] );
+        while( !s->isFinished() ) std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    }
+    int64_t t1 = cnanos();
+
+    int mismatches = 0, frameCounts = 0, wrongPitch = 0;
+    for( int f=0; f < files; ++f ) {
+        std::shared_ptr<AnalysisEngine> s = AnalysisRegistry::get( handles[f] );
+        const std::vector<AnalysisSnapshot>& got = ((RecordingAnalysis&)*s).frames;
+        // a source out of frames publishes nothing to the snapshot
+        if( got.size() != reference[f].size() || s->getFrameCount() != (int64_t)got.size() ) ++frameCounts;
+        for( size_t k=0; k < std::min( got.size(), reference[f].size() ); ++k ) {
+            if( memcmp( &got[k], &reference[f][k], sizeof(AnalysisSnapshot) ) != 0 ) ++mismatches;
+        }
+        // the middle frame is on the pitch of its own file
+        const AnalysisSnapshot& mid = got[ got.size() / 2 ];
+        if( fabsf( 1200.f * log2f( mid.pitch / pitches[f] ) ) > 20.f ) ++wrongPitch;
+        AnalysisRegistry::destroy( handles[f] );
+    }
+    // the live session runs on after its source ran dry, idling without counting frames, until it
+    // is destroyed while this thread still holds it
+    const int liveExpected = (len / 4 + N - 1) / N;
+    while( liveSession->getFrameCount() < liveExpected ) std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+    std::this_thread::sleep_for( std::chrono::milliseconds( 3 * ANALYSIS_IDLE_MS ) );
+    int liveCount = (int)liveSession->getFrameCount();
+    const std::vector<AnalysisSnapshot>& liveGot = ((RecordingAnalysis&)*liveSession).frames;
+    int liveFrames = (int)liveGot.size(), liveMismatches = 0;
+    // the last frame is padded with zeros
+    for( int k=0; k < (len / 4) / N; ++k ) {
+        if( liveGot[k].pitch != reference[0][k].pitch || liveGot[k].note != reference[0][k].note ) ++liveMismatches;
+    }
+    bool liveRunning = !liveSession->isFinished();
+    AnalysisRegistry::destroy( liveHandle );
+    bool stale = !AnalysisRegistry::get( liveHandle ) && !AnalysisRegistry::get( handles[0] );
+    liveSession.reset();
+
+    LOGI("AnalysisEngine: %d sessions at once, %d files of %d frames in %.1f ms, %d frame counts off, %d frames differ from the file alone, %d wrong pitches",
+         sessions, files, (int)reference[0].size(), (t1 - t0) / 1e6, frameCounts, mismatches, wrongPitch);
+    LOGI("AnalysisEngine: live session %d of %d frames, count %d after idling, %d pitches differ from the file alone, still running %d, handles gone after destroy %d, %d left",
+         liveFrames, liveExpected, liveCount, liveMismatches, liveRunning, stale, AnalysisRegistry::size());
+}
+
+// a voice that never ends, read as fast as the analysis goes
+class LoopingAudioSource : public AudioSource
+{
+public:
+    LoopingAudioSource( const float* samples, int len, float R, int bufferLen ) :
+            samples( samples, samples + len ), R( R ), bufferLen( bufferLen ), position( 0 ) { }
+    virtual int getBufferLength() { return this->bufferLen; }
+    virtual float getSamplingRate() { return this->R; }
+    virtual bool live() { return true; }
+    virtual bool isRealtime() { return true; }
+    virtual bool read( float* dest ) {
+        for( int n=0; n < this->bufferLen; ++n ) {
+            dest[n] = this->samples[ this->position ];
+            this->position = (this->position + 1) % (int)this->samples.size();
+        }
+        return true;
+    }
+
+private:
+    std::vector<float>  samples;
+    float               R;
+    int                 bufferLen;
+    int                 position;
+};
+
+// checks every frame against the processor it went through
+class SwapCheckingAnalysis : public AnalysisEngine
+{
+public:
+    SwapCheckingAnalysis( AudioSource* source ) : AnalysisEngine( source ), frames( 0 ), raw( 0 ), wrongLength( 0 ),
+                                                  skipped( 0 ), lastFrame( 0 ), lastNanos( 0 ), maxGap( 0 ) { }
+    int64_t frames, raw, wrongLength, skipped, lastFrame, lastNanos, maxGap;
+
+protected:
+    virtual void onFrame( DSP* processor, const float* out, int len, const AnalysisSnapshot& snapshot ) {
+        int expected = processor != NULL ? processor->getProcessOutputLen() : getSource().getBufferLength();
+        if( len != expected ) ++wrongLength;
+        // touches the whole output, a processor deleted under the frame shows up in ASan and TSan
+        float sum = 0;
+        for( int n=0; n < len; ++n ) sum += out[n];
+        if( sum != sum ) ++wrongLength;
+        if( processor == NULL ) ++raw;
+        if( lastFrame != 0 && snapshot.frame != lastFrame + 1 ) ++skipped;
+        lastFrame = snapshot.frame;
+        int64_t now = cnanos();
+        if( lastNanos != 0 ) maxGap = std::max( maxGap, now - lastNanos );
+        lastNanos = now;
+        ++frames;
+    }
+};
+
+static void test_processor_swap( )
+{
+    const float R = DSP_TEST_R;
+    const int N = DSP_TEST_N;
+    const int toggles = 4000;
+    std::vector<float> signal( (int)R );
+    VoiceState vs = {};
+    for( int n=0; n + N <= (int)signal.size(); n += N ) {
+        synth_voice_continuous( &signal[n], N, R, 220.f, 0.01f, &vs );
+    }
+    const int modes[] = { ProcessingModes::RawAudioOnly, ProcessingModes::MagnitudeSpectrum,
+                          ProcessingModes::Autocorrelation, ProcessingModes::PitchEstimation };
+
+    SwapCheckingAnalysis session( new LoopingAudioSource( &signal[0], (int)signal.size(), R, N ) );
+    session.setNotesEnabled( true );
+    session.start();
+    // a second caller that only retunes, next to the mode changes of this thread
+    std::atomic<bool> tuning( true );
+    std::thread tuner( [&]() {
+        for( int k=0; tuning.load(); ++k ) {
+            session.setTuning( 430.f + (k % 20), k % 12, k & 1 ? NOTEMAP_MASK_CHROMATIC : 0xAB5 );
+            std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+        }
+    } );
+    int64_t t0 = cnanos();
+    uint32_t rng = 1;
+    for( int k=0; k < toggles; ++k ) {
+        rng = rng * 1664525u + 1013904223u;
+        int mode = modes[ (rng >> 16) % 4 ];
+        // half of them wait for the swap, half leave it to the builder thread
+        if( (rng >> 8) & 1 ) {
+            session.setProcessingMode( mode );
+        } else {
+            session.requestProcessingMode( mode );
+        }
+        // the note events, nobody else drains them
+        session.getNoteEvents().clear();
+    }
+    session.setProcessingMode( ProcessingModes::PitchEstimation );
+    int64_t t1 = cnanos();
+    int64_t before = session.getFrameCount();
+    while( session.getFrameCount() < before + 20 ) std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+    tuning.store( false );
+    tuner.join();
+    session.stop();
+    AnalysisSnapshot last = session.getSnapshot().load();
+
+    LOGI("ProcessorSwap: %d mode changes in %.1f ms, %lld swaps, mode %d at the end",
+         toggles, (t1 - t0) / 1e6, (long long)session.getSwaps(), session.getProcessingMode());
+    LOGI("ProcessorSwap: %lld frames, %lld of them raw, %lld of the wrong length, %lld skipped, longest gap %.2f ms, last pitch %.1f Hz",
+         (long long)session.frames, (long long)session.raw,
+         (long long)session.wrongLength, (long long)session.skipped, session.maxGap / 1e6, last.pitch);
+}
+
+/*
+ * The graphs of the modes against the processors they replace on vowels with silent gaps, a graph
+ * with several taps on one transform, and the checks of build().
+ */
+static void test_dsp_graph( )
+{
+    const float R = DSP_TEST_R;
+    const int N = DSP_TEST_N;
+    const int frames = 600;
+    const float vowel[3] = { 570, 840, 2410 };
+    const float bandwidths[3] = { 80, 100, 120 };
+    std::vector<float> signal( frames * N );
+    VoiceState vs = {};
+    srand( 5 );
+    for( int f=0; f < frames; ++f ) {
+        // a note every 20 frames, every fourth of them silent
+        float f0 = 440.f * powf( 2.f, (40 + (f / 20) * 7 % 36 - 69) / 12.f );
+        synth_vowel_continuous( &signal[ f * N ], N, R, f0, vowel, bandwidths, 3, 0.01f, &vs );
+        if( (f / 20) % 4 == 3 ) {
+            for( int n=0; n < N; ++n ) signal[ f * N + n ] *= 1e-4f;
+        }
+    }
+
+    // pitch: the decisions of PitchEstimator2 with refinement and prewhitening, retuned halfway
+    DSP* graph = (DSP*) DspGraph::forMode( ProcessingModes::PitchEstimation, N );
+    PitchEstimator2* estimator = new PitchEstimator2( N );
+    estimator->setRefinement( true );
+    estimator->setPrewhitening( true );
+    DSP* reference = (DSP*) estimator;
+    std::vector<float> outG( 2 * N ), outR( 2 * N );
+    int pitchDiffer = 0, noteDiffer = 0, candidateDiffer = 0, formantDiffer = 0, voiced = 0;
+    float acfDiff = 0;
+    int64_t nsGraph = 0, nsReference = 0;
+    for( DSP* d : { graph, reference } ) d->setSamplingRate( R );
+    for( int f=0; f < frames; ++f ) {
+        if( f == frames / 2 ) {
+            for( DSP* d : { graph, reference } ) {
+                d->getNoteMapper().setReference( 432.f );
+                d->getNoteMapper().setScaleMask( 0xAB5 );
+            }
+        }
+        int64_t t0 = cnanos();
+        graph->process( &signal[ f * N ], N, &outG[0] );
+        int64_t t1 = cnanos();
+        reference->process( &signal[ f * N ], N, &outR[0] );
+        int64_t t2 = cnanos();
+        nsGraph += t1 - t0;
+        nsReference += t2 - t1;
+
+        if( graph->getPitch() != reference->getPitch() || graph->getNacIndex() != reference->getNacIndex() ) ++pitchDiffer;
+        if( graph->getMidiNoteNumber() != reference->getMidiNoteNumber() || graph->getFractionalNote() != reference->getFractionalNote() ) ++noteDiffer;
+        PitchCandidate cg, cr;
+        int ng = graph->getPitchCandidates( &cg, 1 ), nr = reference->getPitchCandidates( &cr, 1 );
+        if( ng != nr || (ng > 0 && (cg.pitch != cr.pitch || cg.confidence != cr.confidence)) ) ++candidateDiffer;
+        float fg[ ANALYSIS_FORMANTS ], fr[ ANALYSIS_FORMANTS ];
+        graph->getFormants( fg, ANALYSIS_FORMANTS );
+        reference->getFormants( fr, ANALYSIS_FORMANTS );
+        if( memcmp( fg, fr, sizeof(fg) ) != 0 ) ++formantDiffer;
+        for( int n=0; n < N; ++n ) acfDiff = std::max( acfDiff, fabsf( outG[n] - outR[n] ) );
+        voiced += ng > 0;
+    }
+    LOGI("DspGraph pitch: %d frames, %d voiced, differs from PitchEstimator2 in pitch %d, note %d, candidate %d, formants %d frames, acf by %.1e; %6.0f against %6.0f ns/frame",
+         frames, voiced, pitchDiffer, noteDiffer, candidateDiffer, formantDiffer, acfDiff,
+         (double)nsGraph / frames, (double)nsReference / frames);
+    delete reference;
+    delete graph;
+
+    // the display modes against their processors
+    const int modes[] = { ProcessingModes::MagnitudeSpectrum, ProcessingModes::Autocorrelation };
+    for( int mode : modes ) {
+        graph = (DSP*) DspGraph::forMode( mode, N );
+        reference = mode == ProcessingModes::MagnitudeSpectrum ? (DSP*) new FastFourierTransformMagnitudeSpectrum( N )
+                                                               : (DSP*) new AutocorrelationNormalized( N );
+        float diff = 0;
+        for( int f=0; f < frames; f += 7 ) {
+            graph->process( &signal[ f * N ], N, &outG[0] );
+            reference->process( &signal[ f * N ], N, &outR[0] );
+            float peak = 0;
+            for( int n=0; n < reference->getProcessOutputLen(); ++n ) peak = std::max( peak, fabsf( outR[n] ) );
+            for( int n=0; n < reference->getProcessOutputLen(); ++n ) diff = std::max( diff, fabsf( outG[n] - outR[n] ) / std::max( peak, 1e-9f ) );
+        }
+        LOGI("DspGraph mode %d: output %d floats like %d, relative difference %.1e",
+             mode, graph->getProcessOutputLen(), reference->getProcessOutputLen(), diff);
+        delete reference;
+        delete graph;
+    }
+
+    // spectrum, ACF and pitch out of one pass, a tracker nothing reads is not scheduled
+    {
+        DspGraph g( N );
+        FftNode* fftNode = new FftNode( N );
+        int fft = g.add( fftNode, g.getFrame() );
+        int spectrum = g.addTap( g.add( new MagnitudeNode( N ), fft ) );
+        int acf = g.addTap( g.add( new AcfNode( N ), fft ) );
+        int gate = g.add( new GateNode( N ), g.getFrame() );
+        int lags = g.add( new CircularAcfNode( N, true ), g.getFrame(), gate );
+        PickerNode* picker = new PickerNode( N );
+        int pitch = g.add( picker, lags, g.getFrame(), gate );
+        g.add( new TrackerNode(), pitch );
+        // the note on a tracker added after it
+        int note = g.add( new NoteNode( ((DSP*)&g)->getNoteMapper() ), pitch + 3 );
+        g.add( new TrackerNode(), pitch );
+        g.setNote( note );
+        g.setDisplay( spectrum );
+        bool built = g.build();
+
+        DSP* magnitude = (DSP*) new FastFourierTransformMagnitudeSpectrum( N );
+        DSP* autocorrelation = (DSP*) new AutocorrelationNormalized( N );
+        DSP* tracked = (DSP*) new PitchTracked( (DSP*) new PitchEstimator2( N ) );
+        DSP* separate[] = { magnitude, autocorrelation, tracked };
+        ((DSP*)&g)->setSamplingRate( R );
+        for( DSP* d : separate ) d->setSamplingRate( R );
+        int64_t nsGraph = 0, nsSeparate = 0;
+        int pitchDiffer = 0;
+        for( int f=0; f < frames; ++f ) {
+            int64_t t0 = cnanos();
+            ((DSP*)&g)->process( &signal[ f * N ], N, &outG[0] );
+            int64_t t1 = cnanos();
+            for( DSP* d : separate ) d->process( &signal[ f * N ], N, &outR[0] );
+            int64_t t2 = cnanos();
+            nsGraph += t1 - t0;
+            nsSeparate += t2 - t1;
+            if( ((DSP*)&g)->getPitch() != tracked->getPitch() ) ++pitchDiffer;
+        }
+        LOGI("DspGraph one pass: built %d, %d of 11 nodes scheduled, %d floats, taps of %d and %d floats, %.2f forward transforms/frame, tracked pitch differs from PitchTracked in %d frames",
+             built, g.getScheduled(), g.getArenaLen(), g.getOutputLen( spectrum ), g.getOutputLen( acf ),
+             (double)fftNode->getContext().getForwardTransforms() / frames, pitchDiffer);
+        LOGI("DspGraph one pass: %6.0f ns/frame, the three processors %6.0f ns/frame",
+             (double)nsGraph / frames, (double)nsSeparate / frames);
+        for( DSP* d : separate ) delete d;
+    }
+
+    // what build() turns down
+    {
+        DspGraph cycle( N );
+        int a = cycle.add( new TrackerNode(), 2 );
+        cycle.add( new TrackerNode(), a );
+        cycle.setNote( cycle.add( new NoteNode( ((DSP*)&cycle)->getNoteMapper() ), a ) );
+        DspGraph type( N );
+        type.setDisplay( type.addTap( type.add( new MagnitudeNode( N ), type.getFrame() ) ) );
+        DspGraph count( N );
+        count.setDisplay( count.addTap( count.add( new PickerNode( N ), count.getFrame() ) ) );
+        bool built[3] = { cycle.build(), type.build(), count.build() };
+        LOGI("DspGraph build: cycle %d, wrong type %d, missing inputs %d (all 0 expected)", built[0], built[1], built[2]);
+    }
+}
+
+// a frame per iteration, each part with the estimator of its own
+struct PoolBatch
+{
+    const float*    frames;
+    int             N;
+    DSP**           estimators;     // by part
+    float*          pitches;
+    float*          scratch;        // 2N per part
+};
+
+static void pool_batch_frames( void* arg, int begin, int end, int part )
+{
+    PoolBatch* b = (PoolBatch*)arg;
+    for( int f = begin; f < end; ++f ) {
+        b->estimators[ part ]->process( (float*)&b->frames[ f * b->N ], b->N, &b->scratch[ part * 2 * b->N ] );
+        b->pitches[f] = b->estimators[ part ]->getPitch();
+    }
+}
+
+static void pool_zero( void* arg, int begin, int end, int /*part*/ )
+{
+    float* x = (float*)arg;
+    for( int n = begin; n < end; ++n ) x[n] = 0;
+}
+
+/*
+ * Dispatch of WorkerPool::parallelFor() against an OpenMP parallel for (with -fopenmp on the host,
+ * the Android build has no OpenMP): an empty range per thread, the 512 sample zeroing loop the
+ * estimators had under a pragma, and a batch of frames through one PitchEstimator2 per part.
+ */
+static void bench_worker_pool( )
+{
+    const int cores = std::max( 1, (int)std::thread::hardware_concurrency() );
+    const int workers = std::max( 1, cores - 1 );
+    const int N = DSP_TEST_N;
+    const int runs = 20000;
+    WorkerPool pool( workers, 1 );
+    int pinned = 0;
+    for( int w=0; w < workers; ++w ) pinned += pool.getCpu( w ) != WORKERPOOL_NO_CPU;
+    LOGI("WorkerPool: %d cores, %d workers, %d pinned", cores, workers, pinned);
+
+    // dispatch, one iteration per thread
+    std::vector<float> x( 2 * N, 1.f );
+    int64_t t0 = cnanos();
+    for( int r=0; r < runs; ++r ) pool.parallelFor( 0, workers + 1, 1, &pool_zero, &x[0] );
+    int64_t t1 = cnanos();
+    double omp = -1;
+#ifdef _OPENMP
+    {
+        int64_t o0 = cnanos();
+        for( int r=0; r < runs; ++r ) {
+            #pragma omp parallel for num_threads( workers + 1 )
+            for( int n=0; n < workers + 1; ++n ) x[n] = 0;
+        }
+        omp = (cnanos() - o0) / 1e3 / runs;
+    }
+#endif
+    LOGI("WorkerPool dispatch to %d threads: pool %6.2f us, OpenMP %6.2f us (-1 without -fopenmp)",
+         workers + 1, (t1 - t0) / 1e3 / runs, omp);
+
+    // the 2N zeroing loop, inline with the grain of a frame against split per element
+    t0 = cnanos();
+    for( int r=0; r < runs; ++r ) pool.parallelFor( 0, 2 * N, 2 * N, &pool_zero, &x[0] );
+    t1 = cnanos();
+    for( int r=0; r < runs; ++r ) pool.parallelFor( 0, 2 * N, 1, &pool_zero, &x[0] );
+    int64_t t2 = cnanos();
+    omp = -1;
+#ifdef _OPENMP
+    {
+        int64_t o0 = cnanos();
+        for( int r=0; r < runs; ++r ) {
+            #pragma omp parallel for
+            for( int n=0; n < 2 * N; ++n ) x[n] = 0;
+        }
+        omp = (cnanos() - o0) / 1e3 / runs;
+    }
+#endif
+    LOGI("WorkerPool %d floats zeroed: below the grain (inline) %6.3f us, split %6.2f us, OpenMP %6.2f us",
+         2 * N, (t1 - t0) / 1e3 / runs, (t2 - t1) / 1e3 / runs, omp);
+
+    // batched frames, the estimators of the parts are independent
+    const int frames = 64;
+    std::vector<float> signal( frames * N );
+    VoiceState vs = {};
+    srand( 9 );
+    for( int f=0; f < frames; ++f ) {
+        synth_voice_continuous( &signal[ f * N ], N, DSP_TEST_R, 110.f * powf( 2.f, (f % 24) / 12.f ), 0.02f, &vs );
+    }
+    std::vector<DSP*> estimators( workers + 1 );
+    for( DSP*& e : estimators ) {
+        e = (DSP*) new PitchEstimator2( N );
+        e->setSamplingRate( DSP_TEST_R );
+    }
+    std::vector<float> pitches( frames ), serial( frames ), scratch( (workers + 1) * 2 * N );
+    PoolBatch batch = { &signal[0], N, &estimators[0], &serial[0], &scratch[0] };
+    const int batches = 20;
+    t0 = cnanos();
+    for( int r=0; r < batches; ++r ) pool_batch_frames( &batch, 0, frames, 0 );
+    t1 = cnanos();
+    batch.pitches = &pitches[0];
+    int parts = 0;
+    for( int r=0; r < batches; ++r ) parts = pool.parallelFor( 0, frames, 4, &pool_batch_frames, &batch );
+    t2 = cnanos();
+    int differ = 0;
+    for( int f=0; f < frames; ++f ) differ += pitches[f] != serial[f];
+    omp = -1;
+#ifdef _OPENMP
+    {
+        int64_t o0 = cnanos();
+        for( int r=0; r < batches; ++r ) {
+            #pragma omp parallel num_threads( workers + 1 )
+            {
+                int part = omp_get_thread_num(), threads = omp_get_num_threads();
+                pool_batch_frames( &batch, part * frames / threads, (part + 1) * frames / threads, part );
+            }
+        }
+        omp = (cnanos() - o0) / 1e3 / batches;
+    }
+#endif
+    LOGI("WorkerPool %d frames through PitchEstimator2: serial %7.1f us, pool %7.1f us in %d parts, OpenMP %7.1f us, %d pitches differ",
+         frames, (t1 - t0) / 1e3 / batches, (t2 - t1) / 1e3 / batches, parts, omp, differ);
+    for( DSP* e : estimators ) delete e;
+}
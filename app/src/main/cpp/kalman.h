@@ -0,0 +1,154 @@
+#pragma once
+
+/**
+ * Kalman pitch smoother
+ *
+ * Constant velocity model over the state (pitch in cents, pitch rate in cents per second),
+ *
+ *      x' = F x + w,   F = | 1 dt |,   Q = q | dt^4/4  dt^3/2 |
+ *                          | 0  1 |          | dt^3/2  dt^2   |
+ *
+ * with white acceleration noise of variance q. A held note or a slow glide needs little
+ * (KALMAN_ACCELERATION squared) and averages the per frame jitter of the estimate out, a vibrato
+ * needs up to a few hundred times more. The filter scales Q by the fourth power of the smoothed
+ * normalized innovation squared (1 while the model fits), so it follows a vibrato within a few
+ * frames and settles again on the held note after it. Once the caller has measured the vibrato,
+ * setManeuver() raises the acceleration to its peak depth (2 pi rate)^2 for as long as it lasts. Every frame measures the pitch only, with a
+ * variance from the NSDF clarity of the estimate:
+ *
+ *      r = (KALMAN_MEASUREMENT_CENTS / clarity)^2
+ *
+ * so an unclear frame barely moves the state. The filter starts over at the measurement on an onset,
+ * when the caller says the note changed, or when the measurement is more than KALMAN_RESET_CENTS
+ * from the prediction.
+ *
+ * The state is Eigen fixed size Vector2f / Matrix2f, nothing is allocated.
+ */
+
+#include <algorithm>
+#include <math.h>
+
+#include "Eigen/Core"
+
+#define KALMAN_ACCELERATION 2000.f          // cents / s^2 on a held note
+#define KALMAN_MAX_SCALE 2000.f             // of the process noise, a 6 Hz vibrato of 25 cents peaks at 35000 cents / s^2
+#define KALMAN_NIS_SMOOTHING 0.25f
+#define KALMAN_MEASUREMENT_CENTS 6.f        // standard deviation of a clear estimate
+#define KALMAN_MIN_CLARITY 0.1f
+#define KALMAN_RESET_CENTS 80.f             // innovation that is a new note, not a bend
+#define KALMAN_RATE_CENTS 200.f             // initial rate standard deviation, cents / s
+
+class PitchKalman
+{
+public:
+    PitchKalman( float frameRate = 11025.f / 256.f ) {
+        this->acceleration = KALMAN_ACCELERATION;
+        this->maneuver = 0;
+        this->resets = 0;
+        setFrameRate( frameRate );
+        reset();
+    }
+
+    void setFrameRate( float frameRate ) {
+        this->dt = 1.f / frameRate;
+        F << 1.f, dt,
+             0.f, 1.f;
+        updateNoise();
+    }
+    void setAcceleration( float centsPerSecond2, float frameRate ) {
+        this->acceleration = centsPerSecond2;
+        setFrameRate( frameRate );
+    }
+    /**
+     * A known maneuver raises the process noise while it lasts, the peak acceleration of a
+     * detected vibrato, 0 when there is none. Without it the adaptive scale lags every swing.
+     */
+    void setManeuver( float centsPerSecond2 ) {
+        if( centsPerSecond2 != this->maneuver ) {
+            this->maneuver = centsPerSecond2;
+            updateNoise();
+        }
+    }
+
+    // the next measurement starts the filter over
+    void reset() {
+        initialized = false;
+        nis = 1;
+        scale = 1;
+        x.setZero();
+        P.setZero();
+    }
+
+    /**
+     * One frame.
+     *
+     * @param cents measured pitch, 100 * fractional MIDI note
+     * @param clarity confidence of the measurement 0..1, the NSDF peak for MPM
+     * @param onset a note onset was detected in this frame
+     * @return filtered pitch in cents
+     */
+    float update( float cents, float clarity, bool onset = false ) {
+        const float c = std::max( KALMAN_MIN_CLARITY, std::min( 1.f, clarity ) );
+        const float sigma = KALMAN_MEASUREMENT_CENTS / c;
+        const float r = sigma * sigma;
+
+        if( initialized && !onset ) {
+            // predict, the process noise grows while the innovations are larger than predicted
+            x = F * x;
+            P = F * P * F.transpose() + scale * Q;
+
+            // a jump far outside the prediction is a new note
+            float innovation = cents - x[ 0 ];
+            if( fabsf( innovation ) <= KALMAN_RESET_CENTS ) {
+                float s = P( 0, 0 ) + r;
+                nis += KALMAN_NIS_SMOOTHING * (innovation * innovation / s - nis);
+                scale = std::max( 1.f, std::min( KALMAN_MAX_SCALE, nis * nis * nis * nis ) );
+                Eigen::Vector2f k = P.col( 0 ) / s;
+                x += k * innovation;
+                P -= k * P.row( 0 );
+                // keep P symmetric against rounding
+                P( 0, 1 ) = P( 1, 0 ) = 0.5f * (P( 0, 1 ) + P( 1, 0 ));
+                return x[ 0 ];
+            }
+        }
+
+        if( initialized ) {
+            ++resets;
+        }
+        nis = 1;
+        scale = 1;
+        x << cents, 0.f;
+        P << r, 0.f,
+             0.f, KALMAN_RATE_CENTS * KALMAN_RATE_CENTS;
+        initialized = true;
+        return x[ 0 ];
+    }
+
+    float getCents() { return x[ 0 ]; }
+    // cents per second
+    float getRate() { return x[ 1 ]; }
+    float getVariance() { return P( 0, 0 ); }
+    int getResets() { return resets; }
+    bool isInitialized() { return initialized; }
+
+protected:
+    void updateNoise() {
+        float a = std::max( acceleration, maneuver );
+        float q = a * a;
+        Q << q * dt * dt * dt * dt / 4.f, q * dt * dt * dt / 2.f,
+             q * dt * dt * dt / 2.f,      q * dt * dt;
+    }
+
+protected:
+    Eigen::Matrix2f F;
+    Eigen::Matrix2f Q;
+    Eigen::Matrix2f P;
+    Eigen::Vector2f x;
+    float           dt;
+    float           acceleration;
+    float           maneuver;       // cents / s^2, of a detected vibrato
+    float           nis;            // smoothed normalized innovation squared, 1 when the model fits
+    float           scale;          // of Q
+    bool            initialized;
+    int             resets;
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#ifdef __ANDROID__
+
 #include <android/log.h>
 
 #define MODULE_NAME  "mmt"
@@ -13,3 +15,24 @@
 #define LOGF(...) __android_log_print(ANDROID_LOG_FATAL,MODULE_NAME, __VA_ARGS__)
 
 #define ASSERT(cond, ...) if (!(cond)) {__android_log_assert(#cond, MODULE_NAME, __VA_ARGS__);}
+
+#else // host (Linux) builds of the dsp headers, e.g. benchmarks in dsp_test.h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MODULE_NAME  "mmt"
+#define APP_NAME MODULE_NAME
+
+#define __LOG_HOST(L, ...) do { fprintf(stderr, "%s/%s: ", L, MODULE_NAME); fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); } while(0)
+
+#define LOGV(...) do { if (0) fprintf(stderr, __VA_ARGS__); } while(0)
+#define LOGD(...) do { if (0) fprintf(stderr, __VA_ARGS__); } while(0)
+#define LOGI(...) __LOG_HOST("I", __VA_ARGS__)
+#define LOGW(...) __LOG_HOST("W", __VA_ARGS__)
+#define LOGE(...) __LOG_HOST("E", __VA_ARGS__)
+#define LOGF(...) __LOG_HOST("F", __VA_ARGS__)
+
+#define ASSERT(cond, ...) if (!(cond)) { __LOG_HOST("F", __VA_ARGS__); abort(); }
+
+#endif
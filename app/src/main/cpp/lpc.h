@@ -0,0 +1,326 @@
+#pragma once
+
+/**
+ * Linear prediction analysis
+ *
+ * The predictor of order p comes from the autocorrelation r of the frame by the Levinson-Durbin
+ * recursion, O(p^2), so a processor that already has the ACF (AcorrEngine, acorr_r, the spectral
+ * context) gets it without a transform. The predictor models the pre-emphasized frame, whose ACF
+ * follows from r itself, so the spectral tilt of the voice does not take poles away from the
+ * formants. The ACF gets a Gaussian lag window (LPC_LAG_WINDOW_HZ of bandwidth expansion) and a
+ * white noise floor (LPC_WHITE_NOISE of r(0)), which keep the poles off the unit circle and off
+ * single harmonics of a high voice.
+ *
+ *      A(z) = 1 + a_1 z^-1 + .. + a_p z^-p
+ *
+ * whiten() runs the pre-emphasis and the inverse filter A(z) over the frame. The residual has the
+ * formant envelope removed, what remains is the excitation: a pulse train at the pitch period with a
+ * flat spectrum. The whitening filter is the bandwidth expanded A(z / LPC_WHITEN_GAMMA): a full
+ * inverse filter lifts the noise in the valleys between formants to the level of the harmonics.
+ * Its autocorrelation peaks at the period do not ride on the formant ringing, which is what makes a
+ * vowel with a strong first formant near the second or third harmonic pick the wrong ACF peak. The
+ * filter state carries over between frames.
+ *
+ * Formants are the roots of A(z) with a positive imaginary part, frequency from the angle and
+ * bandwidth from the radius. The roots are found with Durand-Kerner iterations, O(p^2) each,
+ * warm started from the roots of the previous frame, so a steady vowel converges in a few.
+ *
+ * All storage is fixed size, nothing is allocated.
+ */
+
+#include <algorithm>
+#include <complex>
+#include <math.h>
+
+#define LPC_MAX_ORDER 24
+#define LPC_DEFAULT_ORDER 12                // R / 1000 + 2 at 11025 Hz
+#define LPC_PREEMPHASIS 0.97f               // 1 - u z^-1 flattens the -6 dB per octave of the voice
+#define LPC_WHITEN_GAMMA 0.9f               // a_k gamma^k, leaves the formant peaks a little of their height
+#define LPC_WHITE_NOISE 1e-4f               // of r(0), -40 dB
+#define LPC_LAG_WINDOW_HZ 60.f
+#define LPC_ROOT_ITERATIONS 40
+#define LPC_ROOT_TOLERANCE 1e-6f
+#define LPC_FORMANTS 4
+#define LPC_FORMANT_MIN_HZ 90.f
+#define LPC_FORMANT_MAX_BANDWIDTH 700.f     // Hz, wider poles shape the spectral tilt
+
+class LinearPredictor
+{
+public:
+    LinearPredictor( int order = LPC_DEFAULT_ORDER ) {
+        setOrder( order );
+        this->lagWindowR = 0;
+        this->rootsValid = false;
+        this->rootIterations = 0;
+        reset();
+    }
+
+    void setOrder( int order ) {
+        this->order = std::max( 1, std::min( LPC_MAX_ORDER, order ) );
+        this->rootsValid = false;
+    }
+    int getOrder() { return order; }
+
+    // clears the filter state and the predictor
+    void reset() {
+        for( int k=0; k <= LPC_MAX_ORDER; ++k ) {
+            a[ k ] = k == 0 ? 1.f : 0.f;
+            weighted[ k ] = a[ k ];
+            reflection[ k ] = 0;
+            history[ k ] = 0;
+        }
+        lastInput = 0;
+        error = 0;
+        gain = 0;
+        formantsN = 0;
+        rootsValid = false;
+    }
+
+    /**
+     * ACF of lags [0, order + 1] of the Hamming windowed frame, what analyse() reads, for callers
+     * without one, O(p N). The window keeps the frame edges from widening the formant bandwidths,
+     * the plain ACF of a processor is good enough for whitening but finds fewer formants.
+     *
+     * @param work N samples of scratch
+     */
+    static void autocorrelate( const float* x, int N, float* r, int order, float* work ) {
+        // cos(2 pi n / (N - 1)) by rotation
+        const float step = 2.f * (float)M_PI / std::max( N - 1, 1 );
+        const float cs = cosf( step ), sn = sinf( step );
+        float c = 1, s = 0;
+        for( int n=0; n < N; ++n ) {
+            work[ n ] = x[ n ] * (0.54f - 0.46f * c);
+            float cn = c * cs - s * sn;
+            s = s * cs + c * sn;
+            c = cn;
+        }
+        for( int k=0; k <= order + 1; ++k ) {
+            float sum = 0;
+            for( int n = k; n < N; ++n ) {
+                sum += work[ n ] * work[ n - k ];
+            }
+            r[ k ] = sum;
+        }
+    }
+
+    /**
+     * Levinson-Durbin recursion.
+     *
+     * @param acf autocorrelation, lags [0, order + 1] are read, any scale
+     * @param R sampling rate, for the lag window
+     * @return false when the frame is silent, the predictor is then the identity
+     */
+    bool analyse( const float* acf, float R ) {
+        if( !(acf[ 0 ] > 0) ) {
+            return silent();
+        }
+        prepareLagWindow( R );
+
+        // ACF of the pre-emphasized frame, (1 + u^2) r(k) - u (r(k - 1) + r(k + 1))
+        const double u = LPC_PREEMPHASIS;
+        double r[ LPC_MAX_ORDER + 1 ] = { 0 };
+        for( int k=0; k <= order; ++k ) {
+            double left = k > 0 ? acf[ k - 1 ] : acf[ 1 ];
+            r[ k ] = ((1.0 + u * u) * acf[ k ] - u * (left + acf[ k + 1 ])) * lagWindow[ k ];
+        }
+        if( !(r[ 0 ] > 0) ) {
+            return silent();
+        }
+        r[ 0 ] *= 1.0 + LPC_WHITE_NOISE;
+
+        double c[ LPC_MAX_ORDER + 1 ], previous[ LPC_MAX_ORDER + 1 ];
+        c[ 0 ] = 1;
+        double e = r[ 0 ];
+        for( int i=1; i <= order; ++i ) {
+            double acc = r[ i ];
+            for( int j=1; j < i; ++j ) {
+                acc += c[ j ] * r[ i - j ];
+            }
+            double k = e > 0 ? -acc / e : 0.0;
+            for( int j=1; j < i; ++j ) {
+                previous[ j ] = c[ j ];
+            }
+            for( int j=1; j < i; ++j ) {
+                c[ j ] = previous[ j ] + k * previous[ i - j ];
+            }
+            c[ i ] = k;
+            reflection[ i ] = (float)k;
+            e *= 1.0 - k * k;
+        }
+        double g = 1;
+        for( int k=0; k <= order; ++k ) {
+            a[ k ] = (float)c[ k ];
+            weighted[ k ] = (float)(c[ k ] * g);
+            g *= LPC_WHITEN_GAMMA;
+        }
+        error = (float)(e / r[ 0 ]);
+        gain = (float)sqrt( std::max( e, 0.0 ) );
+        return true;
+    }
+
+    /**
+     * Inverse filter A(z), the prediction residual of x. The last order samples are kept for the
+     * next frame. dest may be x.
+     */
+    void whiten( const float* x, int N, float* dest ) {
+        // pre-emphasis forward, then A(z) backwards, both in place in dest
+        float last = lastInput;
+        for( int n=0; n < N; ++n ) {
+            float v = x[ n ];
+            dest[ n ] = v - LPC_PREEMPHASIS * last;
+            last = v;
+        }
+        lastInput = last;
+
+        float tail[ LPC_MAX_ORDER ];
+        const int keep = std::min( order, N );
+        for( int k=0; k < keep; ++k ) {
+            tail[ k ] = dest[ N - keep + k ];
+        }
+        for( int n = N - 1; n >= 0; --n ) {
+            float sum = dest[ n ];
+            for( int k=1; k <= order; ++k ) {
+                sum += weighted[ k ] * (n - k >= 0 ? dest[ n - k ] : history[ order - (k - n) ]);
+            }
+            dest[ n ] = sum;
+        }
+        // history[ order - 1 ] is the newest sample
+        for( int k=0; k < order - keep; ++k ) {
+            history[ k ] = history[ k + keep ];
+        }
+        for( int k=0; k < keep; ++k ) {
+            history[ order - keep + k ] = tail[ k ];
+        }
+    }
+
+    /**
+     * Formants of the current predictor, sorted by frequency.
+     *
+     * @return number of formants found, at most LPC_FORMANTS
+     */
+    int findFormants( float R ) {
+        findRoots();
+        formantsN = 0;
+        float f[ LPC_MAX_ORDER ], b[ LPC_MAX_ORDER ];
+        int n = 0;
+        for( int k=0; k < order; ++k ) {
+            if( roots[ k ].imag() <= 0 ) continue;
+            float radius = std::abs( roots[ k ] );
+            float hz = std::arg( roots[ k ] ) * R / (2.f * (float)M_PI);
+            float bw = radius > 0 ? -logf( radius ) * R / (float)M_PI : R;
+            if( hz < LPC_FORMANT_MIN_HZ || bw > LPC_FORMANT_MAX_BANDWIDTH ) continue;
+            f[ n ] = hz;
+            b[ n ] = bw;
+            ++n;
+        }
+        // insertion sort, n <= p / 2
+        for( int i=1; i < n; ++i ) {
+            for( int j = i; j > 0 && f[ j ] < f[ j - 1 ]; --j ) {
+                std::swap( f[ j ], f[ j - 1 ] );
+                std::swap( b[ j ], b[ j - 1 ] );
+            }
+        }
+        formantsN = std::min( n, LPC_FORMANTS );
+        for( int k=0; k < formantsN; ++k ) {
+            formants[ k ] = f[ k ];
+            bandwidths[ k ] = b[ k ];
+        }
+        return formantsN;
+    }
+
+    const float* getCoefficients() { return a; }
+    const float* getReflection() { return reflection; }
+    // prediction error over r(0), the spectral flatness the predictor leaves
+    float getError() { return error; }
+    float getGain() { return gain; }
+    int getFormants() { return formantsN; }
+    // Hz, 0 when the formant k was not found
+    float getFormant( int k ) { return k >= 0 && k < formantsN ? formants[ k ] : 0.f; }
+    float getBandwidth( int k ) { return k >= 0 && k < formantsN ? bandwidths[ k ] : 0.f; }
+    int getRootIterations() { return rootIterations; }
+
+protected:
+    // identity predictor for a silent frame, the filter state is kept
+    bool silent() {
+        for( int k=0; k <= order; ++k ) {
+            a[ k ] = k == 0 ? 1.f : 0.f;
+            weighted[ k ] = a[ k ];
+        }
+        error = 0;
+        gain = 0;
+        return false;
+    }
+
+    void prepareLagWindow( float R ) {
+        if( R == lagWindowR ) {
+            return;
+        }
+        for( int k=0; k <= LPC_MAX_ORDER; ++k ) {
+            float w = 2.f * (float)M_PI * LPC_LAG_WINDOW_HZ * k / R;
+            lagWindow[ k ] = expf( -0.5f * w * w );
+        }
+        lagWindowR = R;
+    }
+
+    // Durand-Kerner on z^p + a_1 z^(p-1) + .. + a_p
+    void findRoots() {
+        typedef std::complex<float> C;
+        if( !rootsValid ) {
+            for( int k=0; k < order; ++k ) {
+                roots[ k ] = std::polar( 0.9f, 2.f * (float)M_PI * (k + 0.25f) / order );
+            }
+        }
+        rootIterations = 0;
+        for( int it=0; it < LPC_ROOT_ITERATIONS; ++it ) {
+            float change = 0;
+            for( int k=0; k < order; ++k ) {
+                C z = roots[ k ];
+                C value = 1.f;
+                for( int j=1; j <= order; ++j ) {
+                    value = value * z + a[ j ];
+                }
+                C denominator = 1.f;
+                for( int j=0; j < order; ++j ) {
+                    if( j != k ) denominator *= z - roots[ j ];
+                }
+                if( std::norm( denominator ) < 1e-30f ) {
+                    denominator = 1e-15f;
+                }
+                C step = value / denominator;
+                roots[ k ] = z - step;
+                change = std::max( change, std::norm( step ) );
+            }
+            ++rootIterations;
+            if( change < LPC_ROOT_TOLERANCE * LPC_ROOT_TOLERANCE ) {
+                break;
+            }
+        }
+        // roots that did not converge would seed the next frame badly
+        rootsValid = true;
+        for( int k=0; k < order; ++k ) {
+            if( !std::isfinite( roots[ k ].real() ) || !std::isfinite( roots[ k ].imag() ) ) {
+                rootsValid = false;
+            }
+        }
+    }
+
+protected:
+    int     order;
+    float   a[ LPC_MAX_ORDER + 1 ];
+    float   weighted[ LPC_MAX_ORDER + 1 ];     // a_k gamma^k, the whitening filter
+    float   reflection[ LPC_MAX_ORDER + 1 ];
+    float   history[ LPC_MAX_ORDER + 1 ];     // pre-emphasized input, newest at order - 1
+    float   lastInput;
+    float   error;
+    float   gain;
+
+    float   lagWindow[ LPC_MAX_ORDER + 1 ];
+    float   lagWindowR;
+
+    std::complex<float> roots[ LPC_MAX_ORDER ];
+    bool    rootsValid;
+    int     rootIterations;
+    int     formantsN;
+    float   formants[ LPC_FORMANTS ];
+    float   bandwidths[ LPC_FORMANTS ];
+};
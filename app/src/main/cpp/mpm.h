@@ -20,7 +20,7 @@
 #include <stdexcept>
 #include <vector>
 
-#include "fft.h"
+#include "acorr.h"
 
 #define MPM_CUTOFF 0.93
 #define MPM_SMALL_CUTOFF 0.001
@@ -34,123 +34,59 @@
 template <int N, typename T> class BaseAlloc
 {
 public:
-    std::vector<std::complex<float>> out_im;
     std::vector<T> out_real;
-    T* fftForwardBuffer;
-    T* fftInverseBuffer;
-    FFT<N, T> F;
+    AcorrEngine<T> ac;
 
     BaseAlloc( ) :
-        out_im( std::vector<std::complex<float>>( 2*N ) ),
-        out_real( std::vector<T>(N) )
+        out_real( std::vector<T>(N) ),
+        ac( N, AcorrCircular )
     {
-        fftForwardBuffer = new T[ 2*N ];
-        fftInverseBuffer = new T[ 2*N ];
-    }
-
-    ~BaseAlloc()
-    {
-        delete[] fftForwardBuffer;
-        delete[] fftInverseBuffer;
-    }
-
-protected:
-    void clear()
-    {
-        std::fill( out_im.begin(), out_im.end(), std::complex<T>(0.0, 0.0) );
     }
 };
 
-template <typename T> std::pair<T, T> parabolic_interpolation(const std::vector<T> &array, int x_)
+template <typename T> std::pair<T, T> parabolic_interpolation(const T* array, int size, int x_)
 {
     int x_adjusted;
     T x = (T)x_;
 
-    if (x < 1) {
-        x_adjusted = (array[x] <= array[x + 1]) ? x : x + 1;
-    } else if (x > signed(array.size()) - 1) {
-        x_adjusted = (array[x] <= array[x - 1]) ? x : x - 1;
+    if (x_ < 1) {
+        x_adjusted = (array[x_] <= array[x_ + 1]) ? x_ : x_ + 1;
+    } else if (x_ > size - 1) {
+        x_adjusted = (array[x_] <= array[x_ - 1]) ? x_ : x_ - 1;
     } else {
-        T den = array[x + 1] + array[x - 1] - 2 * array[x];
-        T delta = array[x - 1] - array[x + 1];
-        return (!den) ? std::make_pair(x, array[x])
+        T den = array[x_ + 1] + array[x_ - 1] - 2 * array[x_];
+        T delta = array[x_ - 1] - array[x_ + 1];
+        return (!den) ? std::make_pair(x, array[x_])
                     : std::make_pair(x + delta / (2 * den),
-                            array[x] - delta * delta / (8 * den));
+                            array[x_] - delta * delta / (8 * den));
     }
-    return std::make_pair(x_adjusted, array[x_adjusted]);
+    return std::make_pair((T)x_adjusted, array[x_adjusted]);
 }
 
-template <int N, typename T> void acorr_r( T* audio_buffer, BaseAlloc<N,T> *ba )
+/*
+* Circular autocorrelation of N samples into ba->out_real, scaled by 1/(2N).
+*
+* Only lags [0, lags) are required by the caller: the engine then picks the direct lag product or
+* the FFT path. The symmetric lags N - tau are mirrored in, anything in between is zeroed.
+*/
+template <int N, typename T> void acorr_r( T* audio_buffer, BaseAlloc<N,T> *ba, int lags = N )
 {
 //    if (audio_buffer.size() == 0)
 //        throw std::invalid_argument("audio_buffer shouldn't be empty");
 
-    // std::transform(
-    //     audio_buffer.begin(), 
-    //     audio_buffer.begin() + ba->N,
-    //     ba->out_im.begin(), 
-    //     [](T x) -> std::complex<T> 
-    //     {
-    //         return std::complex(x, static_cast<T>(0.0));
-    //     }
-    // );
-
-    ///ffts_execute(ba->fft_forward, ba->out_im.data(), ba->out_im.data());
-    T* buf = audio_buffer;
-    for (int n = 0; n < N; ++n)
-    {
-        ba->fftForwardBuffer[ 2*n ]   = buf[n]; // real
-        ba->fftForwardBuffer[ 2*n+1 ] = 0;	    // imaginary
-    }
-
-    ba->F.fft( ba->fftForwardBuffer );
-
-    for (int n=0, k=0, nx=2*N; n < nx; n += 2, ++k )
-    {
-        ba->out_im[k] = 
-            std::complex<float>( 
-                (float)ba->fftForwardBuffer[ n ],  // real
-                (float)ba->fftForwardBuffer[ n+1 ] // imaginary
-            );
-    }
-
-    ///std::complex<float> scale = { 1.0f / (float)(ba->N * 2), static_cast<T>(0.0) };
-    std::complex<float> scale = { 1.0f / (float)(2*N), static_cast<T>(0.0) };
-    for (int i = 0; i < N; ++i)
-        ba->out_im[i] *= std::conj(ba->out_im[i]) * scale;
-
-    ///ffts_execute(ba->fft_backward, ba->out_im.data(), ba->out_im.data());
-    for (int n = 0; n < N; ++n)
-    {
-        ba->fftInverseBuffer[ 2*n ]   = ba->out_im[n].real(); // real
-        ba->fftInverseBuffer[ 2*n+1 ] = ba->out_im[n].imag(); // imaginary
-    }
-
-    ba->F.ifft( ba->fftInverseBuffer );
-
-    for (int n=0, k=0, nx=2*N; n < nx; n += 2, ++k )
-    {
-        ba->out_im[k] = 
-            std::complex<float>( 
-                (float)ba->fftInverseBuffer[ n ],  // real
-                (float)ba->fftInverseBuffer[ n+1 ] // imaginary
-            );
+    lags = std::min( lags, N );
+    T* out = ba->out_real.data();
+    ba->ac.compute( audio_buffer, out, lags, (T)1 / (T)(2*N) );
+    for( int tau = lags; tau < N; ++tau ) {
+        out[ tau ] = (N - tau < lags) ? out[ N - tau ] : (T)0;
     }
-
-    std::transform(
-        ba->out_im.begin(), 
-        ba->out_im.begin() + N,
-        ba->out_real.begin(),
-        [](std::complex<float> cplx) -> T { return std::real(cplx); }
-    );
 }
 
-template <typename T> static std::vector<int> peak_picking(const std::vector<T> &nsdf)
+template <typename T> static std::vector<int> peak_picking(const T* nsdf, int size)
 {
 	std::vector<int> max_positions{};
 	int pos = 0;
 	int cur_max_pos = 0;
-	ssize_t size = nsdf.size();
 
 	while (pos < (size - 1) / 3 && nsdf[pos] > 0)
 		pos++;
@@ -193,28 +129,65 @@ template <typename T> static std::vector<int> peak_picking(const std::vector<T>
 template <int N, typename T> class Mpm : public BaseAlloc<N,T>
 {
 public:
-    Mpm( ) : BaseAlloc<N,T>( ) { }
+    Mpm( ) : BaseAlloc<N,T>( ), nsdf( this->out_real.data() ), period( 0 ), clarity( 0 ),
+             lower_pitch_cutoff( MPM_LOWER_PITCH_CUTOFF ) { }
+
+    void setLowerPitchCutoff( T hz ) { lower_pitch_cutoff = hz; }
 
     T pitch( T* audio_buffer, int sample_rate, T* output, int outputLen )
     {
-        acorr_r(audio_buffer, this);
+        // lags past the lowest detectable pitch are never picked
+        acorr_r(audio_buffer, this, (int)(sample_rate / lower_pitch_cutoff) + 2);
         for( int n=0; n < outputLen && n < this->out_real.size(); ++n )
             output[n] = this->out_real[n];
 
-        std::vector<int> max_positions = peak_picking( this->out_real );
+        nsdf = this->out_real.data();
+        return pick(sample_rate);
+    }
+
+    // the same on N lags of the acorr_r() autocorrelation computed by the caller, read in place,
+    // it has to stay unchanged while getClarityAt() is asked about it
+    T pitchFromAcf( const T* acf, int sample_rate )
+    {
+        nsdf = acf;
+        return pick(sample_rate);
+    }
+
+    T getPeriod() { return period; }
+
+    // normalized autocorrelation at the chosen period, 1 for a perfectly periodic frame
+    T getClarity() { return clarity; }
+
+    // the same at any lag, e.g. of a period corrected after the pick, on the parabola through
+    // the three nearest lags as the pick interpolates its peaks
+    T getClarityAt( T lag )
+    {
+        int i = (int)(lag + 0.5);
+        if (i < 1 || i >= N - 1 || nsdf[0] <= 0)
+            return 0;
+        T a = nsdf[i - 1], b = nsdf[i], c = nsdf[i + 1];
+        T d = lag - i;
+        return (b + 0.5 * d * (c - a) + 0.5 * d * d * (a - 2 * b + c)) / nsdf[0];
+    }
+
+protected:
+    T pick( int sample_rate )
+    {
+        std::vector<int> max_positions = peak_picking( nsdf, N );
         std::vector<std::pair<T, T>> estimates;
 
         T highest_amplitude = -DBL_MAX;
 
         for (int i : max_positions) {
-            highest_amplitude = std::max(highest_amplitude, this->out_real[i]);
-            if (this->out_real[i] > MPM_SMALL_CUTOFF) {
-                auto x = parabolic_interpolation(this->out_real, i);
+            highest_amplitude = std::max(highest_amplitude, nsdf[i]);
+            if (nsdf[i] > MPM_SMALL_CUTOFF) {
+                auto x = parabolic_interpolation(nsdf, N, i);
                 estimates.push_back(x);
                 highest_amplitude = std::max(highest_amplitude, std::get<1>(x));
             }
         }
 
+        clarity = 0;
         if (estimates.empty())
             return -1;
 
@@ -224,19 +197,18 @@ public:
         for (auto i : estimates) {
             if (std::get<1>(i) >= actual_cutoff) {
                 period = std::get<0>(i);
+                clarity = nsdf[0] > 0 ? std::get<1>(i) / nsdf[0] : 0;
                 break;
             }
         }
 
         T pitch_estimate = (sample_rate / period);
 
-        this->clear();
-
-        return (pitch_estimate > MPM_LOWER_PITCH_CUTOFF) ? pitch_estimate : -1;
+        return (pitch_estimate > lower_pitch_cutoff) ? pitch_estimate : -1;
     }
 
-    T getPeriod() { return period; }
-
-protected:
+    const T* nsdf;          // the ACF of the last pick, out_real or the caller's
     T period;
+    T clarity;
+    T lower_pitch_cutoff;
 };
\ No newline at end of file
@@ -2,16 +2,31 @@
 #include <android/asset_manager.h>
 #include <android/asset_manager_jni.h>
 #include <jni.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <string>
+#include <thread>
+#include "AnalysisEngine.h"
+#include "AudioSource.h"
 #include "dsp.h"
 #include "log.h"
+#include "onset.h"
+#include "pitchbend.h"
+#include "noteevents.h"
+#include "Decimator.h"
+#include "MidiEngine.h"
+#include "SmfRecorder.h"
 #include "OboeRecorder.h"
 #include "OboePlayer.h"
 #include "MediaStreamer.h"
 #include "LockFreeQueue.h"
+#include "Seqlock.h"
+#include "TripleBuffer.h"
 #include "cpu.h"
 #include "FileDevDumper.h"
 #include "fft_test.h"
+#include "dsp_test.h"
 
 #define DEBUG_FILE_DUMPS
 
@@ -23,32 +38,102 @@ FileDevDumper fDspOutPitchMidi( "/sdcard/dump/dump.dspapp.dspout.pitchmidi.txt"
 FileDevDumper fDspOutMidiNoteNum( "/sdcard/dump/dump.dspapp.dspout.midinotenum.txt" );
 #endif
 
-MediaStreamer media;
-OboeRecorder recorder;
-DSP* dspProcessor = NULL;
-int dspProcessingMode = 0;
-int outputBufferLen = 0;
+// the microphone session, its frames go to the UI and its note events to the MIDI engine
+class LiveAnalysis : public AnalysisEngine
+{
+public:
+    LiveAnalysis( NoteEventQueue* noteEvents ) : AnalysisEngine( new OboeAudioSource(), noteEvents ) { }
+
+    OboeRecorder& getRecorder() { return ((OboeAudioSource&)getSource()).getRecorder(); }
+
+protected:
+    virtual void onFrame( DSP* processor, const float* out, int len, const AnalysisSnapshot& snapshot ) {
+        #ifdef DEBUG_FILE_DUMPS
+        if( processor != NULL ) {
+            float pitchEst = snapshot.pitch;
+            float nacIndex = processor->getNacIndex();
+            float pitchMidi = snapshot.noteHz;
+            float midiNoteNum = snapshot.note;
+            fDspOut.writeAppendCSV( (float*)out, len, true );
+            fDspOutPitchEst.writeAppendCSV( &pitchEst, 1, false );
+            fDspOutNacIndices.writeAppendCSV( &nacIndex, 1, false );
+            fDspOutPitchMidi.writeAppendCSV( &pitchMidi, 1, false );
+            fDspOutMidiNoteNum.writeAppendCSV( &midiNoteNum, 1, false );
+        }
+        #endif
+    }
+};
+
+NoteEventQueue noteEvents;
+MidiEngine midi( noteEvents );
+AMidiSink midiSink;
+SmfRecorder smfRecorder;
+TeeMidiSink midiOut;                // the device in slot 0, the recorder in slot 1
+int midiChannel = 0;
+std::mutex midiLock;                // openMidiEngine runs on the MidiWriter thread, the recording on the UI thread
+
+// the session of the microphone, created with the first call and kept for the life of the process
+LiveAnalysis& live() {
+    static AnalysisHandle handle = AnalysisRegistry::create( new LiveAnalysis( &noteEvents ) );
+    static LiveAnalysis& session = (LiveAnalysis&) *AnalysisRegistry::get( handle );
+    return session;
+}
+
+// the engine runs while the device or the recorder is attached to midiOut
+void restartMidiEngine( int patch ) {
+    midi.stop();
+    live().setNotesEnabled( false );
+    if( !midiOut.isEmpty() ) {
+        midi.start( &midiOut, midiChannel, patch );
+        live().setNotesEnabled( true );
+    }
+}
+
+// a snapshot into the fields of a Java AnalysisSnapshot
+void copyAnalysisSnapshot( JNIEnv* env, jobject out, const AnalysisSnapshot& s ) {
+    // the UI, the SurfaceView and the MIDI thread all copy snapshots, the first one looks the ids up
+    static std::once_flag looked;
+    static jfieldID fFrame, fCaptureNanos, fPitch, fClarity, fNoteHz, fCents, fNote, fGate;
+    std::call_once( looked, [env, out]() {
+        jclass c = env->GetObjectClass( out );
+        fCaptureNanos = env->GetFieldID( c, "captureNanos", "J" );
+        fPitch = env->GetFieldID( c, "pitch", "F" );
+        fClarity = env->GetFieldID( c, "clarity", "F" );
+        fNoteHz = env->GetFieldID( c, "noteHz", "F" );
+        fCents = env->GetFieldID( c, "cents", "F" );
+        fNote = env->GetFieldID( c, "note", "I" );
+        fGate = env->GetFieldID( c, "gate", "Z" );
+        fFrame = env->GetFieldID( c, "frame", "J" );
+        env->DeleteLocalRef( c );
+    } );
+    env->SetLongField( out, fFrame, s.frame );
+    env->SetLongField( out, fCaptureNanos, s.captureNanos );
+    env->SetFloatField( out, fPitch, s.pitch );
+    env->SetFloatField( out, fClarity, s.clarity );
+    env->SetFloatField( out, fNoteHz, s.noteHz );
+    env->SetFloatField( out, fCents, s.cents );
+    env->SetIntField( out, fNote, s.note );
+    env->SetBooleanField( out, fGate, s.gate != 0 );
+}
 
 // MainActivity class native JNI functions
 extern "C" {
     JNIEXPORT jboolean JNICALL Java_com_yourdomain_yourapp_MainActivity_isRecording(JNIEnv *env, jobject thiz) {
-        return recorder.live();
+        return live().getRecorder().live();
     }
 
     JNIEXPORT jint JNICALL Java_com_yourdomain_yourapp_MainActivity_startRecording(JNIEnv *env, jobject /* this */) {
-//        recorder.setWavPath("/sdcard/dump/recorder.wav");
-//        recorder.setWavPath("/storage/emulated/0/dump/recorder.wav");
-//        recorder.setWavPath("/data/local/tmp/recorder.wav");
-        //recorder.setWavPath("/data/data/com.yourdomain.yourapp/recorder.wav");
-        return (int) recorder.start();
+//        live().getRecorder().setWavPath("/sdcard/dump/recorder.wav");
+//        live().getRecorder().setWavPath("/storage/emulated/0/dump/recorder.wav");
+//        live().getRecorder().setWavPath("/data/local/tmp/recorder.wav");
+        //live().getRecorder().setWavPath("/data/data/com.yourdomain.yourapp/recorder.wav");
+        return (int) live().getRecorder().start();
     }
 
     JNIEXPORT void JNICALL Java_com_yourdomain_yourapp_MainActivity_stopRecording(JNIEnv *env, jobject /* this */) {
-        recorder.stop();
-        if( dspProcessor != NULL ) {
-            delete dspProcessor;
-            dspProcessor = NULL;
-        }
+        live().getRecorder().stop();
+        // frees the processor
+        live().requestProcessingMode( ProcessingModes::RawAudioOnly );
     }
 
     JNIEXPORT void JNICALL Java_com_yourdomain_yourapp_MainActivity_setProcessingMode(JNIEnv *env, jobject thiz, jint mode) {
@@ -59,142 +144,165 @@ extern "C" {
             fDspOutPitchMidi.openResetTextFile();
             fDspOutMidiNoteNum.openResetTextFile();
         #endif
+        // built off the UI thread, the analysis goes on with the old one until the new one is ready
+        live().requestProcessingMode( mode );
+    }
+
+    // A4 in Hz, key root 0..11 (C = 0) and a 12 bit mask of the scale degrees notes snap to
+    JNIEXPORT void JNICALL Java_com_yourdomain_yourapp_MainActivity_setTuning(JNIEnv *env, jobject thiz, jfloat a4, jint root, jint scaleMask) {
+        live().setTuning( a4, root, (uint64_t)(uint32_t)scaleMask );
+    }
+
+    JNIEXPORT void JNICALL Java_com_yourdomain_yourapp_MainActivity_getAnalysisSnapshot(JNIEnv *env, jobject thiz, jobject out) {
+        copyAnalysisSnapshot( env, out, live().getSnapshot().load() );
+    }
 
-        if( dspProcessor != NULL ) {
-            delete dspProcessor;
+    // frequency in Hz of formant k = 0..3 of the last frame, 0 when the processor has none
+    JNIEXPORT jfloat JNICALL Java_com_yourdomain_yourapp_MainActivity_getFormant(JNIEnv *env, jobject thiz, jint k) {
+        return live().getFormant( k );
+    }
+
+    /**
+     * Analyses a WAV file on a session thread of its own, alongside the microphone and any other
+     * file.
+     *
+     * @return handle of the session, 0 when the file can not be read
+     */
+    JNIEXPORT jlong JNICALL Java_com_yourdomain_yourapp_MainActivity_openFileAnalysis(JNIEnv *env, jobject thiz, jstring path, jint mode) {
+        const char* p = env->GetStringUTFChars( path, NULL );
+        WavFileAudioSource* source = new WavFileAudioSource( p, DEFAULT_RECORDER_BUFFER_LENGTH );
+        env->ReleaseStringUTFChars( path, p );
+        if( !source->isOpen() ) {
+            delete source;
+            return 0;
         }
-        switch( mode ) {
-            default:
-            case ProcessingModes::RawAudioOnly:
-                dspProcessingMode = (int)ProcessingModes::RawAudioOnly;
-                dspProcessor = NULL;
-                outputBufferLen = recorder.getBufferLength();
-                break;
-            case ProcessingModes::MagnitudeSpectrum:
-                dspProcessingMode = (int)ProcessingModes::MagnitudeSpectrum;
-                dspProcessor = (DSP*) new FastFourierTransformMagnitudeSpectrum(recorder.getBufferLength());
-                outputBufferLen = dspProcessor->getProcessOutputLen();
-                break;
-            case ProcessingModes::Autocorrelation:
-                dspProcessingMode = (int)ProcessingModes::Autocorrelation;
-                dspProcessor = (DSP*) new AutocorrelationNormalized(recorder.getBufferLength());
-                outputBufferLen = dspProcessor->getProcessOutputLen();
-                break;
-            case ProcessingModes::PitchEstimation:
-                dspProcessingMode = (int)ProcessingModes::PitchEstimation;
-                dspProcessor = (DSP*) new PitchEstimator2(recorder.getBufferLength());
-                outputBufferLen = dspProcessor->getProcessOutputLen();
-                break;
+        AnalysisEngine* session = new AnalysisEngine( source );
+        session->setProcessingMode( mode );
+        session->start();
+        return AnalysisRegistry::create( session );
+    }
+
+    // the last snapshot of a file session, @return false once the session is through the file
+    JNIEXPORT jboolean JNICALL Java_com_yourdomain_yourapp_MainActivity_getFileAnalysis(JNIEnv *env, jobject thiz, jlong handle, jobject out) {
+        std::shared_ptr<AnalysisEngine> session = AnalysisRegistry::get( handle );
+        if( !session ) {
+            return false;
         }
+        copyAnalysisSnapshot( env, out, session->getSnapshot().load() );
+        return !session->isFinished();
+    }
+
+    JNIEXPORT void JNICALL Java_com_yourdomain_yourapp_MainActivity_closeFileAnalysis(JNIEnv *env, jobject thiz, jlong handle) {
+        AnalysisRegistry::destroy( handle );
     }
 
-    JNIEXPORT jfloat JNICALL Java_com_yourdomain_yourapp_MainActivity_getPitchEstimate(JNIEnv *env, jobject thiz) {
-        if( dspProcessor != NULL ) {
-            return dspProcessor->getPitch();
-        } else {
-            return 0.f;
+    /**
+     * Sends the note events of the analysis to an input port of a device opened on the Java side.
+     *
+     * @param midiDevice android.media.midi.MidiDevice
+     * @return false when the port can not be opened natively (libamidi is API 29)
+     */
+    JNIEXPORT jboolean JNICALL Java_com_yourdomain_yourapp_MainActivity_openMidiEngine(JNIEnv *env, jobject thiz, jobject midiDevice, jint port, jint channel, jint patch) {
+        std::lock_guard<std::mutex> guard( midiLock );
+        midi.stop();
+        midiOut.set( 0, NULL );
+        midiChannel = channel;
+        bool opened = midiSink.open( env, midiDevice, port );
+        if( opened ) {
+            midiOut.set( 0, &midiSink );
         }
+        restartMidiEngine( patch );
+        return opened;
+    }
+
+    JNIEXPORT void JNICALL Java_com_yourdomain_yourapp_MainActivity_closeMidiEngine(JNIEnv *env, jobject thiz) {
+        std::lock_guard<std::mutex> guard( midiLock );
+        midi.stop();
+        midiOut.set( 0, NULL );
+        midiSink.close();
+        restartMidiEngine( -1 );
     }
 
-    JNIEXPORT jint JNICALL Java_com_yourdomain_yourapp_MainActivity_getMidiNoteNumber(JNIEnv *env, jobject thiz) {
-        if( dspProcessor != NULL ) {
-            return dspProcessor->getMidiNoteNumber();
-        } else {
-            return 0.f;
+    /**
+     * Records the note events into a Standard MIDI File until stopMidiRecording(), with or without a
+     * MIDI device.
+     *
+     * @param format 0 or 1
+     */
+    JNIEXPORT jboolean JNICALL Java_com_yourdomain_yourapp_MainActivity_startMidiRecording(JNIEnv *env, jobject thiz, jstring path, jint format) {
+        std::lock_guard<std::mutex> guard( midiLock );
+        const char* p = env->GetStringUTFChars( path, NULL );
+        midi.stop();
+        bool started = smfRecorder.start( p, format );
+        env->ReleaseStringUTFChars( path, p );
+        if( started ) {
+            midiOut.set( 1, &smfRecorder );
         }
+        restartMidiEngine( -1 );
+        return started;
+    }
+
+    // @return false when nothing was recorded or the file could not be written
+    JNIEXPORT jboolean JNICALL Java_com_yourdomain_yourapp_MainActivity_stopMidiRecording(JNIEnv *env, jobject thiz) {
+        std::lock_guard<std::mutex> guard( midiLock );
+        // the all notes off of the engine ends the file
+        midi.stop();
+        midiOut.set( 1, NULL );
+        bool written = smfRecorder.stop();
+        restartMidiEngine( -1 );
+        return written;
     }
 }
 
 // SurfaceViewDSP class native JNI functions
 extern "C" {
-    static float* __hopper = NULL;
-    static float* __dspOutput = NULL;
-    static jfloatArray __audioDataJVM = NULL;
-
     JNIEXPORT jint JNICALL Java_com_yourdomain_yourapp_SurfaceViewDSP_getProcessingMode(JNIEnv *env, jobject thiz) {
-        return dspProcessingMode;
+        return live().getProcessingMode();
     }
 
-    JNIEXPORT void JNICALL Java_com_yourdomain_yourapp_SurfaceViewDSP_initAudioBridge(JNIEnv *env, jobject /* this */) {
-        if (__audioDataJVM == nullptr) {
-            jfloatArray jArray = env->NewFloatArray(outputBufferLen);
-            __audioDataJVM = (jfloatArray) env->NewGlobalRef(jArray);
-            __dspOutput = new float[ outputBufferLen ];
-            __hopper = new float[ outputBufferLen ];
-        }
-        assert(__audioDataJVM != NULL);
+    /**
+     * Starts the analysis thread of the microphone session and returns the frames it publishes as a
+     * direct ByteBuffer, see TripleBuffer.h for the layout. The buffer stays valid for the life of the
+     * process.
+     */
+    JNIEXPORT jobject JNICALL Java_com_yourdomain_yourapp_SurfaceViewDSP_initAudioBridge(JNIEnv *env, jobject /* this */) {
+        live().start();
+        TripleBuffer& frames = live().getFrames();
+        return env->NewDirectByteBuffer( frames.getRegion(), frames.getRegionBytes() );
     }
 
     JNIEXPORT void JNICALL Java_com_yourdomain_yourapp_SurfaceViewDSP_freeAudioBridge(JNIEnv *env, jobject /* this */) {
-        if (__audioDataJVM != nullptr) {
-            jfloatArray ref = __audioDataJVM;
-            __audioDataJVM = NULL;
-            env->DeleteGlobalRef(ref);
-            delete[] __hopper;
-            delete[] __dspOutput;
-            __hopper = NULL;
-            __dspOutput = NULL;
-        }
-    }
-
-    JNIEXPORT jfloatArray JNICALL Java_com_yourdomain_yourapp_SurfaceViewDSP_getDspOutput(JNIEnv *env, jobject thiz) {
-        assert( __audioDataJVM != NULL);
-        assert(__dspOutput != NULL);
-        assert(__hopper != NULL);
-        int64_t nsStart = 0LL, nsEnd = 0LL;
-        nsStart = cnanos();
-        if (recorder.live()) {
-            recorder.getAudio( &__hopper[0] );
-            if( dspProcessor != NULL ) {
-                dspProcessor->setSamplingRate(recorder.samplingRate());
-                dspProcessor->process( &__hopper[0], recorder.getBufferLength(), &__dspOutput[0] );
-                for( int n=0; n < outputBufferLen; ++n ) __hopper[n] = __dspOutput[n];
-
-                #ifdef DEBUG_FILE_DUMPS
-                float pitchEst = dspProcessor->getPitch();
-                float nacIndex = dspProcessor->getNacIndex();
-                float pitchMidi = dspProcessor->getPitchMidi();
-                float midiNoteNum = dspProcessor->getMidiNoteNumber();
-                fDspOut.writeAppendCSV( &__hopper[0], outputBufferLen, true );
-                fDspOutPitchEst.writeAppendCSV( &pitchEst, 1, false );
-                fDspOutNacIndices.writeAppendCSV( &nacIndex, 1, false );
-                fDspOutPitchMidi.writeAppendCSV( &pitchMidi, 1, false );
-                fDspOutMidiNoteNum.writeAppendCSV( &midiNoteNum, 1, false );
-                #endif
-            }
-        } else {
-            for( int n=0; n < outputBufferLen; ++n ) __hopper[n] = 0;
-            LOGI("getAudio: Recorder NOT recording, returning zero-filled result");
-        }
-        env->SetFloatArrayRegion( __audioDataJVM, 0, outputBufferLen, &__hopper[0] );
-        nsEnd = cnanos();
-        int ns = (int) (nsEnd - nsStart);
-//        LOGI("getDspOutput %d ns", ns);
-        return __audioDataJVM;
+        live().stop();
     }
 
-    JNIEXPORT jfloat JNICALL Java_com_yourdomain_yourapp_SurfaceViewDSP_getPitch(JNIEnv *env, jobject thiz) {
-        if( dspProcessor != NULL ) {
-            return dspProcessor->getPitch();
-        } else {
-            return 0.f;
-        }
+    // slot of the latest complete frame in the bridge buffer, owned by the caller until the next call
+    JNIEXPORT jint JNICALL Java_com_yourdomain_yourapp_SurfaceViewDSP_acquireDspFrame(JNIEnv *env, jobject thiz) {
+        return live().getFrames().acquire();
     }
 
-    JNIEXPORT jfloat JNICALL Java_com_yourdomain_yourapp_SurfaceViewDSP_getPitchMidi(JNIEnv *env, jobject thiz) {
-        if( dspProcessor != NULL ) {
-            return dspProcessor->getPitchMidi();
-        } else {
-            return 0.f;
+    /**
+     * Reduces the range from..to of a frame owned by the UI to width min/max/mean columns, see
+     * Decimator.h.
+     *
+     * @param slot from acquireDspFrame()
+     * @param columns direct ByteBuffer, native order, room for 3 * width floats
+     * @return columns written, 0 for an empty range or a too small buffer
+     */
+    JNIEXPORT jint JNICALL Java_com_yourdomain_yourapp_SurfaceViewDSP_decimateDspFrame(JNIEnv *env, jobject thiz, jint slot, jint from, jint to, jint width, jint scale, jobject columns) {
+        static Decimator decimator;     // UI thread only
+        TripleBuffer& frames = live().getFrames();
+        float* out = (float*) env->GetDirectBufferAddress( columns );
+        to = std::min( to, (jint) frames.getLength( slot ) );
+        from = std::max( from, 0 );
+        if( out == NULL || env->GetDirectBufferCapacity( columns ) < 3 * (jlong) sizeof(float) * width || width <= 0 || to <= from ) {
+            return 0;
         }
+        decimator.process( frames.getFrame( slot ), from, to, width, scale, out );
+        return width;
     }
 
-    JNIEXPORT jint JNICALL Java_com_yourdomain_yourapp_SurfaceViewDSP_getMidiNoteNumber(JNIEnv *env, jobject thiz) {
-        if( dspProcessor != NULL ) {
-            return dspProcessor->getMidiNoteNumber();
-        } else {
-            return 0.f;
-        }
+    JNIEXPORT void JNICALL Java_com_yourdomain_yourapp_SurfaceViewDSP_getAnalysisSnapshot(JNIEnv *env, jobject thiz, jobject out) {
+        copyAnalysisSnapshot( env, out, live().getSnapshot().load() );
     }
 } // extern "C"
 
@@ -219,6 +327,7 @@ Java_com_yourdomain_yourapp_MainActivity_openMediaFile(
     jstring filename
 )
 {
+    static MediaStreamer media;
     jboolean retVal = JNI_FALSE;
     const char* utf8 = env->GetStringUTFChars( filename, NULL );
     if( media.openFile( utf8 ) ) {
@@ -312,6 +421,10 @@ Java_com_yourdomain_yourapp_MainActivity_openMediaFile(
 extern "C"
 JNIEXPORT void JNICALL
 Java_com_yourdomain_yourapp_MainActivity_startup(JNIEnv *env, jobject thiz) {
+
+    // direct / FFT autocorrelation crossover of this device, before the first processor is built
+    AcorrEngine<float>::calibrateDefaults();
+
 //    AutocorrelationNormalized* ac;
 //    ac = new AutocorrelationNormalized( 32 );
 //    ac->process( &testIn[0], 32, &testOut[0] );
@@ -332,4 +445,29 @@ Java_com_yourdomain_yourapp_MainActivity_startup(JNIEnv *env, jobject thiz) {
 //    }
 
 //    test_real();
+//    bench_pitch_estimators();
+//    bench_autocorrelation();
+//    bench_multi_resolution();
+//    bench_pitch_tracker();
+//    bench_onsets();
+//    test_note_mapper();
+//    test_pitch_bend();
+//    test_pitch_kalman();
+//    bench_octave_verifier();
+//    bench_ensemble();
+//    bench_spectral_context();
+//    bench_swipe();
+//    bench_lse();
+//    bench_lpc();
+//    test_triple_buffer();
+//    test_seqlock();
+//    test_note_events();
+//    test_midi_engine();
+//    test_smf_recorder();
+//    test_decimator();
+//    bench_decimator();
+//    test_analysis_engine();
+//    test_processor_swap();
+//    test_dsp_graph();
+//    bench_worker_pool();
 }
\ No newline at end of file
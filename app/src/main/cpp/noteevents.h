@@ -0,0 +1,139 @@
+#pragma once
+
+/**
+ * Note events from the analysis frames
+ *
+ * Every analysis frame the mapped note of the estimator, the onset detector and the frame level
+ * become discrete MIDI events in a NoteEventQueue, stamped with the capture time of the frame, or of
+ * the onset hop for a note an onset started:
+ *
+ *  - a voiced frame starts its note, or replaces the sounding one when the note changed
+ *  - an onset while nothing sounds restarts the last note at once, provisionally: the pitch
+ *    estimator has to confirm it within NOTE_PROVISIONAL_MS or it is released again
+ *  - an unvoiced frame releases the sounding note
+ *  - pitch bends of the PitchBendTracker pass through while the note they belong to sounds
+ *  - the frame level is sent as expression (NOTE_EXPRESSION_CC) while a note sounds, when it moved
+ *    by NOTE_EXPRESSION_STEP or more
+ *
+ * Since every frame is seen, a note change between two polls of the consumer can not get lost.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+
+#include "NoteEventQueue.h"
+
+#define NOTE_PROVISIONAL_MS 60          // how long a note started by an onset waits for a pitch
+#define NOTE_VELOCITY 100
+#define NOTE_EXPRESSION_CC 11
+#define NOTE_EXPRESSION_MIN_DB -60.f    // level of expression 0, 0 dB is 127
+#define NOTE_EXPRESSION_STEP 4
+
+class NoteEventGenerator
+{
+public:
+    NoteEventGenerator( NoteEventQueue& queue ) : queue( queue ) {
+        reset();
+    }
+
+    void reset() {
+        playing = false;
+        provisional = false;
+        provisionalStart = 0;
+        note = 0;
+        expression = -1;
+    }
+
+    /**
+     * One analysis frame.
+     *
+     * @param nanos capture time of the frame
+     * @param mapped MIDI note of the frame, 0 when unvoiced
+     * @param onset the onset detector fired in the frame
+     * @param levelDb frame level, dB full scale
+     * @param onsetNanos capture time of the onset within the frame, -1 for the frame time
+     */
+    void process( int64_t nanos, int mapped, bool onset, float levelDb, int64_t onsetNanos = -1 ) {
+        if( onset && !playing && note > 0 ) {
+            int64_t at = onsetNanos >= 0 ? onsetNanos : nanos;
+            playing = true;
+            provisional = true;
+            provisionalStart = at;
+            sendExpression( at, levelDb, true );
+            send( at, NOTE_EVENT_NOTE_ON, note, NOTE_VELOCITY );
+        }
+
+        if( mapped > 0 ) {
+            provisional = false;
+            if( !playing || mapped != note ) {
+                if( playing ) {
+                    send( nanos, NOTE_EVENT_NOTE_OFF, note, NOTE_VELOCITY );
+                }
+                playing = true;
+                note = mapped;
+                sendExpression( nanos, levelDb, true );
+                send( nanos, NOTE_EVENT_NOTE_ON, note, NOTE_VELOCITY );
+            } else {
+                sendExpression( nanos, levelDb, false );
+            }
+        } else if( provisional && nanos - provisionalStart < NOTE_PROVISIONAL_MS * 1000000LL ) {
+            // wait for the pitch estimator to catch up with the onset
+        } else {
+            provisional = false;
+            if( playing ) {
+                playing = false;
+                send( nanos, NOTE_EVENT_NOTE_OFF, note, NOTE_VELOCITY );
+            }
+        }
+    }
+
+    /**
+     * A pitch bend of the PitchBendTracker, dropped unless its note sounds.
+     *
+     * @param bend 0..16383
+     */
+    void bend( int64_t nanos, int bendNote, int bend ) {
+        if( playing && bendNote == note ) {
+            send( nanos, NOTE_EVENT_PITCH_BEND, bend & 0x7F, (bend >> 7) & 0x7F );
+        }
+    }
+
+    // releases the sounding note, e.g. when the recording stops
+    void release( int64_t nanos ) {
+        if( playing ) {
+            send( nanos, NOTE_EVENT_NOTE_OFF, note, NOTE_VELOCITY );
+        }
+        reset();
+    }
+
+    bool isPlaying() { return playing; }
+    int getNote() { return note; }
+
+protected:
+    void sendExpression( int64_t nanos, float levelDb, bool force ) {
+        float x = (levelDb - NOTE_EXPRESSION_MIN_DB) / -NOTE_EXPRESSION_MIN_DB;
+        int value = std::max( 0, std::min( 127, (int)lrintf( 127.f * x ) ) );
+        if( force || expression < 0 || abs( value - expression ) >= NOTE_EXPRESSION_STEP ) {
+            expression = value;
+            send( nanos, NOTE_EVENT_CONTROL_CHANGE, NOTE_EXPRESSION_CC, value );
+        }
+    }
+
+    void send( int64_t nanos, int status, int data1, int data2 ) {
+        NoteEvent e;
+        e.nanos = nanos;
+        e.status = (uint8_t)status;
+        e.data1 = (uint8_t)data1;
+        e.data2 = (uint8_t)data2;
+        queue.push( e );
+    }
+
+protected:
+    NoteEventQueue& queue;
+    bool            playing;
+    bool            provisional;
+    int64_t         provisionalStart;
+    int             note;           // sounding note, or the last one after an unvoiced frame released it
+    int             expression;     // last value sent, -1 before the first
+};
@@ -0,0 +1,266 @@
+#pragma once
+
+/**
+ * Frequency to MIDI note mapping
+ *
+ * A pitch is converted to cents above the root of the tuning with one log2, the octave (or scale
+ * period) is split off and the position within it is looked up in a table of NOTEMAP_LUT_SIZE
+ * cells that holds the nearest enabled scale degree, so the cost does not depend on the number of
+ * notes or the temperament. The table cell only narrows the choice to a degree and its neighbours,
+ * the final pick compares exact distances.
+ *
+ * The tuning is a list of degree offsets in cents above the root with the period last, as in a
+ * Scala .scl file (12 tone equal temperament is 100, 200 ... 1200). Degree k of period p maps to
+ * MIDI note root + p * degrees + k, the root frequency follows from the A4 reference in equal
+ * temperament. A mask of enabled degrees snaps to a key/scale: pitches land on the nearest degree
+ * that is enabled.
+ *
+ * The fractional note is the mapped note plus the deviation from its degree in semitones, the
+ * value a pitch bend needs.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NOTEMAP_MAX_DEGREES 64
+#define NOTEMAP_LUT_SIZE 1200
+#define NOTEMAP_DEFAULT_A4 440.0f
+
+// degree masks for 12 tone tunings, bit k enables degree k above the root
+#define NOTEMAP_MASK_CHROMATIC      0xFFFull
+#define NOTEMAP_MASK_MAJOR          0xAB5ull    // 0 2 4 5 7 9 11
+#define NOTEMAP_MASK_MINOR          0x5ADull    // 0 2 3 5 7 8 10
+#define NOTEMAP_MASK_PENTATONIC     0x295ull    // 0 2 4 7 9
+#define NOTEMAP_MASK_BLUES          0x4E9ull    // 0 3 5 6 7 10
+
+struct NoteMapping
+{
+    int     note;           // MIDI note 0..127
+    float   fractional;     // note + deviation in semitones
+    float   cents;          // deviation from the degree
+    float   hz;             // frequency of the degree
+};
+
+class NoteMapper
+{
+public:
+    NoteMapper( ) {
+        this->a4 = NOTEMAP_DEFAULT_A4;
+        this->root = 0;
+        this->mask = ~0ull;
+        setEqualTemperament( 12 );
+    }
+
+    // A4 reference in Hz
+    void setReference( float a4 ) {
+        this->a4 = a4;
+        update();
+    }
+    float getReference() { return a4; }
+
+    // MIDI note of degree 0, any octave (0 = C, 9 = A ...)
+    void setRoot( int rootNote ) {
+        this->root = ((rootNote % 12) + 12) % 12;
+        update();
+    }
+    int getRoot() { return root; }
+
+    // bit k enables degree k, degrees above 63 are always enabled
+    void setScaleMask( uint64_t mask ) {
+        this->mask = mask;
+        update();
+    }
+    uint64_t getScaleMask() { return mask; }
+
+    void setEqualTemperament( int notesPerOctave ) {
+        double cents[ NOTEMAP_MAX_DEGREES ];
+        int n = std::min( std::max( notesPerOctave, 1 ), NOTEMAP_MAX_DEGREES );
+        for( int k=0; k < n; ++k ) {
+            cents[ k ] = 1200.0 * (k + 1) / n;
+        }
+        setTuning( cents, n );
+    }
+
+    /**
+     * Degree offsets in cents above the root, ascending, the last one is the period.
+     *
+     * @return false if the list is empty, too long or not ascending
+     */
+    bool setTuning( const double* cents, int n ) {
+        if( n < 1 || n > NOTEMAP_MAX_DEGREES ) {
+            return false;
+        }
+        for( int k=0; k < n; ++k ) {
+            if( cents[ k ] <= (k > 0 ? cents[ k - 1 ] : 0.0) ) {
+                return false;
+            }
+        }
+        degreesN = n;
+        degreeCents[ 0 ] = 0;
+        for( int k=1; k < n; ++k ) {
+            degreeCents[ k ] = (float)cents[ k - 1 ];
+        }
+        period = (float)cents[ n - 1 ];
+        update();
+        return true;
+    }
+
+    bool setTuningRatios( const double* ratios, int n ) {
+        double cents[ NOTEMAP_MAX_DEGREES ];
+        if( n < 1 || n > NOTEMAP_MAX_DEGREES ) {
+            return false;
+        }
+        for( int k=0; k < n; ++k ) {
+            if( ratios[ k ] <= 0 ) return false;
+            cents[ k ] = 1200.0 * log2( ratios[ k ] );
+        }
+        return setTuning( cents, n );
+    }
+
+    /**
+     * Scala .scl text: '!' comment lines, a description, the note count, then one pitch per line,
+     * cents when it contains a '.', otherwise a ratio "a/b" or a whole number.
+     */
+    bool setTuningScala( const char* text ) {
+        double cents[ NOTEMAP_MAX_DEGREES ];
+        int count = -1, n = 0, line = 0;
+        const char* p = text;
+        while( *p ) {
+            const char* end = strchr( p, '\n' );
+            if( !end ) end = p + strlen( p );
+            while( p < end && (*p == ' ' || *p == '\t') ) ++p;
+            if( *p != '!' ) {
+                if( line == 1 ) {
+                    count = atoi( p );
+                    if( count < 1 || count > NOTEMAP_MAX_DEGREES ) return false;
+                } else if( line > 1 && n < count ) {
+                    const char* dot = (const char*) memchr( p, '.', end - p );
+                    const char* slash = (const char*) memchr( p, '/', end - p );
+                    if( dot ) {
+                        cents[ n ] = strtod( p, NULL );
+                    } else {
+                        double num = strtod( p, NULL );
+                        double den = slash ? strtod( slash + 1, NULL ) : 1.0;
+                        if( num <= 0 || den <= 0 ) return false;
+                        cents[ n ] = 1200.0 * log2( num / den );
+                    }
+                    ++n;
+                }
+                ++line;
+            }
+            p = *end ? end + 1 : end;
+        }
+        return count > 0 && n == count && setTuning( cents, n );
+    }
+
+    int getDegreesN() { return degreesN; }
+
+    /**
+     * @return false for pitches outside MIDI 0..127, m is zeroed
+     */
+    bool map( float hz, NoteMapping& m ) {
+        if( hz > 0 ) {
+            float c = 1200.f * log2f( hz / rootHz );
+            float periods = floorf( c / period );
+            float within = c - periods * period;
+            int cell = (int)(within * lutScale);
+            cell = cell < 0 ? 0 : (cell >= NOTEMAP_LUT_SIZE ? NOTEMAP_LUT_SIZE - 1 : cell);
+
+            // the cell holds the nearest target of its center, a neighbour can be nearer at the edges
+            int t = lut[ cell ];
+            if( t > 0 && fabsf( within - targetCents[ t - 1 ] ) < fabsf( within - targetCents[ t ] ) ) {
+                --t;
+            } else if( t + 1 < targetsN && fabsf( within - targetCents[ t + 1 ] ) < fabsf( within - targetCents[ t ] ) ) {
+                ++t;
+            }
+
+            // targets below 0 and past the period belong to the neighbouring periods
+            int k = targetDegree[ t ];
+            int p = (int)periods;
+            if( k < 0 ) { k += degreesN; --p; }
+            if( k >= degreesN ) { k -= degreesN; ++p; }
+
+            int note = rootMidi + p * degreesN + k;
+            if( note >= 0 && note <= 127 ) {
+                float target = p * period + degreeCents[ k ];
+                m.note = note;
+                m.cents = c - target;
+                m.fractional = note + m.cents / 100.f;
+                m.hz = rootHz * exp2f( target / 1200.f );
+                return true;
+            }
+        }
+        m.note = 0;
+        m.fractional = 0;
+        m.cents = 0;
+        m.hz = 0;
+        return false;
+    }
+
+protected:
+    bool enabled( int degree ) {
+        return degree >= 64 || ((mask >> degree) & 1ull);
+    }
+
+    void update() {
+        // degree 0 sits on the lowest MIDI note of the root pitch class, 12 tone equal tempered
+        rootMidi = root;
+        rootHz = a4 * exp2f( (rootMidi - 69) / 12.f );
+        lutScale = NOTEMAP_LUT_SIZE / period;
+
+        // enabled degrees in order, framed by the last one of the period below and the first one
+        // of the period above
+        int first = -1, last = -1;
+        for( int k=0; k < degreesN; ++k ) {
+            if( enabled( k ) ) {
+                if( first < 0 ) first = k;
+                last = k;
+            }
+        }
+        if( first < 0 ) {
+            // an empty mask maps everything chromatically
+            mask = ~0ull;
+            first = 0;
+            last = degreesN - 1;
+        }
+        targetsN = 0;
+        targetDegree[ targetsN ] = last - degreesN;
+        targetCents[ targetsN++ ] = degreeCents[ last ] - period;
+        for( int k=0; k < degreesN; ++k ) {
+            if( enabled( k ) ) {
+                targetDegree[ targetsN ] = k;
+                targetCents[ targetsN++ ] = degreeCents[ k ];
+            }
+        }
+        targetDegree[ targetsN ] = first + degreesN;
+        targetCents[ targetsN++ ] = degreeCents[ first ] + period;
+
+        // nearest target of every cell center
+        int t = 0;
+        for( int cell=0; cell < NOTEMAP_LUT_SIZE; ++cell ) {
+            float c = (cell + 0.5f) / lutScale;
+            while( t + 1 < targetsN && fabsf( c - targetCents[ t + 1 ] ) <= fabsf( c - targetCents[ t ] ) ) {
+                ++t;
+            }
+            lut[ cell ] = (int16_t)t;
+        }
+    }
+
+protected:
+    float       a4;
+    int         root;
+    int         rootMidi;
+    float       rootHz;
+    uint64_t    mask;
+    int         degreesN;
+    float       degreeCents[ NOTEMAP_MAX_DEGREES ];
+    float       period;
+    float       lutScale;
+    int16_t     lut[ NOTEMAP_LUT_SIZE ];
+    float       targetCents[ NOTEMAP_MAX_DEGREES + 2 ];
+    int         targetDegree[ NOTEMAP_MAX_DEGREES + 2 ];
+    int         targetsN;
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+/**
+ * Octave error check for autocorrelation pitch estimates
+ *
+ * The peak picking of the ACF and MPM estimators locks onto twice the period when the frame is
+ * nearly periodic at a subharmonic, and onto half the period when the even harmonics dominate.
+ * The verifier reads the power spectrum at the harmonics of the estimate f and its octave neighbours
+ * f/2 and 2f directly off the autocorrelation r the estimator already has (Wiener-Khinchin with a
+ * Hann lag window v), so no transform is run:
+ *
+ *      P(w) = r(0) + 2 sum_tau v(tau) r(tau) cos(w tau)
+ *
+ * The harmonics of 2f and f are a subset of those of f/2, so everything comes from the
+ * 2 * OCTAVE_HARMONICS multiples of f/2, evaluated together with a cosine recurrence: one pass over
+ * the lags, the inner loop runs across the frequencies and vectorizes. The multiples fall into three
+ * groups by their mean power: the odd multiples of f/2 (harmonics only if f/2 is the pitch), the odd
+ * multiples of f (harmonics of f/2 and f) and the multiples of 2f (harmonics of all three).
+ *
+ * The estimate moves down an octave when the odd multiples of f/2 carry OCTAVE_DOWN_LEVEL of the
+ * power of the harmonics of f, and up an octave when the odd multiples of f are below
+ * OCTAVE_UP_LEVEL of the multiples of 2f. Comparing groups instead of summing all harmonics keeps a
+ * voice with strong even harmonics or a weak fundamental on the right octave.
+ *
+ * All storage is allocated in the constructor.
+ */
+
+#include <algorithm>
+#include <math.h>
+
+#define OCTAVE_HARMONICS 8          // harmonics of the estimate that are scored
+#define OCTAVE_MAX_HZ 3000.f        // harmonics above are not scored, there is little voice left
+#define OCTAVE_DOWN_LEVEL 0.35f     // odd harmonics of f / 2 against the harmonics of f
+#define OCTAVE_UP_LEVEL 0.08f       // odd harmonics of f against the harmonics of 2 f
+
+class OctaveVerifier
+{
+public:
+    static const int F = 2 * OCTAVE_HARMONICS;     // multiples of f / 2
+
+    explicit OctaveVerifier( int maxLags ) {
+        this->maxLags = maxLags;
+        this->window = new float[ maxLags ];
+        this->windowLags = 0;
+        this->corrections = 0;
+        for( int k=0; k < 3; ++k ) {
+            this->level[ k ] = 0;
+        }
+    }
+    ~OctaveVerifier( ) {
+        delete[] window;
+    }
+
+    /**
+     * Check an estimate against its octave neighbours.
+     *
+     * @param acf autocorrelation of the frame, any scale, lags [0, lags) are read
+     * @param pitch estimate in Hz, 0 when unvoiced
+     * @param minHz lowest pitch the estimator may report, neighbours outside are not considered
+     * @return the estimate or the octave neighbour that replaced it
+     */
+    float verify( const float* acf, int lags, float R, float pitch, float minHz, float maxHz ) {
+        level[ 0 ] = level[ 1 ] = level[ 2 ] = 0;
+        lags = std::min( lags, maxLags );
+        if( pitch <= 0 || lags < 2 || acf[ 0 ] <= 0 ) {
+            return pitch;
+        }
+        prepareWindow( lags );
+
+        // P at the multiples j * f / 2 of the half estimate, cos((tau + 1) w) = 2 cos(w) cos(tau w) - cos((tau - 1) w)
+        const float limit = std::min( 0.5f * R, OCTAVE_MAX_HZ );
+        const float half = 0.5f * pitch;
+        int valid = 0;
+        float c2[ F ], prev[ F ], cur[ F ], p[ F ];
+        for( int j=0; j < F; ++j ) {
+            float w = 2.f * (float)M_PI * (j + 1) * half / R;
+            c2[ j ] = 2.f * cosf( w );
+            prev[ j ] = 1.f;
+            cur[ j ] = cosf( w );
+            p[ j ] = 0;
+            if( (j + 1) * half < limit ) valid = j + 1;
+        }
+        for( int tau=1; tau < lags; ++tau ) {
+            const float a = window[ tau ] * acf[ tau ];
+            for( int j=0; j < F; ++j ) {
+                p[ j ] += a * cur[ j ];
+                float next = c2[ j ] * cur[ j ] - prev[ j ];
+                prev[ j ] = cur[ j ];
+                cur[ j ] = next;
+            }
+        }
+
+        // mean power at the odd multiples of f / 2, the odd multiples of f and the multiples of 2 f:
+        // all three are harmonics of f / 2, the last two of f and only the last one of 2 f
+        int count[ 3 ] = { 0, 0, 0 };
+        for( int j=0; j < valid; ++j ) {
+            float power = std::max( acf[ 0 ] + 2.f * p[ j ], 0.f );
+            int k = (j + 1) % 2 ? 0 : ((j + 1) % 4 ? 1 : 2);
+            level[ k ] += power;
+            ++count[ k ];
+        }
+        for( int k=0; k < 3; ++k ) {
+            level[ k ] = count[ k ] > 0 ? level[ k ] / count[ k ] : 0.f;
+        }
+
+        // f / 2 needs its odd harmonics to stand out of the gaps of f, 2 f needs the odd harmonics
+        // of f to be missing
+        float harmonic = 0.5f * (level[ 1 ] + level[ 2 ]);
+        float best = pitch;
+        if( half >= minHz && level[ 0 ] > OCTAVE_DOWN_LEVEL * harmonic ) {
+            best = half;
+        } else if( 2.f * pitch <= maxHz && count[ 2 ] > 0 && level[ 1 ] < OCTAVE_UP_LEVEL * level[ 2 ] ) {
+            best = 2.f * pitch;
+        }
+        if( best != pitch ) {
+            ++corrections;
+        }
+        return best;
+    }
+
+    // mean power at the odd multiples of f / 2 (0), the odd multiples of f (1) and the multiples of 2 f (2)
+    float getLevel( int k ) { return level[ k ]; }
+    int getCorrections() { return corrections; }
+
+protected:
+    void prepareWindow( int lags ) {
+        if( lags == windowLags ) {
+            return;
+        }
+        for( int tau=0; tau < lags; ++tau ) {
+            window[ tau ] = 0.5f + 0.5f * cosf( (float)M_PI * tau / lags );
+        }
+        windowLags = lags;
+    }
+
+protected:
+    int     maxLags;
+    float*  window;         // half Hann lag window
+    int     windowLags;
+    float   level[ 3 ];
+    int     corrections;
+};
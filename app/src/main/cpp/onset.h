@@ -0,0 +1,192 @@
+#pragma once
+
+/**
+ * Low latency onset detection
+ *
+ * The input is cut into hops of B samples (64 at 11025 Hz, 5.8 ms). Every hop the newest 2B samples
+ * are Hann windowed and transformed with the FFT backend of fft.h, the detection function is either
+ *
+ *      spectral flux           sum_k max( 0, log(1 + g|X_k|) - log(1 + g|X_k'|) )
+ *      high frequency content  sum_k k |X_k|^2
+ *
+ * where X' is the spectrum of the previous hop. An onset fires on the first hop whose detection value
+ * exceeds an adaptive threshold, the mean of the last ONSET_HISTORY values scaled plus a constant,
+ * followed by a refractory period. There is no lookahead: the event is available as soon as the hop
+ * that contains the attack is complete, long before a pitch estimator has a full voiced window.
+ *
+ * Events carry the absolute sample position of the hop start and are pushed to a single producer,
+ * single consumer queue, so the note layer can poll them from its own thread.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+
+#include "fft.h"
+#include "log.h"
+#include "LockFreeQueue.h"
+
+#define ONSET_HISTORY 16                // hops in the adaptive threshold mean
+#define ONSET_THRESHOLD_MULTIPLIER 2.0f
+#define ONSET_FLUX_DELTA 4.0f           // constant threshold part, log magnitude units
+#define ONSET_HFC_DELTA 0.5f
+#define ONSET_LOG_GAIN 10.0f            // g of the log compression
+#define ONSET_MIN_ENERGY 1e-4f          // mean square of a hop below which nothing fires (-40 dB)
+#define ONSET_MIN_INTERVAL_MS 50.0f     // refractory period
+#define ONSET_QUEUE_LENGTH 32
+
+enum OnsetFunction
+{
+    OnsetSpectralFlux = 0,
+    OnsetHighFrequencyContent = 1
+};
+
+struct OnsetEvent
+{
+    int64_t sample;     // absolute position of the hop the attack was found in
+    float   strength;   // detection value over threshold, >= 1
+};
+
+template <int B, typename T> class OnsetDetector
+{
+public:
+    static const int N = 2 * B;
+
+    OnsetDetector( OnsetFunction function = OnsetSpectralFlux ) {
+        this->function = function;
+        this->R = 11025;
+        for( int n=0; n < N; ++n ) {
+            window[ n ] = (T)(0.5 - 0.5 * cos( 2.0 * M_PI * n / N ));
+        }
+        reset();
+    }
+
+    void setSamplingRate( float R ) { this->R = R; }
+    void setFunction( OnsetFunction function ) { this->function = function; reset(); }
+
+    void reset() {
+        for( int n=0; n < N; ++n ) {
+            history[ n ] = 0;
+        }
+        for( int k=0; k <= B; ++k ) {
+            prev[ k ] = 0;
+        }
+        for( int n=0; n < ONSET_HISTORY; ++n ) {
+            values[ n ] = 0;
+        }
+        valuesSum = 0;
+        valuesPos = 0;
+        fill = 0;
+        hopFill = 0;
+        samples = 0;
+        lastOnset = INT64_MIN / 2;
+        detection = 0;
+        threshold = 0;
+    }
+
+    /**
+     * Feed any number of samples, complete hops are analysed as they fill up.
+     *
+     * @return onsets found in this call, the events are in the queue
+     */
+    int process( const T* x, int len ) {
+        int found = 0;
+        for( int n=0; n < len; ) {
+            int take = std::min( B - hopFill, len - n );
+            for( int j=0; j < take; ++j ) {
+                history[ B + hopFill + j ] = x[ n + j ];
+            }
+            hopFill += take;
+            n += take;
+            if( hopFill == B ) {
+                found += hop();
+                for( int j=0; j < B; ++j ) {
+                    history[ j ] = history[ B + j ];
+                }
+                hopFill = 0;
+                samples += B;
+            }
+        }
+        return found;
+    }
+
+    bool pop( OnsetEvent& e ) { return events.pop( e ); }
+
+    // samples consumed by complete hops, the clock of OnsetEvent::sample
+    int64_t getSamples() { return samples; }
+    T getDetection() { return detection; }
+    T getThreshold() { return threshold; }
+
+protected:
+    int hop() {
+        T energy = 0;
+        for( int n=0; n < B; ++n ) {
+            energy += history[ B + n ] * history[ B + n ];
+        }
+        energy /= B;
+
+        for( int n=0; n < N; ++n ) {
+            z[ 2*n ]     = history[ n ] * window[ n ];
+            z[ 2*n + 1 ] = 0;
+        }
+        F.fft( z );
+
+        T d = 0;
+        if( function == OnsetSpectralFlux ) {
+            for( int k=1; k <= B; ++k ) {
+                T m = (T)log1pf( ONSET_LOG_GAIN * sqrtf( z[ 2*k ] * z[ 2*k ] + z[ 2*k + 1 ] * z[ 2*k + 1 ] ) );
+                d += std::max( m - prev[ k ], (T)0 );
+                prev[ k ] = m;
+            }
+        } else {
+            for( int k=1; k <= B; ++k ) {
+                d += k * (z[ 2*k ] * z[ 2*k ] + z[ 2*k + 1 ] * z[ 2*k + 1 ]);
+            }
+            d /= (T)N;
+        }
+        detection = d;
+
+        // the threshold only sees past hops, ramping up during the first hops after a reset
+        T mean = fill > 0 ? valuesSum / fill : (T)0;
+        T delta = function == OnsetSpectralFlux ? (T)ONSET_FLUX_DELTA : (T)ONSET_HFC_DELTA;
+        threshold = (T)ONSET_THRESHOLD_MULTIPLIER * mean + delta;
+
+        valuesSum += d - values[ valuesPos ];
+        values[ valuesPos ] = d;
+        valuesPos = (valuesPos + 1) % ONSET_HISTORY;
+        fill = std::min( fill + 1, ONSET_HISTORY );
+
+        const int64_t minInterval = (int64_t)(ONSET_MIN_INTERVAL_MS * R / 1000.f);
+        if( d > threshold && energy > (T)ONSET_MIN_ENERGY && samples - lastOnset >= minInterval ) {
+            lastOnset = samples;
+            OnsetEvent e;
+            e.sample = samples;
+            e.strength = (float)(d / threshold);
+            if( !events.push( e ) ) {
+                LOGE("OnsetDetector queue full");
+            }
+            return 1;
+        }
+        return 0;
+    }
+
+protected:
+    OnsetFunction   function;
+    float           R;
+    FFT<N, T>       F;
+    T               window[ N ];
+    T               history[ N ];   // previous hop, then the hop being filled
+    T               z[ 2*N ];
+    T               prev[ B + 1 ];
+    T               values[ ONSET_HISTORY ];
+    T               valuesSum;
+    int             valuesPos;
+    int             fill;
+    int             hopFill;
+    int64_t         samples;
+    int64_t         lastOnset;
+    T               detection;
+    T               threshold;
+
+    LockFreeQueue<OnsetEvent, ONSET_QUEUE_LENGTH> events;
+};
@@ -0,0 +1,209 @@
+#pragma once
+
+/**
+ * Pitch bend stream with vibrato tracking
+ *
+ * Every analysis frame the fractional note of the estimator (see NoteMapper) is turned into the
+ * deviation from the active note in cents and a 14 bit pitch bend value for a configurable bend
+ * range, centered on 8192.
+ *
+ * A bend is only emitted when the deviation moved by more than a cents threshold since the last
+ * one sent, or when the active note changed. The threshold adapts to the singing: it is
+ * PITCHBEND_THRESHOLD_CENTS on held notes and glides, and a fraction of the vibrato depth while a
+ * vibrato is detected, so a 50 cent vibrato costs a handful of events per cycle instead of one per
+ * frame.
+ *
+ * Vibrato rate and depth come from a sliding window of deviations: the depth from the standard
+ * deviation (a sine of amplitude A has A / sqrt(2)) and the rate from the zero crossings around the
+ * window mean. Both are O(1) per frame.
+ *
+ * With smoothing on the deviation comes from a PitchKalman over the estimate, fed
+ * with the clarity of the frame and restarted on note changes and onsets, so the per frame jitter
+ * of the estimator neither reaches the bend nor triggers events.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+
+#include "kalman.h"
+#include "log.h"
+#include "LockFreeQueue.h"
+
+#define PITCHBEND_CENTER 8192
+#define PITCHBEND_DEFAULT_RANGE 2.0f        // semitones up and down
+#define PITCHBEND_THRESHOLD_CENTS 4.0f
+#define PITCHBEND_VIBRATO_FRACTION 0.2f     // threshold during vibrato, of the depth
+#define PITCHBEND_QUEUE_LENGTH 64
+#define VIBRATO_WINDOW 32                   // frames, 0.74 s at 11025 / 256 frames per second
+#define VIBRATO_MIN_HZ 3.0f
+#define VIBRATO_MAX_HZ 9.0f
+#define VIBRATO_MIN_CENTS 8.0f              // depth, half peak to peak
+
+struct PitchBendEvent
+{
+    int note;   // active note the bend is relative to
+    int bend;   // 0..16383
+};
+
+class PitchBendTracker
+{
+public:
+    PitchBendTracker( float frameRate = 11025.f / 256.f, float range = PITCHBEND_DEFAULT_RANGE ) {
+        this->frameRate = frameRate;
+        this->range = range;
+        this->threshold = PITCHBEND_THRESHOLD_CENTS;
+        this->smoothing = false;
+        this->events = 0;
+        this->kalman.setFrameRate( frameRate );
+        reset();
+    }
+
+    void setFrameRate( float frameRate ) {
+        if( frameRate != this->frameRate ) {
+            this->frameRate = frameRate;
+            this->kalman.setFrameRate( frameRate );
+        }
+    }
+    void setSmoothing( bool enable ) { this->smoothing = enable; }
+    PitchKalman& getKalman() { return kalman; }
+    void setRange( float semitones ) { this->range = std::max( semitones, 0.01f ); }
+    float getRange() { return range; }
+    void setThreshold( float cents ) { this->threshold = cents; }
+
+    void reset() {
+        note = 0;
+        cents = 0;
+        sentCents = 0;
+        bend = PITCHBEND_CENTER;
+        filled = 0;
+        pos = 0;
+        sum = 0;
+        sumSq = 0;
+        crossings = 0;
+        for( int n=0; n < VIBRATO_WINDOW; ++n ) {
+            window[ n ] = 0;
+            crossed[ n ] = 0;
+        }
+        vibrato = false;
+        rate = 0;
+        depth = 0;
+        kalman.reset();
+    }
+
+    /**
+     * One analysis frame.
+     *
+     * @param activeNote MIDI note currently sounding, 0 when unvoiced
+     * @param fractionalNote estimated pitch in fractional MIDI notes
+     * @param clarity confidence of the estimate 0..1, weighs the frame in the smoothing
+     * @param onset a note onset was detected in this frame, restarts the smoothing
+     * @return true when a new bend value should be sent, it is also queued
+     */
+    bool process( int activeNote, float fractionalNote, float clarity = 1.f, bool onset = false ) {
+        if( activeNote <= 0 ) {
+            if( note > 0 ) {
+                reset();
+            }
+            return false;
+        }
+        bool changed = activeNote != note;
+        if( changed ) {
+            reset();
+            note = activeNote;
+        }
+        float pitchCents = 100.f * fractionalNote;
+        if( smoothing ) {
+            // the vibrato measured up to the last frame
+            float w = 2.f * (float)M_PI * rate;
+            kalman.setManeuver( vibrato ? depth * w * w : 0.f );
+            pitchCents = kalman.update( pitchCents, clarity, onset );
+        }
+        cents = pitchCents - 100.f * activeNote;
+        track();
+
+        float limit = vibrato ? std::max( threshold, PITCHBEND_VIBRATO_FRACTION * depth ) : threshold;
+        if( !changed && fabsf( cents - sentCents ) < limit ) {
+            return false;
+        }
+        sentCents = cents;
+        int b = PITCHBEND_CENTER + (int)lrintf( cents / (100.f * range) * PITCHBEND_CENTER );
+        bend = std::max( 0, std::min( 16383, b ) );
+        ++events;
+
+        PitchBendEvent e;
+        e.note = note;
+        e.bend = bend;
+        if( !queue.push( e ) ) {
+            LOGE("PitchBendTracker queue full");
+        }
+        return true;
+    }
+
+    bool pop( PitchBendEvent& e ) { return queue.pop( e ); }
+
+    int getBend() { return bend; }
+    float getCents() { return cents; }
+    bool isVibrato() { return vibrato; }
+    float getVibratoRate() { return rate; }
+    float getVibratoDepth() { return depth; }
+    int getEvents() { return events; }
+
+protected:
+    void track() {
+        // oldest value leaves the window
+        float old = window[ pos ];
+        if( filled == VIBRATO_WINDOW ) {
+            sum -= old;
+            sumSq -= old * old;
+            crossings -= crossed[ pos ];
+        }
+
+        // a zero crossing of the deviation around the window mean
+        float mean = filled > 0 ? (float)(sum / filled) : cents;
+        float last = window[ (pos + VIBRATO_WINDOW - 1) % VIBRATO_WINDOW ];
+        crossed[ pos ] = (filled > 0 && (last - mean) * (cents - mean) < 0) ? 1 : 0;
+        crossings += crossed[ pos ];
+
+        window[ pos ] = cents;
+        sum += cents;
+        sumSq += cents * cents;
+        pos = (pos + 1) % VIBRATO_WINDOW;
+        filled = std::min( filled + 1, VIBRATO_WINDOW );
+
+        // half a window already holds two cycles of a slow vibrato
+        vibrato = false;
+        if( filled >= VIBRATO_WINDOW / 2 ) {
+            double m = sum / filled;
+            double var = std::max( sumSq / filled - m * m, 0.0 );
+            depth = (float)sqrt( 2.0 * var );
+            rate = 0.5f * crossings * frameRate / filled;
+            vibrato = rate >= VIBRATO_MIN_HZ && rate <= VIBRATO_MAX_HZ && depth >= VIBRATO_MIN_CENTS;
+        }
+    }
+
+protected:
+    float       frameRate;
+    float       range;
+    float       threshold;
+    int         note;
+    float       cents;
+    float       sentCents;
+    int         bend;
+    int         events;
+    bool        smoothing;
+    PitchKalman kalman;
+
+    float       window[ VIBRATO_WINDOW ];
+    uint8_t     crossed[ VIBRATO_WINDOW ];
+    int         filled;
+    int         pos;
+    double      sum;        // doubles, the window sums are updated incrementally forever
+    double      sumSq;
+    int         crossings;
+    bool        vibrato;
+    float       rate;
+    float       depth;
+
+    LockFreeQueue<PitchBendEvent, PITCHBEND_QUEUE_LENGTH> queue;
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+/**
+ * Per-frame spectral context
+ *
+ * One forward FFT of the zero padded frame (size M = 2N) is shared by every spectral view of the
+ * frame, each view is computed on first use:
+ *
+ *      spectrum            X_k, complex, M bins
+ *      magnitude / power   |X_k|, |X_k|^2 for k = 0..M/2
+ *      Hann magnitude      |X_k| of the Hann windowed frame, for peak picking
+ *      autocorrelation     IFFT( |X|^2 ), the linear ACF of the frame (Wiener-Khinchin), lags 0..N-1
+ *                          equal AcorrEngine( N, AcorrLinear ) with scale 1
+ *      cepstrum            IFFT( log |X| ), the real cepstrum
+ *
+ * The even bins of the padded spectrum are the N point DFT of the frame, so a display of the plain
+ * N point magnitude reads them without another transform. A Hann window of N samples moves energy
+ * by one N point bin, two bins of the padded spectrum, so the windowed spectrum is the convolution
+ * 0.5 X_k - 0.25 (X_k-2 + X_k+2) and needs no transform either.
+ *
+ * Consumers call update() with the frame they are about to analyse. A frame equal to the loaded one
+ * keeps all views, so a spectral display, an ACF processor and the spectral pitch estimators fed the
+ * same buffer share one transform without agreeing on who loads it. A context is not thread safe,
+ * processors on different threads need their own.
+ *
+ * All storage is allocated in the constructor.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ffts.h"
+
+#define SPECTRAL_LOG_FLOOR 1e-6f        // magnitude floor of the cepstrum log
+
+class SpectralContext
+{
+public:
+    explicit SpectralContext( int frameLen ) {
+        this->N = frameLen;
+        this->M = 2 * frameLen;
+        this->frame = new float[ this->N ];
+        this->spectrum = new float[ 2 * this->M ];
+        this->magnitude = new float[ this->M / 2 + 1 ];
+        this->power = new float[ this->M / 2 + 1 ];
+        this->hann = new float[ this->M / 2 + 1 ];
+        this->acf = new float[ this->M ];
+        this->cepstrum = new float[ this->M ];
+        this->work = new float[ 2 * this->M ];
+        this->forwardTransforms = 0;
+        this->inverseTransforms = 0;
+        for( int n=0; n < this->N; ++n ) {
+            this->frame[ n ] = 0;
+        }
+        this->loaded = false;
+        invalidate();
+    }
+    ~SpectralContext( ) {
+        delete[] work;
+        delete[] cepstrum;
+        delete[] acf;
+        delete[] hann;
+        delete[] power;
+        delete[] magnitude;
+        delete[] spectrum;
+        delete[] frame;
+    }
+
+    /**
+     * Load the frame to analyse, len must be the frame length of the context.
+     *
+     * @return true if the frame differs from the loaded one and the views were dropped
+     */
+    bool update( const float* x, int len ) {
+        assert( len == this->N );
+        if( loaded && memcmp( x, frame, sizeof( float ) * N ) == 0 ) {
+            return false;
+        }
+        memcpy( frame, x, sizeof( float ) * N );
+        loaded = true;
+        invalidate();
+        return true;
+    }
+
+    int getFrameLength() { return N; }
+    // transform size, twice the frame length
+    int getSize() { return M; }
+    // bins of the magnitude and power views
+    int getBins() { return M / 2 + 1; }
+
+    const float* getFrame() { return frame; }
+
+    // interleaved real, imaginary
+    const float* getSpectrum() {
+        if( !hasSpectrum ) {
+            for( int n=0; n < N; ++n ) {
+                spectrum[ 2*n ]     = frame[ n ];
+                spectrum[ 2*n + 1 ] = 0;
+            }
+            dft.fftz( spectrum, N, M );
+            ++forwardTransforms;
+            hasSpectrum = true;
+        }
+        return spectrum;
+    }
+
+    const float* getPower() {
+        if( !hasPower ) {
+            const float* X = getSpectrum();
+            for( int k=0; k <= M / 2; ++k ) {
+                power[ k ] = X[ 2*k ] * X[ 2*k ] + X[ 2*k + 1 ] * X[ 2*k + 1 ];
+            }
+            hasPower = true;
+        }
+        return power;
+    }
+
+    const float* getMagnitude() {
+        if( !hasMagnitude ) {
+            const float* P = getPower();
+            for( int k=0; k <= M / 2; ++k ) {
+                magnitude[ k ] = sqrtf( P[ k ] );
+            }
+            hasMagnitude = true;
+        }
+        return magnitude;
+    }
+
+    const float* getHannMagnitude() {
+        if( !hasHann ) {
+            const float* X = getSpectrum();
+            for( int k=0; k <= M / 2; ++k ) {
+                int lo = 2 * ((k - 2 + M) % M), hi = 2 * ((k + 2) % M);
+                float re = 0.5f * X[ 2*k ] - 0.25f * (X[ lo ] + X[ hi ]);
+                float im = 0.5f * X[ 2*k + 1 ] - 0.25f * (X[ lo + 1 ] + X[ hi + 1 ]);
+                hann[ k ] = sqrtf( re * re + im * im );
+            }
+            hasHann = true;
+        }
+        return hann;
+    }
+
+    // lags [0, N) then the negative lags, like AutocorrelationNormalized
+    const float* getAutocorrelation() {
+        if( !hasAcf ) {
+            inverseOfSymmetric( getPower() );
+            for( int n=0; n < M; ++n ) {
+                acf[ n ] = work[ 2*n ];
+            }
+            hasAcf = true;
+        }
+        return acf;
+    }
+
+    // real cepstrum, quefrencies [0, M)
+    const float* getCepstrum() {
+        if( !hasCepstrum ) {
+            const float* A = getMagnitude();
+            for( int k=0; k <= M / 2; ++k ) {
+                cepstrum[ k ] = logf( std::max( A[ k ], SPECTRAL_LOG_FLOOR ) );
+            }
+            inverseOfSymmetric( cepstrum );
+            for( int n=0; n < M; ++n ) {
+                cepstrum[ n ] = work[ 2*n ];
+            }
+            hasCepstrum = true;
+        }
+        return cepstrum;
+    }
+
+    int64_t getForwardTransforms() { return forwardTransforms; }
+    int64_t getInverseTransforms() { return inverseTransforms; }
+
+protected:
+    void invalidate() {
+        hasSpectrum = false;
+        hasPower = false;
+        hasMagnitude = false;
+        hasHann = false;
+        hasAcf = false;
+        hasCepstrum = false;
+    }
+
+    // inverse transform of a real, even spectrum given for bins 0..M/2, into work
+    void inverseOfSymmetric( const float* half ) {
+        for( int k=0; k <= M / 2; ++k ) {
+            work[ 2*k ]     = half[ k ];
+            work[ 2*k + 1 ] = 0;
+        }
+        for( int k = M / 2 + 1; k < M; ++k ) {
+            work[ 2*k ]     = half[ M - k ];
+            work[ 2*k + 1 ] = 0;
+        }
+        dft.ifft( work, M );
+        ++inverseTransforms;
+    }
+
+protected:
+    int         N;
+    int         M;
+    float*      frame;
+    float*      spectrum;
+    float*      magnitude;
+    float*      power;
+    float*      hann;
+    float*      acf;
+    float*      cepstrum;
+    float*      work;
+    FFTS<float> dft;
+
+    bool        loaded;
+    bool        hasSpectrum;
+    bool        hasPower;
+    bool        hasMagnitude;
+    bool        hasHann;
+    bool        hasAcf;
+    bool        hasCepstrum;
+
+    int64_t     forwardTransforms;
+    int64_t     inverseTransforms;
+};
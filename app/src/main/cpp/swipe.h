@@ -0,0 +1,179 @@
+#pragma once
+
+/**
+ * SWIPE' pitch estimation
+ *
+ * A. Camacho, J. G. Harris, "A sawtooth waveform inspired pitch estimator for speech and music", 2008
+ *
+ * Every pitch candidate f of a log spaced grid (SWIPE_CANDIDATES_PER_OCTAVE) is scored by the inner
+ * product of a harmonic kernel with the loudness spectrum, the square root of the magnitude. The
+ * kernel of f has a cosine lobe at the fundamental and at every prime harmonic p (SWIPE'), with
+ * negative half lobes a half harmonic on either side,
+ *
+ *      K(f, q) = cos(2 pi q) / sqrt(q)         |q - p| < 1/4
+ *      K(f, q) = cos(2 pi q) / (2 sqrt(q))     1/4 <= |q - p| < 3/4,        q = frequency / f
+ *
+ * summed over p (the valley between two adjacent primes gets both halves) up to SWIPE_MAX_HZ. The
+ * negative lobes are scaled to give the kernel zero mean, so broadband noise scores near 0, and the
+ * kernel is normalized to unit length. Non prime harmonics are left out, so a subharmonic of the pitch gets
+ * little credit for the harmonics it shares with it.
+ *
+ * The kernels of all candidates are one sparse matrix, built once per sampling rate and transform
+ * size. A frame is one sparse matrix-vector product with the loudness spectrum: its cost is bound by
+ * the fixed number of non zeros (getNonZeros()), independent of the input. The best candidate is
+ * refined with a parabola over the log frequency grid, its normalized score is the pitch strength.
+ *
+ * Deviations from the paper: one window for all candidates (PitchEstimatorSwipe picks one long
+ * enough for the lowest notes) instead of a window per candidate, and no ERB resampling of the
+ * spectrum, the kernel reads the FFT bins directly.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+#include "Eigen/SparseCore"
+
+#define SWIPE_MIN_HZ 60.f
+#define SWIPE_MAX_PITCH_HZ 1600.f
+#define SWIPE_MAX_HZ 3000.f                 // highest kernel frequency
+#define SWIPE_CANDIDATES_PER_OCTAVE 24
+#define SWIPE_THRESHOLD 0.1f                // strength of a voiced frame, noise scores up to about 0.08
+
+class Swipe
+{
+public:
+    Swipe( ) : R( 0 ), M( 0 ), candidatesN( 0 ), kernelHi( 0 ), log2Min( 0 ), strength( 0 ) { }
+
+    /**
+     * Build the kernels for a sampling rate and a transform size, the magnitude spectrum has
+     * M / 2 + 1 bins. Only allocates when either changes.
+     */
+    void setup( float R, int M ) {
+        if( R == this->R && M == this->M ) {
+            return;
+        }
+        this->R = R;
+        this->M = M;
+        const int bins = M / 2 + 1;
+        const float binHz = R / M;
+        const float maxHz = std::min( SWIPE_MAX_HZ, 0.5f * R );
+
+        candidatesN = (int)floorf( SWIPE_CANDIDATES_PER_OCTAVE * log2f( SWIPE_MAX_PITCH_HZ / SWIPE_MIN_HZ ) ) + 1;
+        log2Min = log2f( SWIPE_MIN_HZ );
+
+        std::vector<Eigen::Triplet<float>> triplets;
+        std::vector<float> row( bins );
+        for( int c=0; c < candidatesN; ++c ) {
+            float f = candidateHz( (float)c );
+            for( int k=0; k < bins; ++k ) row[ k ] = 0;
+
+            float positive = 0, negative = 0;
+            int kLo = std::max( 1, (int)ceilf( 0.75f * f / binHz ) );
+            int kHi = std::min( bins - 1, (int)floorf( maxHz / binHz ) );
+            for( int k = kLo; k <= kHi; ++k ) {
+                // lobes of the two harmonics around q, adjacent primes both add to the valley between them
+                float q = k * binHz / f;
+                float w = 0;
+                for( int p = (int)floorf( q ); p <= (int)floorf( q ) + 1; ++p ) {
+                    float d = fabsf( q - p );
+                    if( !isPrimeOrOne( p ) || d >= 0.75f ) continue;
+                    w += (d < 0.25f ? 1.f : 0.5f) * cosf( 2.f * (float)M_PI * q ) / sqrtf( q );
+                }
+                row[ k ] = w;
+                if( w > 0 ) positive += w; else negative -= w;
+            }
+            // zero mean, so a flat (noise) spectrum scores 0
+            float balance = negative > 0 ? positive / negative : 0.f;
+            float norm = 0;
+            for( int k = kLo; k <= kHi; ++k ) {
+                if( row[ k ] < 0 ) row[ k ] *= balance;
+                norm += row[ k ] * row[ k ];
+            }
+            norm = norm > 0 ? 1.f / sqrtf( norm ) : 0.f;
+            for( int k = kLo; k <= kHi; ++k ) {
+                if( row[ k ] != 0 ) {
+                    triplets.push_back( Eigen::Triplet<float>( c, k, row[ k ] * norm ) );
+                }
+            }
+        }
+        kernel.resize( candidatesN, bins );
+        kernel.setFromTriplets( triplets.begin(), triplets.end() );
+        kernel.makeCompressed();
+        loudness.resize( bins );
+        scores.resize( candidatesN );
+        kernelHi = (int)floorf( maxHz / binHz );
+    }
+
+    /**
+     * @param magnitude M / 2 + 1 bins of the frame spectrum
+     * @return pitch in Hz, 0 when the best strength is below SWIPE_THRESHOLD
+     */
+    float pitch( const float* magnitude ) {
+        const int bins = M / 2 + 1;
+        float norm = 0;
+        for( int k=0; k < bins; ++k ) {
+            float l = k <= kernelHi ? sqrtf( magnitude[ k ] ) : 0.f;
+            loudness[ k ] = l;
+            norm += l * l;
+        }
+        strength = 0;
+        if( norm <= 0 ) {
+            return 0;
+        }
+
+        scores.noalias() = kernel * loudness;
+        scores *= 1.f / sqrtf( norm );
+
+        int best = 0;
+        for( int c=1; c < candidatesN; ++c ) {
+            if( scores[ c ] > scores[ best ] ) best = c;
+        }
+        strength = scores[ best ];
+        if( strength < SWIPE_THRESHOLD ) {
+            return 0;
+        }
+
+        float pos = 0;
+        if( best > 0 && best < candidatesN - 1 ) {
+            float a = scores[ best - 1 ], b = scores[ best ], d = scores[ best + 1 ];
+            float den = a - 2.f * b + d;
+            pos = den != 0 ? 0.5f * (a - d) / den : 0.f;
+        }
+        return candidateHz( best + pos );
+    }
+
+    float getStrength() { return strength; }
+    int getCandidatesN() { return candidatesN; }
+    // multiply-adds of a frame
+    int getNonZeros() { return (int)kernel.nonZeros(); }
+    // scores of the last frame over the candidate grid
+    const float* getScores() { return scores.data(); }
+
+protected:
+    float candidateHz( float c ) {
+        return exp2f( log2Min + c / SWIPE_CANDIDATES_PER_OCTAVE );
+    }
+
+    static bool isPrimeOrOne( int n ) {
+        if( n < 1 ) return false;
+        if( n < 4 ) return true;
+        if( n % 2 == 0 ) return false;
+        for( int d=3; d * d <= n; d += 2 ) {
+            if( n % d == 0 ) return false;
+        }
+        return true;
+    }
+
+protected:
+    float   R;
+    int     M;
+    int     candidatesN;
+    int     kernelHi;
+    float   log2Min;
+    float   strength;
+
+    Eigen::SparseMatrix<float, Eigen::RowMajor> kernel;
+    Eigen::VectorXf loudness;
+    Eigen::VectorXf scores;
+};
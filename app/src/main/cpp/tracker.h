@@ -0,0 +1,272 @@
+#pragma once
+
+/**
+ * Online Viterbi pitch tracking with bounded lookahead
+ *
+ * Hidden states are pitch bins of 1 / binsPerSemitone semitones between two MIDI notes plus one
+ * unvoiced state. Every frame the candidates of an estimator (pitch, confidence) give the
+ * observation likelihood of the bins around them. Octave errors are the common failure of the
+ * autocorrelation estimators, so a candidate also lends TRACKER_OCTAVE_WEIGHT of its confidence to
+ * the bins an octave above and below. The transition model allows
+ *
+ *  - small moves within a band of +-TRACKER_BAND_SEMITONES (glides, vibrato), the weight decays
+ *    exponentially with the distance so a held note stays cheap
+ *  - a jump to any bin with a small constant probability (real note changes, octave leaps)
+ *  - voiced <-> unvoiced switches
+ *
+ * Moves, jumps and voicing switches are priced per target bin rather than normalized over all bins: a
+ * jump (-log 0.005) costs less than one frame against the evidence (-log of the observation
+ * floor), so note changes are followed at once, but more than half of it, so a single octave error
+ * costs more than ignoring it once a lookahead frame can overrule it.
+ *
+ * The constant jump term only needs the best previous voiced score, so a frame costs
+ * O(states * band) instead of O(states^2). Backpointers of the last lookahead + 1 frames are kept
+ * in a ring: the state of frame t - lookahead is decided by backtracking from the best state of
+ * frame t, which lets a few later frames overrule a single octave error at the cost of lookahead
+ * frames of latency. Lookahead 0 is the plain forward decision.
+ *
+ * All storage is allocated in the constructor.
+ */
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+
+#define TRACKER_MAX_LOOKAHEAD 3
+#define TRACKER_MAX_CANDIDATES 8
+#define TRACKER_BAND_SEMITONES 2.0f     // per frame glide range
+#define TRACKER_BAND_DECAY 1.0f         // move weight falls by e per this many bins
+#define TRACKER_JUMP_PROB 0.005f        // to one voiced bin outside the band
+#define TRACKER_SWITCH_PROB 0.005f      // voiced <-> unvoiced, also per target bin
+#define TRACKER_OBS_FLOOR 1e-3f         // likelihood of a bin no candidate points to
+#define TRACKER_OBS_SIGMA 1.0f          // candidate spread in bins
+#define TRACKER_OCTAVE_WEIGHT 0.2f      // support of a candidate for the bins an octave off
+
+class PitchTracker
+{
+public:
+    PitchTracker( int minMidi = 28, int maxMidi = 96, int binsPerSemitone = 5, int lookahead = 1 ) {
+        this->minMidi = minMidi;
+        this->binsPerSemitone = binsPerSemitone;
+        this->S = (maxMidi - minMidi) * binsPerSemitone + 1;
+        this->U = this->S;
+        this->band = std::max( 1, (int)(TRACKER_BAND_SEMITONES * binsPerSemitone) );
+
+        this->delta = new float[ this->S + 1 ];
+        this->next = new float[ this->S + 1 ];
+        this->obs = new float[ this->S + 1 ];
+        this->bandLog = new float[ 2 * this->band + 1 ];
+        for( int k=0; k < TRACKER_MAX_LOOKAHEAD + 1; ++k ) {
+            this->psi[ k ] = new int16_t[ this->S + 1 ];
+        }
+
+        // move costs within the band, per target bin like the jumps
+        float stay = 1.f - TRACKER_JUMP_PROB - TRACKER_SWITCH_PROB;
+        for( int d = -this->band; d <= this->band; ++d ) {
+            this->bandLog[ d + this->band ] = logf( stay ) - std::abs( d ) / TRACKER_BAND_DECAY;
+        }
+        this->jumpLog = logf( TRACKER_JUMP_PROB );
+        this->switchLog = logf( TRACKER_SWITCH_PROB );
+        this->unvoicedStayLog = logf( 1.f - TRACKER_SWITCH_PROB );
+        this->floorLog = logf( TRACKER_OBS_FLOOR );
+
+        setLookahead( lookahead );
+    }
+    ~PitchTracker( ) {
+        for( int k=0; k < TRACKER_MAX_LOOKAHEAD + 1; ++k ) {
+            delete[] psi[ k ];
+        }
+        delete[] bandLog;
+        delete[] obs;
+        delete[] next;
+        delete[] delta;
+    }
+
+    // 0..TRACKER_MAX_LOOKAHEAD frames, restarts the track
+    void setLookahead( int lookahead ) {
+        this->lookahead = std::max( 0, std::min( lookahead, TRACKER_MAX_LOOKAHEAD ) );
+        reset();
+    }
+    int getLookahead() { return this->lookahead; }
+
+    void reset() {
+        for( int s=0; s <= S; ++s ) {
+            delta[ s ] = 0;
+        }
+        frames = 0;
+        pitch = 0;
+        midi = 0;
+        confidence = 0;
+    }
+
+    int getStatesN() { return S + 1; }
+
+    /**
+     * Add the candidates of one frame, pitches in Hz and confidences in 0..1.
+     *
+     * @return true when a decision for the frame lookahead frames back is available
+     */
+    bool push( const float* pitches, const float* confidences, int n ) {
+        n = std::min( n, TRACKER_MAX_CANDIDATES );
+
+        // observation, the best candidate near a bin decides its likelihood
+        float maxConf = 0;
+        for( int s=0; s < S; ++s ) {
+            obs[ s ] = floorLog;
+        }
+        const float octave = 12.f * binsPerSemitone;
+        const int slot = frames % (TRACKER_MAX_LOOKAHEAD + 1);
+        candidatesN[ slot ] = 0;
+        for( int k=0; k < n; ++k ) {
+            if( pitches[ k ] <= 0 || confidences[ k ] <= 0 )
+                continue;
+            float bin = binOf( pitches[ k ] );
+            int b = (int)lrintf( bin );
+            if( b < 0 || b >= S )
+                continue;
+            float c = std::min( confidences[ k ], 1.f );
+            maxConf = std::max( maxConf, c );
+            observe( bin, c );
+            observe( bin - octave, c * TRACKER_OCTAVE_WEIGHT );
+            observe( bin + octave, c * TRACKER_OCTAVE_WEIGHT );
+            candidatePitch[ slot ][ candidatesN[ slot ] ] = pitches[ k ];
+            candidateConf[ slot ][ candidatesN[ slot ] ] = c;
+            ++candidatesN[ slot ];
+        }
+        obs[ U ] = logf( std::max( 1.f - maxConf, TRACKER_OBS_FLOOR ) );
+
+        // best previous voiced state feeds the jump term
+        int16_t* bp = psi[ slot ];
+        int bestVoiced = 0;
+        for( int s=1; s < S; ++s ) {
+            if( delta[ s ] > delta[ bestVoiced ] ) bestVoiced = s;
+        }
+        const float jumpScore = delta[ bestVoiced ] + jumpLog;
+        const float fromUnvoiced = delta[ U ] + switchLog;
+
+        float best = -FLT_MAX;
+        for( int s=0; s < S; ++s ) {
+            float m = jumpScore;
+            int arg = bestVoiced;
+            if( fromUnvoiced > m ) {
+                m = fromUnvoiced;
+                arg = U;
+            }
+            const int lo = std::max( 0, s - band ), hi = std::min( S - 1, s + band );
+            const float* w = &bandLog[ band - s ];
+            for( int p = lo; p <= hi; ++p ) {
+                float v = delta[ p ] + w[ p ];
+                if( v > m ) {
+                    m = v;
+                    arg = p;
+                }
+            }
+            next[ s ] = m + obs[ s ];
+            bp[ s ] = (int16_t)arg;
+            best = std::max( best, next[ s ] );
+        }
+        {
+            float stay = delta[ U ] + unvoicedStayLog;
+            float enter = delta[ bestVoiced ] + switchLog;
+            next[ U ] = std::max( stay, enter ) + obs[ U ];
+            bp[ U ] = (int16_t)(stay >= enter ? U : bestVoiced);
+            best = std::max( best, next[ U ] );
+        }
+
+        // keep the scores bounded
+        for( int s=0; s <= S; ++s ) {
+            delta[ s ] = next[ s ] - best;
+        }
+        ++frames;
+
+        if( frames <= lookahead ) {
+            return false;
+        }
+
+        // backtrack lookahead frames from the current best state
+        int state = U;
+        for( int s=0; s < S; ++s ) {
+            if( delta[ s ] > delta[ state ] ) state = s;
+        }
+        for( int k=0; k < lookahead; ++k ) {
+            state = psi[ (frames - 1 - k) % (TRACKER_MAX_LOOKAHEAD + 1) ][ state ];
+        }
+        decide( state, (frames - 1 - lookahead) % (TRACKER_MAX_LOOKAHEAD + 1) );
+        return true;
+    }
+
+    // tracked pitch of the decided frame in Hz, 0 when unvoiced
+    float getPitch() { return pitch; }
+    // fractional MIDI note of the decided state, 0 when unvoiced
+    float getMidi() { return midi; }
+    // confidence of the candidate behind the decision, 0 when the track bridged a gap
+    float getConfidence() { return confidence; }
+
+protected:
+    float binOf( float hz ) {
+        float m = 69.f + 12.f * log2f( hz / 440.f );
+        return (m - minMidi) * binsPerSemitone;
+    }
+
+    void observe( float bin, float c ) {
+        const int spread = (int)ceilf( 3.f * TRACKER_OBS_SIGMA );
+        const int b = (int)lrintf( bin );
+        for( int s = std::max( 0, b - spread ); s <= std::min( S - 1, b + spread ); ++s ) {
+            float d = (s - bin) / TRACKER_OBS_SIGMA;
+            float l = logf( std::max( c * expf( -0.5f * d * d ), TRACKER_OBS_FLOOR ) );
+            obs[ s ] = std::max( obs[ s ], l );
+        }
+    }
+
+    void decide( int state, int slot ) {
+        if( state == U ) {
+            pitch = 0;
+            midi = 0;
+            confidence = 0;
+            return;
+        }
+        // report the candidate that led to the state, the bin center when the state was bridged
+        float center = (float)minMidi + (float)state / binsPerSemitone;
+        float hz = 440.f * exp2f( (center - 69.f) / 12.f );
+        float bestDist = 1.f;
+        confidence = 0;
+        for( int k=0; k < candidatesN[ slot ]; ++k ) {
+            float d = fabsf( binOf( candidatePitch[ slot ][ k ] ) - state );
+            if( d <= bestDist ) {
+                bestDist = d;
+                hz = candidatePitch[ slot ][ k ];
+                confidence = candidateConf[ slot ][ k ];
+            }
+        }
+        pitch = hz;
+        midi = 69.f + 12.f * log2f( hz / 440.f );
+    }
+
+protected:
+    int         minMidi;
+    int         binsPerSemitone;
+    int         S;              // voiced bins
+    int         U;              // index of the unvoiced state
+    int         band;
+    int         lookahead;
+    int64_t     frames;
+
+    float*      delta;
+    float*      next;
+    float*      obs;
+    float*      bandLog;
+    float       jumpLog;
+    float       switchLog;
+    float       unvoicedStayLog;
+    float       floorLog;
+    int16_t*    psi[ TRACKER_MAX_LOOKAHEAD + 1 ];
+
+    float       candidatePitch[ TRACKER_MAX_LOOKAHEAD + 1 ][ TRACKER_MAX_CANDIDATES ];
+    float       candidateConf[ TRACKER_MAX_LOOKAHEAD + 1 ][ TRACKER_MAX_CANDIDATES ];
+    int         candidatesN[ TRACKER_MAX_LOOKAHEAD + 1 ];
+
+    float       pitch;
+    float       midi;
+    float       confidence;
+};
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
+#include <time.h>
 
 #define THREAD_PRIORITY_AUDIO 0xfffffff0
 
@@ -12,8 +14,9 @@ enum OboeCustomReturns
     StartAudioFailed
 };
 
-struct timespec cnow;
-int64_t cnanos() {
+// called from the analysis thread and its consumers, so the timespec is per call
+inline int64_t cnanos() {
+    struct timespec cnow;
     clock_gettime(CLOCK_MONOTONIC, &cnow);
     return (int64_t) cnow.tv_sec*1000000000LL + cnow.tv_nsec;
 }
\ No newline at end of file
@@ -0,0 +1,261 @@
+#pragma once
+
+/**
+ * YIN and probabilistic YIN (pYIN) pitch detection
+ *
+ * A. de Cheveigne, H. Kawahara, "YIN, a fundamental frequency estimator for speech and music", 2002
+ * M. Mauch, S. Dixon, "pYIN: a fundamental frequency estimator using probabilistic threshold
+ * distributions", 2014
+ *
+ * The difference function over an integration window of W = N/2 samples is computed with the
+ * same FFT backend as acorr_r():
+ *
+ *      d(tau) = e(0) + e(tau) - 2 r(tau)
+ *
+ * where r(tau) is the cross-correlation of the first W samples with the whole frame and e(tau) is
+ * the energy of the W samples starting at tau (prefix sums). Both correlation inputs are packed in
+ * one complex FFT (frame as real part, window as imaginary part), so a frame costs one forward and
+ * one inverse N point transform.
+ */
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+#include "fft.h"
+
+#define YIN_THRESHOLD 0.15
+#define YIN_LOWER_PITCH_CUTOFF 80.0
+#define YIN_UPPER_PITCH_CUTOFF 1600.0
+#define PYIN_N_THRESHOLDS 100
+#define PYIN_MAX_CANDIDATES 8
+#define PYIN_BETA_A 2.0             // beta(2, 18) threshold prior, mean 0.1
+#define PYIN_BETA_B 18.0
+#define PYIN_ABSOLUTE_MIN_PROB 0.01 // weight given to the global minimum when no dip is below a threshold
+
+template <typename T> struct YinCandidate
+{
+    T period;       // lag in samples, parabolically interpolated
+    T probability;  // pYIN: summed threshold prior, YIN: 1 - aperiodicity
+};
+
+template <int N, typename T> class Yin
+{
+public:
+    static const int W = N / 2;
+
+    Yin( ) : threshold( (T)YIN_THRESHOLD ), period( 0 ), aperiodicity( 1 ), candidatesN( 0 )
+    {
+        // discretized beta distribution over the thresholds 0.01, 0.02 ... 1.00
+        double sum = 0;
+        for( int n=0; n < PYIN_N_THRESHOLDS; ++n ) {
+            double s = (double)(n + 1) / PYIN_N_THRESHOLDS;
+            double p = pow( s, PYIN_BETA_A - 1.0 ) * pow( 1.0 - s, PYIN_BETA_B - 1.0 );
+            thresholdPrior[ n ] = (T)p;
+            sum += p;
+        }
+        for( int n=0; n < PYIN_N_THRESHOLDS; ++n ) {
+            thresholdPrior[ n ] = (T)(thresholdPrior[ n ] / sum);
+        }
+    }
+
+    void setThreshold( T t ) { threshold = t; }
+
+    // classic YIN, absolute threshold on the cumulative mean normalized difference
+    T pitch( T* audio_buffer, int sample_rate, T* output, int outputLen )
+    {
+        int tauMin, tauMax;
+        cmndf( audio_buffer, sample_rate, output, outputLen, tauMin, tauMax );
+
+        candidatesN = 0;
+        period = 0;
+        aperiodicity = 1;
+
+        int tau = tauMin;
+        for( ; tau < tauMax; ++tau ) {
+            if( d[ tau ] < threshold ) {
+                while( tau + 1 < tauMax && d[ tau + 1 ] < d[ tau ] ) {
+                    ++tau;
+                }
+                break;
+            }
+        }
+        if( tau >= tauMax )
+            return -1;
+
+        period = interpolate( tau );
+        aperiodicity = d[ tau ];
+        candidates[ 0 ].period = period;
+        candidates[ 0 ].probability = (T)1 - std::min( aperiodicity, (T)1 );
+        candidatesN = 1;
+
+        T pitch_estimate = sample_rate / period;
+        return (pitch_estimate > YIN_LOWER_PITCH_CUTOFF) ? pitch_estimate : -1;
+    }
+
+    // pYIN, every threshold of the prior votes for the first dip below it
+    T probabilisticPitch( T* audio_buffer, int sample_rate, T* output, int outputLen )
+    {
+        int tauMin, tauMax;
+        cmndf( audio_buffer, sample_rate, output, outputLen, tauMin, tauMax );
+
+        candidatesN = 0;
+        period = 0;
+        aperiodicity = 1;
+
+        // interior local minima in lag order with their interpolated depth, and the global minimum
+        int minimaN = 0, globalMin = -1;
+        for( int tau = std::max( tauMin, 1 ); tau + 1 < tauMax; ++tau ) {
+            if( d[ tau ] < d[ tau - 1 ] && d[ tau ] <= d[ tau + 1 ] ) {
+                T a = d[ tau - 1 ], b = d[ tau ], c = d[ tau + 1 ];
+                T den = a - 2 * b + c;
+                minima[ minimaN ] = tau;
+                minimaDepth[ minimaN ] = den > 0 ? std::max( b - (a - c) * (a - c) / (8 * den), (T)0 ) : b;
+                if( globalMin < 0 || minimaDepth[ minimaN ] < minimaDepth[ globalMin ] ) {
+                    globalMin = minimaN;
+                }
+                ++minimaN;
+            }
+        }
+        if( minimaN == 0 )
+            return -1;
+
+        // running minimum over the minima in lag order, the first minimum below a threshold s is the
+        // first index where it drops below s, which only moves to larger lags as s decreases
+        T runningMin = (T)FLT_MAX;
+        for( int m=0; m < minimaN; ++m ) {
+            runningMin = std::min( runningMin, minimaDepth[ m ] );
+            minimaRunningMin[ m ] = runningMin;
+            minimaProb[ m ] = 0;
+        }
+        int first = 0;
+        T globalMinProb = 0;
+        for( int n = PYIN_N_THRESHOLDS - 1; n >= 0; --n ) {
+            T s = (T)(n + 1) / PYIN_N_THRESHOLDS;
+            while( first < minimaN && minimaRunningMin[ first ] >= s ) {
+                ++first;
+            }
+            if( first < minimaN ) {
+                minimaProb[ first ] += thresholdPrior[ n ];
+            } else {
+                globalMinProb += thresholdPrior[ n ] * (T)PYIN_ABSOLUTE_MIN_PROB;
+            }
+        }
+        minimaProb[ globalMin ] += globalMinProb;
+
+        // keep the most probable candidates, highest first
+        for( int m=0; m < minimaN; ++m ) {
+            if( minimaProb[ m ] <= 0 )
+                continue;
+            int k;
+            if( candidatesN < PYIN_MAX_CANDIDATES ) {
+                k = candidatesN++;
+            } else if( candidates[ PYIN_MAX_CANDIDATES - 1 ].probability < minimaProb[ m ] ) {
+                k = PYIN_MAX_CANDIDATES - 1;
+            } else {
+                continue;
+            }
+            candidates[ k ].period = (T)minima[ m ];
+            candidates[ k ].probability = minimaProb[ m ];
+            while( k > 0 && candidates[ k - 1 ].probability < candidates[ k ].probability ) {
+                std::swap( candidates[ k - 1 ], candidates[ k ] );
+                --k;
+            }
+        }
+        if( candidatesN == 0 )
+            return -1;
+
+        for( int k=0; k < candidatesN; ++k ) {
+            candidates[ k ].period = interpolate( (int)candidates[ k ].period );
+        }
+        period = candidates[ 0 ].period;
+        aperiodicity = d[ (int)(period + (T)0.5) ];
+
+        T pitch_estimate = sample_rate / period;
+        return (pitch_estimate > YIN_LOWER_PITCH_CUTOFF) ? pitch_estimate : -1;
+    }
+
+    T getPeriod() { return period; }
+    T getAperiodicity() { return aperiodicity; }
+    int getCandidatesN() { return candidatesN; }
+    const YinCandidate<T>* getCandidates() { return candidates; }
+
+protected:
+    // cumulative mean normalized difference d'(tau) into d[0..W)
+    void cmndf( T* x, int sample_rate, T* output, int outputLen, int& tauMin, int& tauMax )
+    {
+        // z = x + i * x[0..W)
+        for( int n=0; n < N; ++n ) {
+            z[ 2*n ]     = x[ n ];
+            z[ 2*n + 1 ] = n < W ? x[ n ] : (T)0;
+        }
+        F.fft( z );
+
+        // split the packed spectra, X = (Z[k] + Z*[N-k]) / 2, A = (Z[k] - Z*[N-k]) / 2i,
+        // then the cross-spectrum conj(A) X
+        for( int k=0; k <= N / 2; ++k ) {
+            int j = (N - k) & (N - 1);
+            T zr = z[ 2*k ], zi = z[ 2*k + 1 ];
+            T cr = z[ 2*j ], ci = -z[ 2*j + 1 ];
+            T xr = (T)0.5 * (zr + cr), xi = (T)0.5 * (zi + ci);
+            T ar = (T)0.5 * (zi - ci), ai = (T)-0.5 * (zr - cr);
+            T pr = ar*xr + ai*xi;
+            T pi = ar*xi - ai*xr;
+            z[ 2*k ] = pr;
+            z[ 2*k + 1 ] = pi;
+            if( j != k ) {
+                // the correlation is real so the spectrum is hermitian
+                z[ 2*j ] = pr;
+                z[ 2*j + 1 ] = -pi;
+            }
+        }
+        F.ifft( z );
+
+        e[ 0 ] = 0;
+        for( int n=0; n < N; ++n ) {
+            e[ n + 1 ] = e[ n ] + x[ n ] * x[ n ];
+        }
+
+        T e0 = e[ W ];
+        T sum = 0;
+        d[ 0 ] = 1;
+        for( int tau=1; tau < W; ++tau ) {
+            T dt = e0 + (e[ tau + W ] - e[ tau ]) - 2 * z[ 2*tau ];
+            dt = std::max( dt, (T)0 );
+            sum += dt;
+            d[ tau ] = sum > 0 ? dt * tau / sum : (T)1;
+        }
+
+        for( int n=0; n < outputLen; ++n ) {
+            output[ n ] = n < W ? d[ n ] : (T)0;
+        }
+
+        tauMin = std::max( 2, (int)(sample_rate / YIN_UPPER_PITCH_CUTOFF) );
+        tauMax = std::min( W, (int)(sample_rate / YIN_LOWER_PITCH_CUTOFF) + 2 );
+    }
+
+    T interpolate( int tau )
+    {
+        if( tau < 1 || tau + 1 >= W )
+            return (T)tau;
+        T a = d[ tau - 1 ], b = d[ tau ], c = d[ tau + 1 ];
+        T den = a - 2 * b + c;
+        return den != 0 ? tau + (T)0.5 * (a - c) / den : (T)tau;
+    }
+
+protected:
+    FFT<N, T>       F;
+    T               z[ 2*N ];
+    T               e[ N + 1 ];
+    T               d[ W ];
+    int             minima[ W ];
+    T               minimaDepth[ W ];
+    T               minimaProb[ W ];
+    T               minimaRunningMin[ W ];
+    T               thresholdPrior[ PYIN_N_THRESHOLDS ];
+    T               threshold;
+    T               period;
+    T               aperiodicity;
+    YinCandidate<T> candidates[ PYIN_MAX_CANDIDATES ];
+    int             candidatesN;
+};
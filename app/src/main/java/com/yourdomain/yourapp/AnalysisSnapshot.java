@@ -0,0 +1,16 @@
+package com.yourdomain.yourapp;
+
+/**
+ * The results of one analysis frame, filled in a single native call so the fields always belong to
+ * the same frame. See AnalysisSnapshot in dsp.h.
+ */
+public class AnalysisSnapshot {
+    public long frame;          // analysis frames since the start
+    public long captureNanos;   // CLOCK_MONOTONIC when the audio of the frame was taken
+    public float pitch;         // Hz, 0 when unvoiced
+    public float clarity;       // confidence of the pitch 0..1
+    public float noteHz;        // of the mapped note
+    public float cents;         // deviation of the pitch from the mapped note
+    public int note;            // MIDI note, 0 when unvoiced
+    public boolean gate;        // the frame is voiced and maps to a note
+}
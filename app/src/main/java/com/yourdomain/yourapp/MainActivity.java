@@ -31,6 +31,7 @@ import com.yourdomain.yourapp.databinding.ActivityMainBinding;
 
 import com.example.simplefileexplorer.SimpleFileExplorerActivity;
 
+import java.io.File;
 import java.util.ArrayList;
 import java.util.List;
 
@@ -152,7 +153,23 @@ public class MainActivity extends AppCompatActivity implements Runnable {
 
             //Toast.makeText(this, selectedAbsolutePath, Toast.LENGTH_SHORT).show();
 
-            this.openMediaFile( selectedAbsolutePath );
+            // a WAV file is analysed natively next to the microphone, anything else goes to the media streamer
+            final long handle = this.openFileAnalysis( selectedAbsolutePath, this.spinnerProcessingMode.getSelectedItemPosition() );
+            if( handle != 0 ) {
+                new Thread(() -> {
+                    AnalysisSnapshot fileSnapshot = new AnalysisSnapshot();
+                    try {
+                        while( this.getFileAnalysis( handle, fileSnapshot ) ) {
+                            Thread.sleep( 100 );
+                        }
+                    } catch (InterruptedException e) {
+                    }
+                    Log.i(TAG, "analysed " + fileSnapshot.frame + " frames of " + selectedAbsolutePath);
+                    this.closeFileAnalysis( handle );
+                }).start();
+            } else {
+                this.openMediaFile( selectedAbsolutePath );
+            }
         }
     }
 
@@ -162,6 +179,7 @@ public class MainActivity extends AppCompatActivity implements Runnable {
             //this.stop();
             surfaceViewDSP.stop();
             this.stopRecording();
+            this.stopMidiRecording();
             buttonStartStopRecording.setText( R.string.button_main_act_start_recording );
         } else {
             if(isRecordPermissionGranted()) {
@@ -175,6 +193,11 @@ public class MainActivity extends AppCompatActivity implements Runnable {
                     _th = new Thread(new MidiWriter(this, 1));
                     _th.start();
                 }
+                // the performance as a Standard MIDI File, with or without a device
+                if( processingModeSelectionIndex == 3 ) {
+                    File smf = new File( getExternalFilesDir( null ), "performance_" + System.currentTimeMillis() + ".mid" );
+                    this.startMidiRecording( smf.getAbsolutePath(), 1 );
+                }
 
                 this.startRecording();
                 surfaceViewDSP.start();
@@ -193,10 +216,19 @@ public class MainActivity extends AppCompatActivity implements Runnable {
     native boolean isRecording();
     native void setProcessingMode( int mode );
     native boolean openMediaFile(String filename);
+    native long openFileAnalysis( String path, int mode );
+    native boolean getFileAnalysis( long handle, AnalysisSnapshot out );
+    native void closeFileAnalysis( long handle );
     native void startup();
-    public native float getPitchEstimate();
-    public native int getMidiNoteNumber();
-
+    public native void getAnalysisSnapshot( AnalysisSnapshot out );
+    public native float getFormant( int k );
+    public native boolean openMidiEngine( MidiDevice device, int port, int channel, int patch );
+    native void closeMidiEngine();
+    native boolean startMidiRecording( String path, int format );
+    native boolean stopMidiRecording();
+    public native void setTuning( float a4, int root, int scaleMask );
+
+    AnalysisSnapshot snapshot = new AnalysisSnapshot();
     boolean running = false;
     Thread thread = null;
     public void stop() {
@@ -205,6 +237,7 @@ public class MainActivity extends AppCompatActivity implements Runnable {
         try {
             if( this._runMidi ) {
                 this._runMidi = false;
+                closeMidiEngine();
                 _th.join();
             }
 
@@ -228,7 +261,8 @@ public class MainActivity extends AppCompatActivity implements Runnable {
         long msTargetRate = 16;
         while( this.running ) {
             long start = System.currentTimeMillis();
-            this.textViewBottomInfo.setText(String.valueOf(this.getPitchEstimate()));
+            this.getAnalysisSnapshot(this.snapshot);
+            this.textViewBottomInfo.setText(String.valueOf(this.snapshot.pitch));
             long end = System.currentTimeMillis();
             long ts = end - start;
             if( ts < msTargetRate ) {
@@ -42,6 +42,8 @@ class MidiWriter implements Runnable
     {
         _running = true;
 
+        // the native MIDI engine takes over the device, from then on notes, bends and CCs go out from
+        // the analysis without passing through Java, timestamped with the capture time of their audio
         MidiDeviceInfo mdi = _act.getSelectedMidiDeviceInfo();
         _act.getMidiManager().openDevice(
                 mdi,
@@ -54,12 +56,10 @@ class MidiWriter implements Runnable
                             int channel = _act.getChannel();
 
                             _act.setMidiDevice( device );
-                            _act.setMidiInputPort(device.openInputPort(channel));
-                            if (_act.getMidiInputPort() == null) {
+                            if (!_act.openMidiEngine(device, channel, channel, _act.getPatch())) {
                                 Log.e(MidiConstants.TAG, "could not open input port on Midi Device");
                             }
                             else {
-                                changeProgram(_act.getPatch(), channel);
                                 _act.setMidiDeviceOpened();
                             }
                         }
@@ -68,90 +68,6 @@ class MidiWriter implements Runnable
                 null
         );
         // Don't run the callback on the UI thread because openInputPort might take a while.
-
-        // sleep until the midi device actually opens...
-        while( _act.awaitingMidiDeviceOpen() ) {
-            try {
-                Thread.sleep( _ms );
-            } catch (InterruptedException e) {
-                //e.printStackTrace(); // todo
-            }
-        }
-
-        // prepare
-        boolean playing = false;
-        int lastMidiNoteVelocity = 0, lastMidiNote = 0;
-        int patch = _act.getPatch();
-        int channel = _act.getChannel();
-        long accum, acc_st = System.currentTimeMillis();
-
-        // poll each ms for changes to pitch estimate & midi note
-        Process.setThreadPriority(THREAD_PRIORITY_AUDIO);
-
-        // play!
-        while( _act.runMidi() )
-        {
-            long start = System.currentTimeMillis();
-            if (_act.getPitchEstimate() > 0) {
-                int
-                    vel = 100,
-                    note = _act.getMidiNoteNumber();
-                if( playing ) {
-                    if( lastMidiNote != note) {
-                        noteOff(channel, lastMidiNote, lastMidiNoteVelocity);
-                        noteOn(channel, note, vel);
-
-                        lastMidiNoteVelocity = vel;
-                        lastMidiNote = note;
-                    }
-                    else {
-                        // todo adjust volume || detect vibrato - pitch wheel, etc
-                    }
-                }
-                else {
-                    playing = true;
-                    noteOn(channel, note, vel);
-
-                    lastMidiNoteVelocity = vel;
-                    lastMidiNote = note;
-                }
-            } else {
-                if (playing) {
-                    playing = false;
-                    noteOff(channel, lastMidiNote, lastMidiNoteVelocity);
-                }
-            }
-
-            try {
-                Thread.sleep( _ms );
-            } catch (InterruptedException e) {
-                //e.printStackTrace(); // todo
-            }
-        } // while( _act.runMidi() ) {
-
-        // in lieu of this...
-        noteOff(channel, lastMidiNote, lastMidiNoteVelocity );
-
-        // ensure ALL possble notes are off (todo b8r sol)...
-        for( int nMidiNoteNumber=MidiConstants.MIDI_NOTE_NUMBER_MIN; nMidiNoteNumber<=MidiConstants.MIDI_NOTE_NUMBER_MAX; ++nMidiNoteNumber ) {
-            noteOff(channel, nMidiNoteNumber, lastMidiNoteVelocity);
-        }
-
-        if( _act.getMidiInputPort() != null ) {
-            MidiInputPort port = _act.getMidiInputPort();
-
-            try {
-                port.flush();
-            } catch (IOException e) {
-                //e.printStackTrace(); //todo
-            }
-
-            try {
-                port.close();
-            } catch (IOException e) {
-                //e.printStackTrace();  //todo
-            }
-        }
     }
 
     /*
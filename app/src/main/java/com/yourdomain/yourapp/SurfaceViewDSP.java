@@ -9,6 +9,10 @@ import android.util.Log;
 import android.view.SurfaceView;
 import android.view.SurfaceHolder;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.FloatBuffer;
+
 public class SurfaceViewDSP extends SurfaceView implements Runnable {
     static final String TAG = SurfaceViewDSP.class.getName();
 
@@ -81,7 +85,7 @@ public class SurfaceViewDSP extends SurfaceView implements Runnable {
         if( this.pxViewWidth == 0 ) { this.pxViewWidth = this.getWidth(); }
         if( this.pxViewHeight == 0 ) { this.pxViewHeight = this.getHeight(); }
 
-        initAudioBridge();
+        openAudioBridge();
 
         this.pitchHistoryIndex = -1;
         this.pitchMidiHistoryIndex = -1;
@@ -163,6 +167,94 @@ public class SurfaceViewDSP extends SurfaceView implements Runnable {
         }
     }
 
+    // frames published by the native analysis thread, triple buffered, see TripleBuffer.h
+    static final int BRIDGE_HEADER_FLOATS = 4;
+    ByteBuffer bridge;
+    FloatBuffer[] bridgeSlots = new FloatBuffer[3];
+    int bridgeSlotBytes = 0;
+    void openAudioBridge() {
+        this.bridge = initAudioBridge().order(ByteOrder.nativeOrder());
+        this.bridgeSlotBytes = this.bridge.capacity() / 3;
+        FloatBuffer floats = this.bridge.asFloatBuffer();
+        int slotFloats = this.bridgeSlotBytes / 4;
+        for( int slot=0; slot < 3; ++slot ) {
+            floats.limit( (slot + 1) * slotFloats );
+            floats.position( slot * slotFloats + BRIDGE_HEADER_FLOATS );
+            this.bridgeSlots[slot] = floats.slice();
+        }
+    }
+    // the latest complete frame, a view of the shared buffer that stays valid until the next call
+    int dspSlot = 0;
+    FloatBuffer getDspFrame() {
+        this.dspSlot = acquireDspFrame();
+        FloatBuffer frame = this.bridgeSlots[this.dspSlot];
+        frame.limit( this.bridge.getInt( this.dspSlot * this.bridgeSlotBytes ) );
+        return frame;
+    }
+
+    // column reductions of the native Decimator, see Decimator.h
+    static final int DECIMATE_LINEAR = 0;
+    static final int DECIMATE_LOG_FREQUENCY = 1;
+    static final int DECIMATE_DB = 2;
+    ByteBuffer columnBytes = null;
+    FloatBuffer columns = null;
+    float[] columnLines = new float[0];
+    /**
+     * Reduces the range from..to of the frame of the last getDspFrame() to one column per pixel.
+     *
+     * @return pxViewWidth minima, then the maxima, then the means, null when the view has no width
+     */
+    FloatBuffer getDspColumns( int from, int to, int scale ) {
+        int width = this.pxViewWidth;
+        if( width <= 0 || to <= from ) {
+            return null;
+        }
+        if( this.columnBytes == null || this.columnBytes.capacity() < 3 * 4 * width ) {
+            this.columnBytes = ByteBuffer.allocateDirect( 3 * 4 * width ).order( ByteOrder.nativeOrder() );
+            this.columns = this.columnBytes.asFloatBuffer();
+            this.columnLines = new float[ 8 * width ];
+        }
+        if( decimateDspFrame( this.dspSlot, from, to, width, scale, this.columnBytes ) == 0 ) {
+            return null;
+        }
+        return this.columns;
+    }
+    /**
+     * One drawLines() call for all columns: min to max of each column, and the mean of the previous
+     * column to the mean of this one so that single sample columns stay connected.
+     *
+     * @param py0 y of the value 0
+     * @param pyScale pixels per unit, upwards
+     */
+    void drawColumns( Canvas canvas, FloatBuffer cols, float py0, float pyScale, Paint paint ) {
+        int width = this.pxViewWidth;
+        float[] lines = this.columnLines;
+        int k = 0;
+        for( int c=0; c < width; ++c ) {
+            float mean = py0 - cols.get( 2 * width + c ) * pyScale;
+            lines[k++] = c;
+            lines[k++] = py0 - cols.get( c ) * pyScale;
+            lines[k++] = c;
+            lines[k++] = py0 - cols.get( width + c ) * pyScale;
+            if( c > 0 ) {
+                lines[k++] = c - 1;
+                lines[k++] = py0 - cols.get( 2 * width + c - 1 ) * pyScale;
+                lines[k++] = c;
+                lines[k++] = mean;
+            }
+        }
+        canvas.drawLines( lines, 0, k, paint );
+    }
+    // largest magnitude of the column minima and maxima
+    float getColumnsPeak( FloatBuffer cols ) {
+        float peak = 0;
+        for( int n=0; n < 2 * this.pxViewWidth; ++n ) {
+            peak = Math.max( peak, Math.abs( cols.get( n ) ) );
+        }
+        return peak;
+    }
+
+    AnalysisSnapshot snapshot = new AnalysisSnapshot();
     int pitchHistoryIndex = -1;
     int pitchMidiHistoryIndex = -1;
     int midiNoteNumHistoryIndex = -1;
@@ -171,15 +263,16 @@ public class SurfaceViewDSP extends SurfaceView implements Runnable {
     float[] pitchMidiHistory = new float[75];
     int[] midiNoteNumHistory = new int[75];
     void drawPitch(Canvas canvas) {
-        float[] data = getDspOutput();
-        for( int n=0; n < data.length; ++n ) {
-            float absSample = Math.abs(data[n]);
+        FloatBuffer data = getDspFrame();
+        for( int n=0; n < data.limit(); ++n ) {
+            float absSample = Math.abs(data.get(n));
             if( absSample > maxDataAutocorr ) {
                 maxDataAutocorr = absSample;
             }
         }
 
-        float pitch = getPitch();
+        getAnalysisSnapshot( this.snapshot );
+        float pitch = this.snapshot.pitch;
         if( ++pitchHistoryIndex >= pitchHistory.length ) {
             for( int n=1; n < pitchHistory.length; ++n ) {
                 pitchHistory[n-1] = pitchHistory[n];
@@ -194,7 +287,7 @@ public class SurfaceViewDSP extends SurfaceView implements Runnable {
 //            }
 //        }
 
-        float pitchMidi = getPitchMidi();
+        float pitchMidi = this.snapshot.noteHz;
         if( ++pitchMidiHistoryIndex >= pitchMidiHistory.length ) {
             for( int n=1; n < pitchMidiHistory.length; ++n ) {
                 pitchMidiHistory[n-1] = pitchMidiHistory[n];
@@ -203,7 +296,7 @@ public class SurfaceViewDSP extends SurfaceView implements Runnable {
         }
         pitchMidiHistory[pitchMidiHistoryIndex] = pitchMidi;
 
-        int midiNoteNum = getMidiNoteNumber();
+        int midiNoteNum = this.snapshot.note;
         if( ++midiNoteNumHistoryIndex >= midiNoteNumHistory.length ) {
             for( int n=1; n < midiNoteNumHistory.length; ++n ) {
                 midiNoteNumHistory[n-1] = midiNoteNumHistory[n];
@@ -214,13 +307,13 @@ public class SurfaceViewDSP extends SurfaceView implements Runnable {
 
         canvas.drawRect(0, 0, this.pxViewWidth, this.pxViewHeight, paintBg);
 
-        int L = data.length/2;
+        int L = data.limit()/2;
         float pyHeight = (float) this.pxViewHeight/2;
         float pxStride = (float) this.pxViewWidth / (float)L;
         for( int xd=0, pxLast=0, pyLast=0; xd < L; ++xd ){
             int px = (int)(pxStride * (float)xd);
-//            int py = this.pxViewHeight - (int)((data[xd] / maxDataAutocorr) * pyHeight);
-            int py = (int)((data[xd] / maxDataAutocorr) * pyHeight + pyHeight);
+//            int py = this.pxViewHeight - (int)((data.get(xd) / maxDataAutocorr) * pyHeight);
+            int py = (int)((data.get(xd) / maxDataAutocorr) * pyHeight + pyHeight);
             canvas.drawLine(pxLast, pyLast, px, py, paintBlue);
             pxLast = px;
             pyLast = py;
@@ -254,97 +347,59 @@ public class SurfaceViewDSP extends SurfaceView implements Runnable {
 
     float maxDataAutocorr = 0;
     void drawAutocorr(Canvas canvas) {
-        int L;
-        float pxStride, pyHeight;
-
-        float[] data = getDspOutput();
-
-        for( int n=0; n < data.length; ++n ) {
-            float absSample = Math.abs(data[n]);
-            if( absSample > maxDataAutocorr ) {
-                maxDataAutocorr = absSample;
-            }
-        }
+        FloatBuffer data = getDspFrame();
+        FloatBuffer cols = getDspColumns( 0, data.limit()/2, DECIMATE_LINEAR );
 
         canvas.drawRect(0, 0, this.pxViewWidth, this.pxViewHeight, paintBg);
+        if( cols == null ) {
+            return;
+        }
+        maxDataAutocorr = Math.max( maxDataAutocorr, getColumnsPeak( cols ) );
 
-        L = data.length/2;
         float vertOffset = ((float)this.pxViewHeight * .3f);
-        pyHeight = (float) this.pxViewHeight - vertOffset/2;
-//        pyHeight = (float) this.pxViewHeight;
-        pxStride = (float) this.pxViewWidth / (float)L;
-        for( int xd=0, pxLast=0, pyLast=0; xd < L; ++xd ){
-            int px = (int)(pxStride * (float)xd);
-            int py = this.pxViewHeight - (int)((data[xd] / maxDataAutocorr) * pyHeight + (vertOffset / 2f));
-//            int py = this.pxViewHeight - (int)((data[xd] / maxDataAutocorr) * pyHeight);
-            canvas.drawLine(pxLast, pyLast, px, py, paintGreen);
-            pxLast = px;
-            pyLast = py;
-        }
+        float pyHeight = (float) this.pxViewHeight - vertOffset/2;
+        drawColumns( canvas, cols, this.pxViewHeight - vertOffset / 2f, maxDataAutocorr > 0 ? pyHeight / maxDataAutocorr : 0, paintGreen );
     }
 
+    // dB range of the spectrum display, below the loudest column
+    static final float MAG_SPEC_RANGE_DB = 90.f;
     void drawMagSpecLines(Canvas canvas) {
-        int L;
-        float maxData, pxStride, pyHeight;
-
-        float[] data = getDspOutput();
-
-        maxData = 0;
-        for( int n=0; n < data.length/2; ++n ) {
-            float absSample = Math.abs(data[n]);
-            if( absSample > maxData ) {
-                maxData = absSample;
-            }
-        }
+        FloatBuffer data = getDspFrame();
+        // up to Nyquist, the frequency axis logarithmic from the second bin on
+        FloatBuffer cols = getDspColumns( 2, data.limit()/2, DECIMATE_LOG_FREQUENCY | DECIMATE_DB );
 
         canvas.drawRect(0, 0, this.pxViewWidth, this.pxViewHeight, paintBg);
-
-        L = data.length/16;
-        pyHeight = (float) this.pxViewHeight;
-        pxStride = (float) this.pxViewWidth / (float)L;
-        for( int xd=2, pxLast=0, pyLast=0; xd < L; ++xd ){
-            int px = (int)(pxStride * (float)xd);
-            int py = this.pxViewHeight - (int)((data[xd] / maxData) * pyHeight);
-            canvas.drawLine(pxLast, pyLast, px, py, paintGreen);
-            pxLast = px;
-            pyLast = py;
+        if( cols == null ) {
+            return;
+        }
+        float maxDb = -Float.MAX_VALUE;
+        for( int c=0; c < this.pxViewWidth; ++c ) {
+            maxDb = Math.max( maxDb, cols.get( this.pxViewWidth + c ) );
         }
+
+        float pyScale = (float) this.pxViewHeight / MAG_SPEC_RANGE_DB;
+        drawColumns( canvas, cols, this.pxViewHeight + (maxDb - MAG_SPEC_RANGE_DB) * pyScale, pyScale, paintGreen );
     }
 
     void drawRawAudioLines(Canvas canvas) {
-        int L;
-        float maxData, pxStride, pyHeight;
-
-        float[] data = getDspOutput();
-
-        maxData = 0;
-        for( int n=0; n < data.length; ++n ) {
-            float absSample = Math.abs(data[n]);
-            if( absSample > maxData ) {
-                maxData = absSample;
-            }
-        }
+        FloatBuffer data = getDspFrame();
+        FloatBuffer cols = getDspColumns( 0, data.limit(), DECIMATE_LINEAR );
 
         canvas.drawRect(0, 0, this.pxViewWidth, this.pxViewHeight, paintBg);
-
-        L = data.length;
-        pyHeight = (float) this.pxViewHeight / 2;
-        pxStride = (float) this.pxViewWidth / (float)L;
-        for( int xd=0, pxLast=0, pyLast=0; xd < L; ++xd ){
-            int px = (int)(pxStride * (float)xd);
-            int py = this.pxViewHeight / 2 - (int)((data[xd] / maxData) * pyHeight);
-            canvas.drawLine(pxLast, pyLast, px, py, paintGreen);
-            pxLast = px;
-            pyLast = py;
+        if( cols == null ) {
+            return;
         }
+        float maxData = getColumnsPeak( cols );
+
+        float pyHeight = (float) this.pxViewHeight / 2;
+        drawColumns( canvas, cols, this.pxViewHeight / 2, maxData > 0 ? pyHeight / maxData : 0, paintGreen );
     }
 
     static { System.loadLibrary("native-lib"); }
-    native float[] getDspOutput();
-    native void initAudioBridge();
+    native ByteBuffer initAudioBridge();
+    native int acquireDspFrame();
+    native int decimateDspFrame( int slot, int from, int to, int width, int scale, ByteBuffer columns );
     native void freeAudioBridge();
     native int getProcessingMode();
-    native float getPitch();
-    native float getPitchMidi();
-    native int getMidiNoteNumber();
+    native void getAnalysisSnapshot( AnalysisSnapshot out );
 }